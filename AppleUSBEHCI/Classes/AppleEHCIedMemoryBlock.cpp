@@ -26,85 +26,26 @@
 
 #include "AppleEHCIedMemoryBlock.h"
 
-#define super OSObject
-OSDefineMetaClassAndStructors(AppleEHCIedMemoryBlock, OSObject);
+#define super IOUSBControllerMemoryBlock
+OSDefineMetaClassAndStructors(AppleEHCIedMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleEHCIedMemoryBlock*
 AppleEHCIedMemoryBlock::NewMemoryBlock(void)
 {
-    AppleEHCIedMemoryBlock 		*me = new AppleEHCIedMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
+    AppleEHCIedMemoryBlock		*me = new AppleEHCIedMemoryBlock;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleEHCIedMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kEHCIPageSize, kEHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (EHCIQueueHeadSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kEHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kEHCIPageSize))
-			{
-				USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-		}
-		else
-		{
-			USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock, could not allocate buffer! (size: %d, mask: %qd)", kEHCIPageSize, kEHCIStructureAllocationPhysicalMask);
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(EHCIQueueHeadShared), kEHCIQHAlignment, 0, 0, kEHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleEHCIedMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
     return me;
 }
 
@@ -113,7 +54,7 @@ AppleEHCIedMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleEHCIedMemoryBlock::NumEDs(void)
 {
-    return EDsPerBlock;
+    return NumElements();
 }
 
 
@@ -121,27 +62,21 @@ AppleEHCIedMemoryBlock::NumEDs(void)
 IOPhysicalAddress				
 AppleEHCIedMemoryBlock::GetPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    if (index < EDsPerBlock)
-		ret = _sharedPhysical + (index * sizeof(EHCIQueueHeadShared));
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 EHCIQueueHeadSharedPtr
 AppleEHCIedMemoryBlock::GetLogicalPtr(UInt32 index)
 {
-    EHCIQueueHeadSharedPtr ret = NULL;
-    if (index < EDsPerBlock)
-		ret = &_sharedLogical[index];
-    return ret;
+    return (EHCIQueueHeadSharedPtr)GetElementLogicalPtr(index);
 }
 
 
 AppleEHCIedMemoryBlock*
 AppleEHCIedMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleEHCIedMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -149,17 +84,5 @@ AppleEHCIedMemoryBlock::GetNextBlock(void)
 void
 AppleEHCIedMemoryBlock::SetNextBlock(AppleEHCIedMemoryBlock* next)
 {
-    _nextBlock = next;
+    SetNextMemoryBlock(next);
 }
-
-
-void
-AppleEHCIedMemoryBlock::free()
-{
-	if (_buffer)
-	{
-		_buffer->complete();
-		_buffer->release();
-	}
-	super::free();
-}
\ No newline at end of file
@@ -25,85 +25,26 @@
 
 #include "AppleEHCIitdMemoryBlock.h"
 
-#define super OSObject
-OSDefineMetaClassAndStructors(AppleEHCIitdMemoryBlock, OSObject);
+#define super IOUSBControllerMemoryBlock
+OSDefineMetaClassAndStructors(AppleEHCIitdMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleEHCIitdMemoryBlock*
 AppleEHCIitdMemoryBlock::NewMemoryBlock(void)
 {
-    AppleEHCIitdMemoryBlock 	*me = new AppleEHCIitdMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
+    AppleEHCIitdMemoryBlock		*me = new AppleEHCIitdMemoryBlock;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleEHCIitdMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kEHCIPageSize, kEHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (EHCIIsochTransferDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kEHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kEHCIPageSize))
-			{
-				USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-		}
-		else
-		{
-			USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(EHCIIsochTransferDescriptorShared), kEHCIiTDAlignment, 0, 0, kEHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleEHCIitdMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
     return me;
 }
 
@@ -112,7 +53,7 @@ AppleEHCIitdMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleEHCIitdMemoryBlock::NumTDs(void)
 {
-    return ITDsPerBlock;
+    return NumElements();
 }
 
 
@@ -120,29 +61,21 @@ AppleEHCIitdMemoryBlock::NumTDs(void)
 IOPhysicalAddress				
 AppleEHCIitdMemoryBlock::GetPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    if (index < ITDsPerBlock)
-		ret = _sharedPhysical + (index * sizeof(EHCIIsochTransferDescriptorShared));
-	
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 EHCIIsochTransferDescriptorSharedPtr
 AppleEHCIitdMemoryBlock::GetLogicalPtr(UInt32 index)
 {
-    EHCIIsochTransferDescriptorSharedPtr ret = NULL;
-    if (index < ITDsPerBlock)
-		ret = &_sharedLogical[index];
-	
-    return ret;
+    return (EHCIIsochTransferDescriptorSharedPtr)GetElementLogicalPtr(index);
 }
 
 
 AppleEHCIitdMemoryBlock*
 AppleEHCIitdMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleEHCIitdMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -150,17 +83,5 @@ AppleEHCIitdMemoryBlock::GetNextBlock(void)
 void
 AppleEHCIitdMemoryBlock::SetNextBlock(AppleEHCIitdMemoryBlock* next)
 {
-    _nextBlock = next;
-}
-
-
-void
-AppleEHCIitdMemoryBlock::free()
-{
-	if (_buffer)
-	{
-		_buffer->complete();
-		_buffer->release();
-	}
-	super::free();
+    SetNextMemoryBlock(next);
 }
@@ -25,93 +25,33 @@
 
 #include "AppleEHCItdMemoryBlock.h"
 
-#define super OSObject
-OSDefineMetaClassAndStructors(AppleEHCItdMemoryBlock, OSObject);
+#define super IOUSBControllerMemoryBlock
+OSDefineMetaClassAndStructors(AppleEHCItdMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleEHCItdMemoryBlock*
 AppleEHCItdMemoryBlock::NewMemoryBlock(void)
 {
-    AppleEHCItdMemoryBlock					*me = new AppleEHCItdMemoryBlock;
-    IOByteCount								len;
-	IODMACommand							*dmaCommand = NULL;
-	UInt64									offset = 0;
-	IODMACommand::Segment32					segments;
-	UInt32									numSegments = 1;
-	IOReturn								status = kIOReturnSuccess;
-    EHCIGeneralTransferDescriptorSharedPtr	sharedPtr;
-    IOPhysicalAddress						sharedPhysical;
-    UInt32									i;
+    AppleEHCItdMemoryBlock		*me = new AppleEHCItdMemoryBlock;
+    UInt32						i;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleEHCItdMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kEHCIPageSize, kEHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			sharedPtr = (EHCIGeneralTransferDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(sharedPtr, kEHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kEHCIPageSize))
-			{
-				USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			sharedPhysical = segments.fIOVMAddr;
-			for (i=0; i < TDsPerBlock; i++)
-			{
-				me->_TDs[i].pPhysical = sharedPhysical+(i * sizeof(EHCIGeneralTransferDescriptorShared));
-				me->_TDs[i].pShared = &sharedPtr[i];
-			}
-		}
-		else
-		{
-			USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(EHCIGeneralTransferDescriptorShared), kEHCIqTDAlignment, 0, 0, kEHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleEHCItdMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
+	
+	for (i=0; i < me->NumElements(); i++)
+	{
+		me->_TDs[i].pPhysical = me->GetElementPhysicalPtr(i);
+		me->_TDs[i].pShared = (EHCIGeneralTransferDescriptorSharedPtr)me->GetElementLogicalPtr(i);
+	}
     return me;
 }
 
@@ -120,7 +60,7 @@ AppleEHCItdMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleEHCItdMemoryBlock::NumTDs(void)
 {
-    return TDsPerBlock;
+    return NumElements();
 }
 
 
@@ -128,15 +68,14 @@ AppleEHCItdMemoryBlock::NumTDs(void)
 EHCIGeneralTransferDescriptorPtr
 AppleEHCItdMemoryBlock::GetTD(UInt32 index)
 {
-    return (index < TDsPerBlock) ? &_TDs[index] : NULL;
+    return (index < NumElements()) ? &_TDs[index] : NULL;
 }
 
 
-
 AppleEHCItdMemoryBlock*
 AppleEHCItdMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleEHCItdMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -144,18 +83,5 @@ AppleEHCItdMemoryBlock::GetNextBlock(void)
 void
 AppleEHCItdMemoryBlock::SetNextBlock(AppleEHCItdMemoryBlock* next)
 {
-    _nextBlock = next;
+    SetNextMemoryBlock(next);
 }
-
-
-
-void
-AppleEHCItdMemoryBlock::free()
-{
-	if (_buffer)
-	{
-		_buffer->complete();
-		_buffer->release();
-	}
-	super::free();
-}
\ No newline at end of file
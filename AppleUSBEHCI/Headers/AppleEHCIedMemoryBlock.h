@@ -23,28 +23,21 @@
 
 #include <libkern/c++/OSObject.h>
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBEHCI.h"
 #include "USBEHCI.h"
 
-class AppleEHCIedMemoryBlock : public OSObject
+class AppleEHCIedMemoryBlock : public IOUSBControllerMemoryBlock
 {
     
 	OSDeclareDefaultStructors(AppleEHCIedMemoryBlock)
 	
 #define EDsPerBlock	(kEHCIPageSize / sizeof(EHCIQueueHeadShared))
+#define kEHCIQHAlignment	32		// EHCI 3.6 - queue heads are on a 32 byte boundary
 
-private:
-    IOPhysicalAddress			_sharedPhysical;
-    EHCIQueueHeadSharedPtr		_sharedLogical;
-    AppleEHCIedMemoryBlock		*_nextBlock;
-	IOBufferMemoryDescriptor	*_buffer;
-    
 public:
 
-	// OSObject call used to free the buffer when we are done
-    virtual void free();
-	
     static AppleEHCIedMemoryBlock 	*NewMemoryBlock(void);
     void							SetNextBlock(AppleEHCIedMemoryBlock *next);
     AppleEHCIedMemoryBlock			*GetNextBlock(void);
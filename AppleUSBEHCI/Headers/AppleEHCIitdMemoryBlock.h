@@ -23,27 +23,20 @@
 
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBEHCI.h"
 #include "USBEHCI.h"
 
-class AppleEHCIitdMemoryBlock : public OSObject
+class AppleEHCIitdMemoryBlock : public IOUSBControllerMemoryBlock
 {
 	OSDeclareDefaultStructors(AppleEHCIitdMemoryBlock)
     
 #define ITDsPerBlock	(kEHCIPageSize / sizeof(EHCIIsochTransferDescriptorShared))
+#define kEHCIiTDAlignment	32		// EHCI 3.3 - isoch TDs are on a 32 byte boundary
 
-private:
-    IOPhysicalAddress						_sharedPhysical;
-    EHCIIsochTransferDescriptorSharedPtr	_sharedLogical;
-    AppleEHCIitdMemoryBlock					*_nextBlock;
-	IOBufferMemoryDescriptor				*_buffer;
-    
 public:
 
-	// OSObject call used to free the buffer when we are done
-    virtual void free();
-	
     static AppleEHCIitdMemoryBlock			*NewMemoryBlock(void);
     void									SetNextBlock(AppleEHCIitdMemoryBlock *next);
     AppleEHCIitdMemoryBlock					*GetNextBlock(void);
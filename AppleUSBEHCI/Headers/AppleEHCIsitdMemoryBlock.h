@@ -22,27 +22,20 @@
  */
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBEHCI.h"
 #include "USBEHCI.h"
 
-class AppleEHCIsitdMemoryBlock : public OSObject
+class AppleEHCIsitdMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleEHCIsitdMemoryBlock);
     
 #define SITDsPerBlock	(kEHCIPageSize / sizeof(EHCISplitIsochTransferDescriptorShared))
+#define kEHCIsiTDAlignment	32		// EHCI 3.4 - split isoch TDs are on a 32 byte boundary
 
-private:
-    IOPhysicalAddress							_sharedPhysical;
-    EHCISplitIsochTransferDescriptorSharedPtr	_sharedLogical;
-    AppleEHCIsitdMemoryBlock					*_nextBlock;
-	IOBufferMemoryDescriptor					*_buffer;
-    
 public:
 
- 	// OSObject call used to free the buffer when we are done
-    virtual void free();
-	
 	static AppleEHCIsitdMemoryBlock 			*NewMemoryBlock(void);
     void										SetNextBlock(AppleEHCIsitdMemoryBlock *next);
     AppleEHCIsitdMemoryBlock					*GetNextBlock(void);
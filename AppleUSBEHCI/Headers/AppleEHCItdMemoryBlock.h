@@ -22,26 +22,23 @@
 */
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBEHCI.h"
 #include "USBEHCI.h"
 
-class AppleEHCItdMemoryBlock : public OSObject
+class AppleEHCItdMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleEHCItdMemoryBlock);
     
 #define TDsPerBlock	(kEHCIPageSize / sizeof(EHCIGeneralTransferDescriptorShared))
+#define kEHCIqTDAlignment	32		// EHCI 3.5 - queue element TDs are on a 32 byte boundary
 
 private:
     EHCIGeneralTransferDescriptor		_TDs[TDsPerBlock];
-    AppleEHCItdMemoryBlock				*_nextBlock;
-	IOBufferMemoryDescriptor			*_buffer;
     
 public:
 
-	// OSObject call used to free the buffer when we are done
-    virtual void free();
-
     static AppleEHCItdMemoryBlock		*NewMemoryBlock(void);
     UInt32								NumTDs(void);
     EHCIGeneralTransferDescriptorPtr	GetTD(UInt32 index);
@@ -26,85 +26,26 @@
 
 #include "AppleUSBOHCIMemoryBlocks.h"
 
-#define super OSObject
-OSDefineMetaClassAndStructors(AppleUSBOHCIedMemoryBlock, OSObject);
+#define super IOUSBControllerMemoryBlock
+OSDefineMetaClassAndStructors(AppleUSBOHCIedMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleUSBOHCIedMemoryBlock*
 AppleUSBOHCIedMemoryBlock::NewMemoryBlock(void)
 {
-    AppleUSBOHCIedMemoryBlock 	*me = new AppleUSBOHCIedMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
+    AppleUSBOHCIedMemoryBlock		*me = new AppleUSBOHCIedMemoryBlock;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kOHCIPageSize, kOHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (OHCIEndpointDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kOHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kOHCIPageSize))
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-		}
-		else
-		{
-			USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(OHCIEndpointDescriptorShared), kOHCIEDAlignment, 0, 0, kOHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
     return me;
 }
 
@@ -113,7 +54,7 @@ AppleUSBOHCIedMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleUSBOHCIedMemoryBlock::NumEDs(void)
 {
-    return EDsPerBlock;
+    return NumElements();
 }
 
 
@@ -121,21 +62,14 @@ AppleUSBOHCIedMemoryBlock::NumEDs(void)
 IOPhysicalAddress				
 AppleUSBOHCIedMemoryBlock::GetSharedPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    if (index < EDsPerBlock)
-		ret = _sharedPhysical + (index * sizeof(OHCIEndpointDescriptorShared));
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 OHCIEndpointDescriptorSharedPtr
 AppleUSBOHCIedMemoryBlock::GetSharedLogicalPtr(UInt32 index)
 {
-    OHCIEndpointDescriptorSharedPtr ret = NULL;
-    
-    if (index < EDsPerBlock)
-		ret = &_sharedLogical[index];
-    return ret;
+    return (OHCIEndpointDescriptorSharedPtr)GetElementLogicalPtr(index);
 }
 
 
@@ -144,17 +78,18 @@ AppleUSBOHCIedMemoryBlock::GetED(UInt32 index)
 {
     AppleOHCIEndpointDescriptorPtr ret = NULL;
     
-    if (index < EDsPerBlock)
+    if (index < NumElements())
 		ret = &_eds[index];
 	
     return ret;
 }
 
 
+
 AppleUSBOHCIedMemoryBlock*
 AppleUSBOHCIedMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleUSBOHCIedMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -162,107 +97,37 @@ AppleUSBOHCIedMemoryBlock::GetNextBlock(void)
 void
 AppleUSBOHCIedMemoryBlock::SetNextBlock(AppleUSBOHCIedMemoryBlock* next)
 {
-    _nextBlock = next;
+    SetNextMemoryBlock(next);
 }
 
 
 
-void 			
-AppleUSBOHCIedMemoryBlock::free()
-{
-    // IOKit calls this when we are going away
-     if (_buffer)
-	 {
-		 _buffer->complete();						// we need to unmap our buffer
-		 _buffer->release();
-	 }
-    super::free();
-}
-
-
-
-OSDefineMetaClassAndStructors(AppleUSBOHCIgtdMemoryBlock, OSObject);
+OSDefineMetaClassAndStructors(AppleUSBOHCIgtdMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleUSBOHCIgtdMemoryBlock*
 AppleUSBOHCIgtdMemoryBlock::NewMemoryBlock(void)
 {
-    AppleUSBOHCIgtdMemoryBlock 	*me = new AppleUSBOHCIgtdMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
+    AppleUSBOHCIgtdMemoryBlock		*me = new AppleUSBOHCIgtdMemoryBlock;
     uintptr_t					*block0;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kOHCIPageSize, kOHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (OHCIGeneralTransferDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kOHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kOHCIPageSize))
-			{
-				USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-			block0 = (uintptr_t *) me->_sharedLogical;
-			*block0++ = (uintptr_t)me;
-			*block0 =     kAppleUSBOHCIMemBlockGTD;
-		}
-		else
-		{
-			USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleUSBOHCIgtdMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(OHCIGeneralTransferDescriptorShared), kOHCIGTDAlignment, 0, 1, kOHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleUSBOHCIedMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleUSBOHCIgtdMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
+	
+	// the first element of the page is not used by the controller - it holds a pointer back to us and the block type, so
+	// that the done queue processing can get from the physical address of a general TD to our logical one without a search
+	block0 = (uintptr_t*)me->GetReservedLogicalPtr(0);
+	*block0++ = (uintptr_t)me;
+	*block0 = kAppleUSBOHCIMemBlockGTD;
     return me;
 }
 
@@ -271,7 +136,7 @@ AppleUSBOHCIgtdMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleUSBOHCIgtdMemoryBlock::NumGTDs(void)
 {
-    return GTDsPerBlock;
+    return NumElements();
 }
 
 
@@ -279,24 +144,14 @@ AppleUSBOHCIgtdMemoryBlock::NumGTDs(void)
 IOPhysicalAddress				
 AppleUSBOHCIgtdMemoryBlock::GetSharedPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    
-    if (index < GTDsPerBlock)
-		ret = _sharedPhysical + ((index+1) * sizeof(OHCIGeneralTransferDescriptorShared));
-	
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 OHCIGeneralTransferDescriptorSharedPtr
 AppleUSBOHCIgtdMemoryBlock::GetSharedLogicalPtr(UInt32 index)
 {
-    OHCIGeneralTransferDescriptorSharedPtr 	ret = NULL;
-    
-    if (index < GTDsPerBlock)
-		ret = &_sharedLogical[index+1];
-	
-    return ret;
+    return (OHCIGeneralTransferDescriptorSharedPtr)GetElementLogicalPtr(index);
 }
 
 
@@ -305,13 +160,14 @@ AppleUSBOHCIgtdMemoryBlock::GetGTD(UInt32 index)
 {
     AppleOHCIGeneralTransferDescriptorPtr ret = NULL;
     
-    if (index < GTDsPerBlock)
+    if (index < NumElements())
 		ret = &_gtds[index];
 	
     return ret;
 }
 
 
+
 AppleOHCIGeneralTransferDescriptorPtr	
 AppleUSBOHCIgtdMemoryBlock::GetGTDFromPhysical(IOPhysicalAddress addr, UInt32 blockType)
 {
@@ -319,7 +175,7 @@ AppleUSBOHCIgtdMemoryBlock::GetGTDFromPhysical(IOPhysicalAddress addr, UInt32 bl
     //
     IOPhysicalAddress		blockStart;
     AppleUSBOHCIgtdMemoryBlock	*me;
-    UInt32			index;
+    SInt32					index;
 	
     if (!addr)
 		return NULL;
@@ -342,7 +198,9 @@ AppleUSBOHCIgtdMemoryBlock::GetGTDFromPhysical(IOPhysicalAddress addr, UInt32 bl
 #else
 		me = (AppleUSBOHCIgtdMemoryBlock*)IOMappedRead32(blockStart);
 #endif
-		index = ((addr & (kOHCIPageSize-1)) / sizeof(OHCIGeneralTransferDescriptorShared))-1;
+		index = me->PhysicalToIndex(addr);
+		if (index < 0)
+			return NULL;
 
 		return &me->_gtds[index];
     }
@@ -358,10 +216,11 @@ AppleUSBOHCIgtdMemoryBlock::GetGTDFromPhysical(IOPhysicalAddress addr, UInt32 bl
 }
 
 
+
 AppleUSBOHCIgtdMemoryBlock*
 AppleUSBOHCIgtdMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleUSBOHCIgtdMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -369,106 +228,37 @@ AppleUSBOHCIgtdMemoryBlock::GetNextBlock(void)
 void
 AppleUSBOHCIgtdMemoryBlock::SetNextBlock(AppleUSBOHCIgtdMemoryBlock* next)
 {
-    _nextBlock = next;
-}
-
-
-void
-AppleUSBOHCIgtdMemoryBlock::free()
-{
-    // IOKit calls this when we are going away
-    if (_buffer)
-	{
-		_buffer->complete();				// we need to unmap our buffer
-		_buffer->release();
-	}
-    super::free();
+    SetNextMemoryBlock(next);
 }
 
 
 
-OSDefineMetaClassAndStructors(AppleUSBOHCIitdMemoryBlock, OSObject);
+OSDefineMetaClassAndStructors(AppleUSBOHCIitdMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleUSBOHCIitdMemoryBlock*
 AppleUSBOHCIitdMemoryBlock::NewMemoryBlock(void)
 {
-    AppleUSBOHCIitdMemoryBlock 	*me = new AppleUSBOHCIitdMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
-    uintptr_t						*block0;
+    AppleUSBOHCIitdMemoryBlock		*me = new AppleUSBOHCIitdMemoryBlock;
+    uintptr_t					*block0;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kOHCIPageSize, kOHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (OHCIIsochTransferDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kOHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kOHCIPageSize))
-			{
-				USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->_buffer = NULL;
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-			block0 = (uintptr_t*) me->_sharedLogical;
-			*block0++ = (uintptr_t)me;
-			*block0 =     kAppleUSBOHCIMemBlockITD;
-		}
-		else
-		{
-			USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(OHCIIsochTransferDescriptorShared), kOHCIITDAlignment, 0, 1, kOHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleUSBOHCIitdMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
+	
+	// the first element of the page is not used by the controller - it holds a pointer back to us and the block type, so
+	// that the done queue processing can get from the physical address of a isoch TD to our logical one without a search
+	block0 = (uintptr_t*)me->GetReservedLogicalPtr(0);
+	*block0++ = (uintptr_t)me;
+	*block0 = kAppleUSBOHCIMemBlockITD;
     return me;
 }
 
@@ -477,7 +267,7 @@ AppleUSBOHCIitdMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleUSBOHCIitdMemoryBlock::NumITDs(void)
 {
-    return ITDsPerBlock;
+    return NumElements();
 }
 
 
@@ -485,24 +275,14 @@ AppleUSBOHCIitdMemoryBlock::NumITDs(void)
 IOPhysicalAddress				
 AppleUSBOHCIitdMemoryBlock::GetSharedPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    
-    if (index < ITDsPerBlock)
-		ret = _sharedPhysical + ((index+1) * sizeof(OHCIIsochTransferDescriptorShared));
-	
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 OHCIIsochTransferDescriptorSharedPtr
 AppleUSBOHCIitdMemoryBlock::GetSharedLogicalPtr(UInt32 index)
 {
-    OHCIIsochTransferDescriptorSharedPtr ret = NULL;
-    
-    if (index < ITDsPerBlock)
-		ret = &_sharedLogical[index+1];
-	
-    return ret;
+    return (OHCIIsochTransferDescriptorSharedPtr)GetElementLogicalPtr(index);
 }
 
 
@@ -511,7 +291,7 @@ AppleUSBOHCIitdMemoryBlock::GetITD(UInt32 index)
 {
     AppleOHCIIsochTransferDescriptorPtr ret = NULL;
     
-    if (index < ITDsPerBlock)
+    if (index < NumElements())
 		ret = &_itds[index];
 	
     return ret;
@@ -522,15 +302,17 @@ AppleUSBOHCIitdMemoryBlock::GetITD(UInt32 index)
 AppleOHCIIsochTransferDescriptorPtr	
 AppleUSBOHCIitdMemoryBlock::GetITDFromPhysical(IOPhysicalAddress addr, UInt32 blockType)
 {
+    // NOTE:  Don't use any USBLogs here, as this is called at primary interrupt time
+    //
     IOPhysicalAddress		blockStart;
     AppleUSBOHCIitdMemoryBlock	*me;
-    UInt32			index;
-    
+    SInt32					index;
+	
     if (!addr)
 		return NULL;
 	
     blockStart = addr & ~(kOHCIPageSize-1);
-	
+    
     if (!blockType)
 	{
 #if defined (__x86_64__)
@@ -538,8 +320,8 @@ AppleUSBOHCIitdMemoryBlock::GetITDFromPhysical(IOPhysicalAddress addr, UInt32 bl
 #else
 		blockType = IOMappedRead32(blockStart + sizeof(uintptr_t));
 #endif
-	}
-	
+    }
+
     if (blockType == kAppleUSBOHCIMemBlockITD)
     {
 #if defined (__x86_64__)
@@ -547,7 +329,10 @@ AppleUSBOHCIitdMemoryBlock::GetITDFromPhysical(IOPhysicalAddress addr, UInt32 bl
 #else
 		me = (AppleUSBOHCIitdMemoryBlock*)IOMappedRead32(blockStart);
 #endif
-		index = ((addr & (kOHCIPageSize-1)) / sizeof(OHCIIsochTransferDescriptorShared))-1;
+		index = me->PhysicalToIndex(addr);
+		if (index < 0)
+			return NULL;
+
 		return &me->_itds[index];
     }
     else if (blockType == kAppleUSBOHCIMemBlockGTD)
@@ -562,10 +347,11 @@ AppleUSBOHCIitdMemoryBlock::GetITDFromPhysical(IOPhysicalAddress addr, UInt32 bl
 }
 
 
+
 AppleUSBOHCIitdMemoryBlock*
 AppleUSBOHCIitdMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleUSBOHCIitdMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -573,18 +359,5 @@ AppleUSBOHCIitdMemoryBlock::GetNextBlock(void)
 void
 AppleUSBOHCIitdMemoryBlock::SetNextBlock(AppleUSBOHCIitdMemoryBlock* next)
 {
-    _nextBlock = next;
-}
-
-
-void 			
-AppleUSBOHCIitdMemoryBlock::free()
-{
-    // IOKit calls this when we are going away
-    if (_buffer)
-	{
-		_buffer->complete();				// we need to unmap our buffer
-		_buffer->release();					// and release it
-	}
-    super::free();
+    SetNextMemoryBlock(next);
 }
@@ -22,6 +22,7 @@
  */
 
 #include <libkern/OSByteOrder.h>
+#include <libkern/OSAtomic.h>
 
 #include <IOKit/IOService.h>
 #include <IOKit/usb/IOUSBLog.h>
@@ -143,6 +144,13 @@ void AppleUSBOHCI::PollInterrupts(IOUSBCompletionAction safeAction)
 			_pOHCIRegisters->hcInterruptEnable = HostToUSBLong (kOHCIHcInterrupt_MIE | kOHCIHcInterrupt_RHSC);
 			IOSync();
 		}
+		else if ( _myPowerState == kUSBPowerStateOn )
+		{
+			// We have a real change, so report it to the hub driver now instead of waiting for the root hub timer to fire.
+			// When we are coming out of lowPower, the timer will pick it up once EnsureUsability brings us back on.
+			USBLog(5,"AppleUSBOHCI[%p]::PollInterrupts -  RootHubStatusChange  Interrupt on bus %d - reporting change to the root hub", this, (uint32_t)_busNumber );
+			CheckForRootHubChanges();
+		}
 	}
 	
 	// Frame Rollover Interrupt
@@ -150,10 +158,7 @@ void AppleUSBOHCI::PollInterrupts(IOUSBCompletionAction safeAction)
     {
 	
         _frameNumberOverflowInterrupt = 0;
-		// copy the temporary variables over to the real thing
-		// we do this because this method is protected by the workloop gate whereas the FilterInterrupt one is not
-		_anchorTime = _tempAnchorTime;
-		_anchorFrame = _tempAnchorFrame;
+		// the anchor itself was already published by the filter interrupt routine
        
   		USBTrace( kUSBTOHCIInterrupts, kTPOHCIInterruptsPollInterrupts , (uintptr_t)this, 0, 0, 5 );
 		
@@ -318,12 +323,16 @@ AppleUSBOHCI::FilterInterrupt(int index)
 			if ( (USBToHostWord(*(UInt16*)(_pHCCA + kHCCAFrameNumberOffset)) & kOHCIFmNumberMask) < kOHCIBit15 )
 				_frameNumber += kOHCIFrameOverflowBit;
 			
-			// update the get fn with time shadow regs here
+			// update the get fn with time anchor here, under the sequence count so GetFrameNumberWithTime can read it without the gate
 			// note that this code will execute differently on a power PC vs an an Intel platform with 
 			// an OHCI add-in card.
-			_tempAnchorFrame = _frameNumber + framenumber16;
+			_anchorSequence++;
+			OSMemoryBarrier();
+			_anchorFrame = _frameNumber + framenumber16;
 			tempTime = mach_absolute_time();
-			_tempAnchorTime = *(AbsoluteTime*)&tempTime;
+			_anchorTime = *(AbsoluteTime*)&tempTime;
+			OSMemoryBarrier();
+			_anchorSequence++;
 			
 			// Set the shadow field that will tell the secondary interrput that we had an FNO (rollover)
 			// Interrupt event -- the software int handler will read the shadow regs for get fn with time
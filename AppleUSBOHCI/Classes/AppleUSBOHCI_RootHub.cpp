@@ -581,8 +581,8 @@ AppleUSBOHCI::UIMRootHubStatusChange( bool abort )
 /*
  * UIMRootHubStatusChange
  *
- * This method gets called during a 32 ms timer task to see if there is anything that needs to be reported
- * to the root hub driver.
+ * This method gets called from PollInterrupts when we get an RHSC interrupt, and from the (slow) fallback root hub
+ * timer, to see if there is anything that needs to be reported to the root hub driver.
  */
 void 
 AppleUSBOHCI::UIMRootHubStatusChange(void)
@@ -23,6 +23,7 @@
 
 
 #include <libkern/OSByteOrder.h>
+#include <libkern/OSAtomic.h>
 
 extern "C" {
 #include <kern/clock.h>
@@ -36,6 +37,7 @@ extern "C" {
 
 #include "AppleUSBOHCI.h"
 #include "AppleUSBOHCIMemoryBlocks.h"
+#include "OHCIScheduleModel.h"
 #include "USBTracepoints.h"
 
 #define super IOUSBControllerV3
@@ -624,7 +626,8 @@ AppleUSBOHCI::UIMCreateInterruptEndpoint(
             return kIOReturnBadArgument;
         }
         
-        return RootHubStartTimer32(pollingRate);
+        // Status changes are pushed from PollInterrupts when we get an RHSC, so we only need a slow poll as a fallback
+        return RootHubStartTimer32(pollingRate * kOHCIRootHubFallbackPollingMultiplier);
     }
     
     // Modify direction to be an OHCI direction, as opposed to the USB direction.
@@ -817,6 +820,10 @@ AppleUSBOHCI::UIMCreateIsochEndpoint(
     UInt32			edFlags;
 
 
+	// IsocIO only passes kAppleUSBIsocASAPFrame on to a full speed controller. Every isoch pipe is opened through here before
+	// IsocIO can be called on it, so this is set before UIMCreateIsochTransfer can ever see the ASAP frame
+	_controllerSpeed = kUSBDeviceSpeedFull;
+	
     if (direction == kUSBOut)
         direction = kOHCIEDDirectionOut;
     else if (direction == kUSBIn)
@@ -947,6 +954,7 @@ AppleUSBOHCI::UIMAbortEndpoint(short				functionAddress,
     }
 
     pED->pShared->flags |= HostToUSBLong(kOHCIEDControl_K);	// mark the ED as skipped
+	pED->nextIsochFrame = 0;									// an aborted stream starts a new cadence
 
     // We used to wait for a SOF interrupt here.  Now just sleep for 2 ms:  1 to finish processing
     // the frame and 1 to let the filter interrupt routine finish
@@ -1027,6 +1035,7 @@ AppleUSBOHCI::UIMDeleteEndpoint(
     // remove pointer wraps
     pEDQueueBack->pShared->nextED = pED->pShared->nextED;
     pEDQueueBack->pLogicalNext = pED->pLogicalNext;
+	OHCICheckSchedule("UIMDeleteEndpoint");
 
     // clear some bit in hcControl
     hcControl = USBToHostLong(_pOHCIRegisters->hcControl);	
@@ -1064,6 +1073,18 @@ AppleUSBOHCI::UIMDeleteEndpoint(
 
     pED->pShared->nextED = NULL;
 
+    // take it out of the per address index
+    if ((functionAddress >= 0) && (functionAddress < kOHCIMaxFunctionAddresses))
+    {
+        AppleOHCIEndpointDescriptorPtr	*ppED = &_pAddressEDList[functionAddress];
+        
+        while (*ppED && (*ppED != pED))
+            ppED = &(*ppED)->pNextAddressED;
+        if (*ppED)
+            *ppED = pED->pNextAddressED;
+    }
+    pED->pNextAddressED = NULL;
+
     //deallocate ED
     DeallocateED(pED);
        
@@ -1203,6 +1224,7 @@ AppleUSBOHCI::AddEmptyEndPoint(
         pOHCIEndpointDescriptor->pShared->tdQueueHeadPtr = HostToUSBLong( pITD->pPhysical);
         pOHCIEndpointDescriptor->pLogicalTailP = pITD;
         pOHCIEndpointDescriptor->pLogicalHeadP = pITD;		
+		pOHCIEndpointDescriptor->nextIsochFrame = 0;
 
     }
 
@@ -1210,6 +1232,15 @@ AppleUSBOHCI::AddEmptyEndPoint(
     pOHCIEndpointDescriptor->pLogicalNext = pED->pLogicalNext;
     pED->pLogicalNext = pOHCIEndpointDescriptor;
     pED->pShared->nextED = HostToUSBLong(pOHCIEndpointDescriptor->pPhysical);
+	OHCICheckSchedule("AddEmptyEndPoint");
+
+    // index the non isoch EDs by function address so UIMEnableAddressEndpoints doesn't have to walk every list
+    pOHCIEndpointDescriptor->pNextAddressED = NULL;
+    if ((format == kOHCIEDFormatGeneralTD) && (functionAddress < kOHCIMaxFunctionAddresses))
+    {
+        pOHCIEndpointDescriptor->pNextAddressED = _pAddressEDList[functionAddress];
+        _pAddressEDList[functionAddress] = pOHCIEndpointDescriptor;
+    }
 
     return (pOHCIEndpointDescriptor);
 }
@@ -1807,6 +1838,86 @@ AppleUSBOHCI::print_int_list(int level, bool printSkipped, bool printTDs)
     }
 }
 
+
+
+#if OHCI_CHECK_SCHEDULE
+void
+AppleUSBOHCI::CheckEDList(const char *who, AppleOHCIEndpointDescriptorPtr pListHead, AppleOHCIEndpointDescriptorPtr pListTail)
+{
+    AppleOHCIEndpointDescriptorPtr			pED;
+	AppleOHCIGeneralTransferDescriptorPtr	pTD;
+	UInt32									edFlags;
+	int										count;
+
+	for (pED = pListHead, count = 0; pED; pED = pED->pLogicalNext, count++)
+	{
+		if (count > (kOHCIMaxFunctionAddresses * kUSBMaxPipes))
+			panic("AppleUSBOHCI::CheckSchedule(%s) - loop in the ED list at %p", who, pListHead);
+
+		if (pED->pLogicalNext && ((USBToHostLong(pED->pShared->nextED) & kOHCINextEndpointDescriptor_nextED) != pED->pLogicalNext->pPhysical))
+			panic("AppleUSBOHCI::CheckSchedule(%s) - ED %p links to 0x%x instead of %p (0x%x)", who, pED, (uint32_t)USBToHostLong(pED->pShared->nextED), pED->pLogicalNext, (uint32_t)pED->pLogicalNext->pPhysical);
+
+		// the controller retires TDs (and reuses their nextTD for the done queue) from an ED which is running, so only look at the TDs of one which is stopped
+		edFlags = USBToHostLong(pED->pShared->flags);
+		if ((GetEDType(pED) == kOHCIEDFormatGeneralTD) && ((edFlags & kOHCIEDControl_K) || (USBToHostLong(pED->pShared->tdQueueHeadPtr) & kOHCIHeadPointer_H)))
+		{
+			pTD = AppleUSBOHCIgtdMemoryBlock::GetGTDFromPhysical(USBToHostLong(pED->pShared->tdQueueHeadPtr) & kOHCIHeadPMask);
+			while (pTD && (pTD != pED->pLogicalTailP))
+			{
+				if (!pTD->pLogicalNext || (USBToHostLong(pTD->pShared->nextTD) != pTD->pLogicalNext->pPhysical))
+					panic("AppleUSBOHCI::CheckSchedule(%s) - ED %p TD %p does not link to its next TD %p", who, pED, pTD, pTD->pLogicalNext);
+				pTD = pTD->pLogicalNext;
+			}
+			if (pTD != pED->pLogicalTailP)
+				panic("AppleUSBOHCI::CheckSchedule(%s) - ED %p TD list does not end at its tail %p", who, pED, pED->pLogicalTailP);
+		}
+
+		if (pED == pListTail)
+			return;
+	}
+	if (pListTail)
+		panic("AppleUSBOHCI::CheckSchedule(%s) - ED list %p does not reach its tail %p", who, pListHead, pListTail);
+}
+
+
+
+void
+AppleUSBOHCI::CheckSchedule(const char *who)
+{
+    AppleOHCIEndpointDescriptorPtr	pED;
+	int								i;
+	OHCIScheduleModel				model;
+	OHCIScheduleWalk				walk;
+
+	CheckEDList(who, _pControlHead, _pControlTail);
+	CheckEDList(who, _pBulkHead, _pBulkTail);
+	CheckEDList(who, _pIsochHead, _pIsochTail);
+	
+	// each node of the interrupt tree links on into the nodes of the longer polling intervals
+	for (i = 0; i < 63; i++)
+		CheckEDList(who, _pInterruptHead[i].pHead, _pInterruptHead[i].pTail);
+	
+	// and the per address index has to agree with the EDs it points to
+	for (i = 0; i < kOHCIMaxFunctionAddresses; i++)
+	{
+		for (pED = _pAddressEDList[i]; pED; pED = pED->pNextAddressED)
+		{
+			if (((USBToHostLong(pED->pShared->flags) & kOHCIEDControl_FA) >> kOHCIEDControl_FAPhase) != (UInt32)i)
+				panic("AppleUSBOHCI::CheckSchedule(%s) - ED %p is on the index list for address %d but has flags 0x%x", who, pED, i, (uint32_t)USBToHostLong(pED->pShared->flags));
+		}
+	}
+	
+	// and then what the controller itself will find when it follows the shared links
+	model.edBlocks = _edMBHead;
+	model.gtdBlocks = _gtdMBHead;
+	model.itdBlocks = _itdMBHead;
+	model.periodicTailED = _pIsochTail->pPhysical;
+	model.stoppedEDsOnly = true;
+	if (OHCICheckSchedule(&model, (const volatile UInt32 *)(_pHCCA + kHCCAInterruptTableOffset), USBToHostLong(_pOHCIRegisters->hcControlHeadED), USBToHostLong(_pOHCIRegisters->hcBulkHeadED), &walk) != kOHCIScheduleOK)
+		panic("AppleUSBOHCI::CheckSchedule(%s) - list 0x%x: %s (element 0x%x link 0x%x)", who, (uint32_t)walk.list, OHCIScheduleErrorString(walk.error), (uint32_t)walk.element, (uint32_t)walk.link);
+}
+#endif
+
 #pragma mark Timeout Checks
 #define	kOHCIUIMScratchFirstActiveFrame	0
 
@@ -2078,6 +2189,7 @@ AppleUSBOHCI::UIMCreateIsochTransfer(IOUSBIsocCommand *command)
     UInt64										frameDiff;
     UInt64										maxOffset = (UInt64)(0x00007FF0);
     UInt32										diff32;
+	UInt32										framesSkipped;
 	
     UInt32										itdFlags = 0;
     UInt32										numSegs = 0;
@@ -2144,6 +2256,20 @@ AppleUSBOHCI::UIMCreateIsochTransfer(IOUSBIsocCommand *command)
     if ( lowLatency && (updateFrequency == 0))
         useUpdateFrequency = false;
 	
+	if (frameNumberStart == kAppleUSBIsocASAPFrame)
+	{
+		frameNumberStart = command->ResolveASAPStartFrame(pED->nextIsochFrame, curFrameNumber, kUSBIsocASAPLeadFrames, &framesSkipped);
+		frameNumber = (UInt16) frameNumberStart;
+		if (framesSkipped)
+		{
+			USBLog(4,"AppleUSBOHCI[%p]::UIMCreateIsochTransfer ED (%p) fell behind, skipping %d frames to start at %d (curFrameNumber: %d)", this, pED, (uint32_t)framesSkipped, (uint32_t) frameNumberStart, (uint32_t) curFrameNumber);
+			_isochASAPResyncCount++;
+			_isochASAPFramesSkipped += framesSkipped;
+			setProperty("IsochASAPResyncCount", _isochASAPResyncCount, 32);
+			setProperty("IsochASAPFramesSkipped", _isochASAPFramesSkipped, 64);
+		}
+	}
+	
     if (frameNumberStart <= curFrameNumber)
     {
         if (frameNumberStart < (curFrameNumber - maxOffset))
@@ -2446,6 +2572,7 @@ AppleUSBOHCI::UIMCreateIsochTransfer(IOUSBIsocCommand *command)
         // Make new descriptor the tail
         pED->pLogicalTailP = pNewITD;
         OSWriteLittleInt32(&pED->pShared->tdQueueTailPtr, 0, pNewITD->pPhysical);
+		pED->nextIsochFrame = frameNumberStart + frameCount;
     }
 	
     return status;
@@ -2453,29 +2580,24 @@ AppleUSBOHCI::UIMCreateIsochTransfer(IOUSBIsocCommand *command)
 
 
 
-// this call is not gated, so we need to gate it ourselves
+// this call is not gated, and doesn't need to be
+// The filter interrupt routine bumps _anchorSequence before and after it updates the anchor, so we just read the pair
+// and go around again if the sequence was odd or changed underneath us.
 IOReturn
 AppleUSBOHCI::GetFrameNumberWithTime(UInt64* frameNumber, AbsoluteTime *theTime)
 {
-	if (!_commandGate)
-		return kIOReturnUnsupported;
-		
-	return _commandGate->runAction(GatedGetFrameNumberWithTime, frameNumber, theTime);
-}
-
-
-
-// here is the gated version
-IOReturn
-AppleUSBOHCI::GatedGetFrameNumberWithTime(OSObject *owner, void* arg0, void* arg1, void* arg2, void* arg3)
-{
-#pragma unused (arg2, arg3)
-	AppleUSBOHCI		*me = (AppleUSBOHCI*)owner;
-	UInt64				*frameNumber = (UInt64*)arg0;
-	AbsoluteTime		*theTime = (AbsoluteTime*)arg1;
+	UInt32				sequence;
+	
+	do
+	{
+		while ((sequence = _anchorSequence) & 1)
+			;
+		OSMemoryBarrier();
+		*frameNumber = _anchorFrame;
+		*theTime = _anchorTime;
+		OSMemoryBarrier();
+	} while (sequence != _anchorSequence);
 	
-	*frameNumber = me->_anchorFrame;
-	*theTime = me->_anchorTime;
 	return kIOReturnSuccess;
 }
 
@@ -2485,103 +2607,37 @@ AppleUSBOHCI::UIMEnableAddressEndpoints(USBDeviceAddress address, bool enable)
 {
     AppleOHCIEndpointDescriptorPtr	pEDQueue;
 	UInt32							edFlags;
-	int								i;
 
 	USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints(%d, %s)", this, (int)address, enable ? "true" : "false");
-	// look through the lists one at a time - Control first
-    pEDQueue = _pControlHead;
-    while (pEDQueue != _pControlTail)
+	if (address >= kOHCIMaxFunctionAddresses)
+		return kIOReturnBadArgument;
+	
+	// the control, bulk and interrupt EDs for this address are all on its index list, so we don't need to walk the schedule
+    pEDQueue = _pAddressEDList[address];
+    while (pEDQueue)
     {
 		edFlags = USBToHostLong(pEDQueue->pShared->flags);
-        if ((edFlags & kOHCIEDControl_FA) == address)
+		USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - found ED[%p] which matches - %s", this, pEDQueue, enable ? "enabling" : "disabling");
+		if (enable)
 		{
-			USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - found control ED[%p] which matches - %s", this, pEDQueue, enable ? "enabling" : "disabling");
-			if (enable)
-			{
-				if (!(edFlags & kOHCISkipped))
-				{
-					USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was NOT marked as skipped..", this);
-				}
-				edFlags &= ~kOHCISkipped;
-			}
-			else
+			if (!(edFlags & kOHCISkipped))
 			{
-				if (edFlags & kOHCISkipped)
-				{
-					USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was already marked as skipped..", this);
-				}
-				edFlags |= kOHCISkipped;
+				USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was NOT marked as skipped..", this);
 			}
-			pEDQueue->pShared->flags = HostToUSBLong(edFlags);
-			IOSync();
+			edFlags &= ~kOHCISkipped;
 		}
-		pEDQueue = (AppleOHCIEndpointDescriptorPtr) pEDQueue->pLogicalNext;
-	}
-	
-	// now bulk
-    pEDQueue = _pBulkHead;
-    while (pEDQueue != _pBulkTail)
-    {
-		edFlags = USBToHostLong(pEDQueue->pShared->flags);
-        if ((edFlags & kOHCIEDControl_FA) == address)
+		else
 		{
-			USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - found Bulk ED[%p] which matches - %s", this, pEDQueue, enable ? "enabling" : "disabling");
-			if (enable)
-			{
-				if (!(edFlags & kOHCISkipped))
-				{
-					USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was NOT marked as skipped..", this);
-				}
-				edFlags &= ~kOHCISkipped;
-			}
-			else
+			if (edFlags & kOHCISkipped)
 			{
-				if (edFlags & kOHCISkipped)
-				{
-					USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was already marked as skipped..", this);
-				}
-				edFlags |= kOHCISkipped;
+				USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was already marked as skipped..", this);
 			}
-			pEDQueue->pShared->flags = HostToUSBLong(edFlags);
-			IOSync();
+			edFlags |= kOHCISkipped;
 		}
-		pEDQueue = (AppleOHCIEndpointDescriptorPtr) pEDQueue->pLogicalNext;
+		pEDQueue->pShared->flags = HostToUSBLong(edFlags);
+		IOSync();
+		pEDQueue = pEDQueue->pNextAddressED;
 	}
-	
-	// now interrupt
-    for (i = 0; i < 63; i++)
-    {
-        pEDQueue = _pInterruptHead[i].pHead;
-        
-        while (pEDQueue != _pInterruptHead[i].pTail)
-        {
-			edFlags = USBToHostLong(pEDQueue->pShared->flags);
-
-		   if ((edFlags & kOHCIEDControl_FA) == address)
-			{
-				USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - found Interrupt ED[%p] which matches - %s", this, pEDQueue, enable ? "enabling" : "disabling");
-				if (enable)
-				{
-					if (!(edFlags & kOHCISkipped))
-					{
-						USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was NOT marked as skipped..", this);
-					}
-					edFlags &= ~kOHCISkipped;
-				}
-				else
-				{
-					if (edFlags & kOHCISkipped)
-					{
-						USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAddressEndpoints - HMMM - it was already marked as skipped..", this);
-					}
-					edFlags |= kOHCISkipped;
-				}
-				pEDQueue->pShared->flags = HostToUSBLong(edFlags);
-				IOSync();
-			}
-            pEDQueue = pEDQueue->pLogicalNext;
-        }
-    }
 	return kIOReturnSuccess;
 }
 
@@ -2592,54 +2648,85 @@ AppleUSBOHCI::UIMEnableAllEndpoints(bool enable)
 {
     AppleOHCIEndpointDescriptorPtr	pEDQueue;
 	UInt32							edFlags;
-	int								i;
+	int								address;
 
 	USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAllEndpoints(%s)", this, enable ? "true" : "false");
-	// look through the lists one at a time - Control first
-    pEDQueue = _pControlHead;
-    while (pEDQueue != _pControlTail)
+	// address 0 is never left skipped, so start at 1
+    for (address = 1; address < kOHCIMaxFunctionAddresses; address++)
     {
-		edFlags = USBToHostLong(pEDQueue->pShared->flags);
-		if ((edFlags & kOHCISkipped) && (edFlags & kOHCIEDControl_FA))
-		{
-			USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAllEndpoints - found skipped Control ED[%p] for ADDR[%d] ", this, pEDQueue, (int)(edFlags & kOHCIEDControl_FA));
-			edFlags &= ~kOHCISkipped;
-			pEDQueue->pShared->flags = HostToUSBLong(edFlags);
-			IOSync();
-		}
-		
-		pEDQueue = (AppleOHCIEndpointDescriptorPtr) pEDQueue->pLogicalNext;
-	}
-    pEDQueue = _pBulkHead;
-    while (pEDQueue != _pBulkTail)
-    {
-		edFlags = USBToHostLong(pEDQueue->pShared->flags);
-		if ((edFlags & kOHCISkipped) && (edFlags & kOHCIEDControl_FA))
-		{
-			USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAllEndpoints - found skipped Bulk ED[%p] for ADDR[%d] ", this, pEDQueue, (int)(edFlags & kOHCIEDControl_FA));
-			edFlags &= ~kOHCISkipped;
-			pEDQueue->pShared->flags = HostToUSBLong(edFlags);
-			IOSync();
-		}
-		
-		pEDQueue = (AppleOHCIEndpointDescriptorPtr) pEDQueue->pLogicalNext;
-	}
-    for (i = 0; i < 63; i++)
-    {
-        pEDQueue = _pInterruptHead[i].pHead;
-        
-        while (pEDQueue != _pInterruptHead[i].pTail)
+        pEDQueue = _pAddressEDList[address];
+        while (pEDQueue)
         {
 			edFlags = USBToHostLong(pEDQueue->pShared->flags);
-			if ((edFlags & kOHCISkipped) && (edFlags & kOHCIEDControl_FA))
+			if (edFlags & kOHCISkipped)
 			{
-				USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAllEndpoints - found skipped Interrupt ED[%p] for ADDR[%d] ", this, pEDQueue, (int)(edFlags & kOHCIEDControl_FA));
+				USBLog(2, "AppleUSBOHCI[%p]::UIMEnableAllEndpoints - found skipped ED[%p] for ADDR[%d] ", this, pEDQueue, address);
 				edFlags &= ~kOHCISkipped;
 				pEDQueue->pShared->flags = HostToUSBLong(edFlags);
 				IOSync();
 			}
-            pEDQueue = pEDQueue->pLogicalNext;
+            pEDQueue = pEDQueue->pNextAddressED;
         }
     }
 	return kIOReturnSuccess;
-}	
+}
+
+
+
+static short
+OHCIEDDirection(UInt8 direction)
+{
+    if (direction == kUSBOut)
+        return kOHCIEDDirectionOut;
+    else if (direction == kUSBIn)
+        return kOHCIEDDirectionIn;
+    else
+        return kOHCIEDDirectionTD;
+}
+
+
+
+IOReturn
+AppleUSBOHCI::UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+#pragma unused (speed)
+    AppleOHCIEndpointDescriptorPtr		pED;
+	SInt32								needed = 0;
+	SInt32								available = _isochBandwidthAvail;
+	UInt32								i;
+	
+	// only the isoch endpoints have bandwidth reserved for them up front
+	for (i = 0; i < closeCount; i++)
+	{
+		if (closeList[i].transferType != kUSBIsoc)
+			continue;
+		pED = FindIsochronousEndpoint(address, closeList[i].number, OHCIEDDirection(closeList[i].direction), NULL);
+		if (pED)
+			available += (USBToHostLong(pED->pShared->flags) & kOHCIEDControl_MPS) >> kOHCIEDControl_MPSPhase;
+	}
+	
+	for (i = 0; i < openCount; i++)
+	{
+		if (openList[i].transferType != kUSBIsoc)
+			continue;
+		needed += openList[i].maxPacketSize;
+		
+		// an existing endpoint which is not being closed only needs the difference (see UIMCreateIsochEndpoint)
+		if (!IsochEndpointInList(closeList, closeCount, openList[i].number, openList[i].direction))
+		{
+			pED = FindIsochronousEndpoint(address, openList[i].number, OHCIEDDirection(openList[i].direction), NULL);
+			if (pED)
+				needed -= (USBToHostLong(pED->pShared->flags) & kOHCIEDControl_MPS) >> kOHCIEDControl_MPSPhase;
+		}
+	}
+	
+	if (needed > available)
+	{
+		USBLog(3, "AppleUSBOHCI[%p]::UIMCheckPipeBandwidth - address %d needs %d bytes per frame, only %d available", this, address, (int)needed, (int)available);
+		*bandwidthShortfall = needed - available;
+		return kIOReturnNoBandwidth;
+	}
+	
+	*bandwidthShortfall = 0;
+	return kIOReturnSuccess;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include "OHCIScheduleModel.h"
+
+#define kOHCIInterruptTableEntries		32
+
+
+static UInt32
+CountElements(IOUSBControllerMemoryBlock *head)
+{
+	UInt32		count = 0;
+	
+	for (; head; head = head->GetNextMemoryBlock())
+		count += head->NumElements();
+	return count;
+}
+
+
+
+static void *
+FindElement(IOUSBControllerMemoryBlock *head, IOPhysicalAddress addr)
+{
+	IOUSBControllerMemoryBlock		*block = IOUSBControllerMemoryBlock::FindBlockForPhysical(head, addr);
+	
+	return block ? block->PhysicalToLogical(addr) : NULL;
+}
+
+
+
+static OHCIScheduleError
+Fail(OHCIScheduleWalk *walk, OHCIScheduleError error, IOPhysicalAddress element, UInt32 link)
+{
+	walk->error = error;
+	walk->element = element;
+	walk->link = link;
+	return error;
+}
+
+
+
+// from the head pointer to the tail pointer, which is the UIM's dummy TD and so has to be a TD of the right format as well
+static OHCIScheduleError
+CheckTDs(const OHCIScheduleModel *model, IOPhysicalAddress ed, OHCIEndpointDescriptorSharedPtr pED, UInt32 maxTDs, OHCIScheduleWalk *walk)
+{
+	UInt32							flags = USBToHostLong(pED->flags);
+	UInt32							headP = USBToHostLong(pED->tdQueueHeadPtr);
+	UInt32							tailP = USBToHostLong(pED->tdQueueTailPtr);
+	bool							isoch = (flags & kOHCIEDControl_F) != 0;
+	IOUSBControllerMemoryBlock		*blocks = isoch ? model->itdBlocks : model->gtdBlocks;
+	UInt32							reservedBits = isoch ? (kOHCIITDAlignment - 1) : (kOHCIGTDAlignment - 1);
+	IOPhysicalAddress				element = ed;
+	IOPhysicalAddress				td;
+	UInt32							link = headP;
+	void							*pTD;
+	UInt32							count;
+	
+	if (headP & ~(kOHCIHeadPMask | kOHCIHeadPointer_H | kOHCIHeadPointer_C))
+		return Fail(walk, kOHCIScheduleReservedBits, ed, headP);
+	if (tailP & ~kOHCITailPointer_tailP)
+		return Fail(walk, kOHCIScheduleReservedBits, ed, tailP);
+	
+	if (model->stoppedEDsOnly && !(flags & kOHCIEDControl_K) && !(headP & kOHCIHeadPointer_H))
+		return kOHCIScheduleOK;
+	
+	if (!FindElement(blocks, tailP))
+		return Fail(walk, kOHCIScheduleNotTD, ed, tailP);
+	
+	for (td = headP & kOHCIHeadPMask, count = 0; td != tailP; count++)
+	{
+		if (!td)
+			return Fail(walk, kOHCIScheduleNoTail, element, link);
+		if (count >= maxTDs)
+			return Fail(walk, kOHCIScheduleLoop, ed, link);
+		
+		pTD = FindElement(blocks, td);
+		if (!pTD)
+			return Fail(walk, kOHCIScheduleNotTD, element, link);
+		
+		walk->tds++;
+		if (isoch)
+			link = USBToHostLong(((OHCIIsochTransferDescriptorSharedPtr)pTD)->nextTD);
+		else
+			link = USBToHostLong(((OHCIGeneralTransferDescriptorSharedPtr)pTD)->nextTD);
+		if (link & reservedBits)
+			return Fail(walk, kOHCIScheduleReservedBits, td, link);
+		
+		element = td;
+		td = link;
+	}
+	return kOHCIScheduleOK;
+}
+
+
+
+OHCIScheduleError
+OHCICheckScheduleList(const OHCIScheduleModel *model, IOPhysicalAddress head, IOPhysicalAddress tail, OHCIScheduleWalk *walk)
+{
+	OHCIEndpointDescriptorSharedPtr		pED;
+	IOPhysicalAddress					element = 0;
+	IOPhysicalAddress					addr = head;
+	UInt32								link = head;
+	UInt32								maxEDs = CountElements(model->edBlocks);
+	UInt32								maxTDs = CountElements(model->gtdBlocks) + CountElements(model->itdBlocks);
+	UInt32								count;
+	OHCIScheduleError					error;
+	
+	walk->error = kOHCIScheduleOK;
+	walk->list = head;
+	walk->element = 0;
+	walk->link = 0;
+	
+	for (count = 0; addr; count++)
+	{
+		if (link & ~kOHCINextEndpointDescriptor_nextED)
+			return Fail(walk, kOHCIScheduleReservedBits, element, link);
+		if (count >= maxEDs)
+			return Fail(walk, kOHCIScheduleLoop, element, link);
+		
+		pED = (OHCIEndpointDescriptorSharedPtr)FindElement(model->edBlocks, addr);
+		if (!pED)
+			return Fail(walk, kOHCIScheduleNotED, element, link);
+		
+		walk->eds++;
+		error = CheckTDs(model, addr, pED, maxTDs, walk);
+		if (error != kOHCIScheduleOK)
+			return error;
+		
+		if (addr == tail)
+			return kOHCIScheduleOK;
+		
+		link = USBToHostLong(pED->nextED);
+		element = addr;
+		addr = link;
+	}
+	if (tail)
+		return Fail(walk, kOHCIScheduleNoTail, element, link);
+	return kOHCIScheduleOK;
+}
+
+
+
+OHCIScheduleError
+OHCICheckSchedule(const OHCIScheduleModel *model, const volatile UInt32 *interruptTable, IOPhysicalAddress controlHead, IOPhysicalAddress bulkHead, OHCIScheduleWalk *walk)
+{
+	OHCIScheduleError		error;
+	int						i;
+	
+	walk->eds = 0;
+	walk->tds = 0;
+	for (i = 0; i < kOHCIInterruptTableEntries; i++)
+	{
+		error = OHCICheckScheduleList(model, USBToHostLong(interruptTable[i]), model->periodicTailED, walk);
+		if (error != kOHCIScheduleOK)
+			return error;
+	}
+	
+	error = OHCICheckScheduleList(model, controlHead, 0, walk);
+	if (error != kOHCIScheduleOK)
+		return error;
+	return OHCICheckScheduleList(model, bulkHead, 0, walk);
+}
+
+
+
+const char *
+OHCIScheduleErrorString(OHCIScheduleError error)
+{
+	switch (error)
+	{
+		case kOHCIScheduleOK:					return "OK";
+		case kOHCIScheduleReservedBits:			return "reserved bits set in a link";
+		case kOHCIScheduleNotED:				return "link to something which is not an ED";
+		case kOHCIScheduleNotTD:				return "link to something which is not a TD of the ED's format";
+		case kOHCIScheduleLoop:					return "loop in the schedule";
+		case kOHCIScheduleNoTail:				return "list ends before its tail";
+	}
+	return "unknown error";
+}
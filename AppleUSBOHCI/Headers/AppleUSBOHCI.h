@@ -54,6 +54,18 @@ __attribute__((format(printf, 1, 2)));
 #define USBError( LEVEL, FORMAT, ARGS... )  { kprintf( FORMAT "\n", ## ARGS ) ; }
 #endif
 
+/* Schedule consistency assertions: walk the ED lists after every change to the schedule and panic if the hardware links no
+   longer match the software ones. Only a debugging aid for changes to the schedule code, and off by default */
+#ifndef OHCI_CHECK_SCHEDULE
+	#define OHCI_CHECK_SCHEDULE 0
+#endif
+
+#if OHCI_CHECK_SCHEDULE
+#define OHCICheckSchedule( WHO )	CheckSchedule( WHO )
+#else
+#define OHCICheckSchedule( WHO )
+#endif
+
 #ifdef __ppc__
 #define IOSync eieio
 #else
@@ -63,6 +75,9 @@ __attribute__((format(printf, 1, 2)));
 // This is an iVar in our superclass' expansion data
 #define	_ERRATA64BITS					_v3ExpansionData->_errata64Bits
 
+// the ED function address field is 7 bits wide
+#define kOHCIMaxFunctionAddresses		128
+
 typedef struct AppleOHCIIntHeadStruct
                     AppleOHCIIntHead,
                     *AppleOHCIIntHeadPtr;
@@ -96,6 +111,8 @@ struct AppleOHCIEndpointDescriptorStruct
     void*							pLogicalTailP;		
     void*							pLogicalHeadP;
 	bool							pAborting;
+	AppleOHCIEndpointDescriptorPtr	pNextAddressED;		// next control/bulk/interrupt ED for the same function address
+	UInt64							nextIsochFrame;		// frame after the last isoch transfer queued on the ED, 0 if none
 };
 
 struct AppleOHCIGeneralTransferDescriptorStruct
@@ -149,6 +166,10 @@ private:
     void						print_control_list(int level, bool printSkipped, bool printTDs);
     void						print_bulk_list(int level, bool printSkipped, bool printTDs);
     void						print_int_list(int level, bool printSkipped, bool printTDs);
+#if OHCI_CHECK_SCHEDULE
+    void						CheckSchedule(const char *who);
+    void						CheckEDList(const char *who, AppleOHCIEndpointDescriptorPtr pListHead, AppleOHCIEndpointDescriptorPtr pListTail);
+#endif
     bool						IsValidPhysicalAddress(IOPhysicalAddress pageAddr);
     void						showRegisters(UInt32 level, const char *s);
 		
@@ -170,6 +191,7 @@ protected:
     volatile AppleOHCIEndpointDescriptorPtr			_pControlHead;			// ptr to Control list
     volatile AppleOHCIEndpointDescriptorPtr			_pBulkTail;				// ptr to Bulk list
     volatile AppleOHCIEndpointDescriptorPtr			_pControlTail;			// ptr to Control list
+    AppleOHCIEndpointDescriptorPtr					_pAddressEDList[kOHCIMaxFunctionAddresses];	// per function address list of non isoch EDs, linked through pNextAddressED
     volatile AppleOHCIGeneralTransferDescriptorPtr	_pFreeTD;			// list of availabble Trasfer Descriptors
     volatile AppleOHCIIsochTransferDescriptorPtr	_pFreeITD;		// list of availabble Trasfer Descriptors
     volatile AppleOHCIEndpointDescriptorPtr			_pFreeED;				// list of available Endpoint Descriptors
@@ -218,9 +240,8 @@ protected:
     UInt64									_timeElapsed;
 	
     // variables to get the anchor frame
-	AbsoluteTime							_tempAnchorTime;
+	volatile UInt32							_anchorSequence;					// odd while the filter interrupt routine is updating the anchor
 	AbsoluteTime							_anchorTime;
-	UInt64									_tempAnchorFrame;
 	UInt64									_anchorFrame;
 	
 	UInt32									_ExpressCardPort;					// Port number of ExpressCard (0 if no ExpressCard on this controller)
@@ -229,6 +250,8 @@ protected:
 	bool									_rootHubStatuschangedInterruptReceived;	// True when we receive a RHSC interrupt so that we can tell whether a controller waking from Doze is from a device or from software
 	// saved root hub port registers
 	UInt32									_savedHcRhPortStatus[15];
+	UInt32									_isochASAPResyncCount;				// kAppleUSBIsocASAPFrame requests which had fallen behind, exported as properties
+	UInt64									_isochASAPFramesSkipped;			// frames of their endpoints' cadence which went by unused
 
     static void 				InterruptHandler(OSObject *owner,  IOInterruptEventSource * source, int count);
     static bool 				PrimaryInterruptFilter(OSObject *owner, IOFilterInterruptEventSource *source);
@@ -570,10 +593,8 @@ public:
     virtual void UIMCheckForTimeouts(void);
 	virtual IODMACommand					*GetNewDMACommand();
 	
-	// this call is not gated, so we need to gate it ourselves
+	// this call is not gated, and doesn't need to be
 	virtual IOReturn								GetFrameNumberWithTime(UInt64* frameNumber, AbsoluteTime *theTime);
-	// here is the gated version
-	static IOReturn									GatedGetFrameNumberWithTime(OSObject *owner, void* arg0, void* arg1, void* arg2, void* arg3);
 	
 	// separated this from initForPM
 	void											CheckSleepCapability(void);
@@ -588,6 +609,9 @@ public:
 	virtual IOReturn				UIMEnableAddressEndpoints(USBDeviceAddress address, bool enable);
 	virtual IOReturn				UIMEnableAllEndpoints(bool enable);
 	virtual IOReturn				EnableInterruptsFromController(bool enable);
+
+	// in IOUSBControllerV2
+	virtual IOReturn				UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
 };
 
 
@@ -608,4 +632,12 @@ enum
     kOHCICheckForRootHubInactivityPeriod = 30		// Wait for x secs after the last time the root hub was active
 };    
 
+// The RHSC interrupt reports root hub changes as they happen, so the root hub timer
+// is only kept around as a slow safety net (e.g. while RHSC is masked waiting for a clear feature)
+//
+enum
+{
+    kOHCIRootHubFallbackPollingMultiplier = 8		// poll at 8x the root hub interrupt endpoint's polling rate
+};
+
 #endif /* _IOKIT_AppleUSBOHCI_H */
@@ -26,6 +26,7 @@
 #define _APPLEUSBOHCIMEMORYBLOCKS_H_
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBOHCI.h"
 #include "USBOHCI.h"
@@ -37,22 +38,17 @@ enum
 };
 
 
-class AppleUSBOHCIedMemoryBlock : public OSObject
+class AppleUSBOHCIedMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleUSBOHCIedMemoryBlock);
     
 #define EDsPerBlock	(kOHCIPageSize / sizeof(OHCIEndpointDescriptorShared))
 
 private:
-    IOPhysicalAddress					_sharedPhysical;
-    OHCIEndpointDescriptorSharedPtr		_sharedLogical;
-    AppleUSBOHCIedMemoryBlock			*_nextBlock;
     AppleOHCIEndpointDescriptor			_eds[EDsPerBlock];	// the non shared data
-	IOBufferMemoryDescriptor			*_buffer;
     
 public:
 
-    virtual void						free();
     static AppleUSBOHCIedMemoryBlock 	*NewMemoryBlock(void);
     void								SetNextBlock(AppleUSBOHCIedMemoryBlock *next);
     AppleUSBOHCIedMemoryBlock			*GetNextBlock(void);
@@ -64,22 +60,17 @@ public:
 
 
 
-class AppleUSBOHCIgtdMemoryBlock : public OSObject
+class AppleUSBOHCIgtdMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleUSBOHCIgtdMemoryBlock);
     
 #define GTDsPerBlock	((kOHCIPageSize / sizeof(OHCIGeneralTransferDescriptorShared)) - 1)
 
 private:
-    IOPhysicalAddress							_sharedPhysical;
-    OHCIGeneralTransferDescriptorSharedPtr		_sharedLogical;
-    AppleUSBOHCIgtdMemoryBlock					*_nextBlock;
     AppleOHCIGeneralTransferDescriptor			_gtds[GTDsPerBlock];	// the non shared data
-	IOBufferMemoryDescriptor					*_buffer;
     
 public:
 
-    virtual void									free();
     static AppleUSBOHCIgtdMemoryBlock				*NewMemoryBlock(void);
     static AppleOHCIGeneralTransferDescriptorPtr	GetGTDFromPhysical(IOPhysicalAddress addr, UInt32 blockType = 0);
     void											SetNextBlock(AppleUSBOHCIgtdMemoryBlock *next);
@@ -92,22 +83,17 @@ public:
 
 
 
-class AppleUSBOHCIitdMemoryBlock : public OSObject
+class AppleUSBOHCIitdMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleUSBOHCIitdMemoryBlock);
     
 #define ITDsPerBlock	((kOHCIPageSize / sizeof(OHCIIsochTransferDescriptorShared)) - 1)
 
 private:
-    IOPhysicalAddress								_sharedPhysical;
-    OHCIIsochTransferDescriptorSharedPtr			_sharedLogical;
-    AppleUSBOHCIitdMemoryBlock						*_nextBlock;
     AppleOHCIIsochTransferDescriptor				_itds[ITDsPerBlock];	// the non shared data
-	IOBufferMemoryDescriptor						*_buffer;
     
 public:
 
-    virtual void									free();
     static AppleUSBOHCIitdMemoryBlock				*NewMemoryBlock(void);
     static AppleOHCIIsochTransferDescriptorPtr		GetITDFromPhysical(IOPhysicalAddress addr, UInt32 blockType = 0);
     void											SetNextBlock(AppleUSBOHCIitdMemoryBlock *next);
@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOKIT_OHCIScheduleModel_H
+#define _IOKIT_OHCIScheduleModel_H
+
+#include <IOKit/usb/USB.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+
+#include "USBOHCI.h"
+
+/*
+ The schedule as the controller walks it (OHCI 1.0a, section 4), using nothing but the links in the shared memory. Each of the 32
+ interrupt table entries in the HCCA leads down the interrupt tree to the isoch EDs, and the control and bulk lists start from their
+ head registers. Every ED link has to land on the start of an ED in the UIM's blocks, and the TDs of an ED have to run from its head
+ pointer to its tail pointer through general or isoch TDs, as its format says. A loop shows up as a walk which is longer than there are
+ elements in the blocks. The controller retires the TDs of a running ED, and reuses their links for the done queue, so on a live
+ controller only the TDs of skipped or halted EDs can be checked. CheckSchedule runs this after checking the software links when
+ OHCI_CHECK_SCHEDULE is set, and Tests/ScheduleModel runs it on the host.
+*/
+
+enum OHCIScheduleError
+{
+	kOHCIScheduleOK						= 0,
+	kOHCIScheduleReservedBits,			// reserved bits of an ED or TD link are set
+	kOHCIScheduleNotED,					// an ED link which is not the start of an ED
+	kOHCIScheduleNotTD,					// a TD link which is not the start of a TD of the ED's format
+	kOHCIScheduleLoop,					// a list or the TDs of an ED come back around on themselves
+	kOHCIScheduleNoTail					// a list or the TDs of an ED end before their tail
+};
+
+struct OHCIScheduleModel
+{
+	IOUSBControllerMemoryBlock *		edBlocks;				// the UIM's lists of blocks
+	IOUSBControllerMemoryBlock *		gtdBlocks;
+	IOUSBControllerMemoryBlock *		itdBlocks;
+	IOPhysicalAddress					periodicTailED;			// where every interrupt table entry ends up, 0 to not check
+	bool								stoppedEDsOnly;			// only follow the TDs of skipped or halted EDs
+};
+
+struct OHCIScheduleWalk
+{
+	OHCIScheduleError					error;
+	IOPhysicalAddress					list;					// the head of the list being walked
+	IOPhysicalAddress					element;				// the ED or TD holding the bad link, 0 for the head itself
+	UInt32								link;					// and the link
+	UInt32								eds;					// elements visited in the lists walked
+	UInt32								tds;
+};
+
+// head and tail are physical, and a tail of 0 means the list only has to end. interruptTable is the one in the HCCA, in bus order
+OHCIScheduleError	OHCICheckScheduleList(const OHCIScheduleModel *model, IOPhysicalAddress head, IOPhysicalAddress tail, OHCIScheduleWalk *walk);
+OHCIScheduleError	OHCICheckSchedule(const OHCIScheduleModel *model, const volatile UInt32 *interruptTable, IOPhysicalAddress controlHead, IOPhysicalAddress bulkHead, OHCIScheduleWalk *walk);
+const char *		OHCIScheduleErrorString(OHCIScheduleError error);
+
+#endif
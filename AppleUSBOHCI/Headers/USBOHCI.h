@@ -438,6 +438,9 @@ enum
     kOHCIEDToggleBitMask			= OHCIBitRange (1, 1),
     kOHCIGTDClearErrorMask			= OHCIBitRange (0, 25),
     kHCCAalignment					= 0x100,	// required alignment for HCCA
+    kOHCIEDAlignment				= 16,		// OHCI 4.2 - EDs are on a 16 byte boundary
+    kOHCIGTDAlignment				= 16,		// OHCI 4.3.1 - general TDs are on a 16 byte boundary
+    kOHCIITDAlignment				= 32,		// OHCI 4.3.2 - isoch TDs are on a 32 byte boundary
     kHCCAsize						= 256,		// size of HCCA
     kHCCAInterruptTableOffset		= 0x0,
     kHCCAFrameNumberOffset			= 0x80,
@@ -466,3 +466,25 @@ AppleUHCIIsochTransferDescriptor::print(int level)
 	USBLog(level, "AppleUHCIIsochTransferDescriptor::print - alignment buffer[%p]", alignBuffer);
 	USBLog(level, "AppleUHCIIsochTransferDescriptor::print -----------------------------------");
 }
+
+
+
+#undef super
+#define super IOUSBControllerIsochEndpoint
+OSDefineMetaClassAndStructors(AppleUHCIIsochEndpoint, IOUSBControllerIsochEndpoint);
+// -----------------------------------------------------------------
+//		AppleUHCIIsochEndpoint
+// -----------------------------------------------------------------
+bool
+AppleUHCIIsochEndpoint::init()
+{
+	bool		ret;
+	
+	ret = super::init();
+	if (ret)
+	{
+		nextScavengeEP = NULL;
+		onScavengeList = false;
+	}
+	return ret;
+}
@@ -28,83 +28,27 @@
 #include "UHCI.h"
 #include "AppleUHCIqhMemoryBlock.h"
 
-#define super OSObject
+#define super IOUSBControllerMemoryBlock
 
-OSDefineMetaClassAndStructors(AppleUHCIqhMemoryBlock, OSObject);
+OSDefineMetaClassAndStructors(AppleUHCIqhMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleUHCIqhMemoryBlock*
 AppleUHCIqhMemoryBlock::NewMemoryBlock(void)
 {
-    AppleUHCIqhMemoryBlock 		*me = new AppleUHCIqhMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
+    AppleUHCIqhMemoryBlock		*me = new AppleUHCIqhMemoryBlock;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleUHCIqhMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kUHCIPageSize, kUHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (UHCIQueueHeadSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kUHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kUHCIPageSize))
-			{
-				USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-		}
-		else
-		{
-			USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(UHCIQueueHeadShared), kUHCI_QH_ALIGN, 0, 0, kUHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleUHCIqhMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
     return me;
 }
 
@@ -113,34 +57,29 @@ AppleUHCIqhMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleUHCIqhMemoryBlock::NumQHs(void)
 {
-    return QHsPerBlock;
+    return NumElements();
 }
 
 
+
 IOPhysicalAddress				
 AppleUHCIqhMemoryBlock::GetPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    if (index < QHsPerBlock)
-		ret = _sharedPhysical + (index * sizeof(UHCIQueueHeadShared));
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 UHCIQueueHeadSharedPtr
 AppleUHCIqhMemoryBlock::GetLogicalPtr(UInt32 index)
 {
-    UHCIQueueHeadSharedPtr		ret = NULL;
-    if (index < QHsPerBlock)
-		ret = &_sharedLogical[index];
-    return ret;
+    return (UHCIQueueHeadSharedPtr)GetElementLogicalPtr(index);
 }
 
 
 AppleUHCIqhMemoryBlock*
 AppleUHCIqhMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleUHCIqhMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -148,5 +87,5 @@ AppleUHCIqhMemoryBlock::GetNextBlock(void)
 void
 AppleUHCIqhMemoryBlock::SetNextBlock(AppleUHCIqhMemoryBlock* next)
 {
-    _nextBlock = next;
+    SetNextMemoryBlock(next);
 }
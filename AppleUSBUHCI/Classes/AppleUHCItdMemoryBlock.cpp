@@ -28,82 +28,26 @@
 #include "AppleUHCItdMemoryBlock.h"
 #include "AppleUHCIListElement.h"
 
-#define super OSObject
-OSDefineMetaClassAndStructors(AppleUHCItdMemoryBlock, OSObject);
+#define super IOUSBControllerMemoryBlock
+OSDefineMetaClassAndStructors(AppleUHCItdMemoryBlock, IOUSBControllerMemoryBlock);
 
 AppleUHCItdMemoryBlock*
 AppleUHCItdMemoryBlock::NewMemoryBlock(void)
 {
     AppleUHCItdMemoryBlock		*me = new AppleUHCItdMemoryBlock;
-    IOByteCount					len;
-	IODMACommand				*dmaCommand = NULL;
-	UInt64						offset = 0;
-	IODMACommand::Segment32		segments;
-	UInt32						numSegments = 1;
-	IOReturn					status = kIOReturnSuccess;
     
-    if (me)
+    if (!me)
 	{
-		// Use IODMACommand to get the physical address
-		dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
-		if (!dmaCommand)
-		{
-			USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock - could not create IODMACommand");
-			return NULL;
-		}
-		USBLog(6, "AppleUHCItdMemoryBlock::NewMemoryBlock - got IODMACommand %p", dmaCommand);
-		
-		// allocate one page on a page boundary below the 4GB line
-		me->_buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kUHCIPageSize, kUHCIStructureAllocationPhysicalMask);
-		
-		// allocate exactly one physical page
-		if (me->_buffer) 
-		{
-			status = me->_buffer->prepare();
-			if (status)
-			{
-				USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock - could not prepare buffer");
-				me->_buffer->release();
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			me->_sharedLogical = (UHCITransferDescriptorSharedPtr)me->_buffer->getBytesNoCopy();
-			bzero(me->_sharedLogical, kUHCIPageSize);
-			status = dmaCommand->setMemoryDescriptor(me->_buffer);
-			if (status)
-			{
-				USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock - could not set memory descriptor");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->release();
-				dmaCommand->release();
-				return NULL;
-			}
-			status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
-			dmaCommand->clearMemoryDescriptor();
-			dmaCommand->release();
-			if (status || (numSegments != 1) || (segments.fLength != kUHCIPageSize))
-			{
-				USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock - could not get physical segment");
-				me->_buffer->complete();
-				me->_buffer->release();
-				me->release();
-				return NULL;
-			}
-			me->_sharedPhysical = segments.fIOVMAddr;
-		}
-		else
-		{
-			USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock, could not allocate buffer!");
-			me->release();
-			me = NULL;
-		}
+		USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock, constructor failed!");
+		return NULL;
 	}
-	else
+	
+	if (!me->initWithElements(sizeof(UHCITransferDescriptorShared), kUHCI_TD_ALIGN, 0, 0, kUHCIStructureAllocationPhysicalMask))
 	{
-		USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock, constructor failed!");
-    }
+		USBError(1, "AppleUHCItdMemoryBlock::NewMemoryBlock, could not allocate the shared memory!");
+		me->release();
+		return NULL;
+	}
     return me;
 }
 
@@ -112,7 +56,7 @@ AppleUHCItdMemoryBlock::NewMemoryBlock(void)
 UInt32
 AppleUHCItdMemoryBlock::NumTDs(void)
 {
-    return TDsPerBlock;
+    return NumElements();
 }
 
 
@@ -120,27 +64,21 @@ AppleUHCItdMemoryBlock::NumTDs(void)
 IOPhysicalAddress				
 AppleUHCItdMemoryBlock::GetPhysicalPtr(UInt32 index)
 {
-    IOPhysicalAddress		ret = NULL;
-    if (index < TDsPerBlock)
-		ret = _sharedPhysical + (index * sizeof(UHCITransferDescriptorShared));
-    return ret;
+    return GetElementPhysicalPtr(index);
 }
 
 
 UHCITransferDescriptorSharedPtr
 AppleUHCItdMemoryBlock::GetLogicalPtr(UInt32 index)
 {
-    UHCITransferDescriptorSharedPtr ret = NULL;
-    if (index < TDsPerBlock)
-		ret = &_sharedLogical[index];
-    return ret;
+    return (UHCITransferDescriptorSharedPtr)GetElementLogicalPtr(index);
 }
 
 
 AppleUHCItdMemoryBlock*
 AppleUHCItdMemoryBlock::GetNextBlock(void)
 {
-    return _nextBlock;
+    return (AppleUHCItdMemoryBlock*)GetNextMemoryBlock();
 }
 
 
@@ -148,5 +86,5 @@ AppleUHCItdMemoryBlock::GetNextBlock(void)
 void
 AppleUHCItdMemoryBlock::SetNextBlock(AppleUHCItdMemoryBlock* next)
 {
-    _nextBlock = next;
+    SetNextMemoryBlock(next);
 }
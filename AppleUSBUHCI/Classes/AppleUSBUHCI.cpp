@@ -39,12 +39,14 @@ extern "C" {
 #include <IOKit/usb/USB.h>
 #include <IOKit/usb/IOUSBLog.h>
 #include <IOKit/usb/IOUSBRootHubDevice.h>
+#include <IOKit/usb/IOUSBQuirks.h>
 
 #include <libkern/OSAtomic.h>
 
 #include "AppleUSBUHCI.h"
 #include "AppleUHCItdMemoryBlock.h"
 #include "AppleUHCIqhMemoryBlock.h"
+#include "UHCIScheduleModel.h"
 #include "USBTracepoints.h"
 
 #define super IOUSBControllerV3
@@ -80,6 +82,10 @@ AppleUSBUHCI::init(OSDictionary * propTable)
     if (!_isochScheduleLock)
 		goto ErrorExit;
 	
+	_anchorLock = IOSimpleLockAlloc();
+    if (!_anchorLock)
+		goto ErrorExit;
+	
     _uimInitialized = false;
     _myBusState = kUSBBusStateReset;
     _controllerSpeed = kUSBDeviceSpeedFull;	
@@ -99,6 +105,9 @@ ErrorExit:
 	if (_isochScheduleLock)
 		IOSimpleLockFree(_isochScheduleLock);
 	
+	if (_anchorLock)
+		IOSimpleLockFree(_anchorLock);
+	
 	return false;
 }
 
@@ -341,6 +350,7 @@ AppleUSBUHCI::UIMInitialize(IOService * provider)
     IOReturn		status;
 	int				i;
 	uint64_t		tempTime;
+	IOUSBCommandPool	*pool;
     
     USBLog(7, "+AppleUSBUHCI[%p]::UIMInitialize", this);
     
@@ -362,6 +372,9 @@ AppleUSBUHCI::UIMInitialize(IOService * provider)
         // SetVendorInfo() set an errata bit, so we need to OR in our regular errata
         _ERRATA64BITS |= GetErrata64Bits(_vendorID, _deviceID, _revisionID);
 		
+		// and whatever the family's quirks table adds
+		_ERRATA64BITS |= IOUSBQuirks::GetControllerErrata(_vendorID, _deviceID, _revisionID, getName());
+		
 		if (_v3ExpansionData->_onThunderbolt || (_ERRATA64BITS & kErrataDontUseCompanionController))
 		{
 			USBLog(3, "AppleUSBUHCI[%p]::UIMInitialize - Thunderbolt and companion controllers disallowed. Not initializing", this);
@@ -385,12 +398,6 @@ AppleUSBUHCI::UIMInitialize(IOService * provider)
         
 		USBLog(3, "AppleUSBUHCI[%p]::UIMInitialize config @ %x (%x)", this, (uint32_t)_ioVirtAddress, (uint32_t)_ioPhysAddress);
 		
-        _frameLock = IOLockAlloc();
-        if (_frameLock == NULL) 
-		{
-            return kIOReturnNoMemory;
-        }
-
         _isocBandwidth = kUSBMaxFSIsocEndpointReqCount;
 		_expansionData->_isochMaxBusStall = kUHCIIsochMaxBusStall;						// we need a requireMaxBusStall of 10 microseconds for UHCI
 		
@@ -431,6 +438,14 @@ AppleUSBUHCI::UIMInitialize(IOService * provider)
 			_rhResumePortTimerThread[i] = thread_call_allocate((thread_call_func_t)RHResumePortTimerEntry, (thread_call_param_t)this);
 		}
 		
+		// let the command pools give idle commands back after a burst, now that we can take them off our counts
+		pool = OSDynamicCast(IOUSBCommandPool, _freeUSBCommandPool);
+		if (pool)
+			pool->SetReleaseAction(this, CommandPoolReleased);
+		pool = OSDynamicCast(IOUSBCommandPool, _freeUSBIsocCommandPool);
+		if (pool)
+			pool->SetReleaseAction(this, IsocCommandPoolReleased);
+		
         _uimInitialized = true;
 		
 		_myBusState = kUSBBusStateReset;
@@ -443,6 +458,52 @@ AppleUSBUHCI::UIMInitialize(IOService * provider)
 
 
 
+void
+AppleUSBUHCI::CommandPoolReleased(OSObject *owner, UInt32 released)
+{
+	AppleUSBUHCI		*me = OSDynamicCast(AppleUSBUHCI, owner);
+	IOUSBCommandPool	*pool;
+	OSDictionary		*stats;
+	
+	if (!me)
+		return;
+	
+	me->_currentSizeOfCommandPool = (me->_currentSizeOfCommandPool > released) ? (me->_currentSizeOfCommandPool - released) : 0;
+	
+	pool = OSDynamicCast(IOUSBCommandPool, me->_freeUSBCommandPool);
+	stats = pool ? pool->CopyStatistics() : NULL;
+	if (stats)
+	{
+		me->setProperty("Command Pool", stats);
+		stats->release();
+	}
+}
+
+
+
+void
+AppleUSBUHCI::IsocCommandPoolReleased(OSObject *owner, UInt32 released)
+{
+	AppleUSBUHCI		*me = OSDynamicCast(AppleUSBUHCI, owner);
+	IOUSBCommandPool	*pool;
+	OSDictionary		*stats;
+	
+	if (!me)
+		return;
+	
+	me->_currentSizeOfIsocCommandPool = (me->_currentSizeOfIsocCommandPool > released) ? (me->_currentSizeOfIsocCommandPool - released) : 0;
+	
+	pool = OSDynamicCast(IOUSBCommandPool, me->_freeUSBIsocCommandPool);
+	stats = pool ? pool->CopyStatistics() : NULL;
+	if (stats)
+	{
+		me->setProperty("Isoc Command Pool", stats);
+		stats->release();
+	}
+}
+
+
+
 IOReturn
 AppleUSBUHCI::UIMFinalize()
 {
@@ -494,9 +555,6 @@ AppleUSBUHCI::UIMFinalize()
         _interruptSource = NULL;
     }
 	
-    IOLockFree(_frameLock);
-    _frameLock = NULL;
-    
     if (_deviceNameLen) 
 	{
         IOFree((void *)_deviceName, _deviceNameLen);
@@ -615,7 +673,8 @@ AppleUSBUHCI::Reset(bool enableInterrupts)
         ioWrite32(kUHCI_FRBASEADDR, _framesPaddr);
         USBLog(2, "AppleUSBUHCI[%p]::Reset - Command register reports %x", this, ioRead16(kUHCI_CMD));
         
-        ioWrite16(kUHCI_FRNUM, (UInt16)(_lastFrameNumberLow & kUHCI_FRNUM_MASK));
+        InvalidateFrameNumberWithTime();
+        ioWrite16(kUHCI_FRNUM, (UInt16)(_lastFrameNumber & kUHCI_FRNUM_MASK));
 		
         // Use 64-byte packets, and mark controller as configured
         Command(kUHCI_CMD_MAXP | kUHCI_CMD_CF);
@@ -650,6 +709,7 @@ AppleUSBUHCI::Run(bool run)
     } else 
 	{
         cmd = cmd & ~kUHCI_CMD_RS;
+		InvalidateFrameNumberWithTime();				// the frame counter stops but the clock doesn't
     }
     USBLog(7, "AppleUSBUHCI[%p]::Run - About to write command 0x%x", this, cmd);
     Command(cmd);
@@ -676,15 +736,16 @@ AppleUSBUHCI::Run(bool run)
 
 
 
-// For now, the frame number is really only 32 bits
+// The 11 bit frame number register is extended to 64 bits in software. The whole count lives in one 64 bit word which is
+// only ever moved forward with a compare and swap, so this never blocks and is safe to call from the filter interrupt routine
+// or with preemption disabled. A caller which loses a race simply recomputes from the value the winner stored.
 UInt64
 AppleUSBUHCI::GetFrameNumber(void)
 {
-    UInt32				lastFrameNumber;
+    UInt64				lastFrameNumber;
+    UInt64				newFrameNumber;
     UInt32				lastFrame;
     UInt32				thisFrame;
-    UInt32				overflow;
-    UInt32				newFrame;
     
 	
 	//*******************************************************************************************************
@@ -705,53 +766,25 @@ AppleUSBUHCI::GetFrameNumber(void)
 		return 0;
 	}
 	
-    if (_lastFrameNumberLow >= (UInt32)(~kUHCI_FRNUM_MASK)) 
-	{
-        // USBLog(7, "AppleUSBUHCI[%p]::GetFrameNumber - locking to check frame number", this);
-		IOLockLock(_frameLock);
-        lastFrameNumber = _lastFrameNumberLow;
-		
-        overflow = lastFrameNumber & (~kUHCI_FRNUM_MASK);
-        lastFrame = lastFrameNumber & kUHCI_FRNUM_MASK;
-		
-        thisFrame = ReadFrameNumberRegister();
-        if (lastFrame <= thisFrame) 
-		{
-            // No 11-bit overflow
-            newFrame = overflow + thisFrame;
-        } else 
-		{
-            // 11-bit and 32-bit overflow
-            _lastFrameNumberHigh++;
-            newFrame = overflow + thisFrame + kUHCI_FRNUM_COUNT;
-            // USBLog(7, "AppleUSBUHCI[%p]::GetFrameNumber - 64-bit frame number overflow (low %p)", this, (void*)newFrame);
-        }
-        _lastFrameNumberLow = newFrame;
-	    IOLockUnlock(_frameLock);
-		
-    } else do 
+	// On a 32 bit kernel the read of _lastFrameNumber can tear, but then the compare and swap fails and we go around again
+	do 
 	{
-        lastFrameNumber = _lastFrameNumberLow;
-        
-        overflow = lastFrameNumber & (~kUHCI_FRNUM_MASK);
-        lastFrame = lastFrameNumber & kUHCI_FRNUM_MASK;
+        lastFrameNumber = _lastFrameNumber;
+        lastFrame = (UInt32)(lastFrameNumber & kUHCI_FRNUM_MASK);
         
         thisFrame = ReadFrameNumberRegister();
-        if (lastFrame <= thisFrame) 
+        newFrameNumber = (lastFrameNumber & ~((UInt64)kUHCI_FRNUM_MASK)) + thisFrame;
+        if (thisFrame < lastFrame) 
 		{
-            // No 11-bit overflow
-            newFrame = overflow + thisFrame;
-        } else // if (overflow < (~kUHCI_FRNUM_MASK))
-		{
-            // 11-bit overflow, but no 32-bit overflow
-            newFrame = overflow + thisFrame + kUHCI_FRNUM_COUNT;
+            // 11-bit overflow
+            newFrameNumber += kUHCI_FRNUM_COUNT;
             // USBLog(7, "AppleUSBUHCI[%p]::GetFrameNumber - 11-bit frame number overflow", this);
         }
         
-    } while (!OSCompareAndSwap(lastFrameNumber, newFrame, &_lastFrameNumberLow));
+    } while (!OSCompareAndSwap64(lastFrameNumber, newFrameNumber, &_lastFrameNumber));
     
-    // USBLog(7, "AppleUSBUHCI[%p]:: GetFrameNumber - frame number is %qx", this, (UInt64)newFrame | ((UInt64)_lastFrameNumberHigh << 32));
-    return (UInt64)newFrame | ((UInt64)_lastFrameNumberHigh << 32);
+    // USBLog(7, "AppleUSBUHCI[%p]:: GetFrameNumber - frame number is %qx", this, newFrameNumber);
+    return newFrameNumber;
 }
 
 
@@ -763,30 +796,102 @@ AppleUSBUHCI::GetFrameNumber32()
 
 
 
-// this call is not gated, so we need to gate it ourselves
+// this call is not gated, and doesn't need to be
+// UpdateFrameNumberWithTime bumps _anchorSequence before and after it updates the anchor, so we just read the pair
+// and go around again if the sequence was odd or changed underneath us. The writers hold _anchorLock with interrupts
+// off, so an update is only ever a few stores long, but we still give up after kUHCIAnchorReadRetries tries. Then, and
+// before the first frame boundary has been latched, we return the current frame with a time stamp taken inside it,
+// which is what this call has always returned on UHCI.
 IOReturn
 AppleUSBUHCI::GetFrameNumberWithTime(UInt64* frameNumber, AbsoluteTime *theTime)
 {
-	if (!_commandGate)
-		return kIOReturnUnsupported;
-		
-	return _commandGate->runAction(GatedGetFrameNumberWithTime, frameNumber, theTime);
+	UInt32				sequence;
+	UInt32				tries = 0;
+	UInt64				frameBefore;
+	uint64_t			tempTime;
+	
+	do
+	{
+		sequence = _anchorSequence;
+		OSMemoryBarrier();
+		*frameNumber = _anchorFrame;
+		*theTime = _anchorTime;
+		OSMemoryBarrier();
+		if (!(sequence & 1) && (sequence == _anchorSequence))
+		{
+			if (*frameNumber != 0)
+				return kIOReturnSuccess;
+			break;
+		}
+	} while (++tries < kUHCIAnchorReadRetries);
+	
+	do
+	{
+		frameBefore = GetFrameNumber();
+		tempTime = mach_absolute_time();
+		*frameNumber = GetFrameNumber();
+	} while (frameBefore != *frameNumber);
+	*theTime = *(AbsoluteTime*)&tempTime;
+	
+	return kIOReturnSuccess;
 }
 
 
 
-// here is the gated version
-IOReturn
-AppleUSBUHCI::GatedGetFrameNumberWithTime(OSObject *owner, void* arg0, void* arg1, void* arg2, void* arg3)
+// Called on the workloop. UHCI has no start of frame or frame rollover interrupt to take the time from, so we watch the
+// frame number register until it changes and latch the time of the last read which still saw the old frame. That puts the
+// anchor time within one register read of the start of the frame, rather than anywhere in it. Spins for up to a frame.
+void
+AppleUSBUHCI::UpdateFrameNumberWithTime(void)
 {
-#pragma unused (arg2, arg3)
-	AppleUSBUHCI		*me = (AppleUSBUHCI*)owner;
-	UInt64				*frameNumber = (UInt64*)arg0;
-	AbsoluteTime		*theTime = (AbsoluteTime*)arg1;
+	UInt64				startFrame;
+	UInt64				frame;
+	uint64_t			boundaryTime;
+	uint64_t			deadline;
+	IOInterruptState	intState;
+	
+	startFrame = GetFrameNumber();
+	if (!startFrame)
+		return;
 	
-	*frameNumber = me->_anchorFrame;
-	*theTime = me->_anchorTime;
-	return kIOReturnSuccess;
+	clock_interval_to_deadline(kUHCIAnchorLatchTimeoutMS, kMillisecondScale, &deadline);
+	do
+	{
+		boundaryTime = mach_absolute_time();
+		frame = GetFrameNumber();
+	} while ((frame == startFrame) && (boundaryTime < deadline));
+	
+	if (frame != startFrame + 1)
+	{
+		USBLog(5, "AppleUSBUHCI[%p]::UpdateFrameNumberWithTime - frame went from %qd to %qd, not latching", this, startFrame, frame);
+		return;
+	}
+	
+	intState = IOSimpleLockLockDisableInterrupt(_anchorLock);
+	_anchorSequence++;
+	OSMemoryBarrier();
+	_anchorFrame = frame;
+	_anchorTime = *(AbsoluteTime*)&boundaryTime;
+	OSMemoryBarrier();
+	_anchorSequence++;
+	IOSimpleLockUnlockEnableInterrupt(_anchorLock, intState);
+}
+
+
+
+// the frame counter is about to be reloaded or has stopped, so the anchor no longer lines up with the time
+void
+AppleUSBUHCI::InvalidateFrameNumberWithTime(void)
+{
+	IOInterruptState	intState;
+	
+	intState = IOSimpleLockLockDisableInterrupt(_anchorLock);
+	_anchorSequence++;
+	OSMemoryBarrier();
+	_anchorFrame = 0;
+	OSMemoryBarrier();
+	_anchorSequence++;
+	IOSimpleLockUnlockEnableInterrupt(_anchorLock, intState);
 }
 
 
@@ -1005,7 +1110,7 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
     AppleUHCIIsochTransferDescriptor 	*pDoneEl;
     UInt32								cachedProducer;
     UInt32								cachedConsumer;
-    IOUSBControllerIsochEndpoint*		pEP;
+    AppleUHCIIsochEndpoint*				pEP;
     AppleUHCIIsochTransferDescriptor	*prevEl;
     AppleUHCIIsochTransferDescriptor	*nextEl;
     IOInterruptState					intState;
@@ -1039,11 +1144,13 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
 			{
 				pDoneEl->_pEndpoint->onProducerQ--;
 				pDoneEl->_pEndpoint->onReversedList++;
+				MarkIsochEPForScavenge(pDoneEl->_pEndpoint);
 			}
 			if ( cachedProducer == cachedConsumer)
 				break;
 			
-			pDoneEl = OSDynamicCast(AppleUHCIIsochTransferDescriptor, pDoneEl->_doneQueueLink);
+			// only isoch TDs are ever put on the done queue by FilterInterrupt, so there is no need for an OSDynamicCast here
+			pDoneEl = (AppleUHCIIsochTransferDescriptor*)pDoneEl->_doneQueueLink;
 		}
 		
 		// update the consumer count
@@ -1053,7 +1160,7 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
 		// now cachedDoneQueueHead points to the head of the done queue in the right order
 		while (pDoneEl)
 		{
-			nextEl = OSDynamicCast(AppleUHCIIsochTransferDescriptor, pDoneEl->_logicalNext);
+			nextEl = (AppleUHCIIsochTransferDescriptor*)pDoneEl->_logicalNext;
 			pDoneEl->_logicalNext = NULL;
 			if (pDoneEl->_pEndpoint)
 			{
@@ -1065,9 +1172,17 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
 		}
     }
     
-    pEP = _isochEPList;
+    // Only visit the endpoints which retired TDs above or which still have TDs waiting to be scheduled. We take the whole
+	// list first, since AddIsochFramesToSchedule will put an endpoint back on it for the next pass if it could not schedule everything
+    pEP = _isochEPScavengeList;
+	_isochEPScavengeList = NULL;
     while (pEP)
     {
+		AppleUHCIIsochEndpoint	*nextEP = pEP->nextScavengeEP;
+		
+		pEP->nextScavengeEP = NULL;
+		pEP->onScavengeList = false;
+		
 		if (pEP->onReversedList)
 		{
 			USBLog(1, "AppleUSBUHCI[%p]::scavengeIsocTransactions - EP (%p) still had %d TDs on the reversed list!!", this, pEP, (uint32_t)pEP->onReversedList);
@@ -1075,7 +1190,7 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
 		}
 		ReturnIsochDoneQueue(pEP);
 		AddIsochFramesToSchedule(pEP);
-		pEP = pEP->nextEP;
+		pEP = nextEP;
     }
     return kIOReturnSuccess;
 	
@@ -1083,6 +1198,22 @@ AppleUSBUHCI::scavengeIsochTransactions(void)
 
 
 
+void
+AppleUSBUHCI::MarkIsochEPForScavenge(IOUSBControllerIsochEndpoint *pEP)
+{
+	AppleUHCIIsochEndpoint		*pUHCIEP = (AppleUHCIIsochEndpoint*)pEP;		// AllocateIsochEP only ever creates AppleUHCIIsochEndpoints
+	
+	// This can be called with preemption disabled (from AddIsochFramesToSchedule), so no logging here
+	if (pUHCIEP->onScavengeList)
+		return;
+	
+	pUHCIEP->onScavengeList = true;
+	pUHCIEP->nextScavengeEP = _isochEPScavengeList;
+	_isochEPScavengeList = pUHCIEP;
+}
+
+
+
 IOReturn
 AppleUSBUHCI::scavengeAnIsochTD(AppleUHCIIsochTransferDescriptor *pTD)
 {
@@ -1733,6 +1864,15 @@ AppleUSBUHCI::AllocateQH(UInt16 functionNumber, UInt16 endpointNumber, UInt8 dir
 		freeQH->maxPacketSize = maxPacketSize;
 		freeQH->type = type;
         freeQH->stalled = false;
+		freeQH->disabled = false;
+		freeQH->nextAddressQH = NULL;
+		
+		// index the endpoint by its device address so that UIMEnableAddressEndpoints doesn't need to walk the schedule
+		if ((type != kQHTypeDummy) && (functionNumber < kUHCI_NADDRESSES))
+		{
+			freeQH->nextAddressQH = _addressQHList[functionNumber];
+			_addressQHList[functionNumber] = freeQH;
+		}
 	}
     return freeQH;
 }
@@ -1746,6 +1886,19 @@ AppleUSBUHCI::DeallocateQH(AppleUHCIQueueHead *pQH)
 {
     UInt32		physical;
 	
+	// take it out of the per address index
+	if ((pQH->type != kQHTypeDummy) && (pQH->functionNumber < kUHCI_NADDRESSES))
+	{
+		AppleUHCIQueueHead		**ppQH = &_addressQHList[pQH->functionNumber];
+		
+		while (*ppQH && (*ppQH != pQH))
+			ppQH = &(*ppQH)->nextAddressQH;
+		if (*ppQH)
+			*ppQH = pQH->nextAddressQH;
+	}
+	pQH->nextAddressQH = NULL;
+	pQH->disabled = false;
+	
     //zero out all unnecessary fields
     pQH->_logicalNext = NULL;
 	
@@ -1766,9 +1919,9 @@ AppleUSBUHCI::DeallocateQH(AppleUHCIQueueHead *pQH)
 IOUSBControllerIsochEndpoint*			
 AppleUSBUHCI::AllocateIsochEP()
 {
-	IOUSBControllerIsochEndpoint		*pEP;
+	AppleUHCIIsochEndpoint		*pEP;
 	
-	pEP = new IOUSBControllerIsochEndpoint;
+	pEP = new AppleUHCIIsochEndpoint;
 	if (pEP)
 	{
 		if (!pEP->init())
@@ -2285,3 +2438,106 @@ AppleUSBUHCI::PrintFrameList(UInt32 slot, int level)
 		pLE = pLE->_logicalNext;
 	}
 }
+
+
+
+#if UHCI_CHECK_SCHEDULE
+void
+AppleUSBUHCI::CheckSchedule(const char *who)
+{
+	IOUSBControllerListElement		*pLE;
+	IOUSBControllerListElement		*pNext;
+    AppleUHCIQueueHead				*pQH;
+	AppleUHCITransferDescriptor		*pTD;
+	UInt32							slot;
+	int								count;
+	UHCIScheduleModel				model;
+	UHCIScheduleWalk				walk;
+	
+	// each slot starts with its isoch TDs, which then link into the interrupt QH tree
+	for (slot = 0; slot < kUHCI_NVFRAMES; slot++)
+	{
+		pLE = _logicalFrameList[slot];
+		if (!pLE)
+			panic("AppleUSBUHCI::CheckSchedule(%s) - NULL _logicalFrameList[%d]", who, (int)slot);
+		
+		if (USBToHostLong(_frameList[slot]) != pLE->GetPhysicalAddrWithType())
+			panic("AppleUSBUHCI::CheckSchedule(%s) - _frameList[%d] (0x%x) does not match _logicalFrameList[%d] (%p)", who, (int)slot, (uint32_t)USBToHostLong(_frameList[slot]), (int)slot, pLE);
+		
+		for (count = 0; pLE && !OSDynamicCast(AppleUHCIQueueHead, pLE); count++)
+		{
+			pNext = pLE->_logicalNext;
+			if (count > kUHCI_NVFRAMES)
+				panic("AppleUSBUHCI::CheckSchedule(%s) - loop in the isoch list of slot %d", who, (int)slot);
+			
+			// the rollover TD has no software link
+			if (pNext && ((pLE->GetPhysicalLink() & kUHCI_QH_QLP) != (pNext->GetPhysicalAddrWithType() & kUHCI_QH_QLP)))
+				panic("AppleUSBUHCI::CheckSchedule(%s) - slot %d element %p links to 0x%x instead of %p", who, (int)slot, pLE, (uint32_t)pLE->GetPhysicalLink(), pNext);
+			pLE = pNext;
+		}
+	}
+	
+	// every interrupt, control and bulk QH hangs off of the least frequent interrupt QH
+	pQH = _intrQH[kUHCI_NINTR_QHS - 1];
+	for (count = 0; pQH; count++)
+	{
+		if (count > (kUHCI_NADDRESSES * kUSBMaxPipes))
+			panic("AppleUSBUHCI::CheckSchedule(%s) - loop in the queue head list", who);
+		
+		if (pQH->disabled)
+			panic("AppleUSBUHCI::CheckSchedule(%s) - disabled QH %p is still on the schedule", who, pQH);
+		
+		if (pQH->type != kQHTypeDummy)
+		{
+			for (pTD = pQH->firstTD; pTD && (pTD != pQH->lastTD); pTD = OSDynamicCast(AppleUHCITransferDescriptor, pTD->_logicalNext))
+			{
+				if (!pTD->_logicalNext || ((pTD->GetPhysicalLink() & kUHCI_QH_QLP) != (pTD->_logicalNext->GetPhysicalAddrWithType() & kUHCI_QH_QLP)))
+					panic("AppleUSBUHCI::CheckSchedule(%s) - QH %p TD %p does not link to its next TD %p", who, pQH, pTD, pTD->_logicalNext);
+			}
+			if (pTD != pQH->lastTD)
+				panic("AppleUSBUHCI::CheckSchedule(%s) - QH %p TD list does not end at lastTD %p", who, pQH, pQH->lastTD);
+		}
+		
+		pNext = pQH->_logicalNext;
+		if (pNext)
+		{
+			if ((pQH->GetPhysicalLink() & kUHCI_QH_QLP) != (pNext->GetPhysicalAddrWithType() & kUHCI_QH_QLP))
+				panic("AppleUSBUHCI::CheckSchedule(%s) - QH %p links to 0x%x instead of %p", who, pQH, (uint32_t)pQH->GetPhysicalLink(), pNext);
+		}
+		else if (pQH != _lastQH)
+		{
+			panic("AppleUSBUHCI::CheckSchedule(%s) - QH list ends at %p instead of _lastQH %p", who, pQH, _lastQH);
+		}
+		else if ((pQH->GetPhysicalLink() & kUHCI_QH_QLP) != (_fsControlQHStart->GetPhysicalAddrWithType() & kUHCI_QH_QLP))
+		{
+			// bandwidth reclamation loop - see HardwareInit
+			panic("AppleUSBUHCI::CheckSchedule(%s) - _lastQH links to 0x%x instead of the full speed control QH", who, (uint32_t)pQH->GetPhysicalLink());
+		}
+		pQH = OSDynamicCast(AppleUHCIQueueHead, pNext);
+		if (pNext && !pQH)
+			panic("AppleUSBUHCI::CheckSchedule(%s) - non QH %p on the queue head list", who, pNext);
+	}
+	
+	// the end markers have to be on the list after their start markers
+	for (pQH = _lsControlQHStart; pQH && (pQH != _lsControlQHEnd); pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext))
+		;
+	if (pQH != _lsControlQHEnd)
+		panic("AppleUSBUHCI::CheckSchedule(%s) - _lsControlQHEnd %p is not on the schedule", who, _lsControlQHEnd);
+	for (pQH = _fsControlQHStart; pQH && (pQH != _fsControlQHEnd); pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext))
+		;
+	if (pQH != _fsControlQHEnd)
+		panic("AppleUSBUHCI::CheckSchedule(%s) - _fsControlQHEnd %p is not on the schedule", who, _fsControlQHEnd);
+	for (pQH = _bulkQHStart; pQH && (pQH != _bulkQHEnd); pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext))
+		;
+	if (pQH != _bulkQHEnd)
+		panic("AppleUSBUHCI::CheckSchedule(%s) - _bulkQHEnd %p is not on the schedule", who, _bulkQHEnd);
+	
+	// and then what the controller itself will find when it follows the shared links
+	model.tdBlocks = _tdMBHead;
+	model.qhBlocks = _qhMBHead;
+	model.lastQH = _lastQH->GetPhysicalAddrWithType() & kUHCIPtrMask;
+	model.reclamationQH = _fsControlQHStart->GetPhysicalAddrWithType() & kUHCIPtrMask;
+	if (UHCICheckSchedule(&model, (const volatile UInt32 *)_frameList, kUHCI_NVFRAMES, &walk) != kUHCIScheduleOK)
+		panic("AppleUSBUHCI::CheckSchedule(%s) - slot %d: %s (element 0x%x link 0x%x)", who, (int)walk.slot, UHCIScheduleErrorString(walk.error), (uint32_t)walk.element, (uint32_t)walk.link);
+}
+#endif
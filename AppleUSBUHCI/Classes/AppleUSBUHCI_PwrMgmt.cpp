@@ -310,11 +310,73 @@ AppleUSBUHCI::SaveControllerStateForSleep(void)
 	// put the controller into suspend (which suspends all of the downstream ports)
 	SuspendController();
 	
+	// remember enough of the register state to tell on wake whether the controller kept its power
+	_saveFrameAddress = ioRead32(kUHCI_FRBASEADDR);
+	_saveFrameNumber = ioRead16(kUHCI_FRNUM);
+	
 	return kIOReturnSuccess;
 }
 
 
 
+//================================================================================================
+//
+//   ControllerStateSurvivedSleep
+//
+//   Returns true if the registers and the frame list look exactly the way we left them, in which
+//   case we can just resume the controller in place instead of resetting it
+//
+//================================================================================================
+//
+bool
+AppleUSBUHCI::ControllerStateSurvivedSleep(void)
+{
+	UInt16		cmd = ioRead16(kUHCI_CMD);
+	UInt32		frameAddress = ioRead32(kUHCI_FRBASEADDR);
+	UInt32		badEntry = 0;
+	void		*badLogical = NULL;
+	int			badFrame = -1;
+	int			i;
+	
+	// a controller which lost power comes back with CF clear and the frame list base address gone
+	if ((cmd == 0xFFFF) || !(cmd & kUHCI_CMD_CF))
+	{
+		USBLog(2, "AppleUSBUHCI[%p]::ControllerStateSurvivedSleep - CMD(%p) was reset", this, (void*)cmd);
+		return false;
+	}
+	
+	if (!_framesPaddr || ((frameAddress & kUHCI_FLBASEADD_BASE) != _framesPaddr) || (frameAddress != _saveFrameAddress))
+	{
+		USBLog(2, "AppleUSBUHCI[%p]::ControllerStateSurvivedSleep - FRBASEADDR(%p) doesn't match (%p) saved (%p)", this, (void*)frameAddress, (void*)_framesPaddr, (void*)_saveFrameAddress);
+		return false;
+	}
+	
+	// make sure that every frame still points at the first element of our logical schedule. this is a spin lock, so just note
+	// the first mismatch and log it once the lock is dropped
+	IOSimpleLockLock(_isochScheduleLock);
+	for (i=0; i < kUHCI_NVFRAMES; i++)
+	{
+		if (!_logicalFrameList[i] || (USBToHostLong(_frameList[i]) != _logicalFrameList[i]->GetPhysicalAddrWithType()))
+		{
+			badFrame = i;
+			badEntry = USBToHostLong(_frameList[i]);
+			badLogical = _logicalFrameList[i];
+			break;
+		}
+	}
+	IOSimpleLockUnlock(_isochScheduleLock);
+	
+	if (badFrame >= 0)
+	{
+		USBLog(2, "AppleUSBUHCI[%p]::ControllerStateSurvivedSleep - frame[%d] (%p) doesn't match the logical list (%p)", this, badFrame, (void*)badEntry, badLogical);
+		return false;
+	}
+	
+	return true;
+}
+
+
+
 //================================================================================================
 //
 //   RestoreControllerStateFromSleep
@@ -354,7 +416,37 @@ AppleUSBUHCI::RestoreControllerStateFromSleep(void)
 				IOLog("USB (UHCI):Port %d on bus 0x%x has remote wakeup from some device\n", (int)i+1, (uint32_t)_busNumber);
 			}
         }
-	}		
+	}
+	
+	// the common case is that nothing was lost while we were asleep, and we can just pick up where we left off. only if
+	// the verification fails do we pay for a full reset, in which case we rebuild the frame list from the logical one.
+	// HCRESET also resets the root hub ports, so the devices behind them disconnect and are enumerated again - the same
+	// as a controller which lost power always got
+	if (!ControllerStateSurvivedSleep())
+	{
+		IOReturn	err;
+		
+		USBLog(2, "AppleUSBUHCI[%p]::RestoreControllerStateFromSleep - controller state was lost - resetting", this);
+		err = ResetControllerState();
+		if (err)
+			return err;
+		
+		IOSimpleLockLock(_isochScheduleLock);
+		for (i=0; i < kUHCI_NVFRAMES; i++)
+		{
+			if (_logicalFrameList[i])
+				_frameList[i] = HostToUSBLong(_logicalFrameList[i]->GetPhysicalAddrWithType());
+		}
+		IOSimpleLockUnlock(_isochScheduleLock);
+		IOSync();
+		
+		// keep the frame number going from where it was so that the isoch schedule still lines up
+		ioWrite16(kUHCI_FRNUM, (UInt16)(_saveFrameNumber & kUHCI_FRNUM_MASK));
+		
+		return RestartControllerFromReset();
+	}
+	
+	USBLog(5, "AppleUSBUHCI[%p]::RestoreControllerStateFromSleep - controller state intact - resuming in place", this);
 	ResumeController();
 
 	return kIOReturnSuccess;
@@ -485,29 +577,125 @@ AppleUSBUHCI::DozeController(void)
 		}
 	}
 	
-	if (!portsBeingResumed)
+	if (portsBeingResumed)
+		return kUHCIDozeDeclined;
+	
+	if (!DozeIsWorthwhile())
 	{
-		showRegisters(7, "+DozeController -  stopping controller");
-		Run(false);
-		
-		// In order to get a Resume Detected interrupt, the controller needs to be in Global suspend mode, so we will do that even when "dozing".
-		
-		USBLog(6, "AppleUSBUHCI[%p]::DozeController  Globally suspending", this);
-		// Put the controller in Global Suspend
-		cmd = ioRead16(kUHCI_CMD) & ~kUHCI_CMD_FGR;
-		cmd |= kUHCI_CMD_EGSM;
-		ioWrite16(kUHCI_CMD, cmd);
-		
-		_myBusState = kUSBBusStateSuspended;
-		
-		IOSleep(3);
-		
+		USBLog(5, "AppleUSBUHCI[%p]::DozeController - average doze of %d ms is too short to be worth it. not stopping the controller", this, (int)_dozeAverageMS);
+		return kUHCIDozeDeclined;
 	}
+	
+	showRegisters(7, "+DozeController -  stopping controller");
+	Run(false);
+	
+	// In order to get a Resume Detected interrupt, the controller needs to be in Global suspend mode, so we will do that even when "dozing".
+	
+	USBLog(6, "AppleUSBUHCI[%p]::DozeController  Globally suspending", this);
+	// Put the controller in Global Suspend
+	cmd = ioRead16(kUHCI_CMD) & ~kUHCI_CMD_FGR;
+	cmd |= kUHCI_CMD_EGSM;
+	ioWrite16(kUHCI_CMD, cmd);
+	
+	_myBusState = kUSBBusStateSuspended;
+	
+	IOSleep(3);
+	
+	_dozeStartTime = mach_absolute_time();
+	_dozeCount++;
 
 	return kIOReturnSuccess;
 }
 
 
+
+//================================================================================================
+//
+//   DozeIsWorthwhile
+//
+//		Decides from the length of our recent dozes whether the next one is likely to pay for the
+//		cost of suspending and resuming the bus. Every so often we doze anyway, since that is the
+//		only way to find out that the idle periods have gotten longer.
+//
+//================================================================================================
+//
+bool
+AppleUSBUHCI::DozeIsWorthwhile(void)
+{
+	if ((_dozeSamples < kUHCIDozeMinSamples) || (_dozeAverageMS >= kUHCIDozeBreakEvenMS))
+	{
+		_dozeDeclinedInARow = 0;
+		return true;
+	}
+	
+	if (++_dozeDeclinedInARow >= kUHCIDozeProbeInterval)
+	{
+		USBLog(6, "AppleUSBUHCI[%p]::DozeIsWorthwhile - declined %d times in a row, dozing anyway", this, (int)_dozeDeclinedInARow);
+		_dozeDeclinedInARow = 0;
+		return true;
+	}
+	
+	_dozeDeclinedCount++;
+	setProperty("DozeDeclinedCount", _dozeDeclinedCount, 32);
+	return false;
+}
+
+
+
+//================================================================================================
+//
+//   UpdateDozeStatistics
+//
+//		Called as we come out of doze to fold the length of that doze into the running average
+//
+//================================================================================================
+//
+void
+AppleUSBUHCI::UpdateDozeStatistics(void)
+{
+	uint64_t			elapsedTime;
+	UInt64				elapsedNS;
+	UInt32				elapsedMS;
+	UInt32				sampleMS;
+	
+	if (!_dozeStartTime)
+		return;
+	
+	elapsedTime = mach_absolute_time();
+	SUB_ABSOLUTETIME(&elapsedTime, &_dozeStartTime);
+	absolutetime_to_nanoseconds(*(AbsoluteTime*)&elapsedTime, &elapsedNS);
+	_dozeStartTime = 0;
+	
+	elapsedNS /= 1000000;
+	elapsedMS = (elapsedNS > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (UInt32)elapsedNS;
+	
+	// cap the sample which goes into the average, so that one very long doze doesn't keep us dozing through a long run of short
+	// ones. The residency still gets the whole doze
+	sampleMS = elapsedMS;
+	if (sampleMS > (kUHCIDozeBreakEvenMS << kUHCIDozeAverageShift))
+		sampleMS = kUHCIDozeBreakEvenMS << kUHCIDozeAverageShift;
+	
+	if (_dozeSamples == 0)
+		_dozeAverageMS = sampleMS;
+	else
+		_dozeAverageMS = ((_dozeAverageMS << kUHCIDozeAverageShift) - _dozeAverageMS + sampleMS) >> kUHCIDozeAverageShift;
+	
+	if (_dozeSamples < kUHCIDozeMinSamples)
+		_dozeSamples++;
+	
+	if (elapsedMS < kUHCIDozeBreakEvenMS)
+		_dozeShortCount++;
+	
+	_dozeResidencyMS += elapsedMS;
+	
+	USBLog(6, "AppleUSBUHCI[%p]::UpdateDozeStatistics - dozed for %d ms, average now %d ms", this, (int)elapsedMS, (int)_dozeAverageMS);
+	
+	setProperty("DozeCount", _dozeCount, 32);
+	setProperty("DozeShortCount", _dozeShortCount, 32);
+	setProperty("DozeResidencyMS", _dozeResidencyMS, 64);
+}
+
+
 //================================================================================================
 //
 //   WakeControllerFromDoze
@@ -523,6 +711,9 @@ AppleUSBUHCI::WakeControllerFromDoze(void)
     UInt16				status;
 
 	USBTrace( kUSBTUHCI, KTPUHCIWakeFromDoze, (uintptr_t)this, 0, 0, 0);
+	
+	UpdateDozeStatistics();
+	
 	// First, see if we have any ports that have the RD bit set.  If they do, then we can go ahead and clear it after we waited the 20ms for the
 	// Global resume
 	for (i=0; i<kUHCI_NUM_PORTS; i++) 
@@ -123,6 +123,7 @@ AppleUSBUHCI::UIMCreateControlEndpoint(UInt8				functionNumber,
 	{
         _fsControlQHEnd = pQH;
     }
+	UHCICheckSchedule("UIMCreateControlEndpoint");
     
     USBLog(3, "AppleUSBUHCI[%p]::UIMCreateControlEndpoint done pQH %p FN %d EP %d MPS %d", this, pQH, pQH->functionNumber, pQH->endpointNumber, pQH->maxPacketSize);
 
@@ -253,6 +254,7 @@ AppleUSBUHCI::UIMCreateBulkEndpoint(UInt8 functionNumber, UInt8 endpointNumber,
     prevQH->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
     IOSync();
     _bulkQHEnd = pQH;
+	UHCICheckSchedule("UIMCreateBulkEndpoint");
 
     return kIOReturnSuccess;
 }
@@ -407,6 +409,7 @@ AppleUSBUHCI::UIMCreateInterruptEndpoint(short				functionNumber,
     
     prevQH->_logicalNext = pQH;
     prevQH->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
+	UHCICheckSchedule("UIMCreateInterruptEndpoint");
 	
     USBLog(3, "AppleUSBUHCI[%p]::UIMCreateInterruptEndpoint done pQH[%p]", this, pQH);
 
@@ -626,6 +629,29 @@ AppleUSBUHCI::DeleteIsochEP(IOUSBControllerIsochEndpoint* pEP)
 		prevEP = curEP;
 		curEP = curEP->nextEP;
     }
+	
+	// and make sure that scavengeIsochTransactions doesn't visit it after it is gone
+	if (((AppleUHCIIsochEndpoint*)pEP)->onScavengeList)
+	{
+		AppleUHCIIsochEndpoint		*curScavengeEP = _isochEPScavengeList;
+		AppleUHCIIsochEndpoint		*prevScavengeEP = NULL;
+		
+		while (curScavengeEP)
+		{
+			if (curScavengeEP == pEP)
+			{
+				if (prevScavengeEP)
+					prevScavengeEP->nextScavengeEP = curScavengeEP->nextScavengeEP;
+				else
+					_isochEPScavengeList = curScavengeEP->nextScavengeEP;
+				curScavengeEP->nextScavengeEP = NULL;
+				curScavengeEP->onScavengeList = false;
+				break;
+			}
+			prevScavengeEP = curScavengeEP;
+			curScavengeEP = curScavengeEP->nextScavengeEP;
+		}
+	}
     
 	// Save the current max packet size, as DeallocateIsochBandwidth will set the ep->mps to 0
 	currentMaxPacketSize = pEP->maxPacketSize;
@@ -667,6 +693,7 @@ AppleUSBUHCI::CreateIsochTransfer(IOUSBControllerIsochEndpoint* pEP, IOUSBIsocCo
 	IODMACommand *							dmaCommand = command->GetDMACommand();
 	IOMemoryDescriptor *					pBuffer = command->GetBuffer();					// to use for alignment buffers
 	UInt64									offset;
+	UInt32									framesSkipped;
 	IODMACommand::Segment64					segments64;
 	UInt32									numSegments;
 	IOReturn								status;
@@ -681,6 +708,19 @@ AppleUSBUHCI::CreateIsochTransfer(IOUSBControllerIsochEndpoint* pEP, IOUSBIsocCo
 	}
 	
     maxOffset = kUHCI_NVFRAMES;
+	if (frameNumberStart == kAppleUSBIsocASAPFrame)
+	{
+		frameNumberStart = command->ResolveASAPStartFrame(pEP->firstAvailableFrame, curFrameNumber, kUSBIsocASAPLeadFrames, &framesSkipped);
+		if (framesSkipped)
+		{
+			USBLog(4,"AppleUSBUHCI[%p]::CreateIsochTransfer: EP (%p) fell behind, skipping %d frames to start at %qd (curFrameNumber: %qd)", this, pEP, (uint32_t)framesSkipped, frameNumberStart, curFrameNumber);
+			_isochASAPResyncCount++;
+			_isochASAPFramesSkipped += framesSkipped;
+			setProperty("IsochASAPResyncCount", _isochASAPResyncCount, 32);
+			setProperty("IsochASAPFramesSkipped", _isochASAPFramesSkipped, 64);
+		}
+	}
+	
     if (frameNumberStart < pEP->firstAvailableFrame)
     {
 		USBLog(3,"AppleUSBUHCI[%p]::CreateIsochTransfer: no overlapping frames -   EP (%p) frameNumberStart: %qd, pEP->firstAvailableFrame: %qd.  Returning 0x%x", this, pEP, frameNumberStart, pEP->firstAvailableFrame, kIOReturnIsoTooOld);
@@ -1218,22 +1258,16 @@ AppleUSBUHCI::FindQueueHead(short functionNumber, short endpointNumber, UInt8 di
 	
     USBLog(7, "AppleUSBUHCI[%p]::FindQueueHead(%d, %d, %d, %d)", this, functionNumber, endpointNumber, direction, type);
 	
-	// first check the disabled list
-	pQH = _disabledQHList;
+	// first check whether it has been disabled - we only need to look at the queue heads for this address
+	pQH = ((functionNumber >= 0) && (functionNumber < kUHCI_NADDRESSES)) ? _addressQHList[functionNumber] : NULL;
 	while (pQH)
 	{
-		if ((pQH->functionNumber == functionNumber) && (pQH->endpointNumber == endpointNumber) && ((direction == kUSBAnyDirn) || (pQH->direction == direction)) && (pQH->type == type))
+		if (pQH->disabled && (pQH->endpointNumber == endpointNumber) && ((direction == kUSBAnyDirn) || (pQH->direction == direction)) && (pQH->type == type))
 		{
 			USBLog(2, "AppleUSBUHCI[%p]::FindQueueHead - found Queue Head[%p] on the DISABLED list - returning NULL", this, pQH);
 			return NULL;
-#if 0			
-			if (ppQHPrev)
-				*ppQHPrev = prevQH;
-			return pQH;
-#endif
 		}
-		prevQH = pQH;
-		pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext);
+		pQH = pQH->nextAddressQH;
 	}
 	
 	// it is not disabled - look on the regular list
@@ -1299,6 +1333,7 @@ AppleUSBUHCI::UnlinkQueueHead(AppleUHCIQueueHead *pQH, AppleUHCIQueueHead *pQHBa
 	// change the hardware and software link pointers
 	pQHBack->SetPhysicalLink(pQH->GetPhysicalLink());
 	pQHBack->_logicalNext = pQH->_logicalNext;
+	UHCICheckSchedule("UnlinkQueueHead");
 	
 	// there is no doorbell in UHCI like in EHCI
 	// we need to make sure that the queue head is not cached in the controller
@@ -1369,6 +1404,9 @@ AppleUSBUHCI::UIMCheckForTimeouts(void)
     
     _lastTimeoutFrameNumber = frameNumber;
     _lastFrameNumberTime = currentTime;
+	
+	if (frameNumber && (!_anchorFrame || ((frameNumber - _anchorFrame) >= kUHCIAnchorRefreshFrames)))
+		UpdateFrameNumberWithTime();
 
 	for (pQH = _lsControlQHStart; pQH && (loopCount++ < 100); pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext))
 	{
@@ -1975,6 +2013,9 @@ AppleUSBUHCI::AddIsochFramesToSchedule(IOUSBControllerIsochEndpoint* pEP)
 			//USBLog(7, "AppleUSBUHCI[%p]::AddIsochFramesToSchedule - putting TD(%p) on Done Queue instead of Deferred Queue ", this, pTD);
 			PutTDonDoneQueue(pEP, pTD, true);
 		}
+		
+		// the next scavenge needs to return this TD to the client
+		MarkIsochEPForScavenge(pEP);
 	    
         //USBLog(7, "AppleUSBUHCI[%p]::AddIsochFramesToSchedule - pTD = %p", this, pTD);
 		if (pEP->toDoList == NULL)
@@ -2049,9 +2090,14 @@ AppleUSBUHCI::AddIsochFramesToSchedule(IOUSBControllerIsochEndpoint* pEP)
 		// USBLog(7, "AppleUSBUHCI[%p]::AddIsochFramesToSchedule - pEP->inSlot is now 0x%x", this, pEP->inSlot);	
     } while(pEP->toDoList != NULL);
 	
+	// If we caught up with the scavenger before we could schedule everything, make sure we come back to this EP
+	if (pEP->toDoList != NULL)
+		MarkIsochEPForScavenge(pEP);
+	
 	finFrame = GetFrameNumber();
 	// Unlock, reenable preemption, so we can log
 	IOSimpleLockUnlock(_isochScheduleLock);
+	UHCICheckSchedule("AddIsochFramesToSchedule");
 	if ((finFrame - startFrame) > 1)
 		USBError(1, "AppleUSBUHCI::AddIsochFramesToSchedule - end -  startFrame(0x%qd) finFrame(0x%qd)", startFrame, finFrame);
     USBLog(7, "AppleUSBUHCI[%p]::AddIsochFramesToSchedule - finished,  currFrame: %qd", this, GetFrameNumber() );
@@ -2215,6 +2261,7 @@ AppleUSBUHCI::AbortIsochEP(IOUSBControllerIsochEndpoint* pEP)
 			IODelay(1000);
 			activeTD->UpdateFrameList(*(AbsoluteTime *)&timeStamp);
 		}
+		UHCICheckSchedule("AbortIsochEP");
     }
     
     // now transfer any transactions from the todo list to the done queue
@@ -2265,150 +2312,60 @@ AppleUSBUHCI::AbortIsochEP(IOUSBControllerIsochEndpoint* pEP)
 IOReturn
 AppleUSBUHCI::UIMEnableAddressEndpoints(USBDeviceAddress address, bool enable)
 {
-	UInt32							slot;
+	AppleUHCIQueueHead				*pQH;
+	AppleUHCIQueueHead				*pPrevQH;
 	IOReturn						err;
 	
 	USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints(%d, %s)", this, (int)address, enable ? "true" : "false");
+	if (address >= kUHCI_NADDRESSES)
+		return kIOReturnBadArgument;
+	
+	// only the queue heads which belong to this address are looked at, so the cost is proportional to the
+	// number of endpoints the device has rather than to the size of the schedule
+	pQH = _addressQHList[address];
 	if (enable)
 	{
-		AppleUHCIQueueHead					*pQH = _disabledQHList;
-		AppleUHCIQueueHead					*pPrevQH = NULL;
-		AppleUHCIQueueHead					*pPrevQHLive = NULL;
-		
-		USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- looking for QHs for address (%d) in the disabled queue", this, address);
+		USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- looking for disabled QHs for address (%d)", this, address);
 		while (pQH)
 		{
-			if (pQH->functionNumber == address)
+			if (pQH->disabled)
 			{
 				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- found QH[%p] which matches", this, pQH);
-				// first adjust the list
-				if (pPrevQH)
-					pPrevQH->_logicalNext = pQH->_logicalNext;
-				else
-					_disabledQHList = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext);
-				pQH->_logicalNext = NULL;
-				// now stick pQH back in the queue
-				switch (pQH->type)
-				{
-					case kUSBControl:
-						// Now link the endpoint's queue head into the schedule
-						if (pQH->speed == kUSBDeviceSpeedLow) 
-						{
-							pPrevQHLive = _lsControlQHEnd;
-						} else 
-						{
-							pPrevQHLive = _fsControlQHEnd;
-						}
-						
-						pQH->_logicalNext = pPrevQHLive->_logicalNext;
-						pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-						IOSync();
-						
-						pPrevQHLive->_logicalNext = pQH;
-						pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-						IOSync();
-						if (pQH->speed == kUSBDeviceSpeedLow) 
-						{
-							_lsControlQHEnd = pQH;
-						} else 
-						{
-							_fsControlQHEnd = pQH;
-						}
-						break;
-						
-					case kUSBBulk:
-						pPrevQHLive = _bulkQHEnd;
-						pQH->_logicalNext = pPrevQHLive->_logicalNext;
-						pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-						IOSync();
-						
-						pPrevQHLive->_logicalNext = pQH;
-						pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-						IOSync();
-						_bulkQHEnd = pQH;
-					break;
-						
-					case kUSBInterrupt:
-						pPrevQHLive = _intrQH[pQH->interruptSlot];
-						pQH->_logicalNext = pPrevQHLive->_logicalNext;
-						pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-						IOSync();
-						
-						pPrevQHLive->_logicalNext = pQH;
-						pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-					break;
-						
-					default:
-						USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- found QH[%p] with unknown type(%d)", this, pQH, pQH->type);
-						break;
-				}
-				// advance the pointer
-				if (pPrevQH)
-					pQH = OSDynamicCast(AppleUHCIQueueHead, pPrevQH->_logicalNext);
-				else
-					pQH = _disabledQHList;
-			}
-			else
-			{
-				// advance the pointer when we didn't find what we were looking for
-				pPrevQH = pQH;
-				pQH = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext);
+				RelinkQueueHead(pQH);
 			}
+			pQH = pQH->nextAddressQH;
 		}
 		return kIOReturnSuccess;
 	}
 	
 	// the disable case
 	USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- looking for endpoints for device address(%d) to disable", this, address);
-	
-	for (slot=0; slot < kUHCI_NVFRAMES; slot++)
+	while (pQH)
 	{
-		IOUSBControllerListElement				*pLE;
-		IOUSBControllerListElement				*pPrevLE = NULL;
-
-		pLE = _logicalFrameList[slot];
-		while (pLE)
+		if (!pQH->disabled)
 		{
-			// need to determine which kind of list element this is
-			AppleUHCIIsochTransferDescriptor	*pITD = OSDynamicCast(AppleUHCIIsochTransferDescriptor, pLE);
-			AppleUHCIQueueHead					*pQH =	OSDynamicCast(AppleUHCIQueueHead, pLE);
-			
-			if (pQH && (pQH->type != kQHTypeDummy) && (pQH->functionNumber == address))
+			pPrevQH = NULL;
+			// FindQueueHead only walks the part of the schedule which holds this type of endpoint
+			if (FindQueueHead(pQH->functionNumber, pQH->endpointNumber, pQH->direction, pQH->type, &pPrevQH) != pQH)
+			{
+				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- pQH[%p] is not on the schedule", this, pQH);
+			}
+			else
 			{
-				AppleUHCIQueueHead				*pPrevQH =	OSDynamicCast(AppleUHCIQueueHead, pPrevLE);
 				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- found pQH[%p] which matches (pPrevQH[%p])", this, pQH, pPrevQH);
-				if (!pPrevQH)
+				err = UnlinkQueueHead(pQH, pPrevQH);
+				if (err)
 				{
-					USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- unexpected NULL pPrevQH", this);
+					USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- err[%p] unlinking queue head", this, (void*)err);
 				}
 				else
 				{
-					err = UnlinkQueueHead(pQH, pPrevQH);
-					if (err)
-					{
-						USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- err[%p] unlinking queue head", this, (void*)err);
-					}
-					else
-					{
-						// well now that it is off the queue, what do i do with it?
-						pLE = pPrevLE;							// reset for the counter to the previous QH
-						
-						// now link the pQH into the disabled list
-						pQH->_logicalNext = _disabledQHList;
-						_disabledQHList = pQH;
-					}
+					pQH->_logicalNext = NULL;
+					pQH->disabled = true;
 				}
 			}
-			
-			// I need to be aware of where the current frame is when processing the Isoch List
-			if (pITD && (UHCI_TD_GET_ADDR(USBToHostLong(pITD->GetSharedLogical()->token))))
-			{
-				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAddressEndpoints- found pITD[%p] which matches", this, pITD);
-			}
-			pPrevLE = pLE;
-			if (pLE)
-				pLE = pLE->_logicalNext;
 		}
+		pQH = pQH->nextAddressQH;
 	}
 	return kIOReturnSuccess;
 }
@@ -2418,135 +2375,126 @@ AppleUSBUHCI::UIMEnableAddressEndpoints(USBDeviceAddress address, bool enable)
 IOReturn
 AppleUSBUHCI::UIMEnableAllEndpoints(bool enable)
 {
-	UInt32							slot;
-	IOReturn						err;
+	USBDeviceAddress				address;
 	
 	USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints(%s)", this, enable ? "true" : "false");
-	if (enable)
+	for (address = 0; address < kUHCI_NADDRESSES; address++)
+	{
+		if (_addressQHList[address])
+			UIMEnableAddressEndpoints(address, enable);
+	}
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn
+AppleUSBUHCI::UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+#pragma unused (speed)
+	IOUSBControllerIsochEndpoint		*pEP;
+	SInt32								needed = 0;
+	SInt32								available = _isocBandwidth;
+	UInt32								i;
+	
+	// only the isoch endpoints have bandwidth reserved for them up front
+	for (i = 0; i < closeCount; i++)
 	{
-		AppleUHCIQueueHead					*pQH = _disabledQHList;
-		AppleUHCIQueueHead					*pPrevQH = NULL;
-		AppleUHCIQueueHead					*pPrevQHLive = NULL;
+		if (closeList[i].transferType != kUSBIsoc)
+			continue;
+		pEP = FindIsochronousEndpoint(address, closeList[i].number, closeList[i].direction, NULL);
+		if (pEP)
+			available += pEP->maxPacketSize;
+	}
+	
+	for (i = 0; i < openCount; i++)
+	{
+		if (openList[i].transferType != kUSBIsoc)
+			continue;
+		needed += openList[i].maxPacketSize;
 		
-		USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- looking for QHs in the disabled queue", this);
-		while (pQH)
+		// an existing endpoint which is not being closed only needs the difference (see UIMCreateIsochEndpoint)
+		if (!IsochEndpointInList(closeList, closeCount, openList[i].number, openList[i].direction))
 		{
-			USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- found QH[%p] which matches", this, pQH);
-			// first adjust the list
-			_disabledQHList = OSDynamicCast(AppleUHCIQueueHead, pQH->_logicalNext);
-			pQH->_logicalNext = NULL;
-			// now stick pQH back in the queue
-			switch (pQH->type)
-			{
-				case kUSBControl:
-					// Now link the endpoint's queue head into the schedule
-					if (pQH->speed == kUSBDeviceSpeedLow) 
-					{
-						pPrevQHLive = _lsControlQHEnd;
-					} else 
-					{
-						pPrevQHLive = _fsControlQHEnd;
-					}
-					
-					pQH->_logicalNext = pPrevQHLive->_logicalNext;
-					pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-					IOSync();
-					
-					pPrevQHLive->_logicalNext = pQH;
-					pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-					IOSync();
-					if (pQH->speed == kUSBDeviceSpeedLow) 
-					{
-						_lsControlQHEnd = pQH;
-					} else 
-					{
-						_fsControlQHEnd = pQH;
-					}
-					break;
-					
-				case kUSBBulk:
-					pPrevQHLive = _bulkQHEnd;
-					pQH->_logicalNext = pPrevQHLive->_logicalNext;
-					pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-					IOSync();
-					
-					pPrevQHLive->_logicalNext = pQH;
-					pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-					IOSync();
-					_bulkQHEnd = pQH;
-				break;
-					
-				case kUSBInterrupt:
-					pPrevQHLive = _intrQH[pQH->interruptSlot];
-					pQH->_logicalNext = pPrevQHLive->_logicalNext;
-					pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
-					IOSync();
-					
-					pPrevQHLive->_logicalNext = pQH;
-					pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
-				break;
-					
-				default:
-					USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- found QH[%p] with unknown type(%d)", this, pQH, pQH->type);
-					break;
-			}
-			// advance the pointer
-			pQH = _disabledQHList;
+			pEP = FindIsochronousEndpoint(address, openList[i].number, openList[i].direction, NULL);
+			if (pEP)
+				needed -= pEP->maxPacketSize;
 		}
-		return kIOReturnSuccess;
 	}
 	
-	// the disable case
-	USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- looking for endpoints for to disable", this);
-	
-	for (slot=0; slot < kUHCI_NVFRAMES; slot++)
+	if (needed > available)
 	{
-		IOUSBControllerListElement				*pLE;
-		IOUSBControllerListElement				*pPrevLE = NULL;
+		USBLog(3, "AppleUSBUHCI[%p]::UIMCheckPipeBandwidth - address %d needs %d bytes per frame, only %d available", this, address, (int)needed, (int)available);
+		*bandwidthShortfall = needed - available;
+		return kIOReturnNoBandwidth;
+	}
+	
+	*bandwidthShortfall = 0;
+	return kIOReturnSuccess;
+}
 
-		pLE = _logicalFrameList[slot];
-		while (pLE)
-		{
-			// need to determine which kind of list element this is
-			AppleUHCIIsochTransferDescriptor	*pITD = OSDynamicCast(AppleUHCIIsochTransferDescriptor, pLE);
-			AppleUHCIQueueHead					*pQH =	OSDynamicCast(AppleUHCIQueueHead, pLE);
-			
-			if (pQH && (pQH->type != kQHTypeDummy))
+
+
+void
+AppleUSBUHCI::RelinkQueueHead(AppleUHCIQueueHead *pQH)
+{
+	AppleUHCIQueueHead					*pPrevQHLive = NULL;
+	
+	// stick a previously disabled pQH back in the queue
+	switch (pQH->type)
+	{
+		case kUSBControl:
+			// Now link the endpoint's queue head into the schedule
+			if (pQH->speed == kUSBDeviceSpeedLow) 
 			{
-				AppleUHCIQueueHead				*pPrevQH =	OSDynamicCast(AppleUHCIQueueHead, pPrevLE);
-				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- found pQH[%p] which matches (pPrevQH[%p])", this, pQH, pPrevQH);
-				if (!pPrevQH)
-				{
-					USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- unexpected NULL pPrevQH", this);
-				}
-				else
-				{
-					err = UnlinkQueueHead(pQH, pPrevQH);
-					if (err)
-					{
-						USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- err[%p] unlinking queue head", this, (void*)err);
-					}
-					else
-					{
-						// well now that it is off the queue, what do i do with it?
-						pLE = pPrevLE;							// reset for the counter to the previous QH
-						
-						// now link the pQH into the disabled list
-						pQH->_logicalNext = _disabledQHList;
-						_disabledQHList = pQH;
-					}
-				}
+				pPrevQHLive = _lsControlQHEnd;
+			} else 
+			{
+				pPrevQHLive = _fsControlQHEnd;
 			}
 			
-			// I need to be aware of where the current frame is when processing the Isoch List
-			if (pITD && (UHCI_TD_GET_ADDR(USBToHostLong(pITD->GetSharedLogical()->token))))
+			pQH->_logicalNext = pPrevQHLive->_logicalNext;
+			pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
+			IOSync();
+			
+			pPrevQHLive->_logicalNext = pQH;
+			pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
+			IOSync();
+			if (pQH->speed == kUSBDeviceSpeedLow) 
+			{
+				_lsControlQHEnd = pQH;
+			} else 
 			{
-				USBLog(2, "AppleUSBUHCI[%p]::UIMEnableAllEndpoints- found pITD[%p] which matches", this, pITD);
+				_fsControlQHEnd = pQH;
 			}
-			pPrevLE = pLE;
-			if (pLE)
-				pLE = pLE->_logicalNext;
-		}
+			break;
+			
+		case kUSBBulk:
+			pPrevQHLive = _bulkQHEnd;
+			pQH->_logicalNext = pPrevQHLive->_logicalNext;
+			pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
+			IOSync();
+			
+			pPrevQHLive->_logicalNext = pQH;
+			pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
+			IOSync();
+			_bulkQHEnd = pQH;
+		break;
+			
+		case kUSBInterrupt:
+			pPrevQHLive = _intrQH[pQH->interruptSlot];
+			pQH->_logicalNext = pPrevQHLive->_logicalNext;
+			pQH->SetPhysicalLink(pPrevQHLive->GetPhysicalLink());
+			IOSync();
+			
+			pPrevQHLive->_logicalNext = pQH;
+			pPrevQHLive->SetPhysicalLink(pQH->GetPhysicalAddrWithType());
+		break;
+			
+		default:
+			USBLog(2, "AppleUSBUHCI[%p]::RelinkQueueHead- found QH[%p] with unknown type(%d)", this, pQH, pQH->type);
+			return;
 	}
-	return kIOReturnSuccess;
+	pQH->disabled = false;
+	UHCICheckSchedule("RelinkQueueHead");
 }
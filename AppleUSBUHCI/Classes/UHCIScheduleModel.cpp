@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <IOKit/usb/USB.h>
+
+#include "UHCIScheduleModel.h"
+
+#define kUHCIReservedLinkBits		0x00000008				// bit 2 is depth first in a TD and ignored in the other links
+#define kUHCIKnownQHs				32						// QHs whose rest of the schedule has been walked, see UHCICheckSchedule
+
+struct UHCIKnownQHs
+{
+	IOPhysicalAddress		qh[kUHCIKnownQHs];
+	UInt32					count;
+};
+
+
+static UInt32
+CountElements(IOUSBControllerMemoryBlock *head)
+{
+	UInt32		count = 0;
+	
+	for (; head; head = head->GetNextMemoryBlock())
+		count += head->NumElements();
+	return count;
+}
+
+
+
+static void *
+FindElement(IOUSBControllerMemoryBlock *head, IOPhysicalAddress addr)
+{
+	IOUSBControllerMemoryBlock		*block = IOUSBControllerMemoryBlock::FindBlockForPhysical(head, addr);
+	
+	return block ? block->PhysicalToLogical(addr) : NULL;
+}
+
+
+
+static UHCIScheduleError
+Fail(UHCIScheduleWalk *walk, UHCIScheduleError error, IOPhysicalAddress element, UInt32 link)
+{
+	walk->error = error;
+	walk->element = element;
+	walk->link = link;
+	return error;
+}
+
+
+
+// the TDs hanging off of a QH, until a terminated link - the controller only follows them while they are active, but the UIM keeps
+// every one of them on the list until it retires it
+static UHCIScheduleError
+CheckQueue(const UHCIScheduleModel *model, IOPhysicalAddress qh, UInt32 link, UInt32 maxTDs, UHCIScheduleWalk *walk)
+{
+	UHCITransferDescriptorSharedPtr		pTD;
+	IOPhysicalAddress					element = qh;
+	UInt32								count;
+	
+	for (count = 0; !(link & kUHCI_TD_T); count++)
+	{
+		if (link & kUHCIReservedLinkBits)
+			return Fail(walk, kUHCIScheduleReservedBits, element, link);
+		if (link & kUHCI_TD_Q)
+			return Fail(walk, kUHCIScheduleNestedQH, element, link);
+		if (count >= maxTDs)
+			return Fail(walk, kUHCIScheduleLoop, qh, link);
+		
+		pTD = (UHCITransferDescriptorSharedPtr)FindElement(model->tdBlocks, link & kUHCIPtrMask);
+		if (!pTD)
+			return Fail(walk, kUHCIScheduleNotTD, element, link);
+		
+		walk->tds++;
+		element = link & kUHCIPtrMask;
+		link = USBToHostLong(pTD->link);
+	}
+	return kUHCIScheduleOK;
+}
+
+
+
+static bool
+IsKnownQH(const UHCIKnownQHs *known, IOPhysicalAddress qh)
+{
+	UInt32		i;
+	
+	for (i = 0; known && (i < known->count); i++)
+		if (known->qh[i] == qh)
+			return true;
+	return false;
+}
+
+
+
+// a slot which gets to a QH in known is done, and the QHs of a good slot up to the reclamation QH are added to it
+static UHCIScheduleError
+CheckSlot(const UHCIScheduleModel *model, const volatile UInt32 *frameList, UInt32 slot, UHCIKnownQHs *known, UHCIScheduleWalk *walk)
+{
+	UHCITransferDescriptorSharedPtr		pTD;
+	UHCIQueueHeadSharedPtr				pQH;
+	IOPhysicalAddress					element = 0;
+	IOPhysicalAddress					addr;
+	UInt32								link = USBToHostLong(frameList[slot]);
+	UInt32								maxTDs = CountElements(model->tdBlocks);
+	UInt32								maxSteps = maxTDs + CountElements(model->qhBlocks);
+	UInt32								count;
+	bool								sawReclamationQH = false;
+	UHCIKnownQHs						visited;
+	UHCIScheduleError					error;
+	
+	walk->error = kUHCIScheduleOK;
+	walk->slot = slot;
+	walk->element = 0;
+	walk->link = 0;
+	
+	if (link & kUHCI_FRAME_T)
+		return kUHCIScheduleOK;
+	
+	visited.count = 0;
+	for (count = 0; ; count++)
+	{
+		if (link & kUHCI_FRAME_T)
+			return Fail(walk, kUHCIScheduleNoLastQH, element, link);
+		if (link & kUHCIReservedLinkBits)
+			return Fail(walk, kUHCIScheduleReservedBits, element, link);
+		if (count >= maxSteps)
+			return Fail(walk, kUHCIScheduleLoop, element, link);
+		
+		addr = link & kUHCIPtrMask;
+		if (link & kUHCI_FRAME_Q)
+		{
+			// which also means the reclamation QH is still to come
+			if (IsKnownQH(known, addr))
+			{
+				sawReclamationQH = true;
+				break;
+			}
+			
+			pQH = (UHCIQueueHeadSharedPtr)FindElement(model->qhBlocks, addr);
+			if (!pQH)
+				return Fail(walk, kUHCIScheduleNotQH, element, link);
+			
+			walk->qhs++;
+			error = CheckQueue(model, addr, USBToHostLong(pQH->elink), maxTDs, walk);
+			if (error != kUHCIScheduleOK)
+				return error;
+			
+			// whether the reclamation loop is good depends on what came before the reclamation QH, but not what comes after it
+			if (!sawReclamationQH && (visited.count < kUHCIKnownQHs))
+				visited.qh[visited.count++] = addr;
+			if (addr == model->reclamationQH)
+				sawReclamationQH = true;
+			
+			link = USBToHostLong(pQH->hlink);
+			if (addr == model->lastQH)
+			{
+				// the reclamation loop has to go back to a QH which this frame has already been through, or the frame never ends
+				if (!(link & kUHCI_QH_T) && (!sawReclamationQH || ((link & kUHCIPtrMask) != model->reclamationQH) || !(link & kUHCI_QH_Q)))
+					return Fail(walk, kUHCIScheduleBadReclamation, addr, link);
+				break;
+			}
+		}
+		else
+		{
+			pTD = (UHCITransferDescriptorSharedPtr)FindElement(model->tdBlocks, addr);
+			if (!pTD)
+				return Fail(walk, kUHCIScheduleNotTD, element, link);
+			
+			walk->tds++;
+			link = USBToHostLong(pTD->link);
+		}
+		element = addr;
+	}
+	
+	if (known && (sawReclamationQH || !model->reclamationQH))
+	{
+		for (count = 0; (count < visited.count) && (known->count < kUHCIKnownQHs); count++)
+			if (!IsKnownQH(known, visited.qh[count]))
+				known->qh[known->count++] = visited.qh[count];
+	}
+	return kUHCIScheduleOK;
+}
+
+
+
+UHCIScheduleError
+UHCICheckScheduleSlot(const UHCIScheduleModel *model, const volatile UInt32 *frameList, UInt32 slot, UHCIScheduleWalk *walk)
+{
+	walk->tds = 0;
+	walk->qhs = 0;
+	return CheckSlot(model, frameList, slot, NULL, walk);
+}
+
+
+
+UHCIScheduleError
+UHCICheckSchedule(const UHCIScheduleModel *model, const volatile UInt32 *frameList, UInt32 numSlots, UHCIScheduleWalk *walk)
+{
+	UHCIKnownQHs			known;
+	UHCIScheduleError		error;
+	UInt32					slot;
+	
+	// every slot ends in the same interrupt tree and control and bulk QHs, so those are walked once rather than once for each slot
+	known.count = 0;
+	walk->tds = 0;
+	walk->qhs = 0;
+	for (slot = 0; slot < numSlots; slot++)
+	{
+		error = CheckSlot(model, frameList, slot, &known, walk);
+		if (error != kUHCIScheduleOK)
+			return error;
+	}
+	return kUHCIScheduleOK;
+}
+
+
+
+const char *
+UHCIScheduleErrorString(UHCIScheduleError error)
+{
+	switch (error)
+	{
+		case kUHCIScheduleOK:					return "OK";
+		case kUHCIScheduleReservedBits:			return "reserved bits set in a link";
+		case kUHCIScheduleNotTD:				return "link to something which is not a TD";
+		case kUHCIScheduleNotQH:				return "link to something which is not a QH";
+		case kUHCIScheduleNestedQH:				return "QH element list links to a QH";
+		case kUHCIScheduleLoop:					return "loop in the schedule";
+		case kUHCIScheduleNoLastQH:				return "frame ends before the last QH";
+		case kUHCIScheduleBadReclamation:		return "last QH does not link back to the reclamation QH";
+	}
+	return "unknown error";
+}
@@ -63,6 +63,8 @@ public:
 	UInt8										interruptSlot;			// index into the interrupt queue head tree iff type is kUSBInterrupt
     bool										stalled;
 	bool										aborting;				// this endpoint is in the process of aborting
+	bool										disabled;				// this endpoint has been taken off the schedule by UIMEnableAddressEndpoints
+	AppleUHCIQueueHead							*nextAddressQH;			// next QH for the same device address (see _addressQHList)
     
     // AbsoluteTime								timestamp;
         
@@ -136,4 +138,16 @@ public:
 	
 };
 
+
+class AppleUHCIIsochEndpoint : public IOUSBControllerIsochEndpoint
+{
+    OSDeclareDefaultStructors(AppleUHCIIsochEndpoint)
+
+public:
+	virtual bool			init();
+	
+	AppleUHCIIsochEndpoint				*nextScavengeEP;			// next EP with work for scavengeIsochTransactions
+	bool								onScavengeList;				// true while this EP is linked on the controller's _isochEPScavengeList
+};
+
 #endif
\ No newline at end of file
@@ -26,23 +26,18 @@
 #define _IOKIT_AppleUHCIqhMemoryBlock_H
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "AppleUSBUHCI.h"
 #include "UHCI.h"
 
 
-class AppleUHCIqhMemoryBlock : public OSObject
+class AppleUHCIqhMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleUHCIqhMemoryBlock);
     
 #define QHsPerBlock	(kUHCIPageSize / sizeof(UHCIQueueHeadShared))
 	
-private:
-    IOPhysicalAddress							_sharedPhysical;
-    UHCIQueueHeadSharedPtr						_sharedLogical;
-    AppleUHCIqhMemoryBlock						*_nextBlock;
-	IOBufferMemoryDescriptor					*_buffer;
-    
 public:
 		
     static AppleUHCIqhMemoryBlock				*NewMemoryBlock(void);
@@ -26,6 +26,7 @@
 #define _IOKIT_AppleUHCItdMemoryBlock_H
 
 #include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
 
 #include "UHCI.h"
 #include "AppleUSBUHCI.h"
@@ -34,18 +35,12 @@
 // forward declaration
 class AppleUHCITransferDescriptor;
 
-class AppleUHCItdMemoryBlock : public OSObject
+class AppleUHCItdMemoryBlock : public IOUSBControllerMemoryBlock
 {
     OSDeclareDefaultStructors(AppleUHCItdMemoryBlock);
     
 #define TDsPerBlock	(kUHCIPageSize / sizeof(UHCITransferDescriptorShared))
 	
-private:
-    IOPhysicalAddress							_sharedPhysical;
-    UHCITransferDescriptorSharedPtr				_sharedLogical;
-    AppleUHCItdMemoryBlock						*_nextBlock;
-	IOBufferMemoryDescriptor					*_buffer;
-    
 public:
 		
 	static AppleUHCItdMemoryBlock				*NewMemoryBlock(void);
@@ -75,6 +75,19 @@ class AppleUSBUHCIDMACommand;
 #define USBError( LEVEL, FORMAT, ARGS... )  { kprintf( FORMAT "\n", ## ARGS ) ; }
 #endif
 
+// Schedule consistency assertions: walk the frame list and the queues after every change to the schedule and panic
+// if the hardware links no longer match the software ones. Only a debugging aid for changes to the schedule code - it
+// is very slow, off by default, and only catches what the UIM itself does to the schedule on real hardware.
+#ifndef UHCI_CHECK_SCHEDULE
+#define UHCI_CHECK_SCHEDULE 0
+#endif
+
+#if UHCI_CHECK_SCHEDULE
+#define UHCICheckSchedule( WHO )	CheckSchedule( WHO )
+#else
+#define UHCICheckSchedule( WHO )
+#endif
+
 #ifdef __ppc__
 #define IOSync eieio
 #else
@@ -114,6 +127,12 @@ class AppleUSBUHCIDMACommand;
 #define kUHCI_NVFRAMES 1024
 #define kUHCI_NVFRAMES_MASK (kUHCI_NVFRAMES-1)
 
+// UHCI has no frame rollover interrupt, so UIMCheckForTimeouts latches a new GetFrameNumberWithTime anchor this often,
+// which is as often as OHCI gets one from its frame number overflow interrupt
+#define kUHCIAnchorRefreshFrames	32768
+#define kUHCIAnchorLatchTimeoutMS	2					// how long to wait for a frame boundary to latch
+#define kUHCIAnchorReadRetries		100					// GetFrameNumberWithTime reads of an anchor being updated before it gives up on it
+
 // we will allocate 6 interrupt queue heads, representing polling intervals of up to 32 ms
 // intrQH[0] will appear in every frame list
 // intrQH[1] will appear in every 2nd frame list and point to intrQH[0]
@@ -121,6 +140,9 @@ class AppleUSBUHCIDMACommand;
 // etc
 #define kUHCI_NINTR_QHS 6
 
+// number of device addresses we index queue heads by (7 bit USB addresses)
+#define kUHCI_NADDRESSES 128
+
 
 /* Minimum frame offset for scheduling an isochronous transaction. */
 enum {
@@ -219,6 +241,23 @@ enum
 	kUHCITimeoutForPortRecovery = 2						// After 2 seconds, forget we applied the port recovery code
 };    
 
+/* Adaptive doze.
+ * Going in and out of doze costs about 23ms (3ms to suspend plus the 20ms global resume), so a doze which
+ * ends sooner than the break even time costs us more than it saves. We keep a running average of how long
+ * our dozes actually last and decline to doze while that average is under the break even time, allowing
+ * an occasional doze anyway so that the average can follow a change in the traffic pattern.
+ */
+enum
+{
+	kUHCIDozeBreakEvenMS = 100,							// a doze needs to last at least this long to be worth it
+	kUHCIDozeAverageShift = 2,							// 1/4 weighted running average of the doze lengths
+	kUHCIDozeMinSamples = 4,							// always doze until we have this many samples
+	kUHCIDozeProbeInterval = 8							// doze anyway after declining this many times in a row
+};
+
+// what DozeController returns when it leaves the controller running, either for a port resume or because the doze wouldn't pay off
+#define kUHCIDozeDeclined	kIOReturnNotReady
+
 
 class AppleUSBUHCI : public IOUSBControllerV3
 {
@@ -281,9 +320,7 @@ protected:
     AbsoluteTime					_lastTime;
     
     /* 64-bit frame number support. */
-    IOLock *						_frameLock;
-    UInt32							_lastFrameNumberLow;
-    UInt32							_lastFrameNumberHigh;
+    volatile UInt64					_lastFrameNumber __attribute__((aligned(8)));	// only ever advanced with OSCompareAndSwap64
     
     AbsoluteTime					_lastFrameNumberTime;
     UInt64							_lastTimeoutFrameNumber;
@@ -319,8 +356,9 @@ protected:
     AppleUHCIQueueHead				*_lsControlQHStart;
     AppleUHCIQueueHead				*_lsControlQHEnd;
 	
-	// disabled Queue Head list
-    AppleUHCIQueueHead				*_disabledQHList;
+	// per device address list of the non-isoch queue heads, linked through nextAddressQH
+	// this lets us enable or disable a single device without walking the whole schedule
+    AppleUHCIQueueHead				*_addressQHList[kUHCI_NADDRESSES];
     
     // Interrupt queues
     AppleUHCIQueueHead					*_intrQH[kUHCI_NINTR_QHS];
@@ -362,17 +400,16 @@ protected:
     volatile UInt32								_consumerCount;						// Counter used to synchronize reading of the done queue between filter (producer) and action (consumer)
     volatile bool								_filterInterruptActive;				// in the filter interrupt routine
 	bool										_inAbortIsochEP;
+	AppleUHCIIsochEndpoint						*_isochEPScavengeList;				// EPs which retired TDs or still have TDs on the toDo list
 	
-	// variables to get the anchor frame
-	// used to implement GetFrameNumberWithTime
-	AbsoluteTime							_tempAnchorTime;
+	// frame number and the time it started, latched by UpdateFrameNumberWithTime and returned by GetFrameNumberWithTime
+	IOSimpleLock *							_anchorLock;						// serializes the writers, who hold it with interrupts off
+	volatile UInt32							_anchorSequence;					// odd while the anchor is being updated
 	AbsoluteTime							_anchorTime;
-	UInt64									_tempAnchorFrame;
-	UInt64									_lastIrqFrame;
-	UInt32									_lastIrqFrameLow;
-	UInt64									_anchorFrame;
+	UInt64									_anchorFrame;						// 0 until the first frame boundary has been latched
 
 	void                            UpdateFrameNumberWithTime(void);
+	void                            InvalidateFrameNumberWithTime(void);
 	UInt64                          GetFrameNumberInternal(void);
 
     IOReturn						RHAbortEndpoint (short endpointNumber, short direction);
@@ -403,6 +440,7 @@ protected:
     
     AppleUHCIQueueHead				*FindQueueHead(short functionNumber, short endpointNumber, UInt8 direction, UInt8 type, AppleUHCIQueueHead **ppQHPrev = NULL);
 	IOReturn						UnlinkQueueHead(AppleUHCIQueueHead *pQH, AppleUHCIQueueHead *pQHPrev);
+	void							RelinkQueueHead(AppleUHCIQueueHead *pQH);
 	
     IOReturn						DeleteEndpoint(short functionNumber, short endpointNumber, UInt8 direction);
 
@@ -410,11 +448,16 @@ protected:
     static void						InterruptHandler(OSObject *owner, IOInterruptEventSource *, int);
     static bool						PrimaryInterruptFilter(OSObject *owner, IOFilterInterruptEventSource *source);
 
+	// the family's command pools tell us, on the workloop, when they give back commands which we counted when we grew them
+	static void						CommandPoolReleased(OSObject *owner, UInt32 released);
+	static void						IsocCommandPoolReleased(OSObject *owner, UInt32 released);
+
     bool							FilterInterrupt(void);
     void							HandleInterrupt(void);
     void							ProcessCompletedTransactions(void);
 	IOReturn						scavengeIsochTransactions(void);
 	IOReturn						scavengeAnIsochTD(AppleUHCIIsochTransferDescriptor *pTD);
+	void							MarkIsochEPForScavenge(IOUSBControllerIsochEndpoint *pEP);
 	IOReturn						scavengeQueueHeads(IOUSBControllerListElement *);
 	IOReturn						UHCIUIMDoDoneQueueProcessing(AppleUHCITransferDescriptor *pHCDoneTD, OSStatus forceErr, AppleUHCITransferDescriptor *stopAt);
     
@@ -456,6 +499,9 @@ protected:
     void									SingleStep(int count, bool runAfter);
 
 	void									PrintFrameList(UInt32 slot, int level);
+#if UHCI_CHECK_SCHEDULE
+	void									CheckSchedule(const char *who);
+#endif
 
     /*
      * Isochronous support.
@@ -475,9 +521,24 @@ protected:
     IONotifier								*_powerDownNotifier;
 	UInt32									_ExpressCardPort;					// Port number of ExpressCard (0 if no ExpressCard on this controller)
 	bool									_badExpressCardAttached;			// True if a driver has identified a bad ExpressCard
+	
+	// adaptive doze
+	UInt64									_dozeStartTime;						// mach_absolute_time() when we last dozed, 0 if we are not dozing
+	UInt32									_dozeAverageMS;						// running average of how long our dozes last
+	UInt32									_dozeSamples;
+	UInt32									_dozeDeclinedInARow;
+	UInt32									_dozeCount;							// exported as properties
+	UInt32									_dozeDeclinedCount;
+	UInt32									_dozeShortCount;					// dozes which ended before kUHCIDozeBreakEvenMS
+	UInt64									_dozeResidencyMS;
+	UInt32									_isochASAPResyncCount;				// kAppleUSBIsocASAPFrame requests which had fallen behind, exported as properties
+	UInt64									_isochASAPFramesSkipped;			// frames of their endpoints' cadence which went by unused
     
     void									ResumeController(void);
     void									SuspendController(void);
+	bool									ControllerStateSurvivedSleep(void);
+	bool									DozeIsWorthwhile(void);
+	void									UpdateDozeStatistics(void);
     void									EnableUSBInterrupt(bool enableInterrupt);    
     
 public:
@@ -702,10 +763,8 @@ public:
 	virtual IODMACommand							*GetNewDMACommand();
     virtual void									PutTDonDoneQueue(IOUSBControllerIsochEndpoint* pED, IOUSBControllerIsochListElement *pTD, bool checkDeferred);
 	
-	// this call is not gated, so we need to gate it ourselves
+	// this call is not gated, and doesn't need to be
 	virtual IOReturn								GetFrameNumberWithTime(UInt64* frameNumber, AbsoluteTime *theTime);
-	// here is the gated version
-	static IOReturn									GatedGetFrameNumberWithTime(OSObject *owner, void* arg0, void* arg1, void* arg2, void* arg3);
 
 	// separated this from initForPM
 	void											CheckSleepCapability(void);
@@ -728,6 +787,9 @@ public:
 	virtual IOReturn				EnableInterruptsFromController(bool enable);
 	virtual IOReturn				RootHubAbortInterruptRead(void);
 
+	// in IOUSBControllerV2
+	virtual IOReturn				UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+
 };
 
 #endif /* ! _IOKIT_AppleUSBUHCI_H */
@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOKIT_UHCIScheduleModel_H
+#define _IOKIT_UHCIScheduleModel_H
+
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+
+#include "UHCI.h"
+
+/*
+ The schedule as the controller walks it (UHCI 1.1, section 3.4), using nothing but the links in the shared memory. Each frame list
+ slot leads through the isoch TDs of that frame into the interrupt QH tree, and on through the control and bulk QHs to the last QH,
+ whose link is either terminated or goes back to the full speed control QH for bandwidth reclamation. Every link has to land on the
+ start of a TD or a QH in the UIM's memory blocks, with a type bit to match, and the TDs of a QH have to end in a terminated link.
+ A loop other than the reclamation one shows up as a walk which is longer than there are elements in the blocks. CheckSchedule runs
+ this after checking the software links when UHCI_CHECK_SCHEDULE is set, and Tests/ScheduleModel runs it on the host.
+*/
+
+enum UHCIScheduleError
+{
+	kUHCIScheduleOK						= 0,
+	kUHCIScheduleReservedBits,			// bit 3 of a link is set
+	kUHCIScheduleNotTD,					// a TD link which is not the start of a TD
+	kUHCIScheduleNotQH,					// a QH link which is not the start of a QH
+	kUHCIScheduleNestedQH,				// a QH's element list goes on to another QH, which the UIM never builds
+	kUHCIScheduleLoop,					// a frame or the TDs of a QH come back around on themselves
+	kUHCIScheduleNoLastQH,				// a frame which ends before it gets to the last QH
+	kUHCIScheduleBadReclamation			// the last QH goes on to somewhere other than the reclamation QH of that frame
+};
+
+struct UHCIScheduleModel
+{
+	IOUSBControllerMemoryBlock *		tdBlocks;				// the UIM's lists of blocks, isoch TDs included
+	IOUSBControllerMemoryBlock *		qhBlocks;
+	IOPhysicalAddress					lastQH;					// where every frame ends up
+	IOPhysicalAddress					reclamationQH;			// where the last QH may link back to, 0 if it always has to be terminated
+};
+
+struct UHCIScheduleWalk
+{
+	UHCIScheduleError					error;
+	UInt32								slot;					// the frame list slot being walked
+	IOPhysicalAddress					element;				// the TD or QH holding the bad link, 0 for the slot itself
+	UInt32								link;					// and the link
+	UInt32								tds;					// elements visited
+	UInt32								qhs;
+};
+
+// frameList is the shared one, in bus order. A terminated slot is an idle frame, as when the UIM has stopped the schedule for sleep.
+// UHCICheckScheduleSlot walks one slot all the way, and UHCICheckSchedule stops each slot at a QH which an earlier one went through
+UHCIScheduleError	UHCICheckScheduleSlot(const UHCIScheduleModel *model, const volatile UInt32 *frameList, UInt32 slot, UHCIScheduleWalk *walk);
+UHCIScheduleError	UHCICheckSchedule(const UHCIScheduleModel *model, const volatile UInt32 *frameList, UInt32 numSlots, UHCIScheduleWalk *walk);
+const char *		UHCIScheduleErrorString(UHCIScheduleError error);
+
+#endif
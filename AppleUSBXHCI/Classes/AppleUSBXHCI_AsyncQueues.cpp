@@ -609,7 +609,14 @@ AppleXHCIAsyncEndpoint::CreateTDs(IOUSBCommand *command, UInt16 streamID, UInt32
     }
 #endif
     
-    if ((command->GetReqCount() > 0) && (!command->GetDMACommand() || !command->GetDMACommand()->getMemoryDescriptor()))
+    // IOUSBController::Write has already copied a small OUT payload into the command instead of mapping it for DMA
+    if ((immediateTransferSize == kInvalidImmediateTRBTransferSize) && command->GetImmediateTransfer() && (command->GetReqCount() <= kMaxImmediateTRBTransferSize))
+    {
+        immediateTransferSize = (UInt8)command->GetReqCount();
+        immediateBuffer = command->GetImmediateBuffer();
+    }
+    
+    if ((command->GetReqCount() > 0) && (immediateTransferSize > kMaxImmediateTRBTransferSize) && (!command->GetDMACommand() || !command->GetDMACommand()->getMemoryDescriptor()))
     {
         USBError(1, "AppleXHCIAsyncEndpoint::CreateTDs - no DMA Command or missing memory descriptor");
         return kIOReturnBadArgument;
@@ -0,0 +1,347 @@
+//
+//  AppleUSBXHCI_LinkPower.cpp
+//  AppleUSBXHCI
+//
+//  Copyright 2013 Apple Inc. All rights reserved.
+//
+
+#include <string.h>
+
+#include "AppleUSBXHCI_LinkPower.h"
+#include "XHCI.h"
+
+// USB 2.0 LPM ECN, table X-X1 - BESL values in us
+static const UInt16 gBESLMicroseconds[kLinkPowerNumBESLValues] =
+{
+	125, 150, 200, 300, 400, 500, 1000, 2000, 3000, 4000, 5000, 6000, 7000, 8000, 9000, 10000
+};
+
+
+
+#pragma mark Configuration
+
+void
+AppleXHCILinkPowerPolicy::Init(bool superSpeed)
+{
+	bzero(this, sizeof(*this));
+	_superSpeed = superSpeed;
+	_besl = kLinkPowerBESLInvalid;
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::SetSuperSpeedExitLatencies(UInt8 u1DevExitLat, UInt16 u2DevExitLat, UInt16 pathExitLat)
+{
+	_u1DevExitLat = (u1DevExitLat > kLinkPowerMaxU1ExitLatency) ? (UInt8)kLinkPowerMaxU1ExitLatency : u1DevExitLat;
+	_u2DevExitLat = (u2DevExitLat > kLinkPowerMaxU2ExitLatency) ? (UInt16)kLinkPowerMaxU2ExitLatency : u2DevExitLat;
+	_pathExitLat = pathExitLat;
+	_exitLatenciesValid = true;
+	Recalculate();
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::SetUSB2L1Capabilities(bool beslSupported, UInt8 baselineBESL, UInt8 deepBESL)
+{
+	_beslSupported = beslSupported;
+	_baselineBESL = baselineBESL & (kLinkPowerNumBESLValues - 1);
+	_deepBESL = deepBESL & (kLinkPowerNumBESLValues - 1);
+
+	// a deep BESL which is shallower than the baseline is meaningless
+	if (_deepBESL < _baselineBESL)
+		_deepBESL = _baselineBESL;
+	Recalculate();
+}
+
+
+
+static UInt32
+IntervalBucket(UInt32 serviceIntervalUS)
+{
+	UInt32		bucket = 0;
+
+	while ((serviceIntervalUS >>= 1) && (bucket < (kLinkPowerNumIntervalBuckets - 1)))
+		bucket++;
+	return bucket;
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::AddPeriodicEndpoint(UInt32 serviceIntervalUS)
+{
+	_periodicCount[IntervalBucket(serviceIntervalUS)]++;
+	Recalculate();
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::RemovePeriodicEndpoint(UInt32 serviceIntervalUS)
+{
+	UInt32		bucket = IntervalBucket(serviceIntervalUS);
+
+	if (_periodicCount[bucket])
+		_periodicCount[bucket]--;
+	Recalculate();
+}
+
+
+
+#pragma mark Traffic
+
+void
+AppleXHCILinkPowerPolicy::TransferStarted(UInt64 nowUS)
+{
+	if ((_outstanding == 0) && _idleStartValid && (nowUS >= _idleStartUS))
+	{
+		UInt64		gap = nowUS - _idleStartUS;
+		UInt32		gapUS = (gap > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (UInt32)gap;
+
+		// account for the gap with the settings which were in effect during it, and then let it influence the next settings
+		AccountForGap(gapUS);
+
+		if (_gapSamples == 0)
+			_averageGapUS = gapUS;
+		else
+			_averageGapUS = (UInt32)(((((UInt64)_averageGapUS) << kLinkPowerGapAverageShift) - _averageGapUS + gapUS) >> kLinkPowerGapAverageShift);
+
+		if (_gapSamples < kLinkPowerMinGapSamples)
+			_gapSamples++;
+
+		_idleStartValid = false;
+		Recalculate();
+	}
+	_outstanding++;
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::TransferCompleted(UInt64 nowUS)
+{
+	if (_outstanding)
+		_outstanding--;
+
+	if (_outstanding == 0)
+	{
+		_idleStartUS = nowUS;
+		_idleStartValid = true;
+	}
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::AccountForGap(UInt32 gapUS)
+{
+	UInt32		entryUS = 0;
+	UInt32		exitUS = 0;
+
+	_idleTimeUS += gapUS;
+
+	if (_superSpeed)
+	{
+		// the link goes to U1 first (if enabled) and the residency starts there, but the exit latency is that of the deepest state reached
+		if (_u1Timeout && (gapUS > _u1Timeout))
+		{
+			entryUS = _u1Timeout;
+			exitUS = _u1DevExitLat + _pathExitLat;
+		}
+		if (_u2Timeout && (gapUS > ((UInt32)_u2Timeout * kXHCIU2TimeoutUnits)))
+		{
+			if (!entryUS)
+				entryUS = (UInt32)_u2Timeout * kXHCIU2TimeoutUnits;
+			exitUS = _u2DevExitLat + _pathExitLat;
+		}
+	}
+	else if (_l1Enabled)
+	{
+		// L1 is entered after the same inactivity multiple of its exit latency that we use for U1/U2
+		UInt32		l1Latency = BESLToMicroseconds(_besl);
+
+		if (gapUS > (l1Latency * kLinkPowerTimeoutMultiplier))
+		{
+			entryUS = l1Latency * kLinkPowerTimeoutMultiplier;
+			exitUS = l1Latency;
+		}
+	}
+
+	if (entryUS)
+	{
+		_lowPowerResidencyUS += (gapUS - entryUS);
+		_addedLatencyUS += exitUS;
+		_lowPowerEntries++;
+	}
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::ResetStatistics(void)
+{
+	_idleTimeUS = 0;
+	_lowPowerResidencyUS = 0;
+	_addedLatencyUS = 0;
+	_lowPowerEntries = 0;
+}
+
+
+
+#pragma mark Policy
+
+UInt32
+AppleXHCILinkPowerPolicy::MinPeriodicInterval(void)
+{
+	UInt32		bucket;
+
+	// the bucket is the floor of log2, so this errs on the short side
+	for (bucket = 0; bucket < kLinkPowerNumIntervalBuckets; bucket++)
+	{
+		if (_periodicCount[bucket])
+			return (1 << bucket);
+	}
+	return 0;
+}
+
+
+
+UInt32
+AppleXHCILinkPowerPolicy::AllowedExitLatency(void)
+{
+	UInt32		minInterval = MinPeriodicInterval();
+
+	// a periodic endpoint must still be serviced in its interval even if the link has to come out of a low power state first
+	if (minInterval)
+		return minInterval / kLinkPowerPeriodicMarginDivisor;
+
+	return 0xFFFFFFFF;
+}
+
+
+
+void
+AppleXHCILinkPowerPolicy::Recalculate(void)
+{
+	UInt8		u1Timeout = kXHCIUxTimeoutDisabled;
+	UInt8		u2Timeout = kXHCIUxTimeoutDisabled;
+	bool		l1Enabled = false;
+	UInt8		besl = kLinkPowerBESLInvalid;
+	UInt32		allowed = AllowedExitLatency();
+
+	// until we have some idea of the traffic pattern, leave everything off
+	if (_gapSamples >= kLinkPowerMinGapSamples)
+	{
+		if (_superSpeed)
+		{
+			if (_exitLatenciesValid)
+			{
+				UInt32		u1Exit = _u1DevExitLat + _pathExitLat;
+				UInt32		u2Exit = _u2DevExitLat + _pathExitLat;
+				UInt32		timeoutUS;
+
+				timeoutUS = u1Exit * kLinkPowerTimeoutMultiplier;
+				if (timeoutUS == 0)
+					timeoutUS = 1;
+				if (timeoutUS > kXHCIU1TimeoutMax)
+					timeoutUS = kXHCIU1TimeoutMax;
+
+				if ((u1Exit <= allowed) && (_averageGapUS >= (kLinkPowerBreakEvenMultiplier * (u1Exit + timeoutUS))))
+					u1Timeout = (UInt8)timeoutUS;
+
+				// U2 timeouts are in 256us units, so round up
+				timeoutUS = ((u2Exit * kLinkPowerTimeoutMultiplier) + kXHCIU2TimeoutUnits - 1) / kXHCIU2TimeoutUnits;
+				if (timeoutUS == 0)
+					timeoutUS = 1;
+				if (timeoutUS > kXHCIU2TimeoutMax)
+					timeoutUS = kXHCIU2TimeoutMax;
+
+				if ((u2Exit <= allowed) && (_averageGapUS >= (kLinkPowerBreakEvenMultiplier * (u2Exit + (timeoutUS * kXHCIU2TimeoutUnits)))))
+					u2Timeout = (UInt8)timeoutUS;
+			}
+		}
+		else if (_beslSupported)
+		{
+			UInt8		candidates[2] = { _deepBESL, _baselineBESL };
+			int			i;
+
+			// prefer the deep BESL, as long as it still fits in the traffic gaps and periodic intervals
+			for (i = 0; i < 2; i++)
+			{
+				UInt32		latency = BESLToMicroseconds(candidates[i]);
+
+				if ((latency <= allowed) && (_averageGapUS >= (kLinkPowerBreakEvenMultiplier * (latency + (latency * kLinkPowerTimeoutMultiplier)))))
+				{
+					l1Enabled = true;
+					besl = candidates[i];
+					break;
+				}
+			}
+		}
+	}
+
+	if ((u1Timeout != _u1Timeout) || (u2Timeout != _u2Timeout) || (l1Enabled != _l1Enabled) || (besl != _besl))
+	{
+		_u1Timeout = u1Timeout;
+		_u2Timeout = u2Timeout;
+		_l1Enabled = l1Enabled;
+		_besl = besl;
+		_changed = true;
+	}
+}
+
+
+
+UInt8
+AppleXHCILinkPowerPolicy::GetU1Timeout(void)
+{
+	return _u1Timeout;
+}
+
+
+
+UInt8
+AppleXHCILinkPowerPolicy::GetU2Timeout(void)
+{
+	return _u2Timeout;
+}
+
+
+
+bool
+AppleXHCILinkPowerPolicy::GetL1Enabled(void)
+{
+	return _l1Enabled;
+}
+
+
+
+UInt8
+AppleXHCILinkPowerPolicy::GetBESL(void)
+{
+	return _besl;
+}
+
+
+
+bool
+AppleXHCILinkPowerPolicy::PolicyChanged(void)
+{
+	bool		changed = _changed;
+
+	_changed = false;
+	return changed;
+}
+
+
+
+UInt32
+AppleXHCILinkPowerPolicy::BESLToMicroseconds(UInt8 besl)
+{
+	if (besl >= kLinkPowerNumBESLValues)
+		return 0xFFFFFFFF;
+
+	return gBESLMicroseconds[besl];
+}
@@ -0,0 +1,102 @@
+//
+//  AppleUSBXHCI_LinkPower.h
+//  AppleUSBXHCI
+//
+//  Copyright 2013 Apple Inc. All rights reserved.
+//
+
+#ifndef AppleUSBXHCI_AppleUSBXHCI_LinkPower_h
+#define AppleUSBXHCI_AppleUSBXHCI_LinkPower_h
+
+#include <libkern/OSTypes.h>
+
+//
+// Per device link power management policy
+//
+// This class makes no calls into the rest of the UIM, the controller or the kernel. The UIM feeds it the device's
+// declared exit latencies, its periodic endpoints and the time stamps of its transfers, and reads back the U1/U2
+// timeouts (SuperSpeed) or the L1 enable and BESL (USB 2) it should program. The same object can therefore be
+// driven by a recorded or synthetic traffic trace, and reports how much time the link would have spent in a low
+// power state against how much latency that added to the transfers.
+//
+enum
+{
+	kLinkPowerGapAverageShift				= 3,						// idle gap average is a 1/8 weighted running average
+	kLinkPowerMinGapSamples					= 8,						// don't enable anything until we have seen this many gaps
+	kLinkPowerBreakEvenMultiplier			= 4,						// only enter a state if the typical gap is 4x (exit latency + timeout)
+	kLinkPowerTimeoutMultiplier				= 2,						// inactivity timeout is 2x the exit latency of the state
+	kLinkPowerPeriodicMarginDivisor			= 4,						// exit latency must be under 1/4 of the shortest periodic service interval
+
+	kLinkPowerMaxU1ExitLatency				= 10,						// us (USB 3.0 9.6.2.2 bU1DevExitLat)
+	kLinkPowerMaxU2ExitLatency				= 2047,						// us (USB 3.0 9.6.2.2 wU2DevExitLat)
+	kLinkPowerNumBESLValues					= 16,
+	kLinkPowerNumIntervalBuckets			= 32,						// periodic endpoints are counted by log2 of their interval in us
+	kLinkPowerBESLInvalid					= 0xFF
+};
+
+class AppleXHCILinkPowerPolicy
+{
+public:
+	// configuration
+	void			Init(bool superSpeed);
+	void			SetSuperSpeedExitLatencies(UInt8 u1DevExitLat, UInt16 u2DevExitLat, UInt16 pathExitLat);
+	void			SetUSB2L1Capabilities(bool beslSupported, UInt8 baselineBESL, UInt8 deepBESL);
+	void			AddPeriodicEndpoint(UInt32 serviceIntervalUS);
+	void			RemovePeriodicEndpoint(UInt32 serviceIntervalUS);
+
+	// traffic
+	void			TransferStarted(UInt64 nowUS);
+	void			TransferCompleted(UInt64 nowUS);
+
+	// results - these are what the UIM programs into PORTPMSC
+	UInt8			GetU1Timeout(void);						// kXHCIPortMSC_U1Timeout units (us), 0 == disabled
+	UInt8			GetU2Timeout(void);						// kXHCIPortMSC_U2Timeout units (256us), 0 == disabled
+	bool			GetL1Enabled(void);
+	UInt8			GetBESL(void);							// only valid if GetL1Enabled() returns true
+	bool			PolicyChanged(void);					// true once after the results above have changed
+
+	// accounting - residency and added latency as if the current settings were in effect for every gap seen
+	UInt64			GetIdleTimeUS(void)						{ return _idleTimeUS; }
+	UInt64			GetLowPowerResidencyUS(void)			{ return _lowPowerResidencyUS; }
+	UInt64			GetAddedLatencyUS(void)					{ return _addedLatencyUS; }
+	UInt32			GetLowPowerEntries(void)				{ return _lowPowerEntries; }
+	void			ResetStatistics(void);
+
+	static UInt32	BESLToMicroseconds(UInt8 besl);
+
+private:
+	void			Recalculate(void);
+	UInt32			MinPeriodicInterval(void);
+	UInt32			AllowedExitLatency(void);
+	void			AccountForGap(UInt32 gapUS);
+
+	bool			_superSpeed;
+	bool			_exitLatenciesValid;					// SetSuperSpeedExitLatencies has been called
+	UInt8			_u1DevExitLat;							// us, from the SuperSpeed device capability descriptor
+	UInt16			_u2DevExitLat;							// us, from the SuperSpeed device capability descriptor
+	UInt16			_pathExitLat;							// us, added by any hubs between us and the device
+	bool			_beslSupported;							// from the USB 2.0 extension descriptor
+	UInt8			_baselineBESL;
+	UInt8			_deepBESL;
+
+	UInt32			_periodicCount[kLinkPowerNumIntervalBuckets];	// number of periodic endpoints by log2 of the service interval
+
+	UInt32			_outstanding;							// transfers currently in flight
+	UInt64			_idleStartUS;							// when _outstanding last went to 0
+	bool			_idleStartValid;
+	UInt32			_averageGapUS;							// running average of the idle gaps
+	UInt32			_gapSamples;
+
+	UInt8			_u1Timeout;
+	UInt8			_u2Timeout;
+	bool			_l1Enabled;
+	UInt8			_besl;
+	bool			_changed;
+
+	UInt64			_idleTimeUS;
+	UInt64			_lowPowerResidencyUS;
+	UInt64			_addedLatencyUS;
+	UInt32			_lowPowerEntries;
+};
+
+#endif
@@ -515,6 +515,23 @@ enum
 	kXHCIPortMSC_PortTestControl_Shift = XHCIBitRangePhase(28, 31)
 };
 
+// USB3 PortPMSC
+enum 
+{
+	kXHCIPortMSC_U1Timeout_Mask = XHCIBitRange(0, 7),				// U1 inactivity timeout, in us
+	kXHCIPortMSC_U1Timeout_Shift = XHCIBitRangePhase(0, 7),
+	
+	kXHCIPortMSC_U2Timeout_Mask = XHCIBitRange(8, 15),				// U2 inactivity timeout, in 256us units
+	kXHCIPortMSC_U2Timeout_Shift = XHCIBitRangePhase(8, 15),
+	
+	kXHCIPortMSC_FLA = kXHCIBit16,									// Force Link PM Accept
+	
+	kXHCIUxTimeoutDisabled = 0x00,
+	kXHCIU1TimeoutMax = 0x7F,
+	kXHCIU2TimeoutMax = 0xFE,
+	kXHCIU2TimeoutUnits = 256										// us per U2 timeout count
+};
+
 // Interrupter
 enum 
 {
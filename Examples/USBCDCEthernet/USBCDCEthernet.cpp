@@ -395,7 +395,7 @@ void com_apple_driver_dts_USBCDCEthernet::commReadComplete(void *obj, void *para
 //		Method:		com_apple_driver_dts_USBCDCEthernet::dataReadComplete
 //
 //		Inputs:		obj - me
-//				param - unused
+//				param - the pipeInBuffers the read was queued with
 //				rc - return code
 //				remaining - what's left
 //
@@ -408,17 +408,23 @@ void com_apple_driver_dts_USBCDCEthernet::commReadComplete(void *obj, void *para
 void com_apple_driver_dts_USBCDCEthernet::dataReadComplete(void *obj, void *param, IOReturn rc, UInt32 remaining)
 {
     com_apple_driver_dts_USBCDCEthernet	*me = (com_apple_driver_dts_USBCDCEthernet*)obj;
-    IOReturn		ior;
+    pipeInBuffers	*inBuf = (pipeInBuffers *)param;
 
     if (rc == kIOReturnSuccess)	// If operation returned ok
     {	
-        ELG(0, me->fMax_Block_Size - remaining, 'dRC+', "dataReadComplete");
+        ELG(inBuf, me->fMax_Block_Size - remaining, 'dRC+', "dataReadComplete");
 		
-        LogData(kUSBIn, (me->fMax_Block_Size - remaining), me->fPipeInBuffer);
+        LogData(kUSBIn, (me->fMax_Block_Size - remaining), inBuf->pipeInBuffer);
 	
             // Move the incoming bytes up the stack
 
-        me->receivePacket(me->fPipeInBuffer, me->fMax_Block_Size - remaining);
+        if (!me->receivePacket(inBuf, me->fMax_Block_Size - remaining))
+        {
+            ELG(0, 0, 'dRb-', "com_apple_driver_dts_USBCDCEthernet::dataReadComplete - Lost the input buffer, read dead");
+            inBuf->dead = true;
+            me->fDataDead = true;
+            return;
+        }
 	
     } else {
         ELG(0, rc, 'dRc-', "com_apple_driver_dts_USBCDCEthernet::dataReadComplete - Read completion io err");
@@ -436,27 +442,53 @@ void com_apple_driver_dts_USBCDCEthernet::dataReadComplete(void *obj, void *para
 	
     if (rc != kIOReturnAborted)
     {
-        ior = me->fInPipe->Read(me->fPipeInMDP, &me->fReadCompletionInfo, NULL);
-        if (ior != kIOReturnSuccess)
-        {
-            ELG(0, ior, 'dRe-', "com_apple_driver_dts_USBCDCEthernet::dataReadComplete - Failed to queue read");
-            if (ior == kIOUSBPipeStalled)
-            {
-                me->fInPipe->Reset();
-                ior = me->fInPipe->Read(me->fPipeInMDP, &me->fReadCompletionInfo, NULL);
-                if (ior != kIOReturnSuccess)
-                {
-                    ELG(0, ior, 'dR--', "com_apple_driver_dts_USBCDCEthernet::dataReadComplete - Failed, read dead");
-                    me->fDataDead = true;
-                }
-            }
-        }
+        me->queueInputRead(inBuf);
     }
 
     return;
 	
 }/* end dataReadComplete */
 
+/****************************************************************************************************/
+//
+//		Method:		com_apple_driver_dts_USBCDCEthernet::queueInputRead
+//
+//		Inputs:		inBuf - the input buffer to read into
+//
+//		Outputs:	Return code - from the Read
+//
+//		Desc:		Queue a read on the BulkIn pipe, marking the buffer dead if that fails
+//
+/****************************************************************************************************/
+
+IOReturn com_apple_driver_dts_USBCDCEthernet::queueInputRead(pipeInBuffers *inBuf)
+{
+    IOReturn		ior;
+
+    ior = fInPipe->Read(inBuf->pipeInMDP, &inBuf->readCompletionInfo, NULL);
+    if (ior != kIOReturnSuccess)
+    {
+        ELG(0, ior, 'qIR-', "com_apple_driver_dts_USBCDCEthernet::queueInputRead - Failed to queue read");
+        if (ior == kIOUSBPipeStalled)
+        {
+            fInPipe->Reset();
+            ior = fInPipe->Read(inBuf->pipeInMDP, &inBuf->readCompletionInfo, NULL);
+        }
+    }
+    
+    if (ior != kIOReturnSuccess)
+    {
+        ELG(0, ior, 'qIR-', "com_apple_driver_dts_USBCDCEthernet::queueInputRead - Failed, read dead");
+        inBuf->dead = true;
+        fDataDead = true;
+    } else {
+        inBuf->dead = false;
+    }
+    
+    return ior;
+	
+}/* end queueInputRead */
+
 /****************************************************************************************************/
 //
 //		Method:		com_apple_driver_dts_USBCDCEthernet::dataWriteComplete
@@ -719,6 +751,16 @@ bool com_apple_driver_dts_USBCDCEthernet::init(OSDictionary *properties)
         fPipeOutBuff[i].pipeOutBuffer = NULL;
         fPipeOutBuff[i].m = NULL;
     }
+    
+    for (i=0; i<kInBufPool; i++)
+    {
+        fPipeInBuff[i].pipeInMDP = NULL;
+        fPipeInBuff[i].pipeInBuffer = NULL;
+        fPipeInBuff[i].m = NULL;
+        fPipeInBuff[i].dead = false;
+    }
+    fInputFlushSource = NULL;
+    fInputQueued = 0;
 
     return true;
 
@@ -1819,6 +1861,7 @@ bool com_apple_driver_dts_USBCDCEthernet::configureInterface(IONetworkInterface
 bool com_apple_driver_dts_USBCDCEthernet::wakeUp()
 {
     IOReturn 	rtn = kIOReturnSuccess;
+    UInt32	i;
 
     ELG(0, 0, 'wkUp', "com_apple_driver_dts_USBCDCEthernet::wakeUp");
     
@@ -1859,13 +1902,14 @@ bool com_apple_driver_dts_USBCDCEthernet::wakeUp()
     }
     if (rtn == kIOReturnSuccess)
     {
-        	// Read the data-in bulk pipe:
+        	// Read the data-in bulk pipe, into each of the input buffers:
 			
-        fReadCompletionInfo.target = this;
-        fReadCompletionInfo.action = dataReadComplete;
-        fReadCompletionInfo.parameter = NULL;
-		
-        rtn = fInPipe->Read(fPipeInMDP, &fReadCompletionInfo, NULL);
+        for (i=0; i<kInBufPool; i++)
+        {
+            rtn = queueInputRead(&fPipeInBuff[i]);
+            if (rtn != kIOReturnSuccess)
+                break;
+        }
 			
         if (rtn == kIOReturnSuccess)
         {
@@ -2086,15 +2130,58 @@ bool com_apple_driver_dts_USBCDCEthernet::allocateResources()
         ELG(0, fCommPipeBuffer, 'cBuf', "com_apple_driver_dts_USBCDCEthernet::allocateResources - comm buffer");
     }
 
-        // Allocate Memory Descriptor Pointer with memory for the data-in bulk pipe:
-
-    fPipeInMDP = IOBufferMemoryDescriptor::withCapacity(fMax_Block_Size, kIODirectionIn);
-    if (!fPipeInMDP)
+        // Set up the data-in bulk pipe pool. If a whole segment fits in a cluster the device reads
+        // straight into mbufs, which go up the stack without being copied
+        
+    fZeroCopyRx = (fMax_Block_Size <= MCLBYTES);
+    for (i=0; i<kInBufPool; i++)
+    {
+        fPipeInBuff[i].readCompletionInfo.target = this;
+        fPipeInBuff[i].readCompletionInfo.action = dataReadComplete;
+        fPipeInBuff[i].readCompletionInfo.parameter = &fPipeInBuff[i];
+        fPipeInBuff[i].dead = false;
+        
+        if (fZeroCopyRx)
+        {
+            fPipeInBuff[i].m = NULL;
+            fPipeInBuff[i].pipeInMDP = NULL;
+            if (!setupInputBuffer(&fPipeInBuff[i]))
+            {
+                ELG(0, 0, 'ibf-', "com_apple_driver_dts_USBCDCEthernet::allocateResources - Allocate input mbuf failed");
+                return false;
+            }
+        } else {
+            IOBufferMemoryDescriptor	*inMDP = IOBufferMemoryDescriptor::withCapacity(fMax_Block_Size, kIODirectionIn);
+            
+            if (!inMDP)
+            {
+                ELG(0, 0, 'ibf-', "com_apple_driver_dts_USBCDCEthernet::allocateResources - Allocate input descriptor failed");
+                return false;
+            }
+            inMDP->setLength(fMax_Block_Size);
+            fPipeInBuff[i].pipeInMDP = inMDP;
+            fPipeInBuff[i].pipeInBuffer = (UInt8*)inMDP->getBytesNoCopy();
+        }
+        ELG(fPipeInBuff[i].pipeInMDP, fPipeInBuff[i].pipeInBuffer, 'iBuf', "com_apple_driver_dts_USBCDCEthernet::allocateResources - input buffer");
+    }
+    
+        // Received packets are queued on the interface and handed to the stack together, once the
+        // USB workloop has finished delivering the current burst of read completions
+        
+    fInputQueued = 0;
+    fInputFlushSource = IOInterruptEventSource::interruptEventSource(this, inputFlush);
+    if (!fInputFlushSource)
+    {
+        ELG(0, 0, 'ifs-', "com_apple_driver_dts_USBCDCEthernet::allocateResources - Allocate input flush event source failed");
         return false;
-		
-    fPipeInMDP->setLength(fMax_Block_Size);
-    fPipeInBuffer = (UInt8*)fPipeInMDP->getBytesNoCopy();
-    ELG(0, fPipeInBuffer, 'iBuf', "com_apple_driver_dts_USBCDCEthernet::allocateResources - input buffer");
+    }
+    if (fpDevice->getWorkLoop()->addEventSource(fInputFlushSource) != kIOReturnSuccess)
+    {
+        ELG(0, 0, 'ifs-', "com_apple_driver_dts_USBCDCEthernet::allocateResources - Add input flush event source failed");
+        fInputFlushSource->release();
+        fInputFlushSource = NULL;
+        return false;
+    }
     
         // Allocate Memory Descriptor Pointers with memory for the data-out bulk pipe pool
 
@@ -2143,11 +2230,33 @@ void com_apple_driver_dts_USBCDCEthernet::releaseResources()
         }
     }
 	
-    if (fPipeInMDP  )	
-    { 
-        fPipeInMDP->release();	
-        fPipeInMDP = 0; 
+    for (i=0; i<kInBufPool; i++)
+    {
+        if (fPipeInBuff[i].pipeInMDP)	
+        { 
+            fPipeInBuff[i].pipeInMDP->release();	
+            fPipeInBuff[i].pipeInMDP = NULL;
+        }
+        if (fPipeInBuff[i].m)
+        {
+            freePacket(fPipeInBuff[i].m);
+            fPipeInBuff[i].m = NULL;
+        }
+        fPipeInBuff[i].pipeInBuffer = NULL;
+    }
+    
+    if (fInputFlushSource)
+    {
+        if (fInputFlushSource->getWorkLoop())
+            fInputFlushSource->getWorkLoop()->removeEventSource(fInputFlushSource);
+        fInputFlushSource->release();
+        fInputFlushSource = NULL;
+    }
+    if (fInputQueued && fNetworkInterface)
+    {
+        fNetworkInterface->flushInputQueue();
     }
+    fInputQueued = 0;
 	
     if (fCommPipeMDP)	
     { 
@@ -2460,23 +2569,65 @@ IOReturn com_apple_driver_dts_USBCDCEthernet::clearPipeStall(IOUSBPipe *thePipe)
 
 }/* end clearPipeStall */
 
+/****************************************************************************************************/
+//
+//		Method:		com_apple_driver_dts_USBCDCEthernet::setupInputBuffer
+//
+//		Inputs:		inBuf - the input buffer, with a new mbuf in it (or none, in which case one is allocated)
+//
+//		Outputs:	Return code - true(ready for a read), false(failed)
+//
+//		Desc:		Give the input buffer a memory descriptor for its mbuf's cluster. On failure
+//				it is left without one and the port resume path tries again
+//
+/****************************************************************************************************/
+
+bool com_apple_driver_dts_USBCDCEthernet::setupInputBuffer(pipeInBuffers *inBuf)
+{
+    
+        // The old descriptor describes an mbuf which has gone up the stack, so it can't be used again
+    
+    if (inBuf->pipeInMDP)
+    {
+        inBuf->pipeInMDP->release();
+        inBuf->pipeInMDP = NULL;
+    }
+    
+    if (!inBuf->m)
+    {
+        inBuf->m = allocatePacket(fMax_Block_Size);
+        if (!inBuf->m)
+        {
+            inBuf->pipeInBuffer = NULL;
+            return false;
+        }
+    }
+    
+    inBuf->pipeInBuffer = mtod(inBuf->m, UInt8 *);
+    inBuf->pipeInMDP = IOMemoryDescriptor::withAddressRange((mach_vm_address_t)inBuf->pipeInBuffer, fMax_Block_Size, kIODirectionIn, kernel_task);
+    
+    return (inBuf->pipeInMDP != NULL);
+	
+}/* end setupInputBuffer */
+
 /****************************************************************************************************/
 //
 //		Method:		com_apple_driver_dts_USBCDCEthernet::receivePacket
 //
-//		Inputs:		packet - the packet
+//		Inputs:		inBuf - the input buffer holding the packet
 //				size - Number of bytes in the packet
 //
-//		Outputs:	
+//		Outputs:	Return code - true(the buffer can be read into again), false(it has no memory)
 //
-//		Desc:		Build the mbufs and then send to the network stack.
+//		Desc:		Queue the packet on the interface, without copying it if the read went
+//				straight into an mbuf. The queue is flushed up the stack by inputFlush.
 //
 /****************************************************************************************************/
 
-void com_apple_driver_dts_USBCDCEthernet::receivePacket(UInt8 *packet, UInt32 size)
+bool com_apple_driver_dts_USBCDCEthernet::receivePacket(pipeInBuffers *inBuf, UInt32 size)
 {
     struct mbuf		*m;
-    UInt32		submit;
+    bool		replaced = false;
     
     ELG(0, size, 'rcPk', "com_apple_driver_dts_USBCDCEthernet::receivePacket");
     
@@ -2485,15 +2636,30 @@ void com_apple_driver_dts_USBCDCEthernet::receivePacket(UInt8 *packet, UInt32 si
         ELG(0, 0, 'rcP-', "com_apple_driver_dts_USBCDCEthernet::receivePacket - Packet size error, packet dropped");
         if (fInputErrsOK)
             fpNetStats->inputErrors++;
-        return;
+        return true;
+    }
+    
+    if (inBuf->m)
+    {
+            // Small packets are still copied, anything bigger goes up in the mbuf it was read
+            // into and a new one takes its place
+            
+        m = replaceOrCopyPacket(&inBuf->m, size, &replaced);
+    } else {
+        m = allocatePacket(size);
+        if (m)
+        {
+            bcopy(inBuf->pipeInBuffer, mtod(m, unsigned char *), size);
+        }
     }
     
-    m = allocatePacket(size);
     if (m)
     {
-        bcopy(packet, mtod(m, unsigned char *), size);
-        submit = fNetworkInterface->inputPacket(m, size);
-        ELG(0, submit, 'rcSb', "com_apple_driver_dts_USBCDCEthernet::receivePacket - Packets submitted");
+        fNetworkInterface->inputPacket(m, size, IONetworkInterface::kInputOptionQueuePacket);
+        if (fInputQueued++ == 0)
+        {
+            fInputFlushSource->interruptOccurred(0, 0, 0);
+        }
         if (fInputPktsOK)
             fpNetStats->inputPackets++;
     } else {
@@ -2501,9 +2667,43 @@ void com_apple_driver_dts_USBCDCEthernet::receivePacket(UInt8 *packet, UInt32 si
         if (fInputErrsOK)
             fpNetStats->inputErrors++;
     }
+    
+    if (replaced)
+    {
+        return setupInputBuffer(inBuf);
+    }
+    
+    return true;
 
 }/* end receivePacket */
 
+/****************************************************************************************************/
+//
+//		Method:		com_apple_driver_dts_USBCDCEthernet::inputFlush
+//
+//		Inputs:		owner - me
+//
+//		Outputs:	
+//
+//		Desc:		Runs on the USB workloop after it has delivered a burst of read completions,
+//				and hands all the packets they queued to the network stack at once.
+//
+/****************************************************************************************************/
+
+void com_apple_driver_dts_USBCDCEthernet::inputFlush(OSObject *owner, IOInterruptEventSource * /*sender*/, int /*count*/)
+{
+    com_apple_driver_dts_USBCDCEthernet	*me = (com_apple_driver_dts_USBCDCEthernet*)owner;
+    UInt32		submit;
+    
+    if (!me->fInputQueued || !me->fNetworkInterface)
+        return;
+    
+    submit = me->fNetworkInterface->flushInputQueue();
+    ELG(me->fInputQueued, submit, 'rcSb', "com_apple_driver_dts_USBCDCEthernet::inputFlush - Packets submitted");
+    me->fInputQueued = 0;
+
+}/* end inputFlush */
+
 /****************************************************************************************************/
 //
 //		Method:		com_apple_driver_dts_USBCDCEthernet::timeoutFired
@@ -2716,6 +2916,7 @@ void com_apple_driver_dts_USBCDCEthernet::timeoutOccurred(IOTimerEventSource * /
 IOReturn com_apple_driver_dts_USBCDCEthernet::message(UInt32 type, IOService *provider, void *argument)
 {
     IOReturn	ior;
+    UInt32	i;
 	
     ELG(0, type, 'mess', "com_apple_driver_dts_USBCDCEthernet::message");
 	
@@ -2794,12 +2995,25 @@ IOReturn com_apple_driver_dts_USBCDCEthernet::message(UInt32 type, IOService *pr
             
             if (fDataDead)
             {
-                ior = fInPipe->Read(fPipeInMDP, &fReadCompletionInfo, NULL);
-                if (ior != kIOReturnSuccess)
+                fDataDead = false;
+                for (i=0; i<kInBufPool; i++)
                 {
-                    ELG(0, ior, 'msD-', "com_apple_driver_dts_USBCDCEthernet::message - Failed to queue Data pipe read");
-                } else {
-                    fDataDead = false;
+                    if (fPipeInBuff[i].dead)
+                    {
+                            // A buffer which lost its mbuf or descriptor gets another go at allocating them
+                        
+                        if (!fPipeInBuff[i].pipeInMDP && (!fZeroCopyRx || !setupInputBuffer(&fPipeInBuff[i])))
+                        {
+                            ELG(0, 0, 'msB-', "com_apple_driver_dts_USBCDCEthernet::message - Failed to set up Data pipe buffer");
+                            fDataDead = true;
+                            continue;
+                        }
+                        ior = queueInputRead(&fPipeInBuff[i]);
+                        if (ior != kIOReturnSuccess)
+                        {
+                            ELG(0, ior, 'msD-', "com_apple_driver_dts_USBCDCEthernet::message - Failed to queue Data pipe read");
+                        }
+                    }
                 }
             }
 
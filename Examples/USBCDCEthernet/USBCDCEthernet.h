@@ -93,6 +93,7 @@
 #include <IOKit/network/IOGatedOutputQueue.h>
 
 #include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IOInterruptEventSource.h>
 #include <IOKit/assert.h>
 #include <IOKit/IOLib.h>
 #include <IOKit/IOService.h>
@@ -157,6 +158,7 @@ extern "C"
 
 #define kOutBufPool		6
 #define kOutBuffThreshold	100
+#define kInBufPool		4				// bulk-in reads kept outstanding
 
         // USB CDC Definitions (Ethernet Control Model)
 		
@@ -303,6 +305,15 @@ typedef struct
     struct mbuf			*m;
 } pipeOutBuffers;
 
+typedef struct 
+{
+    IOMemoryDescriptor		*pipeInMDP;		// describes m's cluster, or its own buffer when not zero-copy
+    UInt8			*pipeInBuffer;
+    struct mbuf			*m;			// the mbuf the device reads straight into, NULL when not zero-copy
+    IOUSBCompletion		readCompletionInfo;
+    bool			dead;			// the read could not be queued
+} pipeInBuffers;
+
     // Globals
 
 typedef struct globals      // Globals for this module (not per instance)
@@ -348,6 +359,7 @@ private:
     IONetworkStats		*fpNetStats;
     IOEthernetStats		*fpEtherStats;
     IOTimerEventSource		*fTimerSource;
+    IOInterruptEventSource	*fInputFlushSource;		// on the USB workloop, runs once a burst of read completions is done
     
     OSDictionary		*fMediumDict;
 
@@ -369,12 +381,13 @@ private:
     IOUSBPipe			*fCommPipe;
     
     IOBufferMemoryDescriptor	*fCommPipeMDP;
-    IOBufferMemoryDescriptor	*fPipeInMDP;
 
     UInt8			*fCommPipeBuffer;
-    UInt8			*fPipeInBuffer;
     
+    pipeInBuffers		fPipeInBuff[kInBufPool];
     pipeOutBuffers		fPipeOutBuff[kOutBufPool];
+    bool			fZeroCopyRx;				// reads land in mbuf clusters
+    UInt32			fInputQueued;				// packets queued on the interface but not yet flushed
     
     UInt8			fCommInterfaceNumber;
     UInt8			fDataInterfaceNumber;
@@ -395,7 +408,6 @@ private:
     bool			fOutputErrsOK;
 
     IOUSBCompletion		fCommCompletionInfo;
-    IOUSBCompletion		fReadCompletionInfo;
     IOUSBCompletion		fWriteCompletionInfo;
     IOUSBCompletion		fMERCompletionInfo;
     IOUSBCompletion		fStatsCompletionInfo;
@@ -422,7 +434,10 @@ private:
     bool			USBSetMulticastFilter(IOEthernetAddress *addrs, UInt32 count);
     bool			USBSetPacketFilter(void);
     IOReturn			clearPipeStall(IOUSBPipe *thePipe);
-    void			receivePacket(UInt8 *packet, UInt32 size);
+    bool			setupInputBuffer(pipeInBuffers *inBuf);
+    IOReturn			queueInputRead(pipeInBuffers *inBuf);
+    bool			receivePacket(pipeInBuffers *inBuf, UInt32 size);
+    static void			inputFlush(OSObject *owner, IOInterruptEventSource *sender, int count);
     static void 		timerFired(OSObject *owner, IOTimerEventSource *sender);
     void			timeoutOccurred(IOTimerEventSource *timer);
 
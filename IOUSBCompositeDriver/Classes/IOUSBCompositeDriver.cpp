@@ -29,6 +29,8 @@
 //
 #include <IOKit/usb/IOUSBCompositeDriver.h>
 #include <IOKit/usb/IOUSBControllerV3.h>
+#include <IOKit/usb/IOUSBConfigurationIndex.h>
+#include <IOKit/usb/IOUSBQuirks.h>
 
 #include "USBTracepoints.h"
 
@@ -285,9 +287,16 @@ IOUSBCompositeDriver::ConfigureDevice()
     IOReturn                                err = kIOReturnSuccess;
     UInt8                                   prefConfigValue = 0;
     OSNumber *                              prefConfig = NULL;
+    bool                                    havePrefConfig = false;
+    IOUSBDeviceQuirks                       quirks;
     const IOUSBConfigurationDescriptor *    cd = NULL;
     const IOUSBConfigurationDescriptor *    cdTemp = NULL;
+    IOUSBConfigurationIndex *               configIndex = NULL;         // the validated copy cd points into
+    IOUSBConfigurationIndex *               indexTemp = NULL;
+    IOUSBConfigurationIndex *               prefIndex = NULL;           // the validated copy of the preferred configuration, if the device has it
+    const IOUSBConfigurationDescriptor *    prefDesc = NULL;
     UInt8                                   i;
+    UInt8                                   numberOfValidConfigs = 0;
     SInt16                                  maxPower = -1;
     UInt8                                   numberOfConfigs = 0;
 	bool									issueRemoteWakeup = false;
@@ -298,6 +307,7 @@ IOUSBCompositeDriver::ConfigureDevice()
     if ( prefConfig )
     {
         prefConfigValue = prefConfig->unsigned32BitValue();
+        havePrefConfig = true;
         USBLog(3, "%s[%p](%s)::ConfigureDevice found a preferred configuration (%d)", getName(), this, fDevice->getName(), prefConfigValue );
     }
 	else
@@ -307,10 +317,20 @@ IOUSBCompositeDriver::ConfigureDevice()
 		if ( prefConfig )
 		{
 			prefConfigValue = prefConfig->unsigned32BitValue();
+			havePrefConfig = true;
 			USBLog(3, "%s[%p](%s)::ConfigureDevice found a preferred configuration (%d)", getName(), this, fDevice->getName(), prefConfigValue );
 		}
 	}
     
+    // A quirk entry for a device whose descriptors lead us to the wrong configuration wins over either of those
+    //
+    if ( IOUSBQuirks::GetDeviceQuirks(fDevice, &quirks) && (quirks.quirks & kUSBQuirkForceConfiguration) )
+    {
+        prefConfigValue = quirks.configValue;
+        havePrefConfig = true;
+        USBLog(3, "%s[%p](%s)::ConfigureDevice forcing configuration (%d) from the quirks table", getName(), this, fDevice->getName(), prefConfigValue );
+    }
+    
     // No preferred configuration so, find the first config/interface
     //
     numberOfConfigs = fDevice->GetNumConfigurations();
@@ -371,11 +391,30 @@ IOUSBCompositeDriver::ConfigureDevice()
 				}
             }
             
+            // Only look at what the device sent once it has been validated, and skip a configuration which can't be
+            indexTemp = IOUSBConfigurationIndex::withDescriptorBuffer(cdTemp, USBToHostWord(cdTemp->wTotalLength), fDevice->getName());
+            if ( !indexTemp )
+            {
+                USBLog(1, "%s[%p](%s)::ConfigureDevice Config %d has an invalid configuration descriptor, skipping it", getName(), this, fDevice->getName(), i );
+                continue;
+            }
+            cdTemp = indexTemp->GetConfigurationDescriptor();
+            numberOfValidConfigs++;
+            
+            if ( havePrefConfig && !prefIndex && (cdTemp->bConfigurationValue == prefConfigValue) )
+            {
+                indexTemp->retain();
+                prefIndex = indexTemp;
+            }
+            
             // Get the MaxPower for this configuration.  If we have enough power for it AND it's greater than our previous power
             // then use this config
             if ( (fDevice->GetBusPowerAvailable() >= cdTemp->MaxPower) && ( ((SInt16)cdTemp->MaxPower) > maxPower) )
             {
                 USBLog(5,"%s[%p](%s)::ConfigureDevice Config %d with MaxPower %d", getName(), this, fDevice->getName(), i, cdTemp->MaxPower );
+                if ( configIndex )
+                    configIndex->release();
+                configIndex = indexTemp;
                 cd = cdTemp;
                 maxPower = (SInt16) cdTemp->MaxPower;
             }
@@ -383,9 +422,19 @@ IOUSBCompositeDriver::ConfigureDevice()
             {
                 USBLog(5,"%s[%p](%s)::ConfigureDevice Config %d with MaxPower %d cannot be used (available: %d, previous %d)", getName(), this, fDevice->getName(), i, cdTemp->MaxPower, (uint32_t)fDevice->GetBusPowerAvailable(), maxPower );
 				fDevice->setProperty("Failed Requested Power", cdTemp->MaxPower, 32);
+                indexTemp->release();
           }
         }
         
+        // A device none of whose configurations could be parsed is not short of power, so don't tell the user it is
+        //
+        if ( numberOfValidConfigs == 0 )
+        {
+            USBError(1, "%s(%s)::ConfigureDevice none of the %d configuration descriptors is valid", getName(), fDevice->getName(), numberOfConfigs );
+            err = kIOUSBConfigNotFound;
+            goto ErrorExit;
+        }
+        
 		if ( !cd )
         {
 			USBError(1,"USB Low Power Notice:  The device \"%s\" cannot be used because there is not enough power to configure it",fDevice->getName());
@@ -445,6 +494,20 @@ IOUSBCompositeDriver::ConfigureDevice()
                 }
             }
         }
+        
+        configIndex = IOUSBConfigurationIndex::withDescriptorBuffer(cd, USBToHostWord(cd->wTotalLength), fDevice->getName());
+        if ( !configIndex )
+        {
+            USBError(1, "%s(%s)::ConfigureDevice the configuration descriptor is invalid", getName(), fDevice->getName() );
+            err = kIOUSBConfigNotFound;
+            goto ErrorExit;
+        }
+        cd = configIndex->GetConfigurationDescriptor();
+        if ( havePrefConfig && (cd->bConfigurationValue == prefConfigValue) )
+        {
+            configIndex->retain();
+            prefIndex = configIndex;
+        }
     }
     
     // Open our device so that we can configure it
@@ -458,12 +521,13 @@ IOUSBCompositeDriver::ConfigureDevice()
     
     // Save our configuration value
     //
-    fConfigValue = prefConfig ? prefConfigValue : cd->bConfigurationValue;
+    fConfigValue = havePrefConfig ? prefConfigValue : cd->bConfigurationValue;
     
-    // Get the remote wakeup feature if it's supported (there is a bug here where if we have a prefConfig, we are not looking for
-	// the atributes of the pref config, but instead we look at the default's config attributes)
+    // Get the remote wakeup feature if it's supported, from the configuration we are going to set.  All of the descriptors we look at
+    // from here on are the validated copies, never what GetFullConfigurationDescriptor handed back
     //
-    fConfigbmAttributes = cd->bmAttributes;
+    prefDesc = prefIndex ? prefIndex->GetConfigurationDescriptor() : NULL;
+    fConfigbmAttributes = prefDesc ? prefDesc->bmAttributes : cd->bmAttributes;
     if (fConfigbmAttributes & kUSBAtrRemoteWakeup)
     {
 		fIOUSBCompositeExpansionData->fIssueRemoteWakeup = true;
@@ -490,13 +554,14 @@ IOUSBCompositeDriver::ConfigureDevice()
     err = SetConfiguration(fConfigValue, true);
     if (err)
     {
-        USBError(1, "%s(%s)::ConfigureDevice SetConfiguration (%d) returned 0x%x", getName(), fDevice->getName(), (prefConfig ? prefConfigValue : cd->bConfigurationValue), err );
+        USBError(1, "%s(%s)::ConfigureDevice SetConfiguration (%d) returned 0x%x", getName(), fDevice->getName(), (havePrefConfig ? prefConfigValue : cd->bConfigurationValue), err );
         
         // If we tried a "Preferred Configuration" then attempt to set the configuration to the default one:
         //
-        if ( prefConfig )
+        if ( havePrefConfig )
         {
             fConfigValue = cd->bConfigurationValue;
+            fConfigbmAttributes = cd->bmAttributes;
             err = SetConfiguration(fConfigValue, true);
             USBError(1, "%s(%s)::ConfigureDevice SetConfiguration (%d) returned 0x%x", getName(), fDevice->getName(), cd->bConfigurationValue, err );
         }
@@ -512,7 +577,6 @@ IOUSBCompositeDriver::ConfigureDevice()
 	{
 		// Set the remote wakeup feature if it's supported
 		//
-		fConfigbmAttributes = cd->bmAttributes;
 		if (fConfigbmAttributes & kUSBAtrRemoteWakeup  && (fDevice->GetSpeed() != kUSBDeviceSpeedSuper))
 		{
 			USBLog(3,"%s[%p]::ConfigureDevice Setting kUSBFeatureDeviceRemoteWakeup for device: %s", getName(), this, fDevice->getName());
@@ -556,12 +620,19 @@ IOUSBCompositeDriver::ConfigureDevice()
     fExpectingClose = true;
     fDevice->close(this);
     
+    if ( prefIndex )
+        prefIndex->release();
+    configIndex->release();
     return true;
     
 ErrorExit:
         
         USBLog(3, "%s[%p]::start aborting startup (0x%x)", getName(), this, err );
     
+    if ( prefIndex )
+        prefIndex->release();
+    if ( configIndex )
+        configIndex->release();
     return false;
     
 }
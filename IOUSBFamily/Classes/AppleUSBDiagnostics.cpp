@@ -20,10 +20,17 @@
  * @APPLE_LICENSE_HEADER_END@
  */
 
+#include <libkern/OSAtomic.h>
+#include <IOKit/IOWorkLoop.h>
+
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+#include <IOKit/usb/IOUSBLogRateLimit.h>
+
 #include "AppleUSBDiagnostics.h"
 #include "USBTracepoints.h"
 
 OSDefineMetaClassAndStructors(AppleUSBDiagnostics, OSObject)
+OSDefineMetaClassAndStructors(AppleUSBDiagnosticsNub, IOService)
 
 OSObject * AppleUSBDiagnostics::createDiagnostics( UIMDiagnostics* obj, UInt32 *controlBulkTransactionsOut, IOService *controller)
 {
@@ -40,6 +47,8 @@ OSObject * AppleUSBDiagnostics::initDiagnostics(AppleUSBDiagnostics *diagnostics
 		diagnostics->release();
 		diagnostics = NULL;
 	}
+	if( !diagnostics )
+		return NULL;
 	
 	diagnostics->_UIMDiagnostics		= obj;
 	diagnostics->_controlBulkTransactionsOut		= controlBulkTransactionsOut;
@@ -47,30 +56,320 @@ OSObject * AppleUSBDiagnostics::initDiagnostics(AppleUSBDiagnostics *diagnostics
 	
 	bzero(obj, sizeof(UIMDiagnostics));
 	
+	diagnostics->_registrySnapshot = (RegistrySnapshot *)IOMalloc(sizeof(RegistrySnapshot));
+	if( !diagnostics->_registrySnapshot )
+	{
+		diagnostics->release();
+		return NULL;
+	}
+	bzero(diagnostics->_registrySnapshot, sizeof(RegistrySnapshot));
+	
+	diagnostics->_registryLock = IOLockAlloc();
+	if( !diagnostics->_registryLock )
+	{
+		diagnostics->release();
+		return NULL;
+	}
+	
+	// the shared page is optional - without it we still have the registry
+	diagnostics->_sharedBuffer = IOBufferMemoryDescriptor::withOptions(kIOMemoryKernelUserShared | kIODirectionOut, round_page(sizeof(SharedDiagnostics)), page_size);
+	if( diagnostics->_sharedBuffer )
+	{
+		diagnostics->_shared = (SharedDiagnostics *)diagnostics->_sharedBuffer->getBytesNoCopy();
+		bzero(diagnostics->_shared, diagnostics->_sharedBuffer->getLength());
+		diagnostics->_shared->version = kSharedDiagnosticsVersion;
+		diagnostics->_shared->length = sizeof(SharedDiagnostics);
+	}
+	else
+	{
+		USBError(1, "AppleUSBDiagnostics[%p]::initDiagnostics - could not allocate the shared page", diagnostics);
+	}
+	
+	// the controller's user client can't hand out the page, so give a diagnostics tool something of our own to open
+	if( diagnostics->_shared && controller )
+	{
+		diagnostics->_nub = AppleUSBDiagnosticsNub::withDiagnostics(diagnostics);
+		if( diagnostics->_nub && diagnostics->_nub->attach(controller) )
+		{
+			diagnostics->_nub->registerService();
+		}
+		else if( diagnostics->_nub )
+		{
+			USBError(1, "AppleUSBDiagnostics[%p]::initDiagnostics - could not attach the nub to %p", diagnostics, controller);
+			diagnostics->_nub->detachDiagnostics();
+			diagnostics->_nub->release();
+			diagnostics->_nub = NULL;
+		}
+	}
+	
 	return diagnostics;
 }
 
+
+
+void AppleUSBDiagnostics::free(void)
+{
+	// first, so that no user client can get at us while we come apart
+	if( _nub )
+	{
+		_nub->detachDiagnostics();
+		_nub->terminate();
+		_nub->release();
+		_nub = NULL;
+	}
+	if( _sharedTimer )
+	{
+		_sharedTimer->cancelTimeout();
+		if( _sharedTimer->getWorkLoop() )
+			_sharedTimer->getWorkLoop()->removeEventSource(_sharedTimer);
+		_sharedTimer->release();
+		_sharedTimer = NULL;
+	}
+	if( _sharedBuffer )
+	{
+		_sharedBuffer->release();
+		_sharedBuffer = NULL;
+		_shared = NULL;
+	}
+	if( _registrySnapshot )
+	{
+		IOFree(_registrySnapshot, sizeof(RegistrySnapshot));
+		_registrySnapshot = NULL;
+	}
+	if( _registryLock )
+	{
+		IOLockFree(_registryLock);
+		_registryLock = NULL;
+	}
+	OSObject::free();
+}
+
+
+
+IOMemoryDescriptor * AppleUSBDiagnostics::copySharedMemory(void)
+{
+	IOWorkLoop *	workLoop = _controller ? _controller->getWorkLoop() : NULL;
+	
+	if( !_sharedBuffer )
+		return NULL;
+	
+	// nobody pays for the updates until somebody is looking at the page. Two clients can arrive at once, and only one of
+	// them may make the timer
+	IOLockLock(_registryLock);
+	if( !_sharedTimer && workLoop )
+	{
+		_sharedTimer = IOTimerEventSource::timerEventSource(this, SharedTimerFired);
+		if( _sharedTimer && (workLoop->addEventSource(_sharedTimer) != kIOReturnSuccess) )
+		{
+			_sharedTimer->release();
+			_sharedTimer = NULL;
+		}
+	}
+	IOLockUnlock(_registryLock);
+	
+	OSIncrementAtomic(&_sharedClients);
+	
+	// the update is always done on the work loop (so there is only one writer) unless there is no work loop to do it on
+	if( _sharedTimer )
+		_sharedTimer->setTimeoutMS(0);
+	else
+		updateSharedMemory();
+	
+	_sharedBuffer->retain();
+	return _sharedBuffer;
+}
+
+
+
+void AppleUSBDiagnostics::releaseSharedMemory(void)
+{
+	SInt32		clients;
+	
+	clients = OSDecrementAtomic(&_sharedClients);
+	if( clients <= 0 )
+	{
+		USBError(1, "AppleUSBDiagnostics[%p]::releaseSharedMemory - not balanced with copySharedMemory", this);
+		OSIncrementAtomic(&_sharedClients);
+		return;
+	}
+	
+	// the last mapping is gone, so stop waking up to update it. If the timer is running right now it may still arm once more,
+	// but that update sees no clients and doesn't arm again
+	if( (clients == 1) && _sharedTimer )
+		_sharedTimer->cancelTimeout();
+}
+
+
+
+AppleUSBDiagnosticsNub * AppleUSBDiagnosticsNub::withDiagnostics(AppleUSBDiagnostics *diagnostics)
+{
+	AppleUSBDiagnosticsNub *	nub = new AppleUSBDiagnosticsNub;
+	
+	if( nub && !nub->init() )
+	{
+		nub->release();
+		nub = NULL;
+	}
+	if( !nub )
+		return NULL;
+	
+	nub->_lock = IOLockAlloc();
+	if( !nub->_lock )
+	{
+		nub->release();
+		return NULL;
+	}
+	nub->_diagnostics = diagnostics;
+	nub->setProperty("IOUserClientClass", kAppleUSBDiagnosticsUserClientClass);
+	
+	return nub;
+}
+
+
+
+IOMemoryDescriptor * AppleUSBDiagnosticsNub::copySharedMemory(void)
+{
+	IOMemoryDescriptor *	memory = NULL;
+	
+	IOLockLock(_lock);
+	if( _diagnostics )
+		memory = _diagnostics->copySharedMemory();
+	IOLockUnlock(_lock);
+	
+	return memory;
+}
+
+
+
+void AppleUSBDiagnosticsNub::releaseSharedMemory(void)
+{
+	IOLockLock(_lock);
+	if( _diagnostics )
+		_diagnostics->releaseSharedMemory();
+	IOLockUnlock(_lock);
+}
+
+
+
+// once the diagnostics are gone there is nothing to update the page, or to balance a release against
+void AppleUSBDiagnosticsNub::detachDiagnostics(void)
+{
+	IOLockLock(_lock);
+	_diagnostics = NULL;
+	IOLockUnlock(_lock);
+}
+
+
+
+void AppleUSBDiagnosticsNub::free(void)
+{
+	if( _lock )
+	{
+		IOLockFree(_lock);
+		_lock = NULL;
+	}
+	IOService::free();
+}
+
+
+
+void AppleUSBDiagnostics::SharedTimerFired(OSObject *owner, IOTimerEventSource *sender)
+{
+	AppleUSBDiagnostics *	me = OSDynamicCast(AppleUSBDiagnostics, owner);
+	
+	if( !me )
+		return;
+	
+	me->updateSharedMemory();
+	if( me->_sharedClients > 0 )
+		sender->setTimeoutMS(kSharedDiagnosticsUpdateMS);
+}
+
+
+
+void AppleUSBDiagnostics::updateSharedMemory(void) const
+{
+	SharedDiagnostics *		shared = _shared;
+	UInt32					generation;
+	AbsoluteTime			now;
+	UInt64					nanosec;
+	int						numPorts;
+	
+	if( !shared )
+		return;
+	
+	clock_get_uptime(&now);
+	absolutetime_to_nanoseconds(now, &nanosec);
+	
+	numPorts = _UIMDiagnostics->numPorts;
+	if( numPorts > kDiagMaxPorts )
+		numPorts = kDiagMaxPorts;
+	
+	// odd while we are writing, so that a reader can tell that its copy is torn
+	generation = shared->generation;
+	shared->generation = generation + 1;
+	OSMemoryBarrier();
+	
+	shared->numPorts = numPorts;
+	shared->updateNanosec = nanosec;
+	shared->totalBytes = _UIMDiagnostics->totalBytes;
+	shared->totalErrors = _UIMDiagnostics->totalErrors;
+	shared->timeouts = _UIMDiagnostics->timeouts;
+	shared->resets = _UIMDiagnostics->resets;
+	shared->recoveredErrors = _UIMDiagnostics->recoveredErrors;
+	shared->errors2Strikes = _UIMDiagnostics->errors2Strikes;
+	shared->errors3Strikes = _UIMDiagnostics->errors3Strikes;
+	shared->controlBulkTxOut = _controlBulkTransactionsOut ? *_controlBulkTransactionsOut : 0;
+	shared->overFlowPortErrorCount = _UIMDiagnostics->overFlowPortErrorCount;
+	
+	for(int i=0; i<numPorts; i++)
+	{
+		UIMPortDiagnostics *		counts = &_UIMDiagnostics->portCounts[i];
+		SharedPortDiagnostics *		port = &shared->ports[i];
+		
+		port->totalBytes = counts->totalBytes;
+		port->errorCount = counts->errorCount;
+		port->timeouts = counts->timeouts;
+		port->resets = counts->resets;
+		port->enable = counts->enable;
+		port->suspend = counts->suspend;
+		port->resume = counts->resume;
+		port->warmReset = counts->warmReset;
+		port->power = counts->power;
+		port->u1Timeout = counts->u1Timeout;
+		port->u2Timeout = counts->u2Timeout;
+		port->remoteWakeMask = counts->remoteWakeMask;
+		bcopy(counts->linkState, port->linkState, sizeof(port->linkState));
+	}
+	
+	OSMemoryBarrier();
+	shared->generation = generation + 2;
+}
+
 void AppleUSBDiagnostics::serializePort(OSDictionary *dictionary, int port, UIMPortDiagnostics *counts, IOService *controller) const
 {
-#pragma unused(controller, port)
+#pragma unused(controller)
+    RegistryPortSnapshot	*prev = &_registrySnapshot->ports[port];
+    UInt64					bytes = counts->totalBytes;
+    UInt32					timeouts = counts->timeouts;
+    UInt32					resets = counts->resets;
     
     UpdateNumberEntry( dictionary, counts->errorCount, "Port errors");
 
     if( (gUSBStackDebugFlags & kUSBEnableErrorLogMask) != 0)
     {
-        UpdateNumberEntry( dictionary, counts->totalBytes, "Bytes");
-        UpdateNumberEntry( dictionary, counts->totalBytes-counts->prevBytes, "Bytes (New)");
+        UpdateNumberEntry( dictionary, bytes, "Bytes");
+        UpdateNumberEntry( dictionary, bytes-prev->bytes, "Bytes (New)");
+        prev->bytes = bytes;
         
-        counts->prevBytes = counts->totalBytes;
-        
-        UpdateNumberEntry( dictionary, counts->timeouts, "Timeouts");
-        UpdateNumberEntry( dictionary, counts->timeouts-counts->prevTimeouts, "Timeouts (New)");
-        counts->prevTimeouts = counts->timeouts;
+        UpdateNumberEntry( dictionary, timeouts, "Timeouts");
+        UpdateNumberEntry( dictionary, timeouts-prev->timeouts, "Timeouts (New)");
+        prev->timeouts = timeouts;
     }
         
-    UpdateNumberEntry( dictionary, counts->resets, "Resets");
-    UpdateNumberEntry( dictionary, counts->resets-counts->prevResets, "Resets (New)");
-    counts->prevResets = counts->resets;
+    UpdateNumberEntry( dictionary, resets, "Resets");
+    UpdateNumberEntry( dictionary, resets-prev->resets, "Resets (New)");
+    prev->resets = resets;
     
     UpdateNumberEntry( dictionary, counts->enable, "enable");
     UpdateNumberEntry( dictionary, counts->suspend, "suspend");
@@ -111,6 +410,15 @@ bool AppleUSBDiagnostics::serialize( OSSerialize * s ) const
 	UInt64			currms;
 	UInt32			deltams;
 	AbsoluteTime	now;
+	RegistrySnapshot *	prev = _registrySnapshot;
+	UInt64			bytes;
+	UInt32			count;
+	int				numPorts;
+	UInt32			blocks, elements, wastedBytes;
+	OSDictionary *	memoryTypes;
+	UInt64			suppressedMessages;
+	UInt32			suppressingSites;
+	OSNumber *		number;
 	
 	dictionary = OSDictionary::withCapacity( 4 );
 	if( !dictionary )
@@ -118,33 +426,42 @@ bool AppleUSBDiagnostics::serialize( OSSerialize * s ) const
 
 	USBLog(6, "AppleUSBDiagnostics[%p]::serialize", this);
 	
-	_UIMDiagnostics->acessCount++;
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->acessCount, "Access Count");
+	// none of this writes to the UIM's counters, so the shared page readers are not affected by registry readers. The snapshot is
+	// ours though, and two registry readers at once would tear it
+	IOLockLock(_registryLock);
+	prev->acessCount++;
+	UpdateNumberEntry( dictionary, prev->acessCount, "Access Count");
 
-	
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->totalErrors, "Errors (Total)");
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->totalErrors-_UIMDiagnostics->prevErrors, "Errors (New)");
-	_UIMDiagnostics->prevErrors = _UIMDiagnostics->totalErrors;
+	count = _UIMDiagnostics->totalErrors;
+	UpdateNumberEntry( dictionary, count, "Errors (Total)");
+	UpdateNumberEntry( dictionary, count-prev->errors, "Errors (New)");
+	prev->errors = count;
 
 	UpdateNumberEntry( dictionary, gUSBStackDebugFlags, "Debug Flags");
 	if( (gUSBStackDebugFlags & kUSBEnableErrorLogMask) != 0)
 	{
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->recoveredErrors, "Recovered Errors");
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->recoveredErrors-_UIMDiagnostics->prevRecoveredErrors, "Recovered Errors (New)");
-		_UIMDiagnostics->prevRecoveredErrors = _UIMDiagnostics->recoveredErrors;
+		count = _UIMDiagnostics->recoveredErrors;
+		UpdateNumberEntry( dictionary, count, "Recovered Errors");
+		UpdateNumberEntry( dictionary, count-prev->recoveredErrors, "Recovered Errors (New)");
+		prev->recoveredErrors = count;
 		
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->errors2Strikes, "Recovered 2 strike errors");
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->errors2Strikes-_UIMDiagnostics->prevErrors2Strikes, "Recovered 2 strike errors (New)");
-		_UIMDiagnostics->prevErrors2Strikes = _UIMDiagnostics->errors2Strikes;
+		count = _UIMDiagnostics->errors2Strikes;
+		UpdateNumberEntry( dictionary, count, "Recovered 2 strike errors");
+		UpdateNumberEntry( dictionary, count-prev->errors2Strikes, "Recovered 2 strike errors (New)");
+		prev->errors2Strikes = count;
 		
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->errors3Strikes, "Fatal 3 strike errors");
-		UpdateNumberEntry( dictionary, _UIMDiagnostics->errors3Strikes-_UIMDiagnostics->prevErrors3Strikes, "Fatal 3 strike errors (New)");
-		_UIMDiagnostics->prevErrors3Strikes = _UIMDiagnostics->errors3Strikes;
+		count = _UIMDiagnostics->errors3Strikes;
+		UpdateNumberEntry( dictionary, count, "Fatal 3 strike errors");
+		UpdateNumberEntry( dictionary, count-prev->errors3Strikes, "Fatal 3 strike errors (New)");
+		prev->errors3Strikes = count;
         
-        if(_UIMDiagnostics->numPorts)
+		numPorts = _UIMDiagnostics->numPorts;
+		if(numPorts > kDiagMaxPorts)
+			numPorts = kDiagMaxPorts;
+        if(numPorts > 0)
         {
-            UpdateNumberEntry( dictionary, _UIMDiagnostics->numPorts, "Number of ports");
-            for(int i=0; i<_UIMDiagnostics->numPorts; i++)
+            UpdateNumberEntry( dictionary, numPorts, "Number of ports");
+            for(int i=0; i<numPorts; i++)
             {
                 char buf[64];
                 OSDictionary * portDictionary = OSDictionary::withCapacity(1);
@@ -160,34 +477,52 @@ bool AppleUSBDiagnostics::serialize( OSSerialize * s ) const
 	clock_get_uptime(&now);
 	absolutetime_to_nanoseconds(now, &currms);
 	
-	deltams = ((currms-_UIMDiagnostics->lastNanosec)/1000000)+1;	// +1 so this is never zero, makes little difference if delta ms is large
+	deltams = ((currms-prev->lastNanosec)/1000000)+1;	// +1 so this is never zero, makes little difference if delta ms is large
 	UpdateNumberEntry( dictionary, currms/1000000, "ms (Current)");
 	UpdateNumberEntry( dictionary, deltams, "ms (since last read)");
-	_UIMDiagnostics->lastNanosec = currms;
+	prev->lastNanosec = currms;
 	
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->totalBytes, "Bytes");
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->totalBytes-_UIMDiagnostics->prevBytes, "Bytes (New)");
-	UpdateNumberEntry( dictionary, (_UIMDiagnostics->totalBytes-_UIMDiagnostics->prevBytes)/deltams, "Bytes (New)/ms");
+	bytes = _UIMDiagnostics->totalBytes;
+	UpdateNumberEntry( dictionary, bytes, "Bytes");
+	UpdateNumberEntry( dictionary, bytes-prev->bytes, "Bytes (New)");
+	UpdateNumberEntry( dictionary, (bytes-prev->bytes)/deltams, "Bytes (New)/ms");
+	prev->bytes = bytes;
 
-	_UIMDiagnostics->prevBytes = _UIMDiagnostics->totalBytes;
-
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->timeouts, "Timeouts");
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->timeouts-_UIMDiagnostics->prevTimeouts, "Timeouts (New)");
-	_UIMDiagnostics->prevTimeouts = _UIMDiagnostics->timeouts;
+	count = _UIMDiagnostics->timeouts;
+	UpdateNumberEntry( dictionary, count, "Timeouts");
+	UpdateNumberEntry( dictionary, count-prev->timeouts, "Timeouts (New)");
+	prev->timeouts = count;
 	
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->resets, "Resets");
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->resets-_UIMDiagnostics->prevResets, "Resets (New)");
-	_UIMDiagnostics->prevResets = _UIMDiagnostics->resets;
+	count = _UIMDiagnostics->resets;
+	UpdateNumberEntry( dictionary, count, "Resets");
+	UpdateNumberEntry( dictionary, count-prev->resets, "Resets (New)");
+	prev->resets = count;
 
-    if(_controlBulkTransactionsOut)
-    {   // EHCI keeps a note of this separately, maybe it should be in the diagnostics struct
-        _UIMDiagnostics->controlBulkTxOut = *_controlBulkTransactionsOut;
-    }
-    else
-    {
-        _UIMDiagnostics->controlBulkTxOut = 0;
-    }
-	UpdateNumberEntry( dictionary, _UIMDiagnostics->controlBulkTxOut, "ControlBulkTxOut");
+	// EHCI keeps a note of this separately, maybe it should be in the diagnostics struct
+	UpdateNumberEntry( dictionary, _controlBulkTransactionsOut ? *_controlBulkTransactionsOut : 0, "ControlBulkTxOut");
+	IOLockUnlock(_registryLock);
+	
+	// the pages the UIMs carve their TDs, QHs and EDs out of are counted for every controller together
+	IOUSBControllerMemoryBlock::GetStatistics(&blocks, &elements, &wastedBytes);
+	UpdateNumberEntry( dictionary, blocks, "Controller Memory Blocks (All Controllers)");
+	UpdateNumberEntry( dictionary, elements, "Controller Memory Elements (All Controllers)");
+	UpdateNumberEntry( dictionary, wastedBytes, "Controller Memory Bytes Unused (All Controllers)");
+	memoryTypes = IOUSBControllerMemoryBlock::CopyStatistics();
+	if ( memoryTypes )
+	{
+		dictionary->setObject("Controller Memory By Type (All Controllers)", memoryTypes);
+		memoryTypes->release();
+	}
+	
+	// so is the log rate limiting, which would otherwise only show up as the odd summary in the log
+	KernelDebugGetRateLimitStatistics(&suppressedMessages, &suppressingSites);
+	number = OSNumber::withNumber(suppressedMessages, 64);
+	if ( number )
+	{
+		dictionary->setObject(kUSBLogSuppressedMessagesKey, number);
+		number->release();
+	}
+	UpdateNumberEntry( dictionary, suppressingSites, kUSBLogSuppressingSitesKey);
 	
 	ok = dictionary->serialize(s);
 	dictionary->release();
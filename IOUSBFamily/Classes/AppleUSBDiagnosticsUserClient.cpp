@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <libkern/OSAtomic.h>
+
+#include <IOKit/usb/IOUSBLog.h>
+
+#include "AppleUSBDiagnosticsUserClient.h"
+
+#define super IOUserClient
+
+OSDefineMetaClassAndStructors(AppleUSBDiagnosticsUserClient, IOUserClient)
+
+
+
+bool AppleUSBDiagnosticsUserClient::start(IOService *provider)
+{
+	_nub = OSDynamicCast(AppleUSBDiagnosticsNub, provider);
+	if( !_nub )
+		return false;
+	
+	return super::start(provider);
+}
+
+
+
+IOReturn AppleUSBDiagnosticsUserClient::clientMemoryForType(UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory)
+{
+	IOMemoryDescriptor *	shared;
+	
+	if( type != kAppleUSBDiagnosticsSharedMemoryType )
+		return kIOReturnBadArgument;
+	
+	shared = _nub->copySharedMemory();
+	if( !shared )
+		return kIOReturnNoResources;
+	
+	OSIncrementAtomic(&_mappings);
+	*options = kIOMapReadOnly;
+	*memory = shared;						// the caller releases it once it has made the mapping
+	
+	USBLog(5, "AppleUSBDiagnosticsUserClient[%p]::clientMemoryForType - mapping %d", this, (int)_mappings);
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn AppleUSBDiagnosticsUserClient::clientClose(void)
+{
+	// the last client to go stops the page updates
+	while( _mappings > 0 )
+	{
+		OSDecrementAtomic(&_mappings);
+		_nub->releaseSharedMemory();
+	}
+	
+	terminate();
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn AppleUSBDiagnosticsUserClient::clientDied(void)
+{
+	return clientClose();
+}
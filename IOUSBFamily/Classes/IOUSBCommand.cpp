@@ -24,6 +24,8 @@
 #include <libkern/version.h>
 
 #include <libkern/OSDebug.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
 #include <IOKit/IOLib.h>
 #include <IOKit/usb/IOUSBCommand.h>
 #include <IOKit/usb/IOUSBLog.h>
@@ -497,6 +499,29 @@ IOUSBIsocCommand::free()
     super::free();
 }
 
+UInt64
+IOUSBIsocCommand::ResolveASAPStartFrame(UInt64 nextFrame, UInt64 currentFrame, UInt32 leadFrames, UInt32 *framesSkipped)
+{
+	UInt64		earliestFrame = currentFrame + leadFrames;
+	UInt64		skipped = 0;
+	
+	// with nothing scheduled on the endpoint yet there is no cadence to keep, and if it has fallen behind we skip to the earliest frame
+	if (nextFrame == 0)
+		_startFrame = earliestFrame;
+	else if (nextFrame < earliestFrame)
+	{
+		skipped = earliestFrame - nextFrame;
+		_startFrame = earliestFrame;
+	}
+	else
+		_startFrame = nextFrame;
+	
+	if (framesSkipped)
+		*framesSkipped = (skipped > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (UInt32)skipped;
+	
+	return _startFrame;
+}
+
 //================================================================================================
 //
 //   IOUSBCommandPool
@@ -518,6 +543,61 @@ IOUSBCommandPool::withWorkLoop(IOWorkLoop * inWorkLoop)
 	return me;
 }
 
+bool
+IOUSBCommandPool::initWithWorkLoop(IOWorkLoop * inWorkLoop)
+{
+	// IOCommandPool::initWithWorkLoop can't be failed after it has succeeded, so get the expansion data first
+	if (!_expansionData)
+	{
+		_expansionData = (ExpansionData *)IOMalloc(sizeof(ExpansionData));
+		if (!_expansionData)
+			return false;
+		bzero(_expansionData, sizeof(ExpansionData));
+	}
+	
+	if (!IOCommandPool::initWithWorkLoop(inWorkLoop))
+		return false;
+	
+	_expansionData->_trimTimer = IOTimerEventSource::timerEventSource(this, TrimTimerFired);
+	if (!_expansionData->_trimTimer)
+		return false;
+	
+	if (inWorkLoop->addEventSource(_expansionData->_trimTimer) != kIOReturnSuccess)
+	{
+		_expansionData->_trimTimer->release();
+		_expansionData->_trimTimer = NULL;
+		return false;
+	}
+	
+	return true;
+}
+
+void
+IOUSBCommandPool::free()
+{
+	if (_expansionData)
+	{
+		if (_expansionData->_trimTimer)
+		{
+			_expansionData->_trimTimer->cancelTimeout();
+			if (_expansionData->_trimTimer->getWorkLoop())
+				_expansionData->_trimTimer->getWorkLoop()->removeEventSource(_expansionData->_trimTimer);
+			_expansionData->_trimTimer->release();
+			_expansionData->_trimTimer = NULL;
+		}
+		IOFree(_expansionData, sizeof(ExpansionData));
+		_expansionData = NULL;
+	}
+	IOCommandPool::free();
+}
+
+void
+IOUSBCommandPool::SetReleaseAction(OSObject *target, IOUSBCommandPoolReleaseAction action)
+{
+	_expansionData->_releaseTarget = target;
+	_expansionData->_releaseAction = action;
+}
+
 IOReturn
 IOUSBCommandPool::gatedGetCommand(IOCommand ** command, bool blockForCommand)
 {
@@ -525,6 +605,13 @@ IOUSBCommandPool::gatedGetCommand(IOCommand ** command, bool blockForCommand)
 	
 	ret = IOCommandPool::gatedGetCommand(command, blockForCommand);
 	
+	if ((ret == kIOReturnSuccess) && *command && _expansionData->_freeCommands)
+	{
+		_expansionData->_freeCommands--;
+		if (_expansionData->_freeCommands < _expansionData->_minFreeSinceTrim)
+			_expansionData->_minFreeSinceTrim = _expansionData->_freeCommands;
+	}
+	
 	return ret;
 }
 
@@ -619,6 +706,7 @@ IOUSBCommandPool::gatedReturnCommand(IOCommand * command)
 		for ( int i=0; i < kUSBCommandScratchBuffers; i++)
 			usbCommand->SetUIMScratch(i, POISONVALUE);
 		usbCommand->SetStreamID(POISONVALUE);
+		usbCommand->SetImmediateTransfer(false);
 		
 		if ( usbCommand->GetBufferUSBCommand() != NULL )
 		{
@@ -657,8 +745,167 @@ IOUSBCommandPool::gatedReturnCommand(IOCommand * command)
 			USBError(1,"IOUSBCommandPool::gatedReturnCommand - missing dmaCommand in IOUSBIsocCommand");
 		}
 	}
+	
+	// a command which has never been in the pool is one the controller has just allocated to grow it
+	if ((usbCommand && !usbCommand->GetOwningPool()) || (isocCommand && !isocCommand->GetOwningPool()))
+	{
+		if (_expansionData->_releaseAction && _expansionData->_highWaterMark && (_expansionData->_totalCommands >= _expansionData->_highWaterMark))
+		{
+			_expansionData->_rejectedCommands++;
+			USBLog(6,"IOUSBCommandPool[%p]::gatedReturnCommand - at the high water mark (%d), releasing new command %p", this, (uint32_t)_expansionData->_highWaterMark, command);
+			DisposeCommand(command);
+			(*_expansionData->_releaseAction)(_expansionData->_releaseTarget, 1);
+			return kIOReturnSuccess;
+		}
+		
+		if (usbCommand)
+			usbCommand->SetOwningPool(this);
+		else
+			isocCommand->SetOwningPool(this);
+		
+		if (++_expansionData->_totalCommands > _expansionData->_peakCommands)
+			_expansionData->_peakCommands = _expansionData->_totalCommands;
+	}
+	
+	_expansionData->_freeCommands++;
+	if (_expansionData->_releaseAction && !_expansionData->_trimTimerArmed && _expansionData->_trimTimer && (_expansionData->_freeCommands > kUSBCommandPoolMinIdleCommands))
+	{
+		_expansionData->_minFreeSinceTrim = _expansionData->_freeCommands;
+		_expansionData->_trimTimerArmed = true;
+		_expansionData->_trimTimer->setTimeoutMS(kUSBCommandPoolTrimIntervalMS);
+	}
+	
 	return IOCommandPool::gatedReturnCommand(command);
 }
 
+void
+IOUSBCommandPool::DisposeCommand(IOCommand * command)
+{
+	IOUSBCommand		*usbCommand		= OSDynamicCast(IOUSBCommand, command);
+	IOUSBIsocCommand	*isocCommand	= OSDynamicCast(IOUSBIsocCommand, command);
+	IODMACommand		*dmaCommand		= NULL;
+	
+	// the IODMACommand was allocated along with the command, and is not released by it
+	if (usbCommand)
+	{
+		dmaCommand = usbCommand->GetDMACommand();
+		usbCommand->SetDMACommand(NULL);
+	}
+	else if (isocCommand)
+	{
+		dmaCommand = isocCommand->GetDMACommand();
+		isocCommand->SetDMACommand(NULL);
+	}
+	
+	if (dmaCommand)
+		dmaCommand->release();
+	command->release();
+}
+
+UInt32
+IOUSBCommandPool::TrimIdleCommands(UInt32 count)
+{
+	IOCommand		*command;
+	UInt32			trimmed = 0;
+	
+	// the controller still counts every command it gave us until it can be told otherwise
+	if (!_expansionData->_releaseAction)
+		return 0;
+	
+	while ((trimmed < count) && (_expansionData->_freeCommands > kUSBCommandPoolMinIdleCommands))
+	{
+		command = NULL;
+		if ((IOCommandPool::gatedGetCommand(&command, false) != kIOReturnSuccess) || !command)
+			break;
+		
+		_expansionData->_freeCommands--;
+		_expansionData->_totalCommands--;
+		DisposeCommand(command);
+		trimmed++;
+	}
+	
+	_expansionData->_trimmedCommands += trimmed;
+	if (trimmed)
+		(*_expansionData->_releaseAction)(_expansionData->_releaseTarget, trimmed);
+	return trimmed;
+}
+
+void
+IOUSBCommandPool::TrimTimerFired(OSObject *owner, IOTimerEventSource *sender)
+{
+	IOUSBCommandPool	*me = OSDynamicCast(IOUSBCommandPool, owner);
+	UInt32				idle, trimmed = 0;
+	
+	if (!me)
+		return;
+	
+	me->_expansionData->_trimTimerArmed = false;
+	
+	// only the commands which nobody needed for the whole interval are candidates
+	if (me->_expansionData->_minFreeSinceTrim > kUSBCommandPoolMinIdleCommands)
+	{
+		idle = me->_expansionData->_minFreeSinceTrim - kUSBCommandPoolMinIdleCommands;
+		trimmed = me->TrimIdleCommands((idle + kUSBCommandPoolTrimDivisor - 1) / kUSBCommandPoolTrimDivisor);
+		USBLog(6,"IOUSBCommandPool[%p]::TrimTimerFired - released %d of %d idle commands, %d left in the pool", me, (uint32_t)trimmed, (uint32_t)idle, (uint32_t)me->_expansionData->_totalCommands);
+	}
+	
+	if (me->_expansionData->_freeCommands > kUSBCommandPoolMinIdleCommands)
+	{
+		me->_expansionData->_minFreeSinceTrim = me->_expansionData->_freeCommands;
+		me->_expansionData->_trimTimerArmed = true;
+		sender->setTimeoutMS(kUSBCommandPoolTrimIntervalMS);
+	}
+}
+
+IOReturn
+IOUSBCommandPool::ReleaseIdleCommandsGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3)
+{
+	IOUSBCommandPool	*me = OSDynamicCast(IOUSBCommandPool, owner);
+	UInt32				trimmed;
+	
+	if (!me)
+		return kIOReturnBadArgument;
+	
+	trimmed = me->TrimIdleCommands(me->_expansionData->_freeCommands);
+	USBLog(5,"IOUSBCommandPool[%p]::ReleaseIdleCommands - released %d commands, %d left in the pool", me, (uint32_t)trimmed, (uint32_t)me->_expansionData->_totalCommands);
+	return kIOReturnSuccess;
+}
+
+void
+IOUSBCommandPool::ReleaseIdleCommands(void)
+{
+	if (fSerializer)
+		fSerializer->runAction(ReleaseIdleCommandsGated);
+}
+
+OSDictionary *
+IOUSBCommandPool::CopyStatistics(void)
+{
+	OSDictionary	*stats = OSDictionary::withCapacity(6);
+	OSNumber		*number;
+	
+	if (!stats)
+		return NULL;
+	
+#define SET_POOL_STAT(key, value)										\
+	number = OSNumber::withNumber((unsigned long long)(value), 32);		\
+	if (number)															\
+	{																	\
+		stats->setObject(key, number);									\
+		number->release();												\
+	}
+	
+	SET_POOL_STAT("Commands", _expansionData->_totalCommands);
+	SET_POOL_STAT("Free Commands", _expansionData->_freeCommands);
+	SET_POOL_STAT("Peak Commands", _expansionData->_peakCommands);
+	SET_POOL_STAT("High Water Mark", _expansionData->_highWaterMark);
+	SET_POOL_STAT("Trimmed Commands", _expansionData->_trimmedCommands);
+	SET_POOL_STAT("Rejected Commands", _expansionData->_rejectedCommands);
+	
+#undef SET_POOL_STAT
+	
+	return stats;
+}
+
 
 
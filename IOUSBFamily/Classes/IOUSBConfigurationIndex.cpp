@@ -0,0 +1,501 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <IOKit/IOLib.h>
+#include <IOKit/assert.h>
+
+#include <IOKit/usb/IOUSBConfigurationIndex.h>
+#include <IOKit/usb/IOUSBDescriptorValidation.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBConfigurationIndex, OSObject)
+
+// an endpointMask has a bit for each pipe list position
+OSCompileAssert(kUSBMaxPipes <= 32);
+
+
+
+IOUSBConfigurationIndex *
+IOUSBConfigurationIndex::withConfigurationDescriptor(const IOUSBConfigurationDescriptor *configDesc)
+{
+	IOUSBConfigurationIndex	*index = new IOUSBConfigurationIndex;
+
+	if (index && !index->initWithConfigurationDescriptor(configDesc))
+	{
+		index->release();
+		index = NULL;
+	}
+	return index;
+}
+
+
+
+IOUSBConfigurationIndex *
+IOUSBConfigurationIndex::withDescriptorBuffer(const void *buffer, UInt32 length, const char *name)
+{
+	IOUSBConfigurationIndex	*index;
+	void					*copy;
+	UInt32					copyLength, repairs;
+	IOReturn				err;
+
+	if (!buffer || !length)
+		return NULL;
+
+	copy = IOMalloc(length);
+	if (!copy)
+		return NULL;
+
+	err = IOUSBValidateConfigurationDescriptor(buffer, length, copy, &copyLength, &repairs);
+	if (err)
+	{
+		USBLog(1, "IOUSBConfigurationIndex::withDescriptorBuffer - %s: rejected the configuration descriptor (%d bytes), 0x%x", name ? name : "", (uint32_t)length, err);
+		IOFree(copy, length);
+		return NULL;
+	}
+	if (repairs)
+	{
+		USBLog(1, "IOUSBConfigurationIndex::withDescriptorBuffer - %s: repaired the configuration descriptor (0x%x), %d of %d bytes kept", name ? name : "", (uint32_t)repairs, (uint32_t)copyLength, (uint32_t)length);
+	}
+
+	index = new IOUSBConfigurationIndex;
+	if (!index)
+	{
+		IOFree(copy, length);
+		return NULL;
+	}
+
+	// free() takes care of the copy from here on, whether init works or not
+	index->_ownedCopy = copy;
+	index->_ownedLength = length;
+	if (!index->initWithConfigurationDescriptor((const IOUSBConfigurationDescriptor*)copy))
+	{
+		index->release();
+		index = NULL;
+	}
+	return index;
+}
+
+
+
+bool
+IOUSBConfigurationIndex::initWithConfigurationDescriptor(const IOUSBConfigurationDescriptor *configDesc)
+{
+	const UInt8						*start;
+	const UInt8						*end;
+	const UInt8						*cur;
+	const IOUSBDescriptorHeader		*hdr;
+	const IOUSBEndpointDescriptor	*ep;
+	InterfaceEntry					*entry = NULL;
+	UInt16							lastOfClass[256];
+	UInt16							lastOfNumber[256];
+	UInt32							numInterfaces = 0;
+	UInt32							numEndpoints = 0;
+	UInt32							ifIndex = 0;
+	UInt32							epIndex = 0;
+	UInt32							slot;
+	UInt32							i;
+
+	if (!configDesc || !super::init())
+		return false;
+
+	start = (const UInt8*)configDesc;
+	end = start + USBToHostWord(configDesc->wTotalLength);
+
+	// first pass just counts, so we only allocate once
+	for (cur = start; (cur + sizeof(IOUSBDescriptorHeader)) <= end; cur += hdr->bLength)
+	{
+		hdr = (const IOUSBDescriptorHeader*)cur;
+		if ((hdr->bLength < sizeof(IOUSBDescriptorHeader)) || ((cur + hdr->bLength) > end))
+			break;
+		if ((hdr->bDescriptorType == kUSBInterfaceDesc) && (hdr->bLength >= sizeof(IOUSBInterfaceDescriptor)))
+			numInterfaces++;
+		else if ((hdr->bDescriptorType == kUSBEndpointDesc) && (hdr->bLength >= sizeof(IOUSBEndpointDescriptor)) && numInterfaces)
+			numEndpoints++;
+	}
+
+	if ((numInterfaces >= kUSBConfigIndexNone) || (numEndpoints >= kUSBConfigIndexNone))
+	{
+		USBLog(1, "IOUSBConfigurationIndex[%p]::initWithConfigurationDescriptor - %d interfaces and %d endpoints is too many", this, (uint32_t)numInterfaces, (uint32_t)numEndpoints);
+		return false;
+	}
+
+	if (numInterfaces)
+	{
+		_interfaces = (InterfaceEntry*)IOMalloc(numInterfaces * sizeof(InterfaceEntry));
+		if (!_interfaces)
+			return false;
+		bzero(_interfaces, numInterfaces * sizeof(InterfaceEntry));
+		_numInterfaces = numInterfaces;
+	}
+	if (numEndpoints)
+	{
+		_endpoints = (const IOUSBEndpointDescriptor **)IOMalloc(numEndpoints * sizeof(IOUSBEndpointDescriptor*));
+		if (!_endpoints)
+			return false;
+		_numEndpoints = numEndpoints;
+	}
+
+	_configDesc = configDesc;
+	for (i = 0; i < 256; i++)
+	{
+		_firstOfClass[i] = lastOfClass[i] = kUSBConfigIndexNone;
+		_firstOfNumber[i] = lastOfNumber[i] = kUSBConfigIndexNone;
+	}
+
+	for (cur = start; (cur + sizeof(IOUSBDescriptorHeader)) <= end; cur += hdr->bLength)
+	{
+		hdr = (const IOUSBDescriptorHeader*)cur;
+		if ((hdr->bLength < sizeof(IOUSBDescriptorHeader)) || ((cur + hdr->bLength) > end))
+			break;
+
+		if ((hdr->bDescriptorType == kUSBInterfaceDesc) && (hdr->bLength >= sizeof(IOUSBInterfaceDescriptor)) && (ifIndex < numInterfaces))
+		{
+			const IOUSBInterfaceDescriptor	*ifDesc = (const IOUSBInterfaceDescriptor*)cur;
+
+			entry = &_interfaces[ifIndex];
+			entry->desc = ifDesc;
+			entry->nextSameClass = kUSBConfigIndexNone;
+			entry->nextAlternate = kUSBConfigIndexNone;
+			entry->firstEndpoint = epIndex;
+
+			if (lastOfClass[ifDesc->bInterfaceClass] == kUSBConfigIndexNone)
+				_firstOfClass[ifDesc->bInterfaceClass] = ifIndex;
+			else
+				_interfaces[lastOfClass[ifDesc->bInterfaceClass]].nextSameClass = ifIndex;
+			lastOfClass[ifDesc->bInterfaceClass] = ifIndex;
+
+			if (lastOfNumber[ifDesc->bInterfaceNumber] == kUSBConfigIndexNone)
+				_firstOfNumber[ifDesc->bInterfaceNumber] = ifIndex;
+			else
+				_interfaces[lastOfNumber[ifDesc->bInterfaceNumber]].nextAlternate = ifIndex;
+			lastOfNumber[ifDesc->bInterfaceNumber] = ifIndex;
+
+			ifIndex++;
+		}
+		else if ((hdr->bDescriptorType == kUSBEndpointDesc) && (hdr->bLength >= sizeof(IOUSBEndpointDescriptor)) && entry && (epIndex < numEndpoints))
+		{
+			ep = (const IOUSBEndpointDescriptor*)cur;
+
+			// the pipe list only has room for kUSBMaxPipes, and IOUSBInterface::CreatePipes fills it in this same order. Any endpoints
+			// past that get no position, and numEndpoints stops there so it can't wrap around to a position already handed out
+			if (entry->numEndpoints < kUSBMaxPipes)
+			{
+				slot = SlotForAddress(ep->bEndpointAddress);
+				if (!entry->endpointSlot[slot])
+					entry->endpointSlot[slot] = entry->numEndpoints + 1;
+				entry->endpointMask[ep->bmAttributes & kUSBEndpointbmAttributesTransferTypeMask][(ep->bEndpointAddress & kUSBbEndpointDirectionMask) ? 1 : 0] |= (1U << entry->numEndpoints);
+				entry->numEndpoints++;
+			}
+			_endpoints[epIndex++] = ep;
+		}
+	}
+
+	USBLog(6, "IOUSBConfigurationIndex[%p]::initWithConfigurationDescriptor - %d interface descriptors, %d endpoints", this, (uint32_t)_numInterfaces, (uint32_t)_numEndpoints);
+	return true;
+}
+
+
+
+void
+IOUSBConfigurationIndex::free()
+{
+	if (_interfaces)
+	{
+		IOFree(_interfaces, _numInterfaces * sizeof(InterfaceEntry));
+		_interfaces = NULL;
+	}
+	if (_endpoints)
+	{
+		IOFree(_endpoints, _numEndpoints * sizeof(IOUSBEndpointDescriptor*));
+		_endpoints = NULL;
+	}
+	if (_ownedCopy)
+	{
+		IOFree(_ownedCopy, _ownedLength);
+		_ownedCopy = NULL;
+		_configDesc = NULL;
+	}
+	super::free();
+}
+
+
+
+// desc is usually one we handed out, and then its offset into our descriptors finds it exactly - the entries are in descriptor order,
+// so that is a binary search, and it keeps apart two settings a bad device gave the same numbers. Otherwise it is the same interface
+// in some other copy of the descriptors, the device's own say, and it is looked up by its interface number and alternate setting
+SInt32
+IOUSBConfigurationIndex::EntryForDescriptor(const IOUSBInterfaceDescriptor *desc)
+{
+	uintptr_t	base = (uintptr_t)_configDesc;
+	uintptr_t	where = (uintptr_t)desc;
+	uintptr_t	offset;
+	uintptr_t	midOffset;
+	SInt32		low = 0;
+	SInt32		high = (SInt32)_numInterfaces - 1;
+	SInt32		mid;
+
+	if (!desc || !_configDesc)
+		return -1;
+
+	if ((where < base) || (where >= (base + USBToHostWord(_configDesc->wTotalLength))))
+		return EntryFor(desc->bInterfaceNumber, desc->bAlternateSetting);
+
+	offset = where - base;
+	while (low <= high)
+	{
+		mid = (low + high) / 2;
+		midOffset = (uintptr_t)_interfaces[mid].desc - base;
+		if (midOffset == offset)
+			return mid;
+		if (midOffset < offset)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return -1;
+}
+
+
+
+SInt32
+IOUSBConfigurationIndex::EntryFor(UInt8 interfaceNumber, UInt8 alternateSetting)
+{
+	UInt16		i;
+
+	for (i = _firstOfNumber[interfaceNumber]; i != kUSBConfigIndexNone; i = _interfaces[i].nextAlternate)
+	{
+		if (_interfaces[i].desc->bAlternateSetting == alternateSetting)
+			return i;
+	}
+	return -1;
+}
+
+
+
+bool
+IOUSBConfigurationIndex::Matches(const IOUSBInterfaceDescriptor *desc, const IOUSBFindInterfaceRequest *request)
+{
+	if ((request->bInterfaceClass != kIOUSBFindInterfaceDontCare) && (request->bInterfaceClass != desc->bInterfaceClass))
+		return false;
+	if ((request->bInterfaceSubClass != kIOUSBFindInterfaceDontCare) && (request->bInterfaceSubClass != desc->bInterfaceSubClass))
+		return false;
+	if ((request->bInterfaceProtocol != kIOUSBFindInterfaceDontCare) && (request->bInterfaceProtocol != desc->bInterfaceProtocol))
+		return false;
+	if ((request->bAlternateSetting != kIOUSBFindInterfaceDontCare) && (request->bAlternateSetting != desc->bAlternateSetting))
+		return false;
+	return true;
+}
+
+
+
+const IOUSBInterfaceDescriptor *
+IOUSBConfigurationIndex::FindNextInterfaceDescriptor(const IOUSBInterfaceDescriptor *current, const IOUSBFindInterfaceRequest *request)
+{
+	SInt32		start = 0;
+	UInt32		i;
+
+	if (!request)
+		return NULL;
+
+	if (current)
+	{
+		start = EntryForDescriptor(current);
+		if (start < 0)
+			return NULL;
+		start++;
+	}
+
+	if ((request->bInterfaceClass != kIOUSBFindInterfaceDontCare) && (request->bInterfaceClass < 256))
+	{
+		// only look at the ones of the right class
+		for (i = _firstOfClass[request->bInterfaceClass]; i != kUSBConfigIndexNone; i = _interfaces[i].nextSameClass)
+		{
+			if ((i >= (UInt32)start) && Matches(_interfaces[i].desc, request))
+				return _interfaces[i].desc;
+		}
+		return NULL;
+	}
+
+	for (i = start; i < _numInterfaces; i++)
+	{
+		if (Matches(_interfaces[i].desc, request))
+			return _interfaces[i].desc;
+	}
+	return NULL;
+}
+
+
+
+const IOUSBInterfaceDescriptor *
+IOUSBConfigurationIndex::FindNextAltInterface(UInt8 interfaceNumber, const IOUSBInterfaceDescriptor *current, const IOUSBFindInterfaceRequest *request)
+{
+	SInt32		entry;
+	UInt16		i;
+
+	if (!request)
+		return NULL;
+
+	if (current)
+	{
+		entry = EntryForDescriptor(current);
+		if ((entry < 0) || (current->bInterfaceNumber != interfaceNumber))
+			return NULL;
+		i = _interfaces[entry].nextAlternate;
+	}
+	else
+		i = _firstOfNumber[interfaceNumber];
+
+	for ( ; i != kUSBConfigIndexNone; i = _interfaces[i].nextAlternate)
+	{
+		if (Matches(_interfaces[i].desc, request))
+			return _interfaces[i].desc;
+	}
+	return NULL;
+}
+
+
+
+const IOUSBEndpointDescriptor *
+IOUSBConfigurationIndex::FindEndpoint(UInt8 interfaceNumber, UInt8 alternateSetting, UInt8 endpointAddress)
+{
+	SInt32		entry = EntryFor(interfaceNumber, alternateSetting);
+	UInt8		slot;
+
+	if (entry < 0)
+		return NULL;
+
+	slot = _interfaces[entry].endpointSlot[SlotForAddress(endpointAddress)];
+	if (!slot)
+		return NULL;
+
+	return _endpoints[_interfaces[entry].firstEndpoint + slot - 1];
+}
+
+
+
+SInt32
+IOUSBConfigurationIndex::GetEndpointIndex(UInt8 interfaceNumber, UInt8 alternateSetting, UInt8 endpointAddress)
+{
+	SInt32		entry = EntryFor(interfaceNumber, alternateSetting);
+
+	if (entry < 0)
+		return -1;
+
+	return (SInt32)_interfaces[entry].endpointSlot[SlotForAddress(endpointAddress)] - 1;
+}
+
+
+
+SInt32
+IOUSBConfigurationIndex::FindNextEndpointIndex(UInt8 interfaceNumber, UInt8 alternateSetting, SInt32 currentIndex, UInt8 type, UInt8 direction)
+{
+	SInt32		entry = EntryFor(interfaceNumber, alternateSetting);
+	UInt32		mask = 0;
+	UInt32		t, d;
+
+	if ((entry < 0) || (currentIndex >= (kUSBMaxPipes - 1)))
+		return -1;
+
+	for (t = 0; t < kUSBConfigIndexNumTypes; t++)
+	{
+		if ((type != kUSBAnyType) && (type != t))
+			continue;
+		for (d = 0; d < kUSBConfigIndexNumDirections; d++)
+		{
+			if ((direction != kUSBAnyDirn) && (direction != d))
+				continue;
+			mask |= _interfaces[entry].endpointMask[t][d];
+		}
+	}
+
+	// drop everything up to and including currentIndex, then the lowest bit left is the answer
+	if (currentIndex >= 0)
+		mask &= ~((2U << currentIndex) - 1);
+
+	return mask ? (SInt32)(__builtin_ctz(mask)) : -1;
+}
+
+
+
+const IOUSBDescriptorHeader *
+IOUSBConfigurationIndex::FindNextDescriptor(const void *current, UInt8 type)
+{
+	const UInt8						*start = (const UInt8*)_configDesc;
+	const UInt8						*end;
+	const UInt8						*cur = (const UInt8*)current;
+	const IOUSBDescriptorHeader		*hdr;
+
+	if (!_configDesc)
+		return NULL;
+
+	end = start + USBToHostWord(_configDesc->wTotalLength);
+	if (!cur)
+		cur = start;
+	else if ((cur < start) || (cur >= end))
+		return NULL;
+
+	// step over current, then look at each one after it. A validated copy never fails these checks, but a device's own descriptors might
+	for (;;)
+	{
+		if ((cur + sizeof(IOUSBDescriptorHeader)) > end)
+			return NULL;
+		hdr = (const IOUSBDescriptorHeader*)cur;
+		if ((hdr->bLength < sizeof(IOUSBDescriptorHeader)) || ((cur + hdr->bLength) > end))
+			return NULL;
+		cur += hdr->bLength;
+
+		if ((cur + sizeof(IOUSBDescriptorHeader)) > end)
+			return NULL;
+		hdr = (const IOUSBDescriptorHeader*)cur;
+		if ((hdr->bLength < sizeof(IOUSBDescriptorHeader)) || ((cur + hdr->bLength) > end))
+			return NULL;
+		if ((type == kUSBAnyDesc) || (hdr->bDescriptorType == type))
+			return hdr;
+	}
+}
+
+
+
+const IOUSBDescriptorHeader *
+IOUSBConfigurationIndex::FindNextAssociatedDescriptor(const IOUSBInterfaceDescriptor *interfaceDesc, const void *current, UInt8 type)
+{
+	const IOUSBDescriptorHeader		*hdr;
+
+	if (!interfaceDesc || (EntryForDescriptor(interfaceDesc) < 0))
+		return NULL;
+
+	if (!current)
+		current = interfaceDesc;
+
+	// everything up to the next interface descriptor belongs to this one
+	for (hdr = FindNextDescriptor(current, kUSBAnyDesc); hdr; hdr = FindNextDescriptor(hdr, kUSBAnyDesc))
+	{
+		if (hdr->bDescriptorType == kUSBInterfaceDesc)
+			return NULL;
+		if ((type == kUSBAnyDesc) || (hdr->bDescriptorType == type))
+			return hdr;
+	}
+	return NULL;
+}
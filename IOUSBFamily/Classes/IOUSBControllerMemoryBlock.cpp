@@ -0,0 +1,394 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSNumber.h>
+
+#include <IOKit/IODMACommand.h>
+
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBControllerMemoryBlock, OSObject)
+
+// usage across all of the controllers in the system
+static volatile SInt32		gMemoryBlocks = 0;
+static volatile SInt32		gMemoryBlockElements = 0;
+static volatile SInt32		gMemoryBlockWastedBytes = 0;
+
+// and for each subclass. A slot is claimed by the first block of its class and never given back, so the counters can be updated
+// without a lock. The name is copied, as the UIM kext the class lives in may be unloaded, and metaClass is then only compared
+struct IOUSBControllerMemoryBlockTypeStatistics
+{
+	const OSMetaClass *		metaClass;
+	char					className[64];
+	UInt32					elementSize;
+	volatile SInt32			blocks;
+	volatile SInt32			elements;
+	volatile SInt32			wastedBytes;
+};
+
+static IOUSBControllerMemoryBlockTypeStatistics	gMemoryBlockTypes[kUSBControllerMemoryBlockMaxTypes];
+
+
+
+static IOUSBControllerMemoryBlockTypeStatistics *
+TypeStatisticsFor(const OSMetaClass *metaClass, UInt32 elementSize)
+{
+	UInt32		i;
+
+	for (i = 0; i < kUSBControllerMemoryBlockMaxTypes; i++)
+	{
+		if (gMemoryBlockTypes[i].metaClass == metaClass)
+			return &gMemoryBlockTypes[i];
+		if (!gMemoryBlockTypes[i].metaClass)
+		{
+			// two blocks of a new class at once - whichever loses looks at the same slot again
+			if (OSCompareAndSwapPtr(NULL, (void*)metaClass, &gMemoryBlockTypes[i].metaClass) || (gMemoryBlockTypes[i].metaClass == metaClass))
+			{
+				strlcpy(gMemoryBlockTypes[i].className, metaClass->getClassName(), sizeof(gMemoryBlockTypes[i].className));
+				gMemoryBlockTypes[i].elementSize = elementSize;
+				return &gMemoryBlockTypes[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+
+
+bool
+IOUSBControllerMemoryBlock::initWithElements(UInt32 elementSize, UInt32 alignment, UInt32 boundary, UInt32 reservedElements, mach_vm_address_t physicalMask)
+{
+	IOBufferMemoryDescriptor	*buffer = NULL;
+	IODMACommand				*dmaCommand = NULL;
+	UInt64						offset = 0;
+	IODMACommand::Segment32		segments;
+	UInt32						numSegments = 1;
+	UInt32						numSlots;
+	IOReturn					status = kIOReturnSuccess;
+
+	if (!super::init())
+		return false;
+
+	if (!boundary || (boundary > kUSBControllerMemoryBlockSize))
+		boundary = kUSBControllerMemoryBlockSize;
+
+	if (!alignment)
+		alignment = 1;
+
+	// the block itself is page aligned, so anything up to that works as long as it is a power of 2
+	if ((alignment & (alignment - 1)) || (alignment > kUSBControllerMemoryBlockSize) || (kUSBControllerMemoryBlockSize % boundary))
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - bad alignment (%d) or boundary (%d)", this, (uint32_t)alignment, (uint32_t)boundary);
+		return false;
+	}
+
+	_elementStride = (elementSize + alignment - 1) & ~(alignment - 1);
+	if (!elementSize || (_elementStride > boundary))
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - element size (%d) does not fit in the boundary (%d)", this, (uint32_t)elementSize, (uint32_t)boundary);
+		return false;
+	}
+
+	_boundary = boundary;
+	_elementsPerBoundary = boundary / _elementStride;
+	numSlots = (kUSBControllerMemoryBlockSize / boundary) * _elementsPerBoundary;
+	if (numSlots <= reservedElements)
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - no room after %d reserved elements", this, (uint32_t)reservedElements);
+		return false;
+	}
+
+	// Use IODMACommand to get the physical address
+	dmaCommand = IODMACommand::withSpecification(kIODMACommandOutputHost32, 32, PAGE_SIZE, (IODMACommand::MappingOptions)(IODMACommand::kMapped | IODMACommand::kIterateOnly));
+	if (!dmaCommand)
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - could not create IODMACommand", this);
+		return false;
+	}
+
+	// allocate one page on a page boundary below the 4GB line
+	buffer = IOBufferMemoryDescriptor::inTaskWithPhysicalMask(kernel_task, kIOMemoryUnshared | kIODirectionInOut, kUSBControllerMemoryBlockSize, physicalMask);
+	if (!buffer)
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - could not allocate buffer!", this);
+		dmaCommand->release();
+		return false;
+	}
+
+	status = buffer->prepare();
+	if (status)
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - could not prepare buffer", this);
+		buffer->release();
+		dmaCommand->release();
+		return false;
+	}
+
+	// from here on free() will take care of the buffer
+	_buffer = buffer;
+	_sharedLogical = (UInt8*)_buffer->getBytesNoCopy();
+	bzero(_sharedLogical, kUSBControllerMemoryBlockSize);
+
+	status = dmaCommand->setMemoryDescriptor(_buffer);
+	if (status)
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - could not set memory descriptor", this);
+		dmaCommand->release();
+		return false;
+	}
+	status = dmaCommand->gen32IOVMSegments(&offset, &segments, &numSegments);
+	dmaCommand->clearMemoryDescriptor();
+	dmaCommand->release();
+	if (status || (numSegments != 1) || (segments.fLength != kUSBControllerMemoryBlockSize))
+	{
+		USBError(1, "IOUSBControllerMemoryBlock[%p]::initWithElements - could not get physical segment", this);
+		return false;
+	}
+	_sharedPhysical = segments.fIOVMAddr;
+
+	_reservedElements = reservedElements;
+	_numElements = numSlots - reservedElements;
+	_wastedBytes = kUSBControllerMemoryBlockSize - (numSlots * elementSize);
+
+	OSIncrementAtomic(&gMemoryBlocks);
+	OSAddAtomic(_numElements, &gMemoryBlockElements);
+	OSAddAtomic(_wastedBytes, &gMemoryBlockWastedBytes);
+
+	_typeStatistics = TypeStatisticsFor(getMetaClass(), elementSize);
+	if (_typeStatistics)
+	{
+		OSIncrementAtomic(&_typeStatistics->blocks);
+		OSAddAtomic(_numElements, &_typeStatistics->elements);
+		OSAddAtomic(_wastedBytes, &_typeStatistics->wastedBytes);
+	}
+
+	USBLog(6, "IOUSBControllerMemoryBlock[%p]::initWithElements - %d elements of %d bytes at phys 0x%x, %d blocks in use", this, (uint32_t)_numElements, (uint32_t)elementSize, (uint32_t)_sharedPhysical, (uint32_t)gMemoryBlocks);
+	return true;
+}
+
+
+
+void
+IOUSBControllerMemoryBlock::free()
+{
+	if (_numElements)
+	{
+		OSDecrementAtomic(&gMemoryBlocks);
+		OSAddAtomic(-(SInt32)_numElements, &gMemoryBlockElements);
+		OSAddAtomic(-(SInt32)_wastedBytes, &gMemoryBlockWastedBytes);
+		if (_typeStatistics)
+		{
+			OSDecrementAtomic(&_typeStatistics->blocks);
+			OSAddAtomic(-(SInt32)_numElements, &_typeStatistics->elements);
+			OSAddAtomic(-(SInt32)_wastedBytes, &_typeStatistics->wastedBytes);
+			_typeStatistics = NULL;
+		}
+		_numElements = 0;
+	}
+
+	// IOKit calls this when we are going away
+	if (_buffer)
+	{
+		_buffer->complete();						// we need to unmap our buffer
+		_buffer->release();
+		_buffer = NULL;
+	}
+	super::free();
+}
+
+
+
+UInt32
+IOUSBControllerMemoryBlock::ElementOffset(UInt32 slot)
+{
+	return ((slot / _elementsPerBoundary) * _boundary) + ((slot % _elementsPerBoundary) * _elementStride);
+}
+
+
+
+UInt32
+IOUSBControllerMemoryBlock::NumElements(void)
+{
+	return _numElements;
+}
+
+
+
+IOPhysicalAddress
+IOUSBControllerMemoryBlock::GetElementPhysicalPtr(UInt32 index)
+{
+	if (index >= _numElements)
+		return 0;
+
+	return _sharedPhysical + ElementOffset(index + _reservedElements);
+}
+
+
+
+void *
+IOUSBControllerMemoryBlock::GetElementLogicalPtr(UInt32 index)
+{
+	if (index >= _numElements)
+		return NULL;
+
+	return _sharedLogical + ElementOffset(index + _reservedElements);
+}
+
+
+
+void *
+IOUSBControllerMemoryBlock::GetReservedLogicalPtr(UInt32 index)
+{
+	if (index >= _reservedElements)
+		return NULL;
+
+	return _sharedLogical + ElementOffset(index);
+}
+
+
+
+bool
+IOUSBControllerMemoryBlock::ContainsPhysical(IOPhysicalAddress addr)
+{
+	return (_numElements && (addr >= _sharedPhysical) && (addr < (_sharedPhysical + kUSBControllerMemoryBlockSize)));
+}
+
+
+
+SInt32
+IOUSBControllerMemoryBlock::PhysicalToIndex(IOPhysicalAddress addr)
+{
+	// NOTE:  Don't use any USBLogs here, as this may be called at primary interrupt time
+	UInt32		offset;
+	UInt32		withinBoundary;
+	UInt32		slot;
+
+	if (!ContainsPhysical(addr))
+		return -1;
+
+	offset = (UInt32)(addr - _sharedPhysical);
+	withinBoundary = offset % _boundary;
+	if ((withinBoundary % _elementStride) || ((withinBoundary / _elementStride) >= _elementsPerBoundary))
+		return -1;
+
+	slot = ((offset / _boundary) * _elementsPerBoundary) + (withinBoundary / _elementStride);
+	if (slot < _reservedElements)
+		return -1;
+
+	return (SInt32)(slot - _reservedElements);
+}
+
+
+
+void *
+IOUSBControllerMemoryBlock::PhysicalToLogical(IOPhysicalAddress addr)
+{
+	SInt32		index = PhysicalToIndex(addr);
+
+	return (index < 0) ? NULL : GetElementLogicalPtr((UInt32)index);
+}
+
+
+
+IOUSBControllerMemoryBlock *
+IOUSBControllerMemoryBlock::FindBlockForPhysical(IOUSBControllerMemoryBlock *head, IOPhysicalAddress addr)
+{
+	while (head)
+	{
+		if (head->ContainsPhysical(addr))
+			break;
+		head = head->_nextBlock;
+	}
+	return head;
+}
+
+
+
+void
+IOUSBControllerMemoryBlock::GetStatistics(UInt32 *blocks, UInt32 *elements, UInt32 *wastedBytes)
+{
+	if (blocks)
+		*blocks = (UInt32)gMemoryBlocks;
+	if (elements)
+		*elements = (UInt32)gMemoryBlockElements;
+	if (wastedBytes)
+		*wastedBytes = (UInt32)gMemoryBlockWastedBytes;
+}
+
+
+
+static void
+SetNumber(OSDictionary *dict, const char *key, UInt32 value)
+{
+	OSNumber	*number = OSNumber::withNumber(value, 32);
+
+	if (number)
+	{
+		dict->setObject(key, number);
+		number->release();
+	}
+}
+
+
+
+OSDictionary *
+IOUSBControllerMemoryBlock::CopyStatistics(void)
+{
+	OSDictionary	*statistics = OSDictionary::withCapacity(kUSBControllerMemoryBlockMaxTypes);
+	OSDictionary	*type;
+	UInt32			i;
+
+	if (!statistics)
+		return NULL;
+
+	for (i = 0; (i < kUSBControllerMemoryBlockMaxTypes) && gMemoryBlockTypes[i].metaClass; i++)
+	{
+		type = OSDictionary::withCapacity(4);
+		if (!type)
+			break;
+		SetNumber(type, kUSBControllerMemoryBlocksKey, (UInt32)gMemoryBlockTypes[i].blocks);
+		SetNumber(type, kUSBControllerMemoryElementsKey, (UInt32)gMemoryBlockTypes[i].elements);
+		SetNumber(type, kUSBControllerMemoryElementSizeKey, gMemoryBlockTypes[i].elementSize);
+		SetNumber(type, kUSBControllerMemoryBytesUnusedKey, (UInt32)gMemoryBlockTypes[i].wastedBytes);
+		statistics->setObject(gMemoryBlockTypes[i].className, type);
+		type->release();
+	}
+	return statistics;
+}
+
+
+
+#pragma mark Padding Slots
+
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  0);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  1);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  2);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  3);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  4);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  5);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  6);
+OSMetaClassDefineReservedUnused(IOUSBControllerMemoryBlock,  7);
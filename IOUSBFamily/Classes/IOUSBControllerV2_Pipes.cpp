@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <IOKit/IOCommandGate.h>
+
+#include <IOKit/usb/IOUSBControllerV2.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+// ConfigurePipes and the UIM hooks behind it, apart from the rest of IOUSBControllerV2 so that they build on their own in the
+// host tests against a simulated controller
+
+// more arguments than runAction can carry
+struct ConfigurePipesParams
+{
+	USBDeviceAddress	address;
+	UInt8				speed;
+	Endpoint *			closeList;
+	UInt32				closeCount;
+	Endpoint *			openList;
+	UInt32				openCount;
+	UInt32 *			shortfall;
+};
+
+OSMetaClassDefineReservedUsed(IOUSBControllerV2,  27);
+IOReturn IOUSBControllerV2::ConfigurePipes(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+	ConfigurePipesParams	params;
+	UInt32					shortfall = 0;
+	IOReturn				err;
+	
+	if ((closeCount && !closeList) || (openCount && !openList))
+		return kIOReturnBadArgument;
+	
+	params.address = address;
+	params.speed = speed;
+	params.closeList = closeList;
+	params.closeCount = closeCount;
+	params.openList = openList;
+	params.openCount = openCount;
+	params.shortfall = &shortfall;
+	
+	// one trip through the gate, so nobody else sees the device with half of its pipes
+    err = _commandGate->runAction(DoConfigureEPs, &params);
+	
+	if (bandwidthShortfall)
+		*bandwidthShortfall = (err == kIOReturnNoBandwidth) ? shortfall : 0;
+	
+	return err;
+}
+
+OSMetaClassDefineReservedUsed(IOUSBControllerV2,  28);
+IOReturn IOUSBControllerV2::UIMConfigureEndpoints(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+#pragma unused (address, speed, closeList, closeCount, openList, openCount, bandwidthShortfall)
+	return kIOReturnUnsupported;
+}
+
+OSMetaClassDefineReservedUsed(IOUSBControllerV2,  29);
+IOReturn IOUSBControllerV2::UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+#pragma unused (address, speed, closeList, closeCount, openList, openCount, bandwidthShortfall)
+	return kIOReturnUnsupported;
+}
+
+bool IOUSBControllerV2::IsochEndpointInList(Endpoint *list, UInt32 count, UInt8 number, UInt8 direction)
+{
+	UInt32		i;
+	
+	for (i = 0; i < count; i++)
+	{
+		if ((list[i].transferType == kUSBIsoc) && (list[i].number == number) && (list[i].direction == direction))
+			return true;
+	}
+	return false;
+}
+
+IOReturn IOUSBControllerV2::DoConfigureEPs(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3)
+{
+#pragma unused (arg1, arg2, arg3)
+    IOUSBControllerV2		*me = (IOUSBControllerV2 *)owner;
+	ConfigurePipesParams	*params = (ConfigurePipesParams *)arg0;
+	UInt32					closed, opened, i;
+	IOReturn				err;
+	
+	err = me->UIMConfigureEndpoints(params->address, params->speed, params->closeList, params->closeCount, params->openList, params->openCount, params->shortfall);
+	if (err != kIOReturnUnsupported)
+	{
+		if (err)
+		{
+			USBLog(3, "%s[%p]::DoConfigureEPs - UIM could not configure %d/%d endpoints for address %d (0x%x)", me->getName(), me, (int)params->closeCount, (int)params->openCount, params->address, err);
+		}
+		return err;
+	}
+	
+	// if the UIM can tell that the new pipes won't fit, don't touch the old ones at all
+	err = me->UIMCheckPipeBandwidth(params->address, params->speed, params->closeList, params->closeCount, params->openList, params->openCount, params->shortfall);
+	if (err == kIOReturnNoBandwidth)
+	{
+		USBLog(3, "%s[%p]::DoConfigureEPs - new pipes for address %d need %d more bytes per frame, leaving the old ones alone", me->getName(), me, params->address, (int)*params->shortfall);
+		return err;
+	}
+	
+	// the UIM does them one at a time, so close the old ones first to give their bandwidth back before we open the new ones
+	err = kIOReturnSuccess;
+	for (closed = 0; closed < params->closeCount; closed++)
+	{
+		err = me->ClosePipe(params->address, &params->closeList[closed]);
+		if (err)
+			break;
+	}
+	
+	opened = 0;
+	if (!err)
+	{
+		for (opened = 0; opened < params->openCount; opened++)
+		{
+			err = me->OpenPipe(params->address, params->speed, &params->openList[opened]);
+			if (err)
+				break;
+		}
+	}
+	
+	if (err)
+	{
+		// all or nothing - put the device back the way it was
+		USBLog(3, "%s[%p]::DoConfigureEPs - error 0x%x for address %d after closing %d and opening %d pipes, undoing", me->getName(), me, err, params->address, (int)closed, (int)opened);
+		for (i = opened; i > 0; i--)
+			me->ClosePipe(params->address, &params->openList[i-1]);
+		for (i = closed; i > 0; i--)
+		{
+			if (me->OpenPipe(params->address, params->speed, &params->closeList[i-1]))
+			{
+				USBError(1, "%s[%p]::DoConfigureEPs - could not reopen endpoint %d for address %d", me->getName(), me, params->closeList[i-1].number, params->address);
+			}
+		}
+	}
+	
+	return err;
+}
@@ -28,6 +28,7 @@
 
 #include <IOKit/usb/IOUSBController.h>
 #include <IOKit/usb/IOUSBLog.h>
+#include <IOKit/usb/IOUSBPipe.h>
 #include "USBTracepoints.h"
 
 #define super IOUSBBus
@@ -571,7 +572,22 @@ IOUSBController::Write(IOMemoryDescriptor *buffer, USBDeviceAddress address, End
     }
 
 	// 7455477: from this point forward, we have the command object, and we need to be careful to put it back if there is an error..
-	if (reqCount)
+	// A tiny bulk or interrupt OUT payload can be sent by some UIMs as immediate data, in which case we just copy it
+	// into the command and skip setting up the IODMACommand (and the disjoint descriptor check) altogether. The UIM's
+	// capability is looked up the first time each command is used and cached in the command, which stays with this controller
+	if (reqCount && (reqCount <= kUSBCommandMaxImmediateDataSize) && ((endpoint->transferType == kUSBBulk) || (endpoint->transferType == kUSBInterrupt)))
+	{
+		if (command->GetImmediateOUTSupport() == kUSBCommandImmediateOUTUnknown)
+			command->SetImmediateOUTSupport((getProperty(kUSBControllerSupportsImmediateOUTData) == kOSBooleanTrue) ? kUSBCommandImmediateOUTSupported : kUSBCommandImmediateOUTUnsupported);
+		
+		if ((command->GetImmediateOUTSupport() == kUSBCommandImmediateOUTSupported) && (buffer->readBytes(0, command->GetImmediateBuffer(), reqCount) == reqCount))
+		{
+			USBLog(7, "%s[%p]::Write - sending %d bytes as immediate data", getName(), this, (int)reqCount);
+			command->SetImmediateTransfer(true);
+		}
+	}
+	
+	if (reqCount && !command->GetImmediateTransfer())
 	{
 		IOMemoryDescriptor	*memDesc;
 		
@@ -629,7 +645,8 @@ IOUSBController::Write(IOMemoryDescriptor *buffer, USBDeviceAddress address, End
 		nullCompletion.parameter = (void *) NULL;
 		command->SetDisjointCompletion(nullCompletion);
 
-		err = CheckForDisjointDescriptor(command, endpoint->maxPacketSize);
+		if (!command->GetImmediateTransfer())
+			err = CheckForDisjointDescriptor(command, endpoint->maxPacketSize);
 		if (!err)
 		{			
 			err = _commandGate->runAction(DoIOTransfer, command);
@@ -712,6 +729,13 @@ IOUSBController::IsocIO(IOMemoryDescriptor *				buffer,
 		return kIOReturnBadArgument;
 	}
 
+	// only the full speed UIMs (UHCI and OHCI) know what to do with kAppleUSBIsocASAPFrame. The others would take it as a frame number
+	if ( (frameStart == kAppleUSBIsocASAPFrame) && (_controllerSpeed != kUSBDeviceSpeedFull) )
+	{
+		USBLog(3, "%s[%p]::IsocIO - kAppleUSBIsocASAPFrame is not supported by this controller.  Returning kIOReturnUnsupported(0x%x)", getName(), this, kIOReturnUnsupported);
+		return kIOReturnUnsupported;
+	}
+
     if ( completion->action == &IOUSBSyncIsoCompletion )
 	{
 		syncTransfer = true;
@@ -861,6 +885,13 @@ IOUSBController::IsocIO(IOMemoryDescriptor *			buffer,
 		return kIOReturnBadArgument;
 	}
 	
+	// only the full speed UIMs (UHCI and OHCI) know what to do with kAppleUSBIsocASAPFrame. The others would take it as a frame number
+	if ( (frameStart == kAppleUSBIsocASAPFrame) && (_controllerSpeed != kUSBDeviceSpeedFull) )
+	{
+		USBLog(3, "%s[%p]::IsocIO(LL) - kAppleUSBIsocASAPFrame is not supported by this controller.  Returning kIOReturnUnsupported(0x%x)", getName(), this, kIOReturnUnsupported);
+		return kIOReturnUnsupported;
+	}
+	
     if ( (uintptr_t)completion->action == (uintptr_t)&IOUSBSyncIsoCompletion )
 	{
 		syncTransfer = true;
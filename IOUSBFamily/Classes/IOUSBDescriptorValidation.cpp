@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <string.h>
+
+#include <IOKit/usb/IOUSBDescriptorValidation.h>
+
+
+
+IOReturn
+IOUSBValidateConfigurationDescriptor(const void *buffer, UInt32 length, void *outBuffer, UInt32 *outLength, UInt32 *repairs)
+{
+	const IOUSBConfigurationDescriptor	*config = (const IOUSBConfigurationDescriptor*)buffer;
+	const UInt8							*in = (const UInt8*)buffer;
+	UInt8								*out = (UInt8*)outBuffer;
+	IOUSBConfigurationDescriptor		*outConfig = (IOUSBConfigurationDescriptor*)outBuffer;
+	UInt32								total, readOff, writeOff;
+	UInt8								bLength, bDescriptorType;
+	UInt8								interfaceSeen[32];
+	UInt32								numInterfaces = 0;
+	bool								haveInterface = false;
+	SInt32								lastIADEnd = -1;
+	UInt32								firstInterface, lastInterface;
+	bool								keep;
+
+	*repairs = 0;
+	*outLength = 0;
+	if (!buffer || !outBuffer)
+		return kIOReturnBadArgument;
+
+	if (length < sizeof(IOUSBConfigurationDescriptor))
+		return kIOReturnUnderrun;
+
+	if ((config->bDescriptorType != kUSBConfDesc) || (config->bLength < sizeof(IOUSBConfigurationDescriptor)))
+		return kIOReturnBadArgument;
+
+	total = USBToHostWord(config->wTotalLength);
+	if (total > length)
+	{
+		*repairs |= kUSBDescRepairTruncatedTotal;
+		total = length;
+	}
+	if (total < config->bLength)
+		return kIOReturnUnderrun;
+
+	memset(interfaceSeen, 0, sizeof(interfaceSeen));
+
+	// the copy only ever moves descriptors towards the start, so doing it in place is fine
+	if (out != in)
+		memmove(out, in, config->bLength);
+	readOff = writeOff = config->bLength;
+
+	while (readOff < total)
+	{
+		if ((total - readOff) < 2)
+		{
+			*repairs |= kUSBDescRepairTrailingBytes;
+			break;
+		}
+
+		bLength = in[readOff];
+		bDescriptorType = in[readOff + 1];
+		if (bLength < 2)
+		{
+			*repairs |= kUSBDescRepairZeroLength;
+			break;
+		}
+		if (bLength > (total - readOff))
+		{
+			*repairs |= kUSBDescRepairOverrun;
+			break;
+		}
+
+		keep = true;
+		switch (bDescriptorType)
+		{
+			case kUSBConfDesc:
+				*repairs |= kUSBDescRepairOverlap;
+				keep = false;
+				break;
+
+			case kUSBInterfaceDesc:
+				if (bLength < sizeof(IOUSBInterfaceDescriptor))
+				{
+					*repairs |= kUSBDescRepairShortDescriptor;
+					keep = false;
+					break;
+				}
+				haveInterface = true;
+				firstInterface = ((const IOUSBInterfaceDescriptor*)(in + readOff))->bInterfaceNumber;
+				if (!(interfaceSeen[firstInterface >> 3] & (1 << (firstInterface & 7))))
+				{
+					interfaceSeen[firstInterface >> 3] |= (1 << (firstInterface & 7));
+					numInterfaces++;
+				}
+				break;
+
+			case kUSBEndpointDesc:
+				if (bLength < sizeof(IOUSBEndpointDescriptor))
+				{
+					*repairs |= kUSBDescRepairShortDescriptor;
+					keep = false;
+				}
+				else if (!haveInterface)
+				{
+					*repairs |= kUSBDescRepairOrphanEndpoint;
+					keep = false;
+				}
+				break;
+
+			case kUSBInterfaceAssociationDesc:
+				if (bLength < sizeof(IOUSBInterfaceAssociationDescriptor))
+				{
+					*repairs |= kUSBDescRepairShortDescriptor;
+					keep = false;
+					break;
+				}
+				// an IAD has to cover at least one interface, all of them after whatever the previous one covered
+				firstInterface = ((const IOUSBInterfaceAssociationDescriptor*)(in + readOff))->bFirstInterface;
+				lastInterface = firstInterface + ((const IOUSBInterfaceAssociationDescriptor*)(in + readOff))->bInterfaceCount;
+				if ((lastInterface == firstInterface) || (lastInterface > 256) || ((SInt32)firstInterface < lastIADEnd))
+				{
+					*repairs |= kUSBDescRepairOverlap;
+					keep = false;
+					break;
+				}
+				lastIADEnd = (SInt32)lastInterface;
+				break;
+
+			default:
+				break;
+		}
+
+		if (keep)
+		{
+			if ((out != in) || (writeOff != readOff))
+				memmove(out + writeOff, in + readOff, bLength);
+			writeOff += bLength;
+		}
+		readOff += bLength;
+	}
+
+	if (numInterfaces != config->bNumInterfaces)
+		*repairs |= kUSBDescRepairInterfaceCount;
+
+	outConfig->wTotalLength = HostToUSBWord((UInt16)writeOff);
+	*outLength = writeOff;
+	return kIOReturnSuccess;
+}
@@ -0,0 +1,857 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+#include <kern/clock.h>
+
+#include <IOKit/IOWorkLoop.h>
+#include <IOKit/IOMessage.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBController.h>
+#include <IOKit/usb/IOUSBDeviceAutoSuspend.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBDeviceAutoSuspend, OSObject)
+
+IOLock *	IOUSBDeviceAutoSuspend::_deviceLock = NULL;
+
+// one of these rides along with each asynchronous request, between BeginIO and its completion
+struct IOUSBDeviceAutoSuspend::AutoSuspendRequest
+{
+	IOUSBDeviceAutoSuspend *			owner;						// retained until the request is done
+	IOUSBCompletion						completion;					// the client's own completion
+	IOUSBPipe *							pipe;						// retained until the request is done
+	IOUSBAutoSuspendIO					io;							// io.buffer is retained until the request is done
+	AutoSuspendRequest *				next;						// while it waits for the resume
+};
+
+
+
+IOReturn
+IOUSBDeviceAutoSuspend::SetDeviceIdleTime(IOUSBDevice *device, UInt32 idleTimeMS)
+{
+	IOUSBDeviceAutoSuspend	*autoSuspend;
+	IOUSBDeviceAutoSuspend	*loser = NULL;
+	IOLock					*lock;
+
+	if (!device || !device->_expansionData)
+		return kIOReturnBadArgument;
+
+	autoSuspend = CopyAutoSuspend(device);
+	if (!autoSuspend)
+	{
+		if (idleTimeMS == 0)
+			return kIOReturnSuccess;
+
+		if (device->isInactive())
+			return kIOReturnNotResponding;
+
+		if (!_deviceLock)
+		{
+			lock = IOLockAlloc();
+			if (!lock)
+				return kIOReturnNoMemory;
+			if (!OSCompareAndSwapPtr(NULL, lock, &_deviceLock))
+				IOLockFree(lock);
+		}
+
+		autoSuspend = new IOUSBDeviceAutoSuspend;
+		if (!autoSuspend)
+			return kIOReturnNoMemory;
+
+		if (!autoSuspend->initWithDevice(device))
+		{
+			autoSuspend->release();
+			return kIOReturnNoMemory;
+		}
+
+		// the device keeps one reference until it terminates, and we keep the one from new until we are done here
+		IOLockLock(_deviceLock);
+		if (device->_expansionData->_autoSuspend)
+		{
+			loser = autoSuspend;
+			autoSuspend = device->_expansionData->_autoSuspend;
+		}
+		else
+			device->_expansionData->_autoSuspend = autoSuspend;
+		autoSuspend->retain();
+		IOLockUnlock(_deviceLock);
+
+		if (loser)
+			loser->release();
+	}
+
+	USBLog(5, "IOUSBDeviceAutoSuspend[%p]::SetDeviceIdleTime - device %s idle time %d ms", autoSuspend, device->getName(), (uint32_t)idleTimeMS);
+	autoSuspend->SetIdleTime(idleTimeMS);
+	autoSuspend->release();
+	return kIOReturnSuccess;
+}
+
+
+
+IOUSBDeviceAutoSuspend *
+IOUSBDeviceAutoSuspend::CopyAutoSuspend(IOUSBDevice *device)
+{
+	IOUSBDeviceAutoSuspend	*autoSuspend;
+
+	// every request on every pipe comes through here, and almost no device has one, so look before taking the lock
+	if (!device || !device->_expansionData || !device->_expansionData->_autoSuspend || !_deviceLock)
+		return NULL;
+
+	IOLockLock(_deviceLock);
+	autoSuspend = device->_expansionData->_autoSuspend;
+	if (autoSuspend)
+		autoSuspend->retain();
+	IOLockUnlock(_deviceLock);
+
+	return autoSuspend;
+}
+
+
+
+bool
+IOUSBDeviceAutoSuspend::initWithDevice(IOUSBDevice *device)
+{
+	if (!device || !super::init())
+		return false;
+
+	_lock = IOLockAlloc();
+	if (!_lock)
+		return false;
+
+	_idleThread = thread_call_allocate((thread_call_func_t)IdleTimerEntry, (thread_call_param_t)this);
+	if (!_idleThread)
+		return false;
+
+	_resumeThread = thread_call_allocate((thread_call_func_t)ResumeEntry, (thread_call_param_t)this);
+	if (!_resumeThread)
+		return false;
+
+	_device = device;
+	_device->retain();
+
+	_interestNotifier = _device->registerInterest(gIOGeneralInterest, DeviceMessage, this, NULL);
+	if (!_interestNotifier)
+		return false;
+
+	_state = kUSBAutoSuspendActive;
+	return true;
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::free()
+{
+	// pending thread calls and requests all hold a reference, so there is nothing left to cancel by now
+	if (_interestNotifier)
+	{
+		_interestNotifier->remove();
+		_interestNotifier = NULL;
+	}
+	if (_device)
+	{
+		_device->release();
+		_device = NULL;
+	}
+	if (_resumeThread)
+	{
+		thread_call_free(_resumeThread);
+		_resumeThread = NULL;
+	}
+	if (_idleThread)
+	{
+		thread_call_free(_idleThread);
+		_idleThread = NULL;
+	}
+	if (_lock)
+	{
+		IOLockFree(_lock);
+		_lock = NULL;
+	}
+	super::free();
+}
+
+
+
+IOReturn
+IOUSBDeviceAutoSuspend::DeviceMessage(void *target, void *refCon, UInt32 messageType, IOService *provider, void *messageArgument, vm_size_t argSize)
+{
+#pragma unused (refCon, provider, messageArgument, argSize)
+	IOUSBDeviceAutoSuspend	*me = (IOUSBDeviceAutoSuspend*)target;
+
+	if (messageType == kIOMessageServiceIsTerminated)
+		me->DeviceTerminated();
+
+	return kIOReturnSuccess;
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::DeviceTerminated(void)
+{
+	AutoSuspendRequest	*queue;
+	AutoSuspendRequest	*request;
+	UInt32				gateWaiters;
+
+	IOLockLock(_lock);
+	if (_terminated)
+	{
+		IOLockUnlock(_lock);
+		return;
+	}
+	_terminated = true;
+	_idleTimeMS = 0;
+
+	if (thread_call_cancel(_idleThread))
+	{
+		_timerPending = false;
+		release();
+	}
+	if (thread_call_cancel(_resumeThread))
+	{
+		// the resume never started, so nobody else will wake the synchronous requests up
+		_state = kUSBAutoSuspendActive;
+		release();
+	}
+
+	queue = _queueHead;
+	_queueHead = _queueTail = NULL;
+	IOLockWakeup(_lock, &_state, false);
+	gateWaiters = _gateWaiters;
+	IOLockUnlock(_lock);
+	if (gateWaiters)
+		WakeGateWaiters();
+
+	USBLog(5, "IOUSBDeviceAutoSuspend[%p]::DeviceTerminated - %s", this, _device->getName());
+
+	while (queue)
+	{
+		request = queue;
+		queue = request->next;
+		FailRequest(request, kIOReturnNotResponding);
+	}
+
+	// a thread call which was already running may still be using the device, and it keeps the object (and so the device) alive until it is
+	// done. Dropping the device's reference to us here would let us go from inside the notification, so let the idle thread call do it.
+	retain();
+	if (thread_call_enter(_idleThread))
+		release();
+}
+
+
+
+// on the idle thread call, once the device has terminated
+void
+IOUSBDeviceAutoSuspend::Detach(void)
+{
+	IOUSBDevice		*device = _device;
+	IONotifier		*notifier = _interestNotifier;
+	bool			owned = false;
+
+	if (notifier && OSCompareAndSwapPtr(notifier, NULL, &_interestNotifier))
+		notifier->remove();
+
+	IOLockLock(_deviceLock);
+	if (device->_expansionData && (device->_expansionData->_autoSuspend == this))
+	{
+		device->_expansionData->_autoSuspend = NULL;
+		owned = true;
+	}
+	IOLockUnlock(_deviceLock);
+
+	// the device's reference - our caller still holds one of its own, so we can't go away under it
+	if (owned)
+		release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::SetIdleTime(UInt32 idleTimeMS)
+{
+	if (idleTimeMS && (idleTimeMS < kUSBAutoSuspendMinIdleTimeMS))
+		idleTimeMS = kUSBAutoSuspendMinIdleTimeMS;
+
+	IOLockLock(_lock);
+	if (_terminated)
+	{
+		IOLockUnlock(_lock);
+		return;
+	}
+	_idleTimeMS = idleTimeMS;
+	if (idleTimeMS)
+	{
+		if (_outstanding == 0)
+			ArmIdleTimer();
+	}
+	else if (_state == kUSBAutoSuspendSuspended)
+	{
+		// the client turned us off, so don't leave the device suspended behind its back. This can be called from anywhere, so don't wait
+		StartResume();
+	}
+	IOLockUnlock(_lock);
+	PublishStatistics();
+}
+
+
+
+IOReturn
+IOUSBDeviceAutoSuspend::BeginIO(IOUSBPipe *pipe, const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOUSBCompletion *wrapped, bool *deferred)
+{
+	AutoSuspendRequest	*request = NULL;
+	IOWorkLoop			*workLoop;
+
+	if (deferred)
+		*deferred = false;
+
+	if (completion)
+	{
+		if (!pipe || !io || !wrapped || !deferred)
+			return kIOReturnBadArgument;
+
+		request = (AutoSuspendRequest*)IOMalloc(sizeof(AutoSuspendRequest));
+		if (!request)
+			return kIOReturnNoMemory;
+	}
+
+	IOLockLock(_lock);
+	if (!completion && (_transitionThread != current_thread()) && (_issueThread != current_thread()))
+	{
+		// a synchronous request can wait for the port, unless it is on the workloop, where the controller would refuse it anyway
+		while (!_terminated && (_state != kUSBAutoSuspendActive))
+		{
+			workLoop = _device->GetBus() ? _device->GetBus()->getWorkLoop() : NULL;
+			if (workLoop && workLoop->onThread())
+			{
+				IOLockUnlock(_lock);
+				USBLog(1, "IOUSBDeviceAutoSuspend[%p]::BeginIO - synchronous request for suspended %s on the workloop", this, _device->getName());
+				return kIOUSBSyncRequestOnWLThread;
+			}
+
+			if (_state == kUSBAutoSuspendSuspended)
+				StartResume();
+			else if (_state == kUSBAutoSuspendSuspending)
+				_resumeWanted = true;
+
+			if (workLoop && workLoop->inGate())
+			{
+				// the suspend or resume needs the gate this thread is holding, so give it up while we wait. We still hold it between
+				// looking at the state and going to sleep, and WakeGateWaiters takes it to wake us, so the wakeup can't be missed
+				_gateWaiters++;
+				IOLockUnlock(_lock);
+				workLoop->sleepGate(&_state, THREAD_UNINT);
+				IOLockLock(_lock);
+				_gateWaiters--;
+			}
+			else
+				IOLockSleep(_lock, &_state, THREAD_UNINT);
+		}
+	}
+	_outstanding++;
+
+	if (request)
+	{
+		retain();
+		pipe->retain();
+		if (io->buffer)
+			io->buffer->retain();
+		request->owner = this;
+		request->completion = *completion;
+		request->pipe = pipe;
+		request->io = *io;
+		request->next = NULL;
+		wrapped->target = this;
+		wrapped->action = CompletionEntry;
+		wrapped->parameter = request;
+
+		// our own SetFeature/ClearFeature requests come through here while the state is changing, and go straight out
+		if ((_state != kUSBAutoSuspendActive) && (_transitionThread != current_thread()))
+		{
+			if (_queueTail)
+				_queueTail->next = request;
+			else
+				_queueHead = request;
+			_queueTail = request;
+			*deferred = true;
+
+			// IdleTimerFired picks up anything queued while it is suspending
+			if (_state == kUSBAutoSuspendSuspended)
+				StartResume();
+		}
+	}
+	IOLockUnlock(_lock);
+
+	return kIOReturnSuccess;
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::EndIO(IOUSBCompletion *wrapped)
+{
+	if (wrapped)
+	{
+		RequestDone((AutoSuspendRequest*)wrapped->parameter);
+		return;
+	}
+
+	IOLockLock(_lock);
+	if (_outstanding)
+		_outstanding--;
+	if (_outstanding == 0)
+		ArmIdleTimer();
+	IOLockUnlock(_lock);
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::RequestDone(AutoSuspendRequest *request)
+{
+	if (request->io.buffer)
+		request->io.buffer->release();
+	request->pipe->release();
+	IOFree(request, sizeof(AutoSuspendRequest));
+	EndIO();
+	release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::FailRequest(AutoSuspendRequest *request, IOReturn status)
+{
+	IOUSBCompletion		completion = request->completion;
+
+	if (completion.action)
+		(*completion.action)(completion.target, completion.parameter, status, (UInt32)request->io.reqCount);
+
+	RequestDone(request);
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::CompletionEntry(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining)
+{
+	IOUSBDeviceAutoSuspend	*me = (IOUSBDeviceAutoSuspend*)target;
+	AutoSuspendRequest		*request = (AutoSuspendRequest*)parameter;
+	IOUSBCompletion			completion = request->completion;
+
+	// call the client first - most of them queue the next request from here, which keeps the count from touching 0
+	if (completion.action)
+		(*completion.action)(completion.target, completion.parameter, status, bufferSizeRemaining);
+
+	me->RequestDone(request);
+}
+
+
+
+IOReturn
+IOUSBDeviceAutoSuspend::NoteActivity(void)
+{
+	// these can come from completion routines and the workloop, so just start the resume and let the request go
+	IOLockLock(_lock);
+	if (_state == kUSBAutoSuspendSuspended)
+		StartResume();
+	else if (_state == kUSBAutoSuspendSuspending)
+		_resumeWanted = true;
+	else if (_outstanding == 0)
+		ArmIdleTimer();
+	IOLockUnlock(_lock);
+
+	return kIOReturnSuccess;
+}
+
+
+
+// called with the lock held, in the kUSBAutoSuspendSuspended state
+void
+IOUSBDeviceAutoSuspend::StartResume(void)
+{
+	_state = kUSBAutoSuspendResuming;
+	_resumeWanted = false;
+	retain();
+	if (thread_call_enter(_resumeThread))
+		release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::ResumeEntry(thread_call_param_t me, thread_call_param_t unused)
+{
+#pragma unused (unused)
+	IOUSBDeviceAutoSuspend	*autoSuspend = (IOUSBDeviceAutoSuspend*)me;
+
+	autoSuspend->ResumeAndIssue();
+	autoSuspend->release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::ResumeAndIssue(void)
+{
+	UInt32		gateWaiters;
+	
+	IOLockLock(_lock);
+	if (_state != kUSBAutoSuspendResuming)
+	{
+		IOLockUnlock(_lock);
+		return;
+	}
+	_transitionThread = current_thread();
+	IOLockUnlock(_lock);
+
+	Resume();
+
+	IOLockLock(_lock);
+	IssueQueued();
+	gateWaiters = _gateWaiters;
+	IOLockUnlock(_lock);
+	if (gateWaiters)
+		WakeGateWaiters();
+}
+
+
+
+// called with the lock held, on a thread call, once the port is usable again. Leaves the state active
+void
+IOUSBDeviceAutoSuspend::IssueQueued(void)
+{
+	AutoSuspendRequest	*request;
+
+	// issue what was queued in order. Anything new which comes in meanwhile goes on the end of the queue, so it can't pass these
+	_issueThread = current_thread();
+	while ((request = _queueHead) != NULL)
+	{
+		_queueHead = request->next;
+		if (!_queueHead)
+			_queueTail = NULL;
+		IOLockUnlock(_lock);
+
+		IssueRequest(request);
+
+		IOLockLock(_lock);
+	}
+	_issueThread = NULL;
+	_state = kUSBAutoSuspendActive;
+	if (_outstanding == 0)
+		ArmIdleTimer();
+	IOLockWakeup(_lock, &_state, false);
+}
+
+
+
+// called without the lock once a suspend or resume has ended, for synchronous requests waiting in sleepGate
+void
+IOUSBDeviceAutoSuspend::WakeGateWaiters(void)
+{
+	IOWorkLoop		*workLoop = _device->GetBus() ? _device->GetBus()->getWorkLoop() : NULL;
+
+	if (!workLoop)
+		return;
+
+	// the waiter holds the gate until it is asleep, so once we have it the wakeup can't go by unseen
+	workLoop->closeGate();
+	workLoop->wakeupGate(&_state, false);
+	workLoop->openGate();
+}
+
+
+
+// on the resume thread call, with the request already counted and its references taken
+void
+IOUSBDeviceAutoSuspend::IssueRequest(AutoSuspendRequest *request)
+{
+	IOUSBCompletion		wrapped;
+	IOReturn			err;
+
+	wrapped.target = this;
+	wrapped.action = CompletionEntry;
+	wrapped.parameter = request;
+
+	err = request->pipe->DoIO(&request->io, &wrapped, NULL);
+	if (err)
+	{
+		USBLog(3, "IOUSBDeviceAutoSuspend[%p]::IssueRequest - queued request on %s failed (0x%x)", this, _device->getName(), err);
+		FailRequest(request, err);
+	}
+}
+
+
+
+// called with the lock held
+void
+IOUSBDeviceAutoSuspend::ArmIdleTimer(void)
+{
+	uint64_t	deadline;
+
+	if (!_idleTimeMS || (_state != kUSBAutoSuspendActive))
+		return;
+
+	_idleSince = mach_absolute_time();
+
+	// a busy device goes through here on every completion, so only the first one sets the timer and IdleTimerFired takes care of the rest
+	if (_timerPending)
+		return;
+
+	_timerPending = true;
+	clock_interval_to_deadline(_idleTimeMS, kMillisecondScale, &deadline);
+	retain();
+	if (thread_call_enter_delayed(_idleThread, deadline))
+		release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::IdleTimerEntry(thread_call_param_t me, thread_call_param_t unused)
+{
+#pragma unused (unused)
+	IOUSBDeviceAutoSuspend	*autoSuspend = (IOUSBDeviceAutoSuspend*)me;
+
+	autoSuspend->IdleTimerFired();
+	autoSuspend->release();
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::IdleTimerFired(void)
+{
+	uint64_t		interval;
+	uint64_t		deadline;
+	IOReturn		err;
+	UInt32			gateWaiters;
+
+	IOLockLock(_lock);
+	_timerPending = false;
+	if (_terminated)
+	{
+		IOLockUnlock(_lock);
+		Detach();
+		return;
+	}
+	if (!_idleTimeMS || (_state != kUSBAutoSuspendActive) || _outstanding)
+	{
+		IOLockUnlock(_lock);
+		return;
+	}
+
+	// there may have been traffic since the timer was set - if so, wait out the rest of the idle time from the last completion
+	clock_interval_to_absolutetime_interval(_idleTimeMS, kMillisecondScale, &interval);
+	deadline = _idleSince + interval;
+	if (mach_absolute_time() < deadline)
+	{
+		_timerPending = true;
+		retain();
+		if (thread_call_enter_delayed(_idleThread, deadline))
+			release();
+		IOLockUnlock(_lock);
+		return;
+	}
+
+	_state = kUSBAutoSuspendSuspending;
+	_transitionThread = current_thread();
+	IOLockUnlock(_lock);
+
+	USBLog(5, "IOUSBDeviceAutoSuspend[%p]::IdleTimerFired - suspending %s after %d ms idle", this, _device->getName(), (uint32_t)_idleTimeMS);
+	SetRemoteWakeup(true);
+	err = _device->SuspendDevice(true);
+
+	IOLockLock(_lock);
+	_transitionThread = NULL;
+	if (err)
+	{
+		USBLog(2, "IOUSBDeviceAutoSuspend[%p]::IdleTimerFired - could not suspend %s (0x%x)", this, _device->getName(), err);
+		_failedSuspendCount++;
+		IssueQueued();									// which tries again after another idle time
+	}
+	else
+	{
+		_suspendCount++;
+		_suspendedSince = mach_absolute_time();
+		_state = kUSBAutoSuspendSuspended;
+
+		// anything which came in while we were suspending is waiting for this
+		if (_queueHead || _resumeWanted)
+			StartResume();
+		IOLockWakeup(_lock, &_state, false);
+	}
+	gateWaiters = _gateWaiters;
+	IOLockUnlock(_lock);
+	if (gateWaiters)
+		WakeGateWaiters();
+
+	PublishStatistics();
+}
+
+
+
+// called in the kUSBAutoSuspendResuming state, on the _transitionThread, without the lock. The caller issues the queue and goes active
+IOReturn
+IOUSBDeviceAutoSuspend::Resume(void)
+{
+	uint64_t		start = mach_absolute_time();
+	uint64_t		end;
+	uint64_t		latencyNS;
+	uint64_t		suspendedNS;
+	IOReturn		err;
+
+	err = _device->SuspendDevice(false);
+	end = mach_absolute_time();
+	if (err == kIOReturnSuccess)
+		SetRemoteWakeup(false);
+
+	absolutetime_to_nanoseconds(end - start, &latencyNS);
+
+	IOLockLock(_lock);
+	absolutetime_to_nanoseconds(end - _suspendedSince, &suspendedNS);
+	_suspendedTimeNS += suspendedNS;
+	_resumeCount++;
+	_totalResumeLatencyNS += latencyNS;
+	if (latencyNS > _maxResumeLatencyNS)
+		_maxResumeLatencyNS = latencyNS;
+
+	// even if the resume failed there is nothing more we can do with the port, so let the requests go and fail on their own
+	_transitionThread = NULL;
+	IOLockUnlock(_lock);
+
+	USBLog(5, "IOUSBDeviceAutoSuspend[%p]::Resume - %s resumed in %d us (0x%x)", this, _device->getName(), (uint32_t)(latencyNS / 1000), err);
+	PublishStatistics();
+	return err;
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::SetRemoteWakeup(bool enable)
+{
+	const IOUSBConfigurationDescriptor	*cd;
+	IOUSBDevRequest						request;
+	IOReturn							err;
+
+	if (enable)
+	{
+		cd = _device->FindConfig(_device->_currentConfigValue);
+		if (!cd || !(cd->bmAttributes & kUSBAtrRemoteWakeup))
+			return;
+	}
+	else if (!_remoteWakeupArmed)
+		return;
+
+	request.bmRequestType = USBmakebmRequestType(kUSBOut, kUSBStandard, kUSBDevice);
+	request.bRequest = enable ? kUSBRqSetFeature : kUSBRqClearFeature;
+	request.wValue = kUSBFeatureDeviceRemoteWakeup;
+	request.wIndex = 0;
+	request.wLength = 0;
+	request.pData = NULL;
+	request.wLenDone = 0;
+
+	err = _device->DeviceRequest(&request);
+	if (err)
+	{
+		USBLog(3, "IOUSBDeviceAutoSuspend[%p]::SetRemoteWakeup(%s) - error 0x%x", this, enable ? "true" : "false", err);
+		if (enable)
+			return;
+	}
+	_remoteWakeupArmed = enable;
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::GetStatistics(UInt32 *suspends, UInt32 *resumes, UInt64 *suspendedTimeMS, UInt32 *averageResumeLatencyUS, UInt32 *maxResumeLatencyUS)
+{
+	uint64_t		suspendedNS;
+
+	IOLockLock(_lock);
+	suspendedNS = _suspendedTimeNS;
+	if (_state == kUSBAutoSuspendSuspended)
+	{
+		uint64_t	currentNS;
+
+		absolutetime_to_nanoseconds(mach_absolute_time() - _suspendedSince, &currentNS);
+		suspendedNS += currentNS;
+	}
+	if (suspends)
+		*suspends = _suspendCount;
+	if (resumes)
+		*resumes = _resumeCount;
+	if (suspendedTimeMS)
+		*suspendedTimeMS = suspendedNS / 1000000ULL;
+	if (averageResumeLatencyUS)
+		*averageResumeLatencyUS = _resumeCount ? (UInt32)((_totalResumeLatencyNS / _resumeCount) / 1000) : 0;
+	if (maxResumeLatencyUS)
+		*maxResumeLatencyUS = (UInt32)(_maxResumeLatencyNS / 1000);
+	IOLockUnlock(_lock);
+}
+
+
+
+void
+IOUSBDeviceAutoSuspend::PublishStatistics(void)
+{
+	OSDictionary		*dict;
+	OSNumber			*number;
+	UInt32				suspends, resumes, averageLatency, maxLatency;
+	UInt64				suspendedTime;
+
+	GetStatistics(&suspends, &resumes, &suspendedTime, &averageLatency, &maxLatency);
+
+	dict = OSDictionary::withCapacity(6);
+	if (!dict)
+		return;
+
+#define ADD_NUMBER(key, value, bits)				\
+	number = OSNumber::withNumber(value, bits);		\
+	if (number)										\
+	{												\
+		dict->setObject(key, number);				\
+		number->release();							\
+	}
+
+	ADD_NUMBER("Idle Time (ms)", _idleTimeMS, 32);
+	ADD_NUMBER("Suspends", suspends, 32);
+	ADD_NUMBER("Failed Suspends", _failedSuspendCount, 32);
+	ADD_NUMBER("Resumes", resumes, 32);
+	ADD_NUMBER("Suspended Time (ms)", suspendedTime, 64);
+	ADD_NUMBER("Average Resume Latency (us)", averageLatency, 32);
+	ADD_NUMBER("Max Resume Latency (us)", maxLatency, 32);
+
+#undef ADD_NUMBER
+
+	_device->setProperty(kUSBAutoSuspendStatisticsKey, dict);
+	dict->release();
+}
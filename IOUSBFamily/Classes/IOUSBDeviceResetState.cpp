@@ -0,0 +1,273 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <libkern/OSAtomic.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBInterface.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBDeviceResetState.h>
+#include <IOKit/usb/IOUSBQuirks.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBDeviceResetState, OSObject)
+
+
+
+IOUSBDeviceResetState *
+IOUSBDeviceResetState::withDevice(IOUSBDevice *device)
+{
+	IOUSBDeviceResetState	*state = new IOUSBDeviceResetState;
+
+	if (state && !state->initWithDevice(device))
+	{
+		state->release();
+		state = NULL;
+	}
+	return state;
+}
+
+
+
+bool
+IOUSBDeviceResetState::initWithDevice(IOUSBDevice *device)
+{
+	OSArray				*interfaces;
+	IOUSBInterface		*interface;
+	bool				tooMany = false;
+	UInt32				i;
+
+	if (!device || !device->_expansionData || !super::init())
+		return false;
+
+	_device = device;
+	_device->retain();
+	_configValue = _device->_currentConfigValue;
+
+	IOLockLock(_device->_expansionData->_interfaceArrayLock);
+	interfaces = _device->_expansionData->_interfaceArray;
+	for (i = 0; interfaces && (i < interfaces->getCount()); i++)
+	{
+		interface = OSDynamicCast(IOUSBInterface, interfaces->getObject(i));
+		if (!interface)
+			continue;
+
+		if (_numInterfaces == kUSBResetStateMaxInterfaces)
+		{
+			USBLog(1, "IOUSBDeviceResetState[%p]::initWithDevice - %s has more than %d interfaces", this, _device->getName(), kUSBResetStateMaxInterfaces);
+			tooMany = true;
+			break;
+		}
+		interface->retain();
+		_interfaces[_numInterfaces].interface = interface;
+		_interfaces[_numInterfaces].interfaceNumber = interface->GetInterfaceNumber();
+		_interfaces[_numInterfaces].alternateSetting = interface->GetAlternateSetting();
+		_numInterfaces++;
+	}
+	IOLockUnlock(_device->_expansionData->_interfaceArrayLock);
+
+	// a partial restore would be worse than none
+	if (tooMany)
+		return false;
+
+	// streams are only remembered by the interface itself, and only recreated from there
+	for (i = 0; i < _numInterfaces; i++)
+		_interfaces[i].interface->RememberStreams();
+
+	USBLog(5, "IOUSBDeviceResetState[%p]::initWithDevice - %s configuration %d, %d interfaces", this, _device->getName(), _configValue, (uint32_t)_numInterfaces);
+	return true;
+}
+
+
+
+void
+IOUSBDeviceResetState::free()
+{
+	UInt32		i;
+
+	for (i = 0; i < _numInterfaces; i++)
+	{
+		if (_interfaces[i].interface)
+		{
+			_interfaces[i].interface->release();
+			_interfaces[i].interface = NULL;
+		}
+	}
+	_numInterfaces = 0;
+
+	if (_device)
+	{
+		_device->release();
+		_device = NULL;
+	}
+	super::free();
+}
+
+
+
+IOReturn
+IOUSBDeviceResetState::ResetDeviceAndRestore(IOUSBDevice *device)
+{
+	IOUSBDeviceResetState	*state;
+	IOUSBDeviceQuirks		quirks;
+	IOReturn				err;
+
+	if (!device || !device->_expansionData)
+		return kIOReturnBadArgument;
+
+	if (!OSCompareAndSwap(0, 1, &device->_expansionData->_resetRestoreInProgress))
+	{
+		USBLog(2, "IOUSBDeviceResetState::ResetDeviceAndRestore - %s is already being reset", device->getName());
+		return kIOReturnBusy;
+	}
+
+	state = withDevice(device);
+	if (!state)
+	{
+		OSCompareAndSwap(1, 0, &device->_expansionData->_resetRestoreInProgress);
+		return kIOReturnNoMemory;
+	}
+
+	// nothing new gets onto a pipe from here on, so everything outstanding, and everything issued until the restore is done,
+	// ends with kIOReturnAborted before the port goes away underneath it
+	state->AbortPipes();
+
+	err = device->ResetDevice();
+	if (err)
+	{
+		USBLog(2, "IOUSBDeviceResetState[%p]::ResetDeviceAndRestore - ResetDevice returned 0x%x", state, err);
+	}
+	else
+	{
+		// a slow device may not be ready for SET_CONFIGURATION as soon as the reset is done
+		if (IOUSBQuirks::GetDeviceQuirks(device, &quirks) && (quirks.quirks & kUSBQuirkExtraResetDelay))
+			IOSleep(quirks.resetDelayMS);
+		err = state->Restore();
+	}
+
+	OSCompareAndSwap(1, 0, &device->_expansionData->_resetRestoreInProgress);
+	state->release();
+	return err;
+}
+
+
+
+bool
+IOUSBDeviceResetState::BlocksIO(IOUSBDevice *device)
+{
+	return device && device->_expansionData && device->_expansionData->_resetRestoreInProgress;
+}
+
+
+
+void
+IOUSBDeviceResetState::AbortPipes(void)
+{
+	IOUSBPipe		*pipe;
+	UInt32			i, j;
+
+	for (i = 0; i < _numInterfaces; i++)
+	{
+		for (j = 0; j < kUSBMaxPipes; j++)
+		{
+			pipe = _interfaces[i].interface->GetPipeObj(j);
+			if (pipe)
+				pipe->Abort();
+		}
+	}
+
+	pipe = _device->GetPipeZero();
+	if (pipe)
+		pipe->Abort();
+}
+
+
+
+IOReturn
+IOUSBDeviceResetState::Restore(void)
+{
+	InterfaceState	*state;
+	IOReturn		err;
+	UInt32			i;
+
+	if (_configValue == 0)
+		return kIOReturnSuccess;
+
+	// this also puts every interface back to alternate setting 0 and resets the toggles on the device side
+	err = SendStandardRequest(kUSBRqSetConfig, kUSBDevice, _configValue, 0);
+	if (err)
+	{
+		USBLog(1, "IOUSBDeviceResetState[%p]::Restore - SET_CONFIGURATION(%d) on %s returned 0x%x", this, _configValue, _device->getName(), err);
+		return err;
+	}
+
+	for (i = 0; i < _numInterfaces; i++)
+	{
+		state = &_interfaces[i];
+		if (state->alternateSetting)
+		{
+			err = SendStandardRequest(kUSBRqSetInterface, kUSBInterface, state->alternateSetting, state->interfaceNumber);
+			if (err)
+			{
+				USBLog(1, "IOUSBDeviceResetState[%p]::Restore - SET_INTERFACE(%d, %d) on %s returned 0x%x", this, state->interfaceNumber, state->alternateSetting, _device->getName(), err);
+				return err;
+			}
+		}
+
+		// whatever the controller still has of the old endpoints goes, and the pipes get new ones for the setting now selected
+		state->interface->UnlinkPipes();
+		state->interface->ReopenPipes();
+
+		err = state->interface->RecreateStreams();
+		if (err)
+		{
+			USBLog(1, "IOUSBDeviceResetState[%p]::Restore - RecreateStreams on interface %d returned 0x%x", this, state->interfaceNumber, err);
+			return err;
+		}
+	}
+
+	USBLog(5, "IOUSBDeviceResetState[%p]::Restore - %s is back in configuration %d", this, _device->getName(), _configValue);
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn
+IOUSBDeviceResetState::SendStandardRequest(UInt8 bRequest, UInt8 recipient, UInt16 wValue, UInt16 wIndex)
+{
+	IOUSBDevRequest		request;
+
+	request.bmRequestType = USBmakebmRequestType(kUSBOut, kUSBStandard, recipient);
+	request.bRequest = bRequest;
+	request.wValue = wValue;
+	request.wIndex = wIndex;
+	request.wLength = 0;
+	request.pData = NULL;
+	request.wLenDone = 0;
+
+	// straight to pipe zero, past the BlocksIO check its public ControlRequest makes
+	return _device->GetPipeZero()->DoControlRequest(&request, kUSBDefaultControlNoDataTimeoutMS, kUSBDefaultControlCompletionTimeoutMS, NULL);
+}
+
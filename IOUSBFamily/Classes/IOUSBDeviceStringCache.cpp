@@ -0,0 +1,319 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <libkern/OSByteOrder.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBDeviceStringCache.h>
+#include <IOKit/usb/IOUSBQuirks.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBDeviceStringCache, OSObject)
+
+
+
+IOUSBDeviceStringCache *
+IOUSBDeviceStringCache::withDevice(IOUSBDevice *device)
+{
+	IOUSBDeviceStringCache	*cache = new IOUSBDeviceStringCache;
+
+	if (cache && !cache->initWithDevice(device))
+	{
+		cache->release();
+		cache = NULL;
+	}
+	return cache;
+}
+
+
+
+bool
+IOUSBDeviceStringCache::initWithDevice(IOUSBDevice *device)
+{
+	if (!device || !super::init())
+		return false;
+
+	_lock = IOLockAlloc();
+	if (!_lock)
+		return false;
+
+	_device = device;
+	return true;
+}
+
+
+
+void
+IOUSBDeviceStringCache::free()
+{
+	if (_lock)
+	{
+		Invalidate();
+		IOLockFree(_lock);
+		_lock = NULL;
+	}
+	super::free();
+}
+
+
+
+bool
+IOUSBDeviceStringCache::Lookup(UInt8 index, UInt16 lang, char *buf, int maxLen)
+{
+	bool		found = false;
+	int			i;
+
+	if (!buf || (maxLen <= 0))
+		return false;
+
+	IOLockLock(_lock);
+	for (i = 0; i < kUSBStringCacheEntries; i++)
+	{
+		if (_entries[i].string && (_entries[i].index == index) && (_entries[i].lang == lang))
+		{
+			strlcpy(buf, _entries[i].string->getCStringNoCopy(), maxLen);
+			found = true;
+			break;
+		}
+	}
+	if (found)
+	{
+		_hits++;
+		_transfersSaved += kUSBStringCacheTransfersPerString;
+	}
+	else
+		_misses++;
+	IOLockUnlock(_lock);
+
+	return found;
+}
+
+
+
+void
+IOUSBDeviceStringCache::Insert(UInt8 index, UInt16 lang, const char *string)
+{
+	OSString	*newString;
+	OSString	*oldString = NULL;
+	int			i;
+	int			slot = -1;
+
+	// string 0 is the LANGID list, not a string
+	if ((index == 0) || !string)
+		return;
+
+	newString = OSString::withCString(string);
+	if (!newString)
+		return;
+
+	IOLockLock(_lock);
+	for (i = 0; i < kUSBStringCacheEntries; i++)
+	{
+		if (_entries[i].string && (_entries[i].index == index) && (_entries[i].lang == lang))
+		{
+			slot = i;
+			break;
+		}
+		if (!_entries[i].string && (slot < 0))
+			slot = i;
+	}
+	if (slot < 0)
+	{
+		slot = _nextVictim;
+		_nextVictim = (_nextVictim + 1) % kUSBStringCacheEntries;
+	}
+	oldString = _entries[slot].string;
+	_entries[slot].string = newString;
+	_entries[slot].index = index;
+	_entries[slot].lang = lang;
+	IOLockUnlock(_lock);
+
+	if (oldString)
+		oldString->release();
+}
+
+
+
+void
+IOUSBDeviceStringCache::Invalidate(void)
+{
+	OSString	*strings[kUSBStringCacheEntries];
+	int			i;
+
+	IOLockLock(_lock);
+	for (i = 0; i < kUSBStringCacheEntries; i++)
+	{
+		strings[i] = _entries[i].string;
+		_entries[i].string = NULL;
+	}
+	_nextVictim = 0;
+	_numLanguages = 0;
+	IOLockUnlock(_lock);
+
+	// don't release them with the lock held
+	for (i = 0; i < kUSBStringCacheEntries; i++)
+	{
+		if (strings[i])
+			strings[i]->release();
+	}
+}
+
+
+
+IOReturn
+IOUSBDeviceStringCache::ReadLanguages(void)
+{
+	IOUSBDevRequest		request;
+	UInt8				desc[2 + (2 * kUSBStringCacheMaxLanguages)];
+	UInt32				numLanguages;
+	UInt32				i;
+	IOReturn			err;
+
+	bzero(desc, sizeof(desc));
+	request.bmRequestType = USBmakebmRequestType(kUSBIn, kUSBStandard, kUSBDevice);
+	request.bRequest = kUSBRqGetDescriptor;
+	request.wValue = (kUSBStringDesc << 8) | 0;
+	request.wIndex = 0;
+	request.wLength = sizeof(desc);
+	request.wLenDone = 0;
+	request.pData = desc;
+
+	err = _device->DeviceRequest(&request);
+	if (err)
+	{
+		USBLog(5, "IOUSBDeviceStringCache[%p]::ReadLanguages - error 0x%x reading the LANGID list", this, err);
+		return err;
+	}
+
+	// the list has to hold at least one LANGID, both in what we got and in what the descriptor says it is
+	if ((request.wLenDone < 4) || (desc[0] < 4) || (desc[1] != kUSBStringDesc))
+	{
+		USBLog(5, "IOUSBDeviceStringCache[%p]::ReadLanguages - bad LANGID list (%d bytes, type %d)", this, (int)request.wLenDone, desc[1]);
+		return kIOReturnUnderrun;
+	}
+
+	numLanguages = (((desc[0] < request.wLenDone) ? desc[0] : request.wLenDone) - 2) / 2;
+	if (numLanguages > kUSBStringCacheMaxLanguages)
+		numLanguages = kUSBStringCacheMaxLanguages;
+
+	IOLockLock(_lock);
+	for (i = 0; i < numLanguages; i++)
+		_languages[i] = OSReadLittleInt16(desc, 2 + (2 * i));
+	_numLanguages = numLanguages;
+	IOLockUnlock(_lock);
+
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn
+IOUSBDeviceStringCache::Prefetch(void)
+{
+	IOUSBDeviceQuirks	quirks;
+	UInt8		indexes[3];
+	UInt16		languages[kUSBStringCacheMaxLanguages + 1];
+	UInt32		numLanguages;
+	UInt32		i, j;
+	char		buf[256];
+	IOReturn	err;
+
+	indexes[0] = _device->GetManufacturerStringIndex();
+	indexes[1] = _device->GetProductStringIndex();
+	indexes[2] = _device->GetSerialNumberStringIndex();
+	if (!indexes[0] && !indexes[1] && !indexes[2])
+		return kIOReturnSuccess;
+
+	// some devices hang, or worse, when asked for a string
+	if (IOUSBQuirks::GetDeviceQuirks(_device, &quirks) && (quirks.quirks & kUSBQuirkSkipStringDescriptors))
+		return kIOReturnSuccess;
+
+	err = ReadLanguages();
+	if (err)
+		return err;
+
+	IOLockLock(_lock);
+	numLanguages = _numLanguages;
+	bcopy(_languages, languages, numLanguages * sizeof(UInt16));
+	IOLockUnlock(_lock);
+
+	// GetStringDescriptor defaults to US English, so always have that one even if it is not the device's first language
+	for (i = 0; (i < numLanguages) && (languages[i] != kUSBStringCacheDefaultLanguage); i++)
+		;
+	if (i == numLanguages)
+		languages[numLanguages++] = kUSBStringCacheDefaultLanguage;
+
+	for (i = 0; i < numLanguages; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			if (!indexes[j])
+				continue;
+
+			err = _device->GetStringDescriptor(indexes[j], buf, sizeof(buf), languages[i]);
+			if (err)
+			{
+				USBLog(5, "IOUSBDeviceStringCache[%p]::Prefetch - error 0x%x reading string %d in language 0x%x", this, err, indexes[j], languages[i]);
+				continue;
+			}
+			Insert(indexes[j], languages[i], buf);
+		}
+	}
+
+	USBLog(6, "IOUSBDeviceStringCache[%p]::Prefetch - done, %d languages", this, (int)numLanguages);
+	return kIOReturnSuccess;
+}
+
+
+
+IOReturn
+IOUSBDeviceStringCache::GetString(UInt8 index, char *buf, int maxLen, UInt16 lang)
+{
+	IOReturn	err;
+
+	if (Lookup(index, lang, buf, maxLen))
+		return kIOReturnSuccess;
+
+	err = _device->GetStringDescriptor(index, buf, maxLen, lang);
+	if (err == kIOReturnSuccess)
+		Insert(index, lang, buf);
+
+	return err;
+}
+
+
+
+void
+IOUSBDeviceStringCache::GetStatistics(UInt32 *hits, UInt32 *misses, UInt32 *transfersSaved)
+{
+	IOLockLock(_lock);
+	if (hits)
+		*hits = _hits;
+	if (misses)
+		*misses = _misses;
+	if (transfersSaved)
+		*transfersSaved = _transfersSaved;
+	IOLockUnlock(_lock);
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBIsocFeedback.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBIsocFeedback, OSObject)
+
+
+
+static UInt32
+IntervalsPerPacket(IOUSBPipe *pipe)
+{
+	const IOUSBEndpointDescriptor	*ep = pipe->GetEndpointDescriptor();
+	UInt8							interval = ep ? ep->bInterval : 1;
+
+	// isoch bInterval is an exponent at every speed
+	if (interval < 1)
+		interval = 1;
+	if (interval > 16)
+		interval = 16;
+	return 1 << (interval - 1);
+}
+
+
+
+IOUSBIsocFeedback *
+IOUSBIsocFeedback::withPipes(IOUSBDevice *device, IOUSBPipe *dataPipe, IOUSBPipe *feedbackPipe, UInt32 sampleRate, UInt32 bytesPerSampleFrame)
+{
+	IOUSBIsocFeedback	*feedback = new IOUSBIsocFeedback;
+
+	if (feedback && !feedback->initWithPipes(device, dataPipe, feedbackPipe, sampleRate, bytesPerSampleFrame))
+	{
+		feedback->release();
+		feedback = NULL;
+	}
+	return feedback;
+}
+
+
+
+bool
+IOUSBIsocFeedback::initWithPipes(IOUSBDevice *device, IOUSBPipe *dataPipe, IOUSBPipe *feedbackPipe, UInt32 sampleRate, UInt32 bytesPerSampleFrame)
+{
+	UInt8		speed;
+
+	if (!device || !dataPipe || !sampleRate || !bytesPerSampleFrame || !super::init())
+		return false;
+
+	if ((dataPipe->GetType() != kUSBIsoc) || (dataPipe->GetDirection() != kUSBOut))
+	{
+		USBLog(1, "IOUSBIsocFeedback[%p]::initWithPipes - data pipe %p is not an isoch OUT pipe", this, dataPipe);
+		return false;
+	}
+
+	if (dataPipe->GetSyncType() != kUSBAsynchronousIsocSyncType)
+	{
+		USBLog(3, "IOUSBIsocFeedback[%p]::initWithPipes - data pipe %p has sync type %d, not asynchronous", this, dataPipe, dataPipe->GetSyncType());
+	}
+
+	if (feedbackPipe)
+	{
+		if ((feedbackPipe->GetType() != kUSBIsoc) || (feedbackPipe->GetDirection() != kUSBIn))
+		{
+			USBLog(1, "IOUSBIsocFeedback[%p]::initWithPipes - feedback pipe %p is not an isoch IN pipe", this, feedbackPipe);
+			return false;
+		}
+
+		// anything but an explicit feedback endpoint is an IN data endpoint running from the same clock
+		_format = (feedbackPipe->GetUsageType() == kUSBFeedbackIsocUsageType) ? kUSBIsocFeedbackUnknown : kUSBIsocFeedbackImplicit;
+		_feedbackIntervalsPerPacket = IntervalsPerPacket(feedbackPipe);
+		_feedbackPacketSize = feedbackPipe->GetMaxPacketSize();
+		if ((_format != kUSBIsocFeedbackImplicit) && (_feedbackPacketSize > kUSBIsocFeedbackMaxPacketSize))
+			_feedbackPacketSize = kUSBIsocFeedbackMaxPacketSize;
+
+		_feedbackPipe = feedbackPipe;
+		_feedbackPipe->retain();
+	}
+
+	_dataPipe = dataPipe;
+	_dataPipe->retain();
+
+	speed = device->GetSpeed();
+	_busIntervalsPerSecond = ((speed == kUSBDeviceSpeedHigh) || (speed == kUSBDeviceSpeedSuper)) ? 8000 : 1000;
+	_intervalsPerPacket = IntervalsPerPacket(dataPipe);
+	_maxPacketSize = dataPipe->GetMaxPacketSize();
+	_bytesPerSampleFrame = bytesPerSampleFrame;
+
+	Reset(sampleRate);
+
+	USBLog(5, "IOUSBIsocFeedback[%p]::initWithPipes - %d Hz, %d bus intervals per packet, nominal 0x%x per interval, feedback pipe %p", this, (uint32_t)sampleRate, (uint32_t)_intervalsPerPacket, (uint32_t)_nominalRate, feedbackPipe);
+	return true;
+}
+
+
+
+void
+IOUSBIsocFeedback::free()
+{
+	if (_feedbackPipe)
+	{
+		_feedbackPipe->release();
+		_feedbackPipe = NULL;
+	}
+	if (_dataPipe)
+	{
+		_dataPipe->release();
+		_dataPipe = NULL;
+	}
+	super::free();
+}
+
+
+
+void
+IOUSBIsocFeedback::Reset(UInt32 sampleRate)
+{
+	if (sampleRate)
+	{
+		_sampleRate = sampleRate;
+		_nominalRate = (UInt32)(((UInt64)sampleRate << 16) / _busIntervalsPerSecond);
+	}
+
+	_currentRate = _nominalRate;
+	_remainder = 0;
+	_minRate = _nominalRate;
+	_maxRate = _nominalRate;
+}
+
+
+
+bool
+IOUSBIsocFeedback::RateIsPlausible(UInt32 rate)
+{
+	UInt32	tolerance = _nominalRate >> kUSBIsocFeedbackToleranceShift;
+
+	return (rate >= (_nominalRate - tolerance)) && (rate <= (_nominalRate + tolerance));
+}
+
+
+
+void
+IOUSBIsocFeedback::SetCurrentRate(UInt32 rate)
+{
+	_currentRate = rate;
+	_feedbackCount++;
+	if (rate < _minRate)
+		_minRate = rate;
+	if (rate > _maxRate)
+		_maxRate = rate;
+}
+
+
+
+UInt32
+IOUSBIsocFeedback::ParseExplicitFeedback(const UInt8 *packet, UInt32 length)
+{
+	UInt32		value, as10_14, as16_16;
+
+	if (length < 3)
+		return 0;
+
+	value = packet[0] | (packet[1] << 8) | (packet[2] << 16);
+	if (length >= 4)
+		value |= (packet[3] << 24);
+
+	as10_14 = (value & 0x00FFFFFF) << 2;
+	as16_16 = value;
+
+	switch (_format)
+	{
+		case kUSBIsocFeedback10_14:
+			return as10_14;
+
+		case kUSBIsocFeedback16_16:
+			return as16_16;
+
+		default:
+			break;
+	}
+
+	// try the format the spec calls for at this speed first
+	if (_busIntervalsPerSecond == 1000)
+	{
+		if (RateIsPlausible(as10_14))
+			_format = kUSBIsocFeedback10_14;
+		else if (RateIsPlausible(as16_16))
+			_format = kUSBIsocFeedback16_16;
+	}
+	else
+	{
+		if (RateIsPlausible(as16_16))
+			_format = kUSBIsocFeedback16_16;
+		else if (RateIsPlausible(as10_14))
+			_format = kUSBIsocFeedback10_14;
+	}
+
+	if (_format == kUSBIsocFeedbackUnknown)
+		return 0;
+
+	USBLog(5, "IOUSBIsocFeedback[%p]::ParseExplicitFeedback - %d byte feedback is %s", this, (uint32_t)length, (_format == kUSBIsocFeedback10_14) ? "10.14" : "16.16");
+	return (_format == kUSBIsocFeedback10_14) ? as10_14 : as16_16;
+}
+
+
+
+UInt32
+IOUSBIsocFeedback::GetFeedbackBufferSize(UInt32 numFrames)
+{
+	return numFrames * _feedbackPacketSize;
+}
+
+
+
+void
+IOUSBIsocFeedback::PrepareFeedbackRead(IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames)
+{
+	UInt32		i;
+
+	for (i = 0; i < numFrames; i++)
+	{
+		frameList[i].frStatus = kIOReturnInvalid;
+		frameList[i].frReqCount = _feedbackPacketSize;
+		frameList[i].frActCount = 0;
+		AbsoluteTime_to_scalar(&frameList[i].frTimeStamp) = 0;
+	}
+}
+
+
+
+UInt32
+IOUSBIsocFeedback::ProcessFeedback(const UInt8 *buffer, IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames)
+{
+	UInt32		offset = 0;
+	UInt32		updates = 0;
+	UInt32		rate;
+	UInt64		samples = 0;
+	UInt32		packets = 0;
+	UInt32		i;
+
+	if (!_feedbackPipe || !buffer || !frameList)
+		return 0;
+
+	// the packets are where their frReqCount put them, whatever the device actually sent
+	for (i = 0; i < numFrames; offset += frameList[i].frReqCount, i++)
+	{
+		if ((frameList[i].frStatus != kIOReturnSuccess) && (frameList[i].frStatus != kIOReturnUnderrun))
+			continue;
+
+		if (_format == kUSBIsocFeedbackImplicit)
+		{
+			samples += frameList[i].frActCount / _bytesPerSampleFrame;
+			packets++;
+			continue;
+		}
+
+		if (frameList[i].frActCount == 0)
+			continue;
+
+		rate = ParseExplicitFeedback(buffer + offset, frameList[i].frActCount);
+		if (!rate || !RateIsPlausible(rate))
+		{
+			_rejectedFeedback++;
+			continue;
+		}
+
+		SetCurrentRate(rate);
+		updates++;
+	}
+
+	if (packets)
+	{
+		rate = (UInt32)((samples << 16) / ((UInt64)packets * _feedbackIntervalsPerPacket));
+		if (RateIsPlausible(rate))
+		{
+			SetCurrentRate(rate);
+			updates++;
+		}
+		else
+			_rejectedFeedback++;
+	}
+	return updates;
+}
+
+
+
+UInt32
+IOUSBIsocFeedback::FillFrameList(IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames)
+{
+	UInt64		perPacket = (UInt64)_currentRate * _intervalsPerPacket;
+	UInt64		accumulator;
+	UInt32		samples, bytes;
+	UInt32		total = 0;
+	UInt32		i;
+
+	for (i = 0; i < numFrames; i++)
+	{
+		accumulator = _remainder + perPacket;
+		samples = (UInt32)(accumulator >> 16);
+		_remainder = (UInt32)(accumulator & 0xFFFF);
+
+		bytes = samples * _bytesPerSampleFrame;
+		if (bytes > _maxPacketSize)
+		{
+			USBLog(6, "IOUSBIsocFeedback[%p]::FillFrameList - %d bytes won't fit in a %d byte packet", this, (uint32_t)bytes, (uint32_t)_maxPacketSize);
+			bytes = (_maxPacketSize / _bytesPerSampleFrame) * _bytesPerSampleFrame;
+		}
+
+		frameList[i].frStatus = kIOReturnInvalid;
+		frameList[i].frReqCount = bytes;
+		frameList[i].frActCount = 0;
+		total += bytes;
+	}
+	return total;
+}
+
+
+
+UInt32
+IOUSBIsocFeedback::GetCurrentSampleRate(void)
+{
+	return (UInt32)(((UInt64)_currentRate * _busIntervalsPerSecond + 0x8000) >> 16);
+}
+
+
+
+void
+IOUSBIsocFeedback::GetStatistics(UInt32 *feedbackPackets, UInt32 *rejected, UInt32 *minSampleRate, UInt32 *maxSampleRate)
+{
+	if (feedbackPackets)
+		*feedbackPackets = _feedbackCount;
+	if (rejected)
+		*rejected = _rejectedFeedback;
+	if (minSampleRate)
+		*minSampleRate = (UInt32)(((UInt64)_minRate * _busIntervalsPerSecond + 0x8000) >> 16);
+	if (maxSampleRate)
+		*maxSampleRate = (UInt32)(((UInt64)_maxRate * _busIntervalsPerSecond + 0x8000) >> 16);
+}
@@ -23,9 +23,12 @@
 
 
 #include <sys/systm.h>
+#include <libkern/OSAtomic.h>
 
 #include <IOKit/usb/IOUSBLog.h>
 #include <IOKit/usb/USB.h>
+#include <IOKit/usb/IOUSBLogRateLimit.h>
+#include <IOKit/usb/IOUSBLogOutput.h>
 
 #ifdef	__cplusplus
 	extern "C" {
@@ -42,6 +45,9 @@ com_apple_iokit_KLog *		gKernelLogger		= NULL;
 const char LOWEST = 0x20;
 char *armor(void *buffer, int bytecount);
 
+// no rate limiting once the debug level is raised past this - the limiter itself is in IOUSBLogRateLimit.cpp
+UInt32						gKernelDebugRateLimitMaxLevel	= 1;
+
 //===========================================================================================================================
 //	EnableKernelDebugger
 //===========================================================================================================================
@@ -111,6 +117,30 @@ void	KernelDebugSetOutputType( KernelDebuggingOutputType inType )
 	IOLog( DEBUG_NAME "Debugging type changed to: %d\n", (int) gKernelDebugOutputType );
 }
 
+//===========================================================================================================================
+//	KernelDebugLogUnlimited
+//		For the suppression summaries, which must not be rate limited themselves.
+//===========================================================================================================================
+
+static void	KernelDebugLogUnlimited( UInt32 inLevel,  UInt32 inTag, char const *inFormatString, ... )
+{
+	va_list		ap;
+	
+	va_start( ap, inFormatString );
+	KernelDebugLogOutput( inLevel, inTag, inFormatString, ap );
+	va_end( ap );
+}
+
+//===========================================================================================================================
+//	KernelDebugLogSuppressed
+//		Called by the limiter's sweep for the sites which have gone quiet, as well as for the summaries handed back to us.
+//===========================================================================================================================
+
+void	KernelDebugLogSuppressed( const KernelDebugSuppressedSummary *inSummary )
+{
+	KernelDebugLogUnlimited( inSummary->level, inSummary->tag, "%d similar messages suppressed (%p): %s", (uint32_t)inSummary->suppressed, inSummary->object, inSummary->format );
+}
+
 //===========================================================================================================================
 //	KernelDebugLogInternal
 //		This is called when a macro is invoked or KernelDebugLog is called.
@@ -118,58 +148,27 @@ void	KernelDebugSetOutputType( KernelDebuggingOutputType inType )
 
 void	KernelDebugLogInternal( UInt32 inLevel,  UInt32 inTag, char const *inFormatString, ... )
 {	
-    UInt64		elapsedTime;
-    uint32_t		secs, milliSecs;
+    KernelDebugSuppressedSummary	summaries[kKernelDebugMaxSummaries];
+    UInt32							numSummaries = 0, i;
+    va_list							ap;
+    bool							allow = true;
     
     if ( inLevel > gKernelDebugLevel )
     {
         // The level is not high enough to be displayed, we're skipping this item.
         return;
     }
-    else
-    {
-        // Print to the console.
-
-        if ( gKernelDebugOutputType & kKernelDebugOutputIOLogType )
-        {		
-            va_list		ap;
-            extern void 	conslog_putc(char);
-           // extern void 	logwakeup();
-                    
-            // First, print our USB tag with the time
-            // Find our current time in seconds (since bootup)
-            //
-			uint64_t	currentTime = mach_absolute_time();
-			absolutetime_to_nanoseconds(*(AbsoluteTime *)&currentTime, &elapsedTime);
-            
-            // Convert it to milliseconds
-            //
-            elapsedTime = elapsedTime/(1000000);
-            secs = elapsedTime / 1000;
-            milliSecs = elapsedTime % 1000;
-
-            IOLog("%c%c%c%c:\t%d.%3.3d\t",(char)(inTag>>24), (char)(inTag>>16), (char)(inTag>>8), (uint32_t)inTag, secs, milliSecs);
-
-			va_start( ap, inFormatString );
-			IOLogv(inFormatString, ap);
-            va_end( ap );
-			
-            // And add a newline for USB logging
-            if ( inTag == 'USBF')
-                IOLog("\n");
-        }
-
-        // Write to the kernel logger if available.
-        
-        if ( (gKernelDebugOutputType & kKernelDebugOutputKextLoggerType) && gKernelLogger )
-        {
-            va_list		ap;
-                    
-            va_start( ap, inFormatString );
-            gKernelLogger->vLog( inLevel, inTag, inFormatString, ap );
-            va_end( ap );
-        }
-    }
+    
+    va_start( ap, inFormatString );
+    if ( gKernelDebugLevel <= gKernelDebugRateLimitMaxLevel )
+        allow = KernelDebugRateLimit( inLevel, inTag, inFormatString, ap, summaries, &numSummaries );
+    
+    for ( i = 0; i < numSummaries; i++ )
+        KernelDebugLogSuppressed( &summaries[i] );
+    
+    if ( allow )
+        KernelDebugLogOutput( inLevel, inTag, inFormatString, ap );
+    va_end( ap );
 }
 
 //====================================================================================================
@@ -0,0 +1,192 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <sys/systm.h>
+#include <libkern/OSAtomic.h>
+#include <kern/clock.h>
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBLog.h>
+#include <IOKit/usb/IOUSBLogOutput.h>
+
+// Scratch buffers for formatting a message once for every output. More than one thread logging at once is
+// rare, so a handful is plenty; when they're all taken we just format the old way
+#define kKernelDebugScratchBuffers			8
+#define kKernelDebugScratchSize				512
+
+static char							gKernelDebugScratch[kKernelDebugScratchBuffers][kKernelDebugScratchSize];
+static volatile UInt32				gKernelDebugScratchInUse	= 0;
+
+static void		KernelDebugLogTimestamp( uint32_t *outSecs, uint32_t *outMilliSecs );
+
+//===========================================================================================================================
+//	KernelDebugLogOutputDirect
+//		Formats the message separately for each output. Only used when there's no scratch buffer free or the message
+//		doesn't fit in one.
+//===========================================================================================================================
+
+void	KernelDebugLogOutputDirect( UInt32 inLevel,  UInt32 inTag, char const *inFormatString, va_list inArgs )
+{	
+    uint32_t		secs, milliSecs;
+    
+    // Print to the console.
+
+    if ( gKernelDebugOutputType & kKernelDebugOutputIOLogType )
+    {		
+        va_list		ap;
+        extern void 	conslog_putc(char);
+       // extern void 	logwakeup();
+                
+        // First, print our USB tag with the time
+        // Find our current time in seconds (since bootup)
+        //
+        KernelDebugLogTimestamp(&secs, &milliSecs);
+
+        IOLog("%c%c%c%c:\t%d.%3.3d\t",(char)(inTag>>24), (char)(inTag>>16), (char)(inTag>>8), (uint32_t)inTag, secs, milliSecs);
+
+        va_copy( ap, inArgs );
+        IOLogv(inFormatString, ap);
+        va_end( ap );
+        
+        // And add a newline for USB logging
+        if ( inTag == 'USBF')
+            IOLog("\n");
+    }
+
+    // Write to the kernel logger if available.
+    
+    if ( (gKernelDebugOutputType & kKernelDebugOutputKextLoggerType) && gKernelLogger )
+    {
+        va_list		ap;
+                
+        va_copy( ap, inArgs );
+        gKernelLogger->vLog( inLevel, inTag, inFormatString, ap );
+        va_end( ap );
+    }
+}
+
+//===========================================================================================================================
+//	KernelDebugLogTimestamp
+//		Seconds and milliseconds since boot. Where absolute time is already in nanoseconds, which is everywhere we run
+//		but ARM, the conversion is skipped.
+//===========================================================================================================================
+
+static void	KernelDebugLogTimestamp( uint32_t *outSecs, uint32_t *outMilliSecs )
+{
+	static mach_timebase_info_data_t	timebase = { 0, 0 };
+	uint64_t							elapsedTime = mach_absolute_time();
+	
+	if ( timebase.denom == 0 )
+		clock_timebase_info( &timebase );
+	
+	if ( timebase.numer != timebase.denom )
+		absolutetime_to_nanoseconds( elapsedTime, &elapsedTime );
+	
+	elapsedTime /= 1000000;
+	*outSecs = (uint32_t)(elapsedTime / 1000);
+	*outMilliSecs = (uint32_t)(elapsedTime - (*outSecs * 1000ULL));
+}
+
+//===========================================================================================================================
+//	KernelDebugKLogString
+//		KLog only takes a format and a va_list, so a message which has already been formatted goes through "%.*s".
+//===========================================================================================================================
+
+static void	KernelDebugKLogString( UInt32 inLevel,  UInt32 inTag, char const *inFormatString, ... )
+{
+	va_list		ap;
+	
+	va_start( ap, inFormatString );
+	gKernelLogger->vLog( inLevel, inTag, inFormatString, ap );
+	va_end( ap );
+}
+
+//===========================================================================================================================
+//	KernelDebugLogOutput
+//		The message is formatted once, tag and timestamp included, into a scratch buffer which every enabled output
+//		then shares.
+//===========================================================================================================================
+
+void	KernelDebugLogOutput( UInt32 inLevel,  UInt32 inTag, char const *inFormatString, va_list inArgs )
+{	
+    bool		toIOLog = (gKernelDebugOutputType & kKernelDebugOutputIOLogType);
+    bool		toKLog = (gKernelDebugOutputType & kKernelDebugOutputKextLoggerType) && gKernelLogger;
+    uint32_t	secs, milliSecs;
+    UInt32		mask = 0;
+    char *		buffer = NULL;
+    int			prefixLen, msgLen;
+    int			i;
+    va_list		ap;
+    
+    if ( !toIOLog && !toKLog )
+        return;
+    
+    for ( i = 0; i < kKernelDebugScratchBuffers; i++ )
+    {
+        mask = 1 << i;
+        if ( !(OSBitOrAtomic(mask, &gKernelDebugScratchInUse) & mask) )
+        {
+            buffer = gKernelDebugScratch[i];
+            break;
+        }
+    }
+    
+    if ( !buffer )
+    {
+        KernelDebugLogOutputDirect( inLevel, inTag, inFormatString, inArgs );
+        return;
+    }
+    
+    KernelDebugLogTimestamp(&secs, &milliSecs);
+    prefixLen = snprintf(buffer, kKernelDebugScratchSize, "%c%c%c%c:\t%d.%3.3d\t",(char)(inTag>>24), (char)(inTag>>16), (char)(inTag>>8), (char)inTag, secs, milliSecs);
+    
+    va_copy( ap, inArgs );
+    msgLen = vsnprintf(buffer + prefixLen, kKernelDebugScratchSize - prefixLen, inFormatString, ap);
+    va_end( ap );
+    
+    // leave room for the newline
+    if ( (prefixLen + msgLen + 2) > kKernelDebugScratchSize )
+    {
+        OSBitAndAtomic(~mask, &gKernelDebugScratchInUse);
+        KernelDebugLogOutputDirect( inLevel, inTag, inFormatString, inArgs );
+        return;
+    }
+    
+    // KLog has its own timestamp, and doesn't want the newline
+    if ( toKLog )
+        KernelDebugKLogString( inLevel, inTag, "%.*s", msgLen, buffer + prefixLen );
+    
+    if ( toIOLog )
+    {
+        // And add a newline for USB logging
+        if ( inTag == 'USBF')
+        {
+            buffer[prefixLen + msgLen] = '\n';
+            buffer[prefixLen + msgLen + 1] = '\0';
+        }
+        IOLog("%s", buffer);
+    }
+    
+    OSBitAndAtomic(~mask, &gKernelDebugScratchInUse);
+}
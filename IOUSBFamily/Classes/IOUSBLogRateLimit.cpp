@@ -0,0 +1,310 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <string.h>
+#include <libkern/OSAtomic.h>
+#include <kern/clock.h>
+#include <kern/thread_call.h>
+
+#include <IOKit/IOTypes.h>
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBLogRateLimit.h>
+
+// The format string belongs to whichever kext logged it and may be gone by the time of the summary, so its address is only
+// ever compared, and the summary prints the start of it which was copied when the slot was taken
+#define kKernelDebugRateLimitSlotBits		6
+#define kKernelDebugRateLimitSlots			(1 << kKernelDebugRateLimitSlotBits)
+
+UInt32						gKernelDebugRateLimitBurst		= 20;			// 0 == no rate limiting
+UInt32						gKernelDebugRateLimitPerSecond	= 5;
+UInt64						gKernelDebugSuppressedMessages	= 0;			// since boot
+UInt32						gKernelDebugSuppressingSites	= 0;			// slots holding unreported suppressed messages
+
+typedef struct KernelDebugRateLimitSlot
+{
+	uintptr_t				formatKey;				// address of the format string - never dereferenced
+	char					format[kKernelDebugFormatCopySize];
+	const void *			object;
+	UInt32					level;
+	UInt32					tag;
+	UInt32					milliTokens;
+	uint64_t				lastRefill;				// mach_absolute_time
+	UInt32					suppressed;				// since the last summary
+} KernelDebugRateLimitSlot;
+
+static KernelDebugRateLimitSlot		gRateLimitSlots[kKernelDebugRateLimitSlots];
+static volatile OSSpinLock			gRateLimitLock			= 0;
+static thread_call_t				gRateLimitSweepCall		= NULL;
+static volatile UInt32				gRateLimitSweepArmed	= 0;
+
+static void		KernelDebugRateLimitSweep( thread_call_param_t param0, thread_call_param_t param1 );
+
+// The sweep's thread call is allocated when the family loads, rather than by whichever thread first gets throttled - that may be
+// one which can't block. A sweep still queued when the family goes away must not fire into it.
+class KernelDebugRateLimitSweeper
+{
+public:
+	KernelDebugRateLimitSweeper()
+	{
+		gRateLimitSweepCall = thread_call_allocate( KernelDebugRateLimitSweep, NULL );
+	}
+	
+	~KernelDebugRateLimitSweeper()
+	{
+		if ( gRateLimitSweepCall )
+		{
+			thread_call_cancel( gRateLimitSweepCall );
+			thread_call_free( gRateLimitSweepCall );
+			gRateLimitSweepCall = NULL;
+		}
+	}
+};
+
+static KernelDebugRateLimitSweeper	gRateLimitSweeper;
+
+//===========================================================================================================================
+//	KernelDebugLogObject
+//		Our messages almost always start with "Class[%p]" or "%s[%p]" for the object doing the logging, which lets a
+//		misbehaving device be throttled without silencing the same message from every other one.
+//===========================================================================================================================
+
+static const void *	KernelDebugLogObject( char const *inFormatString, va_list inArgs )
+{
+	const char *	fmt = inFormatString;
+	const void *	object = NULL;
+	va_list			ap;
+	
+	while ( *fmt && ((fmt[0] != '%') || (fmt[1] == '%')) )
+		fmt += (fmt[0] == '%') ? 2 : 1;
+	
+	if ( !*fmt )
+		return NULL;
+	
+	// skip the flags, width, precision and length of the first conversion
+	fmt++;
+	while ( *fmt && strchr("-+ #0123456789.hlqjzt", *fmt) )
+		fmt++;
+	
+	va_copy( ap, inArgs );
+	if ( *fmt == 'p' )
+	{
+		object = va_arg( ap, const void * );
+	}
+	else if ( (*fmt == 's') && (strncmp(fmt + 1, "[%p]", 4) == 0) )
+	{
+		(void) va_arg( ap, const char * );
+		object = va_arg( ap, const void * );
+	}
+	va_end( ap );
+	
+	return object;
+}
+
+//===========================================================================================================================
+//	KernelDebugRateLimitHash
+//		Objects are often page aligned, and a kext's format strings sit close together, so the low bits of either say little.
+//		Multiplying spreads every bit of both into the top of the key, which is the only part of it worth using.
+//===========================================================================================================================
+
+static UInt32	KernelDebugRateLimitHash( char const *inFormatString, const void *inObject )
+{
+	uint64_t	key;
+	
+	key = ((uint64_t)(uintptr_t)inObject * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)(uintptr_t)inFormatString;
+	key *= 0x9E3779B97F4A7C15ULL;
+	return (UInt32)(key >> (64 - kKernelDebugRateLimitSlotBits));
+}
+
+//===========================================================================================================================
+//	KernelDebugSummarize
+//		Takes what the slot has held back, with the lock held.
+//===========================================================================================================================
+
+static void	KernelDebugSummarize( KernelDebugRateLimitSlot *inSlot, KernelDebugSuppressedSummary *outSummary )
+{
+	bcopy( inSlot->format, outSummary->format, sizeof(outSummary->format) );
+	outSummary->object = inSlot->object;
+	outSummary->level = inSlot->level;
+	outSummary->tag = inSlot->tag;
+	outSummary->suppressed = inSlot->suppressed;
+	inSlot->suppressed = 0;
+	gKernelDebugSuppressingSites--;
+}
+
+//===========================================================================================================================
+//	KernelDebugArmSweep
+//		A site which has gone quiet would otherwise never report what it dropped. This is safe from any context, since the
+//		thread call is already allocated.
+//===========================================================================================================================
+
+static void	KernelDebugArmSweep( void )
+{
+	uint64_t	deadline;
+	
+	if ( !gRateLimitSweepCall || !OSCompareAndSwap(0, 1, &gRateLimitSweepArmed) )
+		return;
+	
+	clock_interval_to_deadline( kKernelDebugRateLimitSweepMS, kMillisecondScale, &deadline );
+	thread_call_enter_delayed( gRateLimitSweepCall, deadline );
+}
+
+//===========================================================================================================================
+//	KernelDebugRateLimitSweep
+//		Reports every site which is holding messages back, a few at a time since they can't be logged with the lock held.
+//		If a logger has the lock, the next sweep gets them.
+//===========================================================================================================================
+
+static void	KernelDebugRateLimitSweep( thread_call_param_t param0, thread_call_param_t param1 )
+{
+#pragma unused(param0, param1)
+	KernelDebugSuppressedSummary	summaries[kKernelDebugMaxSummaries];
+	UInt32							numSummaries, slot = 0, i;
+	
+	while ( slot < kKernelDebugRateLimitSlots )
+	{
+		if ( !OSSpinLockTry(&gRateLimitLock) )
+			break;
+		
+		for ( numSummaries = 0; (slot < kKernelDebugRateLimitSlots) && (numSummaries < kKernelDebugMaxSummaries); slot++ )
+		{
+			if ( gRateLimitSlots[slot].suppressed )
+				KernelDebugSummarize( &gRateLimitSlots[slot], &summaries[numSummaries++] );
+		}
+		OSSpinLockUnlock(&gRateLimitLock);
+		
+		for ( i = 0; i < numSummaries; i++ )
+			KernelDebugLogSuppressed( &summaries[i] );
+	}
+	
+	// anything that started suppressing while we were at it didn't arm us, since we were still armed
+	gRateLimitSweepArmed = 0;
+	OSMemoryBarrier();
+	if ( gKernelDebugSuppressingSites )
+		KernelDebugArmSweep();
+}
+
+//===========================================================================================================================
+//	KernelDebugRateLimit
+//		Returns false if the message should be dropped. Summaries of suppressed messages which are due are returned in
+//		outSummaries for the caller to log, since they can't be printed with the lock held.
+//===========================================================================================================================
+
+bool	KernelDebugRateLimit( UInt32 inLevel, UInt32 inTag, char const *inFormatString, va_list inArgs,
+							  KernelDebugSuppressedSummary *outSummaries, UInt32 *outNumSummaries )
+{
+	KernelDebugRateLimitSlot *	slot;
+	const void *				object;
+	uint64_t					now, elapsedNS;
+	UInt32						burst = gKernelDebugRateLimitBurst;
+	UInt32						maxMilliTokens;
+	bool						allow = true;
+	
+	*outNumSummaries = 0;
+	if ( burst == 0 )
+		return true;
+	
+	// rather than wait behind another thread, let the message through
+	if ( !OSSpinLockTry(&gRateLimitLock) )
+		return true;
+	
+	object = KernelDebugLogObject( inFormatString, inArgs );
+	now = mach_absolute_time();
+	maxMilliTokens = burst * 1000;
+	slot = &gRateLimitSlots[ KernelDebugRateLimitHash(inFormatString, object) ];
+	
+	if ( (slot->formatKey != (uintptr_t)inFormatString) || (slot->object != object) )
+	{
+		// a different call site had this slot, report what it was holding back before reusing it
+		if ( slot->suppressed )
+			KernelDebugSummarize( slot, &outSummaries[(*outNumSummaries)++] );
+		
+		// the caller's format string is good for as long as this call, so this is the one time it can be read
+		slot->formatKey = (uintptr_t)inFormatString;
+		strncpy( slot->format, inFormatString, sizeof(slot->format) - 1 );
+		slot->format[sizeof(slot->format) - 1] = '\0';
+		slot->object = object;
+		slot->milliTokens = maxMilliTokens;
+		slot->lastRefill = now;
+	}
+	else
+	{
+		absolutetime_to_nanoseconds( now - slot->lastRefill, &elapsedNS );
+		elapsedNS = (elapsedNS / 1000000ULL) * gKernelDebugRateLimitPerSecond;
+		if ( slot->milliTokens > maxMilliTokens )
+			slot->milliTokens = maxMilliTokens;				// the burst was lowered
+		if ( elapsedNS >= (uint64_t)(maxMilliTokens - slot->milliTokens) )
+			slot->milliTokens = maxMilliTokens;
+		else
+			slot->milliTokens += (UInt32) elapsedNS;
+		slot->lastRefill = now;
+	}
+	slot->level = inLevel;
+	slot->tag = inTag;
+	
+	if ( slot->milliTokens >= 1000 )
+	{
+		slot->milliTokens -= 1000;
+		if ( slot->suppressed )
+			KernelDebugSummarize( slot, &outSummaries[(*outNumSummaries)++] );
+	}
+	else
+	{
+		if ( slot->suppressed++ == 0 )
+			gKernelDebugSuppressingSites++;
+		gKernelDebugSuppressedMessages++;
+		allow = false;
+	}
+	
+	OSSpinLockUnlock(&gRateLimitLock);
+	
+	if ( !allow && !gRateLimitSweepArmed )
+		KernelDebugArmSweep();
+	
+	return allow;
+}
+
+//===========================================================================================================================
+//	KernelDebugGetRateLimitStatistics
+//===========================================================================================================================
+
+void	KernelDebugGetRateLimitStatistics( UInt64 *outSuppressedMessages, UInt32 *outSuppressingSites )
+{
+	if ( outSuppressedMessages )
+		*outSuppressedMessages = gKernelDebugSuppressedMessages;
+	if ( outSuppressingSites )
+		*outSuppressingSites = gKernelDebugSuppressingSites;
+}
+
+//===========================================================================================================================
+//	KernelDebugSetRateLimit
+//		A burst of 0 turns rate limiting off. It is also off whenever gKernelDebugLevel is above gKernelDebugRateLimitMaxLevel.
+//===========================================================================================================================
+
+void	KernelDebugSetRateLimit( UInt32 inBurst, UInt32 inPerSecond )
+{
+	gKernelDebugRateLimitBurst = inBurst;
+	gKernelDebugRateLimitPerSecond = inPerSecond;
+	IOLog( "[KernelDebugging] Rate limit changed to: %d messages, %d per second\n", (int) inBurst, (int) inPerSecond );
+}
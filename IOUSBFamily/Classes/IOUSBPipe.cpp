@@ -38,6 +38,8 @@
 #include <IOKit/usb/IOUSBDevice.h>
 #include <IOKit/usb/IOUSBPipe.h>
 #include <IOKit/usb/IOUSBNub.h>
+#include <IOKit/usb/IOUSBDeviceAutoSuspend.h>
+#include <IOKit/usb/IOUSBDeviceResetState.h>
 #include <IOKit/usb/IOUSBLog.h>
 
 #include "IOUSBInterfaceUserClient.h"
@@ -354,6 +356,103 @@ IOUSBPipe::ClosePipe(void)
 }
 
 
+
+//================================================================================================
+//
+//   AutoSuspendIO
+//
+//   Straight to DoIO unless a client has turned on autosuspend for our device
+//
+//================================================================================================
+//
+IOReturn
+IOUSBPipe::AutoSuspendIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead)
+{
+	IOUSBDeviceAutoSuspend	*autoSuspend = NULL;
+	IOUSBCompletion			wrapped;
+	bool					deferred = false;
+	IOReturn				err;
+	
+	if (_expansionData && IOUSBDeviceResetState::BlocksIO(_DEVICE))
+	{
+		USBLog(3, "IOUSBPipe[%p]::AutoSuspendIO - the device is being reset, returning kIOReturnAborted", this);
+		return kIOReturnAborted;
+	}
+	
+	if (_expansionData)
+		autoSuspend = IOUSBDeviceAutoSuspend::CopyAutoSuspend(_DEVICE);
+	
+	// a completion with no action is rejected further down, so don't bother counting it
+	if (!autoSuspend || (completion && !completion->action))
+	{
+		if (autoSuspend)
+			autoSuspend->release();
+		return DoIO(io, completion, bytesRead);
+	}
+	
+	err = autoSuspend->BeginIO(this, io, completion, completion ? &wrapped : NULL, &deferred);
+	if ((err == kIOReturnSuccess) && !deferred)
+	{
+		err = DoIO(io, completion ? &wrapped : NULL, bytesRead);
+		if (!completion)
+			autoSuspend->EndIO();
+		else if (err)
+			autoSuspend->EndIO(&wrapped);
+	}
+	
+	autoSuspend->release();
+	return err;
+}
+
+
+
+IOReturn
+IOUSBPipe::AutoSuspendNoteActivity(void)
+{
+	IOUSBDeviceAutoSuspend	*autoSuspend;
+	IOReturn				err = kIOReturnSuccess;
+	
+	if (!_expansionData)
+		return kIOReturnSuccess;
+	
+	if (IOUSBDeviceResetState::BlocksIO(_DEVICE))
+	{
+		USBLog(3, "IOUSBPipe[%p]::AutoSuspendNoteActivity - the device is being reset, returning kIOReturnAborted", this);
+		return kIOReturnAborted;
+	}
+	
+	autoSuspend = IOUSBDeviceAutoSuspend::CopyAutoSuspend(_DEVICE);
+	if (autoSuspend)
+	{
+		err = autoSuspend->NoteActivity();
+		autoSuspend->release();
+	}
+	return err;
+}
+
+
+
+IOReturn
+IOUSBPipe::DoIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead)
+{
+	switch (io->type)
+	{
+		case kUSBAutoSuspendIORead:
+			return DoRead(io->buffer, io->noDataTimeout, io->completionTimeout, io->reqCount, completion, bytesRead);
+			
+		case kUSBAutoSuspendIOWrite:
+			return DoWrite(io->buffer, io->noDataTimeout, io->completionTimeout, io->reqCount, completion);
+			
+		case kUSBAutoSuspendIOControl:
+			return DoControlRequest((IOUSBDevRequest*)io->request, io->noDataTimeout, io->completionTimeout, completion);
+			
+		case kUSBAutoSuspendIOControlDesc:
+			return DoControlRequest((IOUSBDevRequestDesc*)io->request, io->noDataTimeout, io->completionTimeout, completion);
+	}
+	return kIOReturnBadArgument;
+}
+
+
 //================================================================================================
 //
 //   ClearPipeStall
@@ -656,6 +755,14 @@ IOUSBPipe::Read(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 complet
 
 IOReturn 
 IOUSBPipe::Read(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion, IOByteCount *bytesRead)
+{
+	IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIORead, buffer, NULL, noDataTimeout, completionTimeout, reqCount };
+	
+	return AutoSuspendIO(&io, completion, bytesRead);
+}
+
+IOReturn 
+IOUSBPipe::DoRead(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion, IOByteCount *bytesRead)
 {
 	IOUSBPipeV2		*pipev2 = OSDynamicCast(IOUSBPipeV2, this);
 	
@@ -758,6 +865,11 @@ IOUSBPipe::Read(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 complet
     USBLog(7, "IOUSBPipe[%p]::Read #4 (addr %d:%d type %d) - reqCount = %qd", this, _address, _endpoint.number , _endpoint.transferType, (uint64_t)reqCount);
 	USBTrace_Start( kUSBTPipe, kTPIBulkReadTS, _address, _endpoint.number , _endpoint.transferType, reqCount );
 	
+	// the time stamp completion has its own signature, so this one is not counted either
+	err = AutoSuspendNoteActivity();
+	if (err)
+		return err;
+	
     if ((_endpoint.transferType != kUSBBulk) && (noDataTimeout || completionTimeout))
     {
         USBLog(5, "IOUSBPipe[%p]::Read #4 - bad arguments:  (EP type: %d != kUSBBulk(%d)) && ( dataTimeout: %d || completionTimeout: %d)", this, _endpoint.transferType, kUSBBulk, (uint32_t)noDataTimeout, (uint32_t)completionTimeout);
@@ -860,6 +972,14 @@ IOUSBPipe::Write(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 comple
 
 IOReturn 
 IOUSBPipe::Write(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion)
+{
+	IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIOWrite, buffer, NULL, noDataTimeout, completionTimeout, reqCount };
+	
+	return AutoSuspendIO(&io, completion, NULL);
+}
+
+IOReturn 
+IOUSBPipe::DoWrite(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion)
 {
 	IOUSBPipeV2		*pipev2 = OSDynamicCast(IOUSBPipeV2, this);
 	
@@ -957,6 +1077,11 @@ IOUSBPipe::Read(IOMemoryDescriptor * buffer, UInt64 frameStart, UInt32 numFrames
 	
 	// USBTrace_Start( kUSBTPipe, kTPIsocPipeRead, (uintptr_t)this, (uintptr_t)buffer, frameStart, numFrames );
 	
+	// we can't follow isoch requests to their completion, so they only keep the device awake
+	err = AutoSuspendNoteActivity();
+	if (err)
+		return err;
+	
     if (_CORRECTSTATUS == kIOUSBPipeStalled)
     {
         USBLog(2, "IOUSBPipe[%p]::Read - invalid read on a stalled isoch pipe", this);
@@ -1020,6 +1145,10 @@ IOUSBPipe::Write(IOMemoryDescriptor * buffer, UInt64 frameStart, UInt32 numFrame
 	
 	// USBTrace_Start( kUSBTPipe, kTPIsocPipeWrite, (uintptr_t)this, (uintptr_t)buffer, frameStart, numFrames );
 	
+	err = AutoSuspendNoteActivity();
+	if (err)
+		return err;
+	
     if (_CORRECTSTATUS == kIOUSBPipeStalled)
     {
         USBLog(2, "IOUSBPipe[%p]::Write - invalid write on a stalled isoch pipe", this);
@@ -1089,6 +1218,10 @@ IOUSBPipe::Read(IOMemoryDescriptor *	buffer,
     USBLog(7, "IOUSBPipe[%p]::Read (Low Latency Isoc) buffer: %p, completion: %p, numFrames: %d, update: %d", this, buffer, completion, (uint32_t)numFrames, (uint32_t)updateFrequency);
 	// USBTrace_Start( kUSBTPipe, kTPIsocPipeReadLL, (uintptr_t)buffer, (uintptr_t)completion, (uint32_t)numFrames, (uint32_t)updateFrequency );
 	
+	err = AutoSuspendNoteActivity();
+	if (err)
+		return err;
+	
     if (_CORRECTSTATUS == kIOUSBPipeStalled)
     {
         USBLog(2, "IOUSBPipe[%p]::Read (Low Latency Isoc) - invalid read on a stalled low latency isoch pipe", this);
@@ -1155,6 +1288,10 @@ IOUSBPipe::Write(IOMemoryDescriptor * buffer, UInt64 frameStart, UInt32 numFrame
     USBLog(7, "IOUSBPipe[%p]::Write (Low Latency Isoc) buffer: %p, completion: %p, numFrames: %d, update: %d", this, buffer, completion, (uint32_t)numFrames, (uint32_t)updateFrequency);
 	//USBTrace_Start( kUSBTPipe, kTPIsocPipeWriteLL, (uintptr_t)buffer, (uintptr_t)completion, (uint32_t)numFrames, (uint32_t)updateFrequency);
 	
+	err = AutoSuspendNoteActivity();
+	if (err)
+		return err;
+	
     if (_CORRECTSTATUS == kIOUSBPipeStalled)
     {
         USBLog(2, "IOUSBPipe[%p]::Write (Low Latency Isoc) - invalid write on a stalled isoch pipe", this);
@@ -1222,6 +1359,19 @@ IOUSBPipe::ControlRequest(IOUSBDevRequest *request, IOUSBCompletion *completion)
 
 IOReturn 
 IOUSBPipe::ControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)
+{
+	IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIOControl, NULL, request, noDataTimeout, completionTimeout, 0 };
+	
+	if (!request)
+		return DoControlRequest(request, noDataTimeout, completionTimeout, completion);
+	
+	io.reqCount = request->wLength;
+	return AutoSuspendIO(&io, completion, NULL);
+}
+
+
+IOReturn 
+IOUSBPipe::DoControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)
 {
     IOReturn	err = kIOReturnSuccess;
 
@@ -1278,6 +1428,19 @@ IOUSBPipe::ControlRequest(IOUSBDevRequestDesc *request, IOUSBCompletion	*complet
 
 IOReturn 
 IOUSBPipe::ControlRequest(IOUSBDevRequestDesc *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion	*completion)
+{
+	IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIOControlDesc, NULL, request, noDataTimeout, completionTimeout, 0 };
+	
+	if (!request)
+		return DoControlRequest(request, noDataTimeout, completionTimeout, completion);
+	
+	io.reqCount = request->wLength;
+	return AutoSuspendIO(&io, completion, NULL);
+}
+
+
+IOReturn 
+IOUSBPipe::DoControlRequest(IOUSBDevRequestDesc *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion	*completion)
 {
     IOReturn	err = kIOReturnSuccess;
 	
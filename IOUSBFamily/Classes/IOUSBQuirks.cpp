@@ -0,0 +1,523 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <libkern/OSAtomic.h>
+#include <libkern/c++/OSBoolean.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+#include <libkern/c++/OSOrderedSet.h>
+
+#include <IOKit/IOCatalogue.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBQuirks.h>
+#include <IOKit/usb/IOUSBLog.h>
+
+#define super OSObject
+OSDefineMetaClassAndStructors(IOUSBQuirks, OSObject)
+
+IOLock *		IOUSBQuirks::_lock = NULL;
+IOUSBQuirks *	IOUSBQuirks::_current = NULL;
+bool			IOUSBQuirks::_loaded = false;
+bool			IOUSBQuirks::_pinned = false;
+SInt32			IOUSBQuirks::_generation = 0;
+
+
+
+static bool
+GetNumber(OSDictionary *dict, const char *key, UInt64 *value)
+{
+	OSNumber	*number = OSDynamicCast(OSNumber, dict->getObject(key));
+
+	if (!number)
+		return false;
+	*value = number->unsigned64BitValue();
+	return true;
+}
+
+
+
+static bool
+GetBoolean(OSDictionary *dict, const char *key)
+{
+	return (dict->getObject(key) == kOSBooleanTrue);
+}
+
+
+
+IOUSBQuirks *
+IOUSBQuirks::withArray(OSArray *entries)
+{
+	IOUSBQuirks	*quirks = new IOUSBQuirks;
+
+	if (quirks && !quirks->initWithArray(entries))
+	{
+		quirks->release();
+		quirks = NULL;
+	}
+	return quirks;
+}
+
+
+
+bool
+IOUSBQuirks::initWithArray(OSArray *entries)
+{
+	OSDictionary	*dict;
+	UInt32			count, i;
+
+	if (!entries || !super::init())
+		return false;
+
+	count = entries->getCount();
+	if (count > kUSBQuirksMaxEntries)
+	{
+		USBLog(1, "IOUSBQuirks[%p]::initWithArray - %d entries, only using the first %d", this, (uint32_t)count, kUSBQuirksMaxEntries);
+		count = kUSBQuirksMaxEntries;
+	}
+
+	_entries = entries;
+	_entries->retain();
+
+	if (count)
+	{
+		_devices = (DeviceEntry*)IOMalloc(count * sizeof(DeviceEntry));
+		_controllers = (ControllerEntry*)IOMalloc(count * sizeof(ControllerEntry));
+		_maxEntries = count;										// before anything can fail, so free() gives back what we got
+		if (!_devices || !_controllers)
+			return false;
+		bzero(_devices, count * sizeof(DeviceEntry));
+		bzero(_controllers, count * sizeof(ControllerEntry));
+	}
+
+	// a bad entry is skipped rather than failing the whole table, so one typo doesn't take every other workaround with it
+	for (i = 0; i < count; i++)
+	{
+		dict = OSDynamicCast(OSDictionary, entries->getObject(i));
+		if (!dict)
+		{
+			USBLog(1, "IOUSBQuirks[%p]::initWithArray - entry %d is not a dictionary", this, (uint32_t)i);
+			continue;
+		}
+
+		if (dict->getObject(kUSBQuirkVendorIDKey))
+		{
+			if (ParseDeviceEntry(dict, &_devices[_numDevices]))
+				_numDevices++;
+			else
+				USBLog(1, "IOUSBQuirks[%p]::initWithArray - device entry %d is not valid", this, (uint32_t)i);
+		}
+		else if (dict->getObject(kUSBQuirkPCIVendorIDKey))
+		{
+			if (ParseControllerEntry(dict, &_controllers[_numControllers]))
+				_numControllers++;
+			else
+				USBLog(1, "IOUSBQuirks[%p]::initWithArray - controller entry %d is not valid", this, (uint32_t)i);
+		}
+		else
+			USBLog(1, "IOUSBQuirks[%p]::initWithArray - entry %d has neither %s nor %s", this, (uint32_t)i, kUSBQuirkVendorIDKey, kUSBQuirkPCIVendorIDKey);
+	}
+
+	USBLog(5, "IOUSBQuirks[%p]::initWithArray - %d device and %d controller entries", this, (uint32_t)_numDevices, (uint32_t)_numControllers);
+	return true;
+}
+
+
+
+void
+IOUSBQuirks::free()
+{
+	if (_devices)
+	{
+		IOFree(_devices, _maxEntries * sizeof(DeviceEntry));
+		_devices = NULL;
+	}
+	if (_controllers)
+	{
+		IOFree(_controllers, _maxEntries * sizeof(ControllerEntry));
+		_controllers = NULL;
+	}
+	if (_entries)
+	{
+		_entries->release();
+		_entries = NULL;
+	}
+	super::free();
+}
+
+
+
+bool
+IOUSBQuirks::ParseDeviceEntry(OSDictionary *dict, DeviceEntry *entry)
+{
+	OSString	*comment = OSDynamicCast(OSString, dict->getObject(kUSBQuirkCommentKey));
+	UInt64		value;
+
+	if (!GetNumber(dict, kUSBQuirkVendorIDKey, &value) || (value > 0xFFFF))
+		return false;
+	entry->vendorID = (UInt16)value;
+
+	entry->anyProduct = !GetNumber(dict, kUSBQuirkProductIDKey, &value);
+	if (!entry->anyProduct)
+	{
+		if (value > 0xFFFF)
+			return false;
+		entry->productID = (UInt16)value;
+	}
+
+	entry->releaseLow = 0;
+	if (GetNumber(dict, kUSBQuirkDeviceReleaseLowKey, &value))
+	{
+		if (value > 0xFFFF)
+			return false;
+		entry->releaseLow = (UInt16)value;
+	}
+	entry->releaseHigh = 0xFFFF;
+	if (GetNumber(dict, kUSBQuirkDeviceReleaseHighKey, &value))
+	{
+		if (value > 0xFFFF)
+			return false;
+		entry->releaseHigh = (UInt16)value;
+	}
+	if (entry->releaseLow > entry->releaseHigh)
+		return false;
+
+	if (GetBoolean(dict, kUSBQuirkSkipStringDescriptorsKey))
+		entry->quirks.quirks |= kUSBQuirkSkipStringDescriptors;
+	if (GetBoolean(dict, kUSBQuirkDisableLPMKey))
+		entry->quirks.quirks |= kUSBQuirkDisableLPM;
+	if (GetBoolean(dict, kUSBQuirkBounceBufferKey))
+		entry->quirks.quirks |= kUSBQuirkBounceBuffer;
+	if (GetNumber(dict, kUSBQuirkResetDelayKey, &value) && value)
+	{
+		entry->quirks.quirks |= kUSBQuirkExtraResetDelay;
+		entry->quirks.resetDelayMS = (value > kUSBQuirksMaxResetDelayMS) ? (UInt32)kUSBQuirksMaxResetDelayMS : (UInt32)value;
+	}
+	if (GetNumber(dict, kUSBQuirkForceConfigurationKey, &value))
+	{
+		if (value > 0xFF)
+			return false;
+		entry->quirks.quirks |= kUSBQuirkForceConfiguration;
+		entry->quirks.configValue = (UInt8)value;
+	}
+
+	entry->comment = comment ? comment->getCStringNoCopy() : "";
+	return (entry->quirks.quirks != 0);
+}
+
+
+
+bool
+IOUSBQuirks::ParseControllerEntry(OSDictionary *dict, ControllerEntry *entry)
+{
+	OSString	*comment = OSDynamicCast(OSString, dict->getObject(kUSBQuirkCommentKey));
+	UInt64		value;
+
+	if (!GetNumber(dict, kUSBQuirkPCIVendorIDKey, &value) || (value > 0xFFFF))
+		return false;
+	entry->vendorID = (UInt16)value;
+
+	entry->anyDevice = !GetNumber(dict, kUSBQuirkPCIDeviceIDKey, &value);
+	if (!entry->anyDevice)
+	{
+		if (value > 0xFFFF)
+			return false;
+		entry->deviceID = (UInt16)value;
+	}
+
+	entry->revisionLow = 0;
+	if (GetNumber(dict, kUSBQuirkPCIRevisionLowKey, &value))
+	{
+		if (value > 0xFF)
+			return false;
+		entry->revisionLow = (UInt8)value;
+	}
+	entry->revisionHigh = 0xFF;
+	if (GetNumber(dict, kUSBQuirkPCIRevisionHighKey, &value))
+	{
+		if (value > 0xFF)
+			return false;
+		entry->revisionHigh = (UInt8)value;
+	}
+	if (entry->revisionLow > entry->revisionHigh)
+		return false;
+
+	if (!GetNumber(dict, kUSBQuirkErrataKey, &value) || !value)
+		return false;
+	entry->errata = value;
+
+	entry->comment = comment ? comment->getCStringNoCopy() : "";
+	return true;
+}
+
+
+
+bool
+IOUSBQuirks::MatchDevice(UInt16 vendorID, UInt16 productID, UInt16 deviceRelease, IOUSBDeviceQuirks *quirks, const char **comment)
+{
+	DeviceEntry		*entry;
+	bool			matched = false;
+	UInt32			i;
+
+	bzero(quirks, sizeof(*quirks));
+	for (i = 0; i < _numDevices; i++)
+	{
+		entry = &_devices[i];
+		if ((entry->vendorID != vendorID) || (!entry->anyProduct && (entry->productID != productID)) ||
+			(deviceRelease < entry->releaseLow) || (deviceRelease > entry->releaseHigh))
+			continue;
+
+		// the values of a later entry win
+		quirks->quirks |= entry->quirks.quirks;
+		if (entry->quirks.quirks & kUSBQuirkExtraResetDelay)
+			quirks->resetDelayMS = entry->quirks.resetDelayMS;
+		if (entry->quirks.quirks & kUSBQuirkForceConfiguration)
+			quirks->configValue = entry->quirks.configValue;
+		if (comment)
+			*comment = entry->comment;
+		matched = true;
+	}
+	return matched;
+}
+
+
+
+UInt64
+IOUSBQuirks::MatchController(UInt16 vendorID, UInt16 deviceID, UInt8 revisionID, const char **comment)
+{
+	ControllerEntry		*entry;
+	UInt64				errata = 0;
+	UInt32				i;
+
+	for (i = 0; i < _numControllers; i++)
+	{
+		entry = &_controllers[i];
+		if ((entry->vendorID != vendorID) || (!entry->anyDevice && (entry->deviceID != deviceID)) ||
+			(revisionID < entry->revisionLow) || (revisionID > entry->revisionHigh))
+			continue;
+
+		errata |= entry->errata;
+		if (comment)
+			*comment = entry->comment;
+	}
+	return errata;
+}
+
+
+
+#pragma mark Family table
+
+bool
+IOUSBQuirks::MakeLock(void)
+{
+	IOLock			*lock;
+
+	// the lock is only made once, by whoever gets here first
+	if (!_lock)
+	{
+		lock = IOLockAlloc();
+		if (!lock)
+			return false;
+		if (!OSCompareAndSwapPtr(NULL, lock, &_lock))
+			IOLockFree(lock);
+	}
+	return true;
+}
+
+
+
+IOUSBQuirks *
+IOUSBQuirks::CreateFromCatalogue(SInt32 *generation)
+{
+	OSDictionary	*matching;
+	OSString		*providerClass;
+	OSOrderedSet	*personalities = NULL;
+	OSDictionary	*personality;
+	OSArray			*table;
+	OSArray			*entries;
+	IOUSBQuirks		*quirks = NULL;
+	UInt32			i;
+
+	*generation = gIOCatalogue->getGenerationCount();
+	matching = OSDictionary::withCapacity(1);
+	providerClass = OSString::withCString(kUSBQuirksProviderClass);
+	entries = OSArray::withCapacity(16);
+	if (matching && providerClass && entries)
+	{
+		matching->setObject(gIOProviderClassKey, providerClass);
+		personalities = gIOCatalogue->findDrivers(matching, generation);
+	}
+
+	if (personalities)
+	{
+		for (i = 0; i < personalities->getCount(); i++)
+		{
+			personality = OSDynamicCast(OSDictionary, personalities->getObject(i));
+			table = personality ? OSDynamicCast(OSArray, personality->getObject(kUSBQuirksKey)) : NULL;
+			if (table)
+				entries->merge(table);
+		}
+		personalities->release();
+	}
+
+	if (entries && entries->getCount())
+		quirks = withArray(entries);
+
+	USBLog(3, "IOUSBQuirks::CreateFromCatalogue - %d device and %d controller entries (generation %d)", quirks ? (uint32_t)quirks->_numDevices : 0, quirks ? (uint32_t)quirks->_numControllers : 0, (int)*generation);
+
+	if (entries)
+		entries->release();
+	if (providerClass)
+		providerClass->release();
+	if (matching)
+		matching->release();
+	return quirks;
+}
+
+
+
+IOUSBQuirks *
+IOUSBQuirks::CopyCurrent(void)
+{
+	IOUSBQuirks		*quirks;
+	IOUSBQuirks		*old = NULL;
+
+	if (!MakeLock())
+		return NULL;
+
+	IOLockLock(_lock);
+	if (!_pinned && (!_loaded || (gIOCatalogue->getGenerationCount() != _generation)))
+	{
+		// the first lookup, or the first one since a kext was loaded or unloaded - whoever gets here builds it for everyone
+		old = _current;
+		_current = CreateFromCatalogue(&_generation);
+		_loaded = true;
+	}
+	quirks = _current;
+	if (quirks)
+		quirks->retain();
+	IOLockUnlock(_lock);
+
+	if (old)
+		old->release();
+	return quirks;
+}
+
+
+
+IOReturn
+IOUSBQuirks::LoadQuirks(OSArray *entries)
+{
+	IOUSBQuirks		*quirks = NULL;
+	IOUSBQuirks		*old;
+
+	if (!MakeLock())
+		return kIOReturnNoMemory;
+
+	if (entries && entries->getCount())
+	{
+		quirks = withArray(entries);
+		if (!quirks)
+			return kIOReturnNoMemory;
+	}
+
+	IOLockLock(_lock);
+	old = _current;
+	_current = quirks;
+	_pinned = (entries != NULL);
+	_loaded = _pinned;											// after NULL, the next lookup reads the catalogue again
+	IOLockUnlock(_lock);
+
+	if (old)
+		old->release();
+
+	USBLog(3, "IOUSBQuirks::LoadQuirks - %d device and %d controller entries loaded", quirks ? (uint32_t)quirks->_numDevices : 0, quirks ? (uint32_t)quirks->_numControllers : 0);
+	return kIOReturnSuccess;
+}
+
+
+
+bool
+IOUSBQuirks::GetDeviceQuirks(IOUSBDevice *device, IOUSBDeviceQuirks *quirks)
+{
+	IOUSBQuirks		*table;
+	const char		*comment = "";
+	UInt16			vendorID, productID, deviceRelease;
+	bool			matched;
+
+	bzero(quirks, sizeof(*quirks));
+	if (!device)
+		return false;
+
+	table = CopyCurrent();
+	if (!table)
+		return false;
+
+	vendorID = device->GetVendorID();
+	productID = device->GetProductID();
+	deviceRelease = device->GetDeviceRelease();
+	matched = table->MatchDevice(vendorID, productID, deviceRelease, quirks, &comment);
+	table->release();
+
+	if (!matched)
+		return false;
+
+	USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s (0x%04x/0x%04x/0x%04x) has quirks 0x%x %s", device->getName(), vendorID, productID, deviceRelease, (uint32_t)quirks->quirks, comment);
+	if (quirks->quirks & kUSBQuirkSkipStringDescriptors)
+		USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s: not reading string descriptors", device->getName());
+	if (quirks->quirks & kUSBQuirkExtraResetDelay)
+		USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s: %d ms extra delay after reset", device->getName(), (uint32_t)quirks->resetDelayMS);
+	if (quirks->quirks & kUSBQuirkDisableLPM)
+		USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s: link power management disabled", device->getName());
+	if (quirks->quirks & kUSBQuirkForceConfiguration)
+		USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s: forcing configuration %d", device->getName(), quirks->configValue);
+	if (quirks->quirks & kUSBQuirkBounceBuffer)
+		USBLog(1, "IOUSBQuirks::GetDeviceQuirks - %s: bounce buffering transfers", device->getName());
+	return true;
+}
+
+
+
+UInt64
+IOUSBQuirks::GetControllerErrata(UInt16 vendorID, UInt16 deviceID, UInt8 revisionID, const char *name)
+{
+	IOUSBQuirks		*table;
+	const char		*comment = "";
+	UInt64			errata;
+
+	table = CopyCurrent();
+	if (!table)
+		return 0;
+
+	errata = table->MatchController(vendorID, deviceID, revisionID, &comment);
+	table->release();
+
+	if (errata)
+	{
+		USBLog(1, "IOUSBQuirks::GetControllerErrata - %s (0x%04x/0x%04x rev 0x%02x) gets errata 0x%qx %s", name ? name : "controller", vendorID, deviceID, revisionID, errata, comment);
+	}
+	return errata;
+}
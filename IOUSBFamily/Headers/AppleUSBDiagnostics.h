@@ -24,9 +24,15 @@
 #define _IOKIT_APPLEUSBDIAGNOSTICS_H
 
 #include <IOKit/IOService.h>
+#include <IOKit/IOBufferMemoryDescriptor.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/usb/IOUSBLog.h>
 
+// what a diagnostics tool matches on to open an AppleUSBDiagnosticsUserClient for a controller's shared page
+#define kAppleUSBDiagnosticsNubClass		"AppleUSBDiagnosticsNub"
+#define kAppleUSBDiagnosticsUserClientClass	"AppleUSBDiagnosticsUserClient"
 
+class AppleUSBDiagnosticsNub;
 
 
 class AppleUSBDiagnostics : public OSObject
@@ -38,7 +44,9 @@ public:
     enum{
         kDiagMaxPorts = 32,
         kXHCIMaxCompletionCodes = 256,
-        kXHCILinkStates = 16
+        kXHCILinkStates = 16,
+        kSharedDiagnosticsVersion = 1,
+        kSharedDiagnosticsUpdateMS = 1000
     };
     typedef struct
     {
@@ -85,10 +93,82 @@ public:
         UInt32          overFlowPortErrorCount;
     } UIMDiagnostics;
     
+    // The UIM only ever increments the counters above. The prev* fields are no longer written - the "(New)" values in
+    // the registry are relative to the last registry read, which is kept here instead.
+    typedef struct
+    {
+        UInt64			bytes;
+        UInt32			timeouts;
+        UInt32			resets;
+    } RegistryPortSnapshot;
+    
+    typedef struct
+    {
+        UInt64			lastNanosec;
+        UInt64			bytes;
+        UInt32			acessCount;
+        UInt32			errors;
+        UInt32			timeouts;
+        UInt32			resets;
+        UInt32			recoveredErrors;
+        UInt32			errors2Strikes;
+        UInt32			errors3Strikes;
+        RegistryPortSnapshot ports[kDiagMaxPorts];
+    } RegistrySnapshot;
+    
+    // Layout of the read only page returned by copySharedMemory. The counters only ever go up, so each reader keeps its own
+    // copy of the last one it read and computes its own deltas. generation is odd while the page is being updated - a reader
+    // copies the page and retries if generation was odd or changed during the copy. The XHCI completion codes are only in the registry.
+    typedef struct
+    {
+        UInt64			totalBytes;
+        UInt32			errorCount;
+        UInt32			timeouts;
+        UInt32			resets;
+        UInt32			enable;
+        UInt32			suspend;
+        UInt32			resume;
+        UInt32			warmReset;
+        UInt32			power;
+        UInt32			u1Timeout;
+        UInt32			u2Timeout;
+        UInt32			remoteWakeMask;
+        UInt32			linkState[kXHCILinkStates];
+    } SharedPortDiagnostics;
+    
+    typedef struct
+    {
+        UInt32			version;					// kSharedDiagnosticsVersion
+        UInt32			length;						// sizeof(SharedDiagnostics)
+        volatile UInt32	generation;
+        SInt32			numPorts;
+        UInt64			updateNanosec;				// uptime of the last update
+        UInt64			totalBytes;
+        UInt32			totalErrors;
+        UInt32			timeouts;
+        UInt32			resets;
+        UInt32			recoveredErrors;
+        UInt32			errors2Strikes;
+        UInt32			errors3Strikes;
+        UInt32			controlBulkTxOut;
+        UInt32			overFlowPortErrorCount;
+        SharedPortDiagnostics ports[kDiagMaxPorts];
+    } SharedDiagnostics;
+    
 private:
 	UIMDiagnostics *			_UIMDiagnostics;
 	UInt32 *                    _controlBulkTransactionsOut;
     IOService *                 _controller;
+    RegistrySnapshot *          _registrySnapshot;
+    IOLock *                    _registryLock;          // registry readers can come in on any thread, and each one moves _registrySnapshot on
+    IOBufferMemoryDescriptor *  _sharedBuffer;
+    SharedDiagnostics *         _shared;
+    IOTimerEventSource *        _sharedTimer;
+    volatile SInt32             _sharedClients;         // copySharedMemory calls not yet balanced by releaseSharedMemory
+    AppleUSBDiagnosticsNub *    _nub;                   // published under the controller, for user space to reach the shared page
+    
+    static void                 SharedTimerFired(OSObject *owner, IOTimerEventSource *sender);
+    
 public:
     
 	
@@ -96,11 +176,40 @@ public:
     virtual OSObject *      initDiagnostics(AppleUSBDiagnostics *diagnostics, UIMDiagnostics* obj, UInt32 *controlBulkTransactionsOut, IOService *_controller);
 	virtual bool			serialize( OSSerialize * s ) const;
     virtual void            serializePort(OSDictionary *	dictionary, int port, UIMPortDiagnostics *counts, IOService *controller) const;
+    
+    // for a user client's clientMemoryForType - map it with kIOMapReadOnly. The page is kept up to date until the client calls
+    // releaseSharedMemory (from its clientClose), once for each copySharedMemory, and the last one to go stops the updates
+    virtual IOMemoryDescriptor *	copySharedMemory(void);
+    virtual void			releaseSharedMemory(void);
+    virtual void			updateSharedMemory(void) const;
 	
 protected:
 	
 	virtual void			UpdateNumberEntry( OSDictionary * dictionary, UInt32 value, const char * name ) const;
+    virtual void			free(void);
 	
 };
 
+
+// The controller's own user client knows nothing about the shared page, so each controller's diagnostics publish one of these
+// under it for AppleUSBDiagnosticsUserClient to be opened on. It doesn't keep the diagnostics alive - they detach themselves as
+// they go away, and from then on there is no page to map.
+class AppleUSBDiagnosticsNub : public IOService
+{
+	OSDeclareDefaultStructors(AppleUSBDiagnosticsNub);
+	
+private:
+    IOLock *                    _lock;
+    AppleUSBDiagnostics *       _diagnostics;
+    
+public:
+    static AppleUSBDiagnosticsNub *	withDiagnostics(AppleUSBDiagnostics *diagnostics);
+    virtual IOMemoryDescriptor *	copySharedMemory(void);
+    virtual void			releaseSharedMemory(void);
+    virtual void			detachDiagnostics(void);
+	
+protected:
+    virtual void			free(void);
+};
+
 #endif
\ No newline at end of file
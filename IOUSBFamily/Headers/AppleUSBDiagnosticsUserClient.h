@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOKIT_APPLEUSBDIAGNOSTICSUSERCLIENT_H
+#define _IOKIT_APPLEUSBDIAGNOSTICSUSERCLIENT_H
+
+#include <IOKit/IOUserClient.h>
+
+#include "AppleUSBDiagnostics.h"
+
+enum
+{
+	kAppleUSBDiagnosticsSharedMemoryType	= 0			// IOConnectMapMemory type for the AppleUSBDiagnostics::SharedDiagnostics page
+};
+
+
+// Opened on an AppleUSBDiagnosticsNub. It has no methods: a tool maps the page read only and computes its own deltas from it,
+// as described with SharedDiagnostics. Every mapping keeps the page updated until the connection is closed.
+class AppleUSBDiagnosticsUserClient : public IOUserClient
+{
+	OSDeclareDefaultStructors(AppleUSBDiagnosticsUserClient);
+	
+private:
+    AppleUSBDiagnosticsNub *    _nub;
+    volatile SInt32             _mappings;              // copySharedMemory calls to balance when the connection goes
+    
+public:
+    virtual bool			start(IOService *provider);
+    virtual IOReturn		clientClose(void);
+    virtual IOReturn		clientDied(void);
+    virtual IOReturn		clientMemoryForType(UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory);
+};
+
+#endif
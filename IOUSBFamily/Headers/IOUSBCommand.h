@@ -28,6 +28,7 @@
 #include <IOKit/IOCommandPool.h>
 #include <IOKit/IOMemoryDescriptor.h>
 #include <IOKit/IODMACommand.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/usb/USB.h>
 
 /*
@@ -53,6 +54,20 @@ typedef enum {
 } usbCommand;
 
 #define 	kUSBCommandScratchBuffers	10
+#define		kUSBIsocASAPLeadFrames		2			// how far ahead of the current frame a kAppleUSBIsocASAPFrame request may start
+#define 	kUSBCommandMaxImmediateDataSize	8
+
+// Controller property (normally from the UIM's IOKit personality) for a UIM which can send small bulk and interrupt
+// OUT transfers as immediate data. IOUSBController::Write will then copy such a payload into the IOUSBCommand instead
+// of preparing an IODMACommand
+#define		kUSBControllerSupportsImmediateOUTData	"kUSBControllerSupportsImmediateOUTData"
+
+// Cached answer to the above, kept in each IOUSBCommand so that Write only looks at the property once per command
+enum {
+	kUSBCommandImmediateOUTUnknown		= 0,
+	kUSBCommandImmediateOUTUnsupported	= 1,
+	kUSBCommandImmediateOUTSupported	= 2
+};
 
 /*
  IOUSBCommand
@@ -98,6 +113,10 @@ protected:
 		IOUSBCommand		*_masterUSBCommand;						// points from the bufferUSBCommand back to the parent command
 		UInt32				_streamID;
 		void *				_backTrace[kUSBCommandScratchBuffers];
+		IOCommandPool *		_owningPool;							// set the first time the command goes into an IOUSBCommandPool
+		bool				_immediateTransfer;						// the OUT data is in _immediateBuffer and there is no DMA mapping
+		UInt8				_immediateBuffer[kUSBCommandMaxImmediateDataSize];
+		UInt8				_immediateOUTSupport;					// kUSBCommandImmediateOUT*, survives the trip back to the pool
     };
     ExpansionData * 		_expansionData;
     
@@ -140,6 +159,8 @@ public:
 	void					SetIsSyncTransfer(bool);
 	inline void				SetDMACommand(IODMACommand *dmaCommand)					{ _expansionData->_dmaCommand = dmaCommand; }
 	inline void				SetStreamID(UInt32 streamID)					{ _expansionData->_streamID = streamID; }
+	inline void				SetImmediateTransfer(bool immediate)			{ _expansionData->_immediateTransfer = immediate; }
+	inline void				SetImmediateOUTSupport(UInt8 support)			{ _expansionData->_immediateOUTSupport = support; }
 	void					SetBufferUSBCommand(IOUSBCommand *bufferUSBCommand);
 	void					SetBT(UInt32 index, void * value);
 	
@@ -174,6 +195,11 @@ public:
 	inline IODMACommand *		GetDMACommand(void)							{return _expansionData->_dmaCommand; }
 	inline UInt32				GetStreamID(void)							{return _expansionData->_streamID; }
 	inline IOUSBCommand *		GetBufferUSBCommand(void)					{return _expansionData->_bufferUSBCommand; }
+	inline IOCommandPool *		GetOwningPool(void)							{return _expansionData->_owningPool; }
+	inline void					SetOwningPool(IOCommandPool *pool)			{ _expansionData->_owningPool = pool; }
+	inline bool					GetImmediateTransfer(void)					{return _expansionData->_immediateTransfer; }
+	inline UInt8 *				GetImmediateBuffer(void)					{return _expansionData->_immediateBuffer; }
+	inline UInt8				GetImmediateOUTSupport(void)				{return _expansionData->_immediateOUTSupport; }
 };
 
 
@@ -204,6 +230,7 @@ protected:
 		IOUSBIsocCompletion	_uslCompletion;
 		bool				_lowLatency;
 		UInt32				_UIMScratch[kUSBCommandScratchBuffers];
+		IOCommandPool *		_owningPool;									// set the first time the command goes into an IOUSBCommandPool
     };
     ExpansionData * 		_expansionData;
 
@@ -256,18 +283,84 @@ public:
 	IODMACommand *			GetDMACommand(void)								{ return _expansionData->_dmaCommand; }
     IOUSBIsocCompletion		GetUSLCompletion(void)							{ return _expansionData->_uslCompletion; }
 	bool					GetLowLatency(void)								{ return _expansionData->_lowLatency; }
+	IOCommandPool *			GetOwningPool(void)								{ return _expansionData->_owningPool; }
+	void					SetOwningPool(IOCommandPool *pool)				{ _expansionData->_owningPool = pool; }
+	
+	// for a kAppleUSBIsocASAPFrame request, called by the UIM with the frame after the endpoint's last transfer (0 if there is none).
+	// Sets and returns the start frame, which is later than nextFrame if the endpoint has fallen behind. framesSkipped (may be NULL)
+	// gets the number of frames of the endpoint's cadence which went by unused, 0 if it kept up
+	UInt64					ResolveASAPStartFrame(UInt64 nextFrame, UInt64 currentFrame, UInt32 leadFrames, UInt32 *framesSkipped);
+};
+
+enum
+{
+	kUSBCommandPoolTrimIntervalMS		= 5000,				// how often idle commands are looked at
+	kUSBCommandPoolMinIdleCommands		= 32,				// never trimmed below this many free commands
+	kUSBCommandPoolTrimDivisor			= 2					// each interval frees this fraction of the commands which stayed idle for all of it
 };
 
+/*
+ IOUSBCommandPool
+ Grows when the controller adds commands to it (IncreaseCommandPool). Once the pool holds its high water mark of commands
+ (0 == no limit), further new commands are released instead of being queued, so getCommand fails and the request is
+ refused with kIOReturnNoResources rather than the pool growing for ever. After a burst, the commands which stay idle for
+ a whole trim interval are released a fraction at a time, down to kUSBCommandPoolMinIdleCommands. ReleaseIdleCommands
+ frees all of them at once, for when memory is short. A command, and its IODMACommand, belong to the pool once it has
+ been returned to it.
+ The controller counts the commands it has given the pool, so none of this happens until it calls SetReleaseAction to be told
+ how many commands were released. Until then the pool never gives a command back.
+ IOUSBCommandPool used to have no instance variables and no reserved slots, so _expansionData makes the object bigger: this is
+ a binary incompatible change, and a driver which subclasses IOUSBCommandPool has to be rebuilt against this header. Nothing in
+ the family does; the controllers only ever create them with withWorkLoop.
+*/
+typedef void (*IOUSBCommandPoolReleaseAction)(OSObject *target, UInt32 released);
+
 class IOUSBCommandPool : public IOCommandPool
 {
     OSDeclareDefaultStructors( IOUSBCommandPool )
 	
+    struct ExpansionData
+    {
+		IOTimerEventSource *			_trimTimer;
+		bool							_trimTimerArmed;
+		UInt32							_totalCommands;					// owned by the pool, free or in use
+		UInt32							_freeCommands;
+		UInt32							_minFreeSinceTrim;				// how many stayed free for the whole of the current interval
+		UInt32							_peakCommands;
+		UInt32							_highWaterMark;
+		UInt32							_trimmedCommands;
+		UInt32							_rejectedCommands;				// new commands released because the pool was at its high water mark
+		OSObject *						_releaseTarget;					// not retained - the controller owns the pool
+		IOUSBCommandPoolReleaseAction	_releaseAction;					// NULL == never release a command
+    };
+    ExpansionData * 		_expansionData;
+	
+	static void				TrimTimerFired(OSObject *owner, IOTimerEventSource *sender);
+	static IOReturn			ReleaseIdleCommandsGated(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3);
+	UInt32					TrimIdleCommands(UInt32 count);
+	void					DisposeCommand(IOCommand *command);
+	
 protected:
+	virtual bool initWithWorkLoop(IOWorkLoop * inWorkLoop);
+	virtual void free();
     virtual IOReturn gatedReturnCommand(IOCommand * command);
 	virtual IOReturn gatedGetCommand(IOCommand ** command, bool blockForCommand);
 	
 public:
     static IOCommandPool * withWorkLoop(IOWorkLoop * inWorkLoop);
+	
+	// called on the pool's workloop with the number of commands released, so the controller can take them off its own count. Enables trimming
+	void					SetReleaseAction(OSObject *target, IOUSBCommandPoolReleaseAction action);
+	
+	// only enforced once there is a release action
+	void					SetHighWaterMark(UInt32 maxCommands)			{ _expansionData->_highWaterMark = maxCommands; }
+	UInt32					GetHighWaterMark(void)							{ return _expansionData->_highWaterMark; }
+	
+	// release every free command above kUSBCommandPoolMinIdleCommands now, rather than waiting for the trim timer
+	void					ReleaseIdleCommands(void);
+	
+	// the counters, as a dictionary suitable for setProperty. The caller releases it
+	OSDictionary *			CopyStatistics(void);
 };
 
 
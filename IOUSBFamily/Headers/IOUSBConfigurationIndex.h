@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IOUSBCONFIGURATIONINDEX_H
+#define _IOUSBCONFIGURATIONINDEX_H
+
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/usb/USB.h>
+
+
+enum
+{
+	kUSBConfigIndexNone						= 0xFFFF,					// end of a chain
+	kUSBConfigIndexEndpointSlots			= 32,						// one for each endpoint address, in and out
+	kUSBConfigIndexNumTypes					= 4,						// control, isoch, bulk, interrupt
+	kUSBConfigIndexNumDirections			= 2							// out, in
+};
+
+
+/*
+ class IOUSBConfigurationIndex
+ The interface and endpoint descriptors of one full configuration descriptor, parsed once when the device is configured so that the
+ FindNextInterface, CreateInterfaceIterator, FindNextAltInterface and FindNextPipe queries don't walk the descriptors each time.
+ Interface descriptors are kept in descriptor order, chained by class and by interface number, so "the next one after current"
+ keeps its old meaning. Each alternate setting also gets a table from endpoint address to its position in the interface's pipe
+ list, and a mask of those positions for each transfer type and direction.
+ The index only points into the configuration descriptor, so it must not outlive it. One made withDescriptorBuffer instead has its own
+ copy, put through IOUSBValidateConfigurationDescriptor first, so walking it with FindNextDescriptor and FindNextAssociatedDescriptor
+ can never leave the descriptors, whatever the device sent.
+*/
+class IOUSBConfigurationIndex : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBConfigurationIndex)
+
+private:
+	struct InterfaceEntry
+	{
+		const IOUSBInterfaceDescriptor *	desc;
+		UInt16								nextSameClass;				// next interface descriptor with the same bInterfaceClass
+		UInt16								nextAlternate;				// next alternate setting of the same bInterfaceNumber
+		UInt16								firstEndpoint;				// into _endpoints
+		UInt8								numEndpoints;				// with a pipe list position, so never more than kUSBMaxPipes
+		UInt8								endpointSlot[kUSBConfigIndexEndpointSlots];		// pipe list position + 1 by endpoint address, 0 == none
+		UInt32								endpointMask[kUSBConfigIndexNumTypes][kUSBConfigIndexNumDirections];
+	};
+
+	const IOUSBConfigurationDescriptor *	_configDesc;				// not retained - it belongs to the device, unless it is _ownedCopy
+	void *								_ownedCopy;					// the validated copy, from withDescriptorBuffer
+	UInt32								_ownedLength;
+	InterfaceEntry *					_interfaces;
+	UInt32								_numInterfaces;
+	const IOUSBEndpointDescriptor **	_endpoints;
+	UInt32								_numEndpoints;
+	UInt16								_firstOfClass[256];
+	UInt16								_firstOfNumber[256];
+
+	SInt32								EntryForDescriptor(const IOUSBInterfaceDescriptor *desc);
+	SInt32								EntryFor(UInt8 interfaceNumber, UInt8 alternateSetting);
+	static bool							Matches(const IOUSBInterfaceDescriptor *desc, const IOUSBFindInterfaceRequest *request);
+	static UInt8						SlotForAddress(UInt8 endpointAddress)		{ return (endpointAddress & kUSBbEndpointAddressMask) | ((endpointAddress & kUSBbEndpointDirectionMask) >> 3); }
+
+protected:
+	virtual bool						initWithConfigurationDescriptor(const IOUSBConfigurationDescriptor *configDesc);
+	virtual void						free();
+
+public:
+	static IOUSBConfigurationIndex *	withConfigurationDescriptor(const IOUSBConfigurationDescriptor *configDesc);
+
+	// validate length bytes of a configuration descriptor as read from the device, and index a canonical copy of them. name is only for logging
+	static IOUSBConfigurationIndex *	withDescriptorBuffer(const void *buffer, UInt32 length, const char *name);
+
+	const IOUSBConfigurationDescriptor *	GetConfigurationDescriptor(void)		{ return _configDesc; }
+
+	// same semantics as IOUSBDevice::FindNextInterfaceDescriptor - the first match after current (NULL for the start), in descriptor order
+	const IOUSBInterfaceDescriptor *	FindNextInterfaceDescriptor(const IOUSBInterfaceDescriptor *current, const IOUSBFindInterfaceRequest *request);
+
+	// the next alternate setting of the interface after current (NULL to start at the first one) which matches, as IOUSBInterface::FindNextAltInterface
+	const IOUSBInterfaceDescriptor *	FindNextAltInterface(UInt8 interfaceNumber, const IOUSBInterfaceDescriptor *current, const IOUSBFindInterfaceRequest *request);
+
+	const IOUSBEndpointDescriptor *		FindEndpoint(UInt8 interfaceNumber, UInt8 alternateSetting, UInt8 endpointAddress);
+
+	// position in the interface's pipe list of the next endpoint after currentIndex (-1 for the start) of the given type and direction,
+	// either of which may be kUSBAnyType / kUSBAnyDirn. -1 if there isn't one
+	SInt32								FindNextEndpointIndex(UInt8 interfaceNumber, UInt8 alternateSetting, SInt32 currentIndex, UInt8 type, UInt8 direction);
+	SInt32								GetEndpointIndex(UInt8 interfaceNumber, UInt8 alternateSetting, UInt8 endpointAddress);
+
+	// bounds checked walks, as IOUSBDevice::FindNextDescriptor and IOUSBInterface::FindNextAssociatedDescriptor. type may be kUSBAnyDesc
+	const IOUSBDescriptorHeader *		FindNextDescriptor(const void *current, UInt8 type);
+	const IOUSBDescriptorHeader *		FindNextAssociatedDescriptor(const IOUSBInterfaceDescriptor *interfaceDesc, const void *current, UInt8 type);
+};
+
+#endif
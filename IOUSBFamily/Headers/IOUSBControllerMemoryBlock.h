@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IOUSBCONTROLLERMEMORYBLOCK_H
+#define _IOUSBCONTROLLERMEMORYBLOCK_H
+
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSDictionary.h>
+
+#include <IOKit/IOTypes.h>
+#include <IOKit/IOBufferMemoryDescriptor.h>
+
+
+enum
+{
+	kUSBControllerMemoryBlockSize				= 4096,						// one page - every UIM carves its shared structures out of these
+	kUSBControllerMemoryBlockPhysicalMask		= 0xFFFFF000,				// below 4GB and page aligned
+	kUSBControllerMemoryBlockMaxTypes			= 16						// subclasses counted on their own - any more only show in the totals
+};
+
+// keys of each type's dictionary from CopyStatistics
+#define kUSBControllerMemoryBlocksKey				"Blocks"
+#define kUSBControllerMemoryElementsKey				"Elements"
+#define kUSBControllerMemoryElementSizeKey			"Element Size"
+#define kUSBControllerMemoryBytesUnusedKey			"Bytes Unused"
+
+struct IOUSBControllerMemoryBlockTypeStatistics;
+
+
+/*
+ class IOUSBControllerMemoryBlock
+ One page of memory shared with a USB controller, carved into fixed size elements (TDs, QHs, EDs, ...). This does the
+ allocation, the mapping to a physical address and the layout of the elements - each element is aligned and never
+ crosses the given boundary - for all of the UIMs. The UIM subclasses only add their typed accessors, and keep their
+ own per type free lists of the elements, which act as the caches in front of this allocator. The blocks, elements and bytes
+ lost to the layout are counted for every controller together, and for each subclass on its own.
+*/
+class IOUSBControllerMemoryBlock : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBControllerMemoryBlock)
+
+private:
+	IOBufferMemoryDescriptor			*_buffer;
+    IOPhysicalAddress					_sharedPhysical;			// physical address of the start of the block
+    UInt8								*_sharedLogical;			// logical address of the above
+    IOUSBControllerMemoryBlock			*_nextBlock;				// the UIM keeps a list of its blocks of each type
+	UInt32								_elementStride;				// element size rounded up to the alignment
+	UInt32								_elementsPerBoundary;		// elements which fit between two boundaries
+	UInt32								_boundary;
+	UInt32								_reservedElements;			// elements at the start of the block which the subclass uses for itself
+	UInt32								_numElements;				// elements available to the UIM
+	UInt32								_wastedBytes;				// lost to alignment, boundaries and the end of the block
+	IOUSBControllerMemoryBlockTypeStatistics *	_typeStatistics;	// the counters of our subclass, NULL if there was no room for it
+
+	UInt32								ElementOffset(UInt32 slot);
+
+protected:
+
+	// elementSize bytes aligned on alignment, none of them crossing boundary (0 means kUSBControllerMemoryBlockSize). The first reservedElements are
+	// not counted in NumElements() and are not returned by the accessors, but the subclass can get to them with GetReservedLogicalPtr
+    virtual bool						initWithElements(UInt32 elementSize, UInt32 alignment, UInt32 boundary = 0, UInt32 reservedElements = 0, mach_vm_address_t physicalMask = kUSBControllerMemoryBlockPhysicalMask);
+    virtual void						free();
+
+	void *								GetReservedLogicalPtr(UInt32 index);
+
+public:
+
+	UInt32								NumElements(void);
+    IOPhysicalAddress					GetElementPhysicalPtr(UInt32 index);
+    void *								GetElementLogicalPtr(UInt32 index);
+
+	// reverse lookup - returns -1 (or NULL) if the address is not the start of an element in this block
+	bool								ContainsPhysical(IOPhysicalAddress addr);
+	SInt32								PhysicalToIndex(IOPhysicalAddress addr);
+	void *								PhysicalToLogical(IOPhysicalAddress addr);
+	static IOUSBControllerMemoryBlock *	FindBlockForPhysical(IOUSBControllerMemoryBlock *head, IOPhysicalAddress addr);
+
+    void								SetNextMemoryBlock(IOUSBControllerMemoryBlock *next)			{ _nextBlock = next; }
+    IOUSBControllerMemoryBlock *		GetNextMemoryBlock(void)										{ return _nextBlock; }
+
+	// usage across all of the controllers in the system
+	static void							GetStatistics(UInt32 *blocks, UInt32 *elements, UInt32 *wastedBytes);
+
+	// the same for each subclass, keyed by class name, each a dictionary of the kUSBControllerMemory keys above. The caller releases it
+	static OSDictionary *				CopyStatistics(void);
+
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  0);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  1);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  2);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  3);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  4);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  5);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  6);
+    OSMetaClassDeclareReservedUnused(IOUSBControllerMemoryBlock,  7);
+};
+
+#endif
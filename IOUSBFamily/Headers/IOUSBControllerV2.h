@@ -92,6 +92,13 @@ protected:
                            void *arg0, void *arg1,
                            void *arg2, void *arg3);
 
+    static IOReturn  DoConfigureEPs(OSObject *owner,
+                           void *arg0, void *arg1,
+                           void *arg2, void *arg3);
+
+	// for a UIM's UIMCheckPipeBandwidth: is there an isoch endpoint with this number and direction in the list
+	static bool		IsochEndpointInList(Endpoint *list, UInt32 count, UInt8 number, UInt8 direction);
+
     static void		clearTTHandler( 
 							OSObject *	target,
                             void *	parameter,
@@ -438,9 +445,59 @@ public:
 
     
     
-	OSMetaClassDeclareReservedUnused(IOUSBControllerV2,  27);
-    OSMetaClassDeclareReservedUnused(IOUSBControllerV2,  28);
-    OSMetaClassDeclareReservedUnused(IOUSBControllerV2,  29);
+	OSMetaClassDeclareReservedUsed(IOUSBControllerV2,  27);
+	/*!
+	 @function ConfigurePipes
+	 Close and open a set of pipes on one device as a single operation, e.g. all of the endpoints of an interface when the configuration
+	 or the alternate setting changes. Either all of the pipes in openList are opened (and all of the ones in closeList are closed) or,
+	 if there is not enough bandwidth for all of them or one of them fails, the device is left with the pipes it had before. If the
+	 controller can tell up front that the new pipes will not fit, nothing is closed at all.
+	 @param address Address of the device on the USB bus
+	 @param speed of the device: kUSBDeviceSpeedLow, kUSBDeviceSpeedFull, kUSBDeviceSpeedHigh or kUSBDeviceSpeedSuper
+	 @param closeList endpoints to close, or NULL
+	 @param closeCount number of entries in closeList
+	 @param openList endpoints to open, or NULL
+	 @param openCount number of entries in openList
+	 @param bandwidthShortfall may be NULL. Otherwise set to how many more bytes per frame the new pipes would need when kIOReturnNoBandwidth is returned (0 if unknown)
+	 */
+	virtual IOReturn		ConfigurePipes(USBDeviceAddress	address,
+										   UInt8			speed,
+										   Endpoint *		closeList,
+										   UInt32			closeCount,
+										   Endpoint *		openList,
+										   UInt32			openCount,
+										   UInt32 *			bandwidthShortfall);
+	
+    OSMetaClassDeclareReservedUsed(IOUSBControllerV2,  28);
+	/*!
+	 @function UIMConfigureEndpoints
+	 Called behind the gate by ConfigurePipes. A UIM which can drop and add a set of endpoints with one controller operation (such as an
+	 XHCI Configure Endpoint command), and admit their bandwidth all at once, overrides this. The default returns kIOReturnUnsupported,
+	 in which case the endpoints are deleted and created one at a time and the changes are undone if one of them fails.
+	 */
+	virtual IOReturn		UIMConfigureEndpoints(USBDeviceAddress	address,
+												  UInt8				speed,
+												  Endpoint *		closeList,
+												  UInt32			closeCount,
+												  Endpoint *		openList,
+												  UInt32			openCount,
+												  UInt32 *			bandwidthShortfall);
+    
+    OSMetaClassDeclareReservedUsed(IOUSBControllerV2,  29);
+	/*!
+	 @function UIMCheckPipeBandwidth
+	 Called behind the gate by ConfigurePipes before anything is closed, when the UIM does not implement UIMConfigureEndpoints. Returns
+	 kIOReturnNoBandwidth, and the number of bytes per frame which are missing in bandwidthShortfall, if the endpoints in openList will
+	 not fit even after the ones in closeList have given their bandwidth back. The default returns kIOReturnUnsupported (no pre-check).
+	 */
+	virtual IOReturn		UIMCheckPipeBandwidth(USBDeviceAddress	address,
+												  UInt8				speed,
+												  Endpoint *		closeList,
+												  UInt32			closeCount,
+												  Endpoint *		openList,
+												  UInt32			openCount,
+												  UInt32 *			bandwidthShortfall);
+    
     
 };
 
@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOUSBDESCRIPTORVALIDATION_H
+#define _IOUSBDESCRIPTORVALIDATION_H
+
+
+#include <IOKit/usb/USB.h>
+
+
+// what IOUSBValidateConfigurationDescriptor had to do to the descriptors. Any of these should be logged by the caller
+enum
+{
+	kUSBDescRepairTruncatedTotal			= (1 << 0),					// wTotalLength was more than the device sent
+	kUSBDescRepairTrailingBytes				= (1 << 1),					// bytes at the end too short to be a descriptor
+	kUSBDescRepairZeroLength				= (1 << 2),					// a bLength of 0 or 1 - nothing after it can be found
+	kUSBDescRepairOverrun					= (1 << 3),					// a descriptor ran past wTotalLength - it and the rest were dropped
+	kUSBDescRepairShortDescriptor			= (1 << 4),					// an interface, endpoint or IAD shorter than its fixed part was dropped
+	kUSBDescRepairOrphanEndpoint			= (1 << 5),					// an endpoint before any interface was dropped
+	kUSBDescRepairOverlap					= (1 << 6),					// a nested configuration, or an IAD overlapping the previous one, was dropped
+	kUSBDescRepairInterfaceCount			= (1 << 7)					// bNumInterfaces didn't match the interfaces present (not changed)
+};
+
+/*
+ IOUSBValidateConfigurationDescriptor
+ The one pass that everything trusting bLength and wTotalLength should come through. buffer holds length bytes as read from the device.
+ The canonical copy written to outBuffer (which may be buffer itself, and needs room for length bytes) has a wTotalLength that is
+ exactly the bytes kept, and every descriptor in it has a bLength of at least 2 which stays inside it, so a walker only has to check
+ for the end. Anything which can't be trusted is dropped, and noted in *repairs. A buffer that doesn't start with a configuration
+ descriptor is rejected with kIOReturnBadArgument, and one too short for it with kIOReturnUnderrun.
+ This only uses the descriptor definitions, no IOKit services, so it can be built and fuzzed outside the kernel - see Tests/DescriptorValidation.
+*/
+IOReturn	IOUSBValidateConfigurationDescriptor(const void *buffer, UInt32 length, void *outBuffer, UInt32 *outLength, UInt32 *repairs);
+
+#endif
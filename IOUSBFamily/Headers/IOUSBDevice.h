@@ -51,6 +51,10 @@ class IOUSBController;
 class IOUSBControllerV2;
 class IOUSBInterface;
 class IOUSBHubPolicyMaker;
+class IOUSBDeviceStringCache;
+class IOUSBDeviceAutoSuspend;
+class IOUSBDeviceResetState;
+class IOUSBConfigurationIndex;
 /*!
     @class IOUSBDevice
     @abstract The IOService object representing a device on the USB bus.
@@ -64,6 +68,8 @@ class IOUSBDevice : public IOUSBNub
     friend class IOUSBControllerV2;
     friend class IOUSBInterface;
     friend class IOUSBPipe;
+    friend class IOUSBDeviceAutoSuspend;
+    friend class IOUSBDeviceResetState;
 	friend class IOUSBInterfaceUserClientV2;
 	friend class IOUSBInterfaceUserClientV3;
 	friend class IOUSBDeviceUserClientV2;
@@ -130,6 +136,10 @@ protected:
 		UInt32					_wakeUSB3PowerAllocated;			// how much extra "USB3" power during wake did we already give our client
 		bool					_attachedToEnclosureAndUsingExtraWakePower;
 		bool					_deviceIsOnThunderbolt;					// Will be set if all our upstream hubs are on Thunderbolt
+		IOUSBDeviceStringCache *	_stringCache;						// strings already read by GetStringDescriptor - invalidated on reset and re-enumeration
+		IOUSBDeviceAutoSuspend *	_autoSuspend;						// set once a client opts in to autosuspend, cleared when the device terminates
+		IOUSBConfigurationIndex *	_configIndex;						// interface and endpoint lookups for the current configuration - rebuilt by SetConfiguration
+		volatile UInt32			_resetRestoreInProgress;			// non zero while IOUSBDeviceResetState::ResetDeviceAndRestore has the device
 
     };
     ExpansionData * _expansionData;
@@ -225,7 +235,8 @@ public:
 	@function ResetDevice
 	Reset the device, returning it to the addressed, unconfigured state.
 	This is useful if a device has got badly confused. Note that the AppleUSBComposite driver will automatically
-        reconfigure the device if it is a composite device.
+        reconfigure the device if it is a composite device. IOUSBDeviceResetState::ResetDeviceAndRestore will do the reset
+        and then put back the configuration, alternate settings, pipes and streams itself.
     */
     virtual IOReturn ResetDevice();
 
@@ -410,6 +421,7 @@ public:
         @abstract Instruct the hub to which this device is attached to suspend or resume the port to which the device is attached.
         Note that if there are any outstanding transactions on any pipes in the device, those transactions will get returned with a 
         kIOReturnNotResponding error.
+        A client which would rather have the family do this for it when the device is idle can use IOUSBDeviceAutoSuspend::SetDeviceIdleTime instead.
         @param suspend Boolean value. true = suspend, false = resume.
     */
     virtual IOReturn SuspendDevice( bool suspend);
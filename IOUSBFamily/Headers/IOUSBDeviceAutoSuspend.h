@@ -0,0 +1,176 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IOUSBDEVICEAUTOSUSPEND_H
+#define _IOUSBDEVICEAUTOSUSPEND_H
+
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/IOLocks.h>
+#include <IOKit/usb/USB.h>
+
+#include <kern/thread_call.h>
+
+
+class IOUSBDevice;
+class IOUSBPipe;
+class IONotifier;
+class IOService;
+class IOMemoryDescriptor;
+
+#define kUSBAutoSuspendStatisticsKey		"AutoSuspend Statistics"
+
+enum
+{
+	kUSBAutoSuspendMinIdleTimeMS			= 100							// anything shorter just thrashes the port
+};
+
+enum USBAutoSuspendState
+{
+	kUSBAutoSuspendActive					= 0,
+	kUSBAutoSuspendSuspending				= 1,
+	kUSBAutoSuspendSuspended				= 2,
+	kUSBAutoSuspendResuming					= 3
+};
+
+enum USBAutoSuspendIOType
+{
+	kUSBAutoSuspendIORead					= 0,
+	kUSBAutoSuspendIOWrite					= 1,
+	kUSBAutoSuspendIOControl				= 2,						// request is an IOUSBDevRequest
+	kUSBAutoSuspendIOControlDesc			= 3							// request is an IOUSBDevRequestDesc
+};
+
+// what an asynchronous request needs to be issued later, if it arrives while the device is suspended
+typedef struct IOUSBAutoSuspendIO
+{
+	USBAutoSuspendIOType					type;
+	IOMemoryDescriptor *					buffer;						// Read and Write
+	void *									request;					// ControlRequest
+	UInt32									noDataTimeout;
+	UInt32									completionTimeout;
+	IOByteCount								reqCount;
+} IOUSBAutoSuspendIO;
+
+
+/*
+ class IOUSBDeviceAutoSuspend
+ Opt in selective suspend for a device whose driver never calls SuspendDevice itself. IOUSBPipe brackets every Read, Write and
+ ControlRequest with BeginIO and EndIO. Once nothing has been outstanding on any of the device's pipes for the idle time, the
+ port is suspended (with remote wakeup armed if the configuration supports it) from a thread call. Nothing which can be called
+ from a completion routine or the workloop ever waits for the port: an asynchronous request which arrives while the device is
+ suspended (or on its way there) is queued, the resume is done from another thread call, and the queued requests are issued from
+ there in the order they came in, so the client never sees the device suspended. Only synchronous requests wait for the resume,
+ and those are already refused on the workloop. One made by another thread which holds the workloop's gate waits in sleepGate,
+ since the suspend and resume need the gate. Isoch and time stamped reads can't be queued or tracked to completion, so they
+ only start the resume and restart the idle time, and may lose their first frames to it.
+ The object keeps the device retained. When the device is terminated the timers are cancelled, queued requests complete with
+ kIOReturnNotResponding and the device's reference to us is dropped, which lets both go. SetIdleTime(0) turns the policy off
+ and resumes the device.
+*/
+class IOUSBDeviceAutoSuspend : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBDeviceAutoSuspend)
+
+private:
+	struct AutoSuspendRequest;
+
+	IOUSBDevice *						_device;					// retained until we are freed
+	IONotifier *						_interestNotifier;			// for the device's termination
+	IOLock *							_lock;
+	thread_call_t						_idleThread;
+	thread_call_t						_resumeThread;
+	thread_t							_transitionThread;			// the thread doing a suspend or resume, whose own requests pass straight through
+	thread_t							_issueThread;				// the thread issuing the queue, which must not wait for itself
+	USBAutoSuspendState					_state;
+	UInt32								_idleTimeMS;				// 0 == disabled
+	UInt32								_outstanding;				// counted requests on all of the device's pipes, queued ones included
+	AutoSuspendRequest *				_queueHead;					// asynchronous requests waiting for the resume
+	AutoSuspendRequest *				_queueTail;
+	bool								_remoteWakeupArmed;
+	bool								_timerPending;
+	bool								_resumeWanted;				// a synchronous request is waiting for a suspend to finish
+	UInt32								_gateWaiters;				// synchronous requests waiting in the workloop's sleepGate
+	bool								_terminated;
+	uint64_t							_idleSince;					// absolute time _outstanding last went to 0
+
+	static IOLock *						_deviceLock;				// guards the devices' _autoSuspend pointers against Detach
+
+	// statistics
+	UInt32								_suspendCount;
+	UInt32								_resumeCount;
+	UInt32								_failedSuspendCount;
+	uint64_t							_suspendedSince;			// absolute time, valid while suspended
+	UInt64								_suspendedTimeNS;			// completed suspended intervals
+	UInt64								_totalResumeLatencyNS;
+	UInt64								_maxResumeLatencyNS;
+
+	IOReturn							Resume(void);
+	void								StartResume(void);
+	void								ResumeAndIssue(void);
+	void								IssueQueued(void);
+	void								WakeGateWaiters(void);
+	void								IssueRequest(AutoSuspendRequest *request);
+	void								FailRequest(AutoSuspendRequest *request, IOReturn status);
+	void								RequestDone(AutoSuspendRequest *request);
+	void								ArmIdleTimer(void);
+	void								IdleTimerFired(void);
+	void								SetRemoteWakeup(bool enable);
+	void								PublishStatistics(void);
+	void								DeviceTerminated(void);
+	void								Detach(void);
+
+	static void							IdleTimerEntry(thread_call_param_t me, thread_call_param_t unused);
+	static void							ResumeEntry(thread_call_param_t me, thread_call_param_t unused);
+	static void							CompletionEntry(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining);
+	static IOReturn						DeviceMessage(void *target, void *refCon, UInt32 messageType, IOService *provider, void *messageArgument, vm_size_t argSize);
+
+protected:
+	virtual bool						initWithDevice(IOUSBDevice *device);
+	virtual void						free();
+
+public:
+	// create the device's policy object if it does not have one yet, and set its idle time (0 == off)
+	static IOReturn						SetDeviceIdleTime(IOUSBDevice *device, UInt32 idleTimeMS);
+
+	// the device's policy object, retained, or NULL if it has none
+	static IOUSBDeviceAutoSuspend *		CopyAutoSuspend(IOUSBDevice *device);
+
+	void								SetIdleTime(UInt32 idleTimeMS);
+	UInt32								GetIdleTime(void)										{ return _idleTimeMS; }
+
+	// called by IOUSBPipe around each request. If completion is not NULL, wrapped is filled in with the completion to give to the controller
+	// instead, and io says how to issue the request later. If *deferred comes back true the request has been queued for the resume, and the
+	// caller must not issue it; otherwise EndIO is called by the wrapped completion, or by the caller with wrapped if the controller refused
+	// the request. Synchronous requests pass NULL for io, completion and wrapped, wait for any resume, and call EndIO() once they are done.
+	IOReturn							BeginIO(IOUSBPipe *pipe, const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOUSBCompletion *wrapped, bool *deferred);
+	void								EndIO(IOUSBCompletion *wrapped = NULL);
+
+	// a request we can't follow to completion - resume if needed and restart the idle time
+	IOReturn							NoteActivity(void);
+
+	void								GetStatistics(UInt32 *suspends, UInt32 *resumes, UInt64 *suspendedTimeMS, UInt32 *averageResumeLatencyUS, UInt32 *maxResumeLatencyUS);
+};
+
+#endif
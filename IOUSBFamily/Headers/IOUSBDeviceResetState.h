@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IOUSBDEVICERESETSTATE_H
+#define _IOUSBDEVICERESETSTATE_H
+
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/usb/USB.h>
+
+
+class IOUSBDevice;
+class IOUSBInterface;
+
+enum
+{
+	kUSBResetStateMaxInterfaces				= 32						// more than any composite device we have seen
+};
+
+
+/*
+ class IOUSBDeviceResetState
+ What a device's drivers would otherwise have to put back by hand after IOUSBDevice::ResetDevice: the configuration, the alternate
+ setting of each interface and the streams on its pipes. The IOUSBInterface and IOUSBPipe objects are kept, so the drivers' pointers
+ stay good. Restore sends SET_CONFIGURATION and SET_INTERFACE straight to the device rather than going through SetConfiguration,
+ which would tear the interfaces down. It then unlinks and reopens each interface's pipes on the controller, since an XHCI Reset
+ Device command disables every endpoint but the default one, and a new endpoint also starts from DATA0 as the device just did.
+ The streams are recreated last, on the new endpoints.
+ ResetDeviceAndRestore does the whole thing. From before the pipes are aborted until the restore is done, BlocksIO is true for the
+ device and new requests on any of its pipes fail with kIOReturnAborted, the status everything that was outstanding completes with.
+ If it fails, the caller should fall back to ReEnumerateDevice.
+*/
+class IOUSBDeviceResetState : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBDeviceResetState)
+
+private:
+	struct InterfaceState
+	{
+		IOUSBInterface *					interface;					// retained
+		UInt8								interfaceNumber;
+		UInt8								alternateSetting;
+	};
+
+	IOUSBDevice *						_device;					// retained
+	UInt8								_configValue;				// 0 if the device was not configured
+	UInt32								_numInterfaces;
+	InterfaceState						_interfaces[kUSBResetStateMaxInterfaces];
+
+	void								AbortPipes(void);
+	IOReturn							SendStandardRequest(UInt8 bRequest, UInt8 recipient, UInt16 wValue, UInt16 wIndex);
+
+protected:
+	virtual bool						initWithDevice(IOUSBDevice *device);
+	virtual void						free();
+
+public:
+	// take a snapshot of the device's current configuration, alternate settings and streams
+	static IOUSBDeviceResetState *		withDevice(IOUSBDevice *device);
+
+	// put the snapshot back on a device which has just been reset
+	IOReturn							Restore(void);
+
+	static IOReturn						ResetDeviceAndRestore(IOUSBDevice *device);
+
+	// true while ResetDeviceAndRestore has the device to itself
+	static bool							BlocksIO(IOUSBDevice *device);
+};
+
+#endif
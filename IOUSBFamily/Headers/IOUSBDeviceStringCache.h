@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IOUSBDEVICESTRINGCACHE_H
+#define _IOUSBDEVICESTRINGCACHE_H
+
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSString.h>
+
+#include <IOKit/IOLocks.h>
+
+
+class IOUSBDevice;
+
+enum
+{
+	kUSBStringCacheEntries					= 16,						// a handful of strings in a handful of languages
+	kUSBStringCacheMaxLanguages				= 4,						// we only prefetch in the first few languages the device lists
+	kUSBStringCacheDefaultLanguage			= 0x409,					// US English, the default for GetStringDescriptor
+	kUSBStringCacheTransfersPerString		= 2							// GetStringDescriptor reads the length, then the string
+};
+
+
+/*
+ class IOUSBDeviceStringCache
+ The ASCII strings which have already been read from a device with IOUSBDevice::GetStringDescriptor, by index and language.
+ GetString looks here first and only goes to the bus on a miss, adding what it reads. Prefetch reads the manufacturer, product and
+ serial number strings in the languages from the LANGID list once at enumeration, and Invalidate throws everything away when the
+ device is reset or re-enumerated. Only successful reads are cached, so a flaky device still gets asked again. GetStatistics
+ reports the hits and misses, and the control transfers the hits saved.
+*/
+class IOUSBDeviceStringCache : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBDeviceStringCache)
+
+private:
+	struct StringCacheEntry
+	{
+		OSString *							string;						// NULL if the entry is free
+		UInt16								lang;
+		UInt8								index;
+	};
+
+	IOUSBDevice *						_device;					// not retained - the device owns us
+	IOLock *							_lock;
+	StringCacheEntry					_entries[kUSBStringCacheEntries];
+	UInt32								_nextVictim;				// round robin replacement once the cache is full
+	UInt16								_languages[kUSBStringCacheMaxLanguages];
+	UInt32								_numLanguages;
+	UInt32								_hits;
+	UInt32								_misses;
+	UInt32								_transfersSaved;
+
+	IOReturn							ReadLanguages(void);
+
+protected:
+	virtual bool						initWithDevice(IOUSBDevice *device);
+	virtual void						free();
+
+public:
+	static IOUSBDeviceStringCache *		withDevice(IOUSBDevice *device);
+
+	// true, with the string copied into buf, if we already have it. Never goes to the bus
+	bool								Lookup(UInt8 index, UInt16 lang, char *buf, int maxLen);
+	void								Insert(UInt8 index, UInt16 lang, const char *string);
+	void								Invalidate(void);
+
+	// Lookup, and on a miss GetStringDescriptor and Insert
+	IOReturn							GetString(UInt8 index, char *buf, int maxLen, UInt16 lang = kUSBStringCacheDefaultLanguage);
+
+	// read the LANGID list and the device descriptor strings in each of those languages
+	IOReturn							Prefetch(void);
+
+	void								GetStatistics(UInt32 *hits, UInt32 *misses, UInt32 *transfersSaved);
+};
+
+#endif
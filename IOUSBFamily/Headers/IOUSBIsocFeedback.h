@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOUSBISOCFEEDBACK_H
+#define _IOUSBISOCFEEDBACK_H
+
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/usb/USB.h>
+
+
+class IOUSBDevice;
+class IOUSBPipe;
+
+enum USBIsocFeedbackFormat
+{
+	kUSBIsocFeedbackUnknown					= 0,
+	kUSBIsocFeedback10_14					= 1,						// 3 bytes, samples per 1 ms frame
+	kUSBIsocFeedback16_16					= 2,						// 4 bytes, samples per 125 us microframe (or per frame from some full speed devices)
+	kUSBIsocFeedbackImplicit				= 3							// the device's own IN data packets set the rate
+};
+
+enum
+{
+	kUSBIsocFeedbackToleranceShift			= 3,						// feedback more than nominal / 8 away from nominal is ignored
+	kUSBIsocFeedbackMaxPacketSize			= 4
+};
+
+
+/*
+ class IOUSBIsocFeedback
+ Rate matching for an asynchronous isochronous OUT endpoint. The data pipe is paired with its explicit feedback pipe, or with an
+ implicit feedback IN data pipe, and the rate the device reports is kept as samples per bus interval in 16.16 fixed point. Explicit
+ feedback is 10.14 in 3 bytes at full speed and 16.16 in 4 bytes at high and super speed. Since a good number of full speed devices
+ send 16.16 anyway, a packet is read in whichever format lands near the nominal rate, and that format is kept from then on.
+ The driver still schedules the transfers itself. PrepareFeedbackRead sets up the frame list for a Read on the feedback pipe, and
+ ProcessFeedback is called from that Read's completion, which may be at interrupt time. FillFrameList then gives the frReqCount of
+ each outgoing packet. The fraction left over from each packet is carried to the next one, so over time the number of samples sent
+ matches the device's clock exactly. FillFrameList should only be called from one context at a time.
+*/
+class IOUSBIsocFeedback : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBIsocFeedback)
+
+private:
+	IOUSBPipe *							_dataPipe;					// retained
+	IOUSBPipe *							_feedbackPipe;				// retained, NULL for a fixed rate
+	USBIsocFeedbackFormat				_format;
+	UInt32								_busIntervalsPerSecond;		// 1000 at full speed, 8000 above
+	UInt32								_intervalsPerPacket;		// from the data endpoint's bInterval
+	UInt32								_feedbackIntervalsPerPacket;
+	UInt32								_feedbackPacketSize;
+	UInt32								_bytesPerSampleFrame;
+	UInt32								_maxPacketSize;
+	UInt32								_sampleRate;				// nominal, in Hz
+	UInt32								_nominalRate;				// samples per bus interval, 16.16
+	volatile UInt32						_currentRate;				// samples per bus interval, 16.16
+	UInt32								_remainder;					// fraction of a sample carried between packets, 16.16
+
+	// statistics
+	UInt32								_feedbackCount;
+	UInt32								_rejectedFeedback;
+	UInt32								_minRate;
+	UInt32								_maxRate;
+
+	bool								RateIsPlausible(UInt32 rate);
+	void								SetCurrentRate(UInt32 rate);
+	UInt32								ParseExplicitFeedback(const UInt8 *packet, UInt32 length);
+
+protected:
+	virtual bool						initWithPipes(IOUSBDevice *device, IOUSBPipe *dataPipe, IOUSBPipe *feedbackPipe, UInt32 sampleRate, UInt32 bytesPerSampleFrame);
+	virtual void						free();
+
+public:
+	// feedbackPipe may be NULL, in which case the nominal sample rate is used throughout
+	static IOUSBIsocFeedback *			withPipes(IOUSBDevice *device, IOUSBPipe *dataPipe, IOUSBPipe *feedbackPipe, UInt32 sampleRate, UInt32 bytesPerSampleFrame);
+
+	// how big the buffer for a feedback Read of numFrames has to be
+	UInt32								GetFeedbackBufferSize(UInt32 numFrames);
+	void								PrepareFeedbackRead(IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames);
+
+	// buffer is the one the feedback Read completed into. Returns the number of packets which updated the rate
+	UInt32								ProcessFeedback(const UInt8 *buffer, IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames);
+
+	// sets frReqCount for each of the packets and returns the total, which is how much of the buffer the Write will send
+	UInt32								FillFrameList(IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames);
+
+	// back to the nominal rate, e.g. after the stream was stopped or the sample rate changed
+	void								Reset(UInt32 sampleRate = 0);
+
+	UInt32								GetCurrentRate(void)									{ return _currentRate; }
+	UInt32								GetCurrentSampleRate(void);
+	USBIsocFeedbackFormat				GetFormat(void)											{ return _format; }
+	void								GetStatistics(UInt32 *feedbackPackets, UInt32 *rejected, UInt32 *minSampleRate, UInt32 *maxSampleRate);
+};
+
+#endif
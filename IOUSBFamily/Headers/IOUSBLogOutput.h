@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Where a USBLog or USBError message goes once it has passed the level check and the rate limiter: the console through IOLog, the
+ KLog kext, or both, as gKernelDebugOutputType says. The message is formatted once, tag and timestamp included, into a scratch buffer
+ which every enabled output shares.
+*/
+
+#ifndef _IOKIT_IOUSBLOGOUTPUT_H
+#define _IOKIT_IOUSBLOGOUTPUT_H
+
+#include <stdarg.h>
+#include <libkern/OSTypes.h>
+
+#ifdef	__cplusplus
+	extern "C" {
+#endif
+
+void	KernelDebugLogOutput( UInt32 inLevel, UInt32 inTag, char const *inFormatString, va_list inArgs );
+
+// Formats the message again for each output, as it was done before there were scratch buffers. KernelDebugLogOutput falls back on
+// it when every buffer is taken or the message doesn't fit in one
+void	KernelDebugLogOutputDirect( UInt32 inLevel, UInt32 inTag, char const *inFormatString, va_list inArgs );
+
+#ifdef	__cplusplus
+	}
+#endif
+
+#endif
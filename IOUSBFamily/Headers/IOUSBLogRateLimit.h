@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Rate limiting for USBLog and USBError, so that a device which keeps failing the same way can't flood the log. Each call site (format
+ string) and object logging from it gets a token bucket of a burst of messages, refilled at so many a second. What a site suppresses
+ is summarized when it next gets to log, when another site takes its slot, or by a sweep which runs from a thread call for as long as
+ any site is holding messages back.
+*/
+
+#ifndef _IOKIT_IOUSBLOGRATELIMIT_H
+#define _IOKIT_IOUSBLOGRATELIMIT_H
+
+#include <stdarg.h>
+#include <libkern/OSTypes.h>
+
+// the counters, as AppleUSBDiagnostics publishes them
+#define kUSBLogSuppressedMessagesKey		"Log Messages Suppressed"
+#define kUSBLogSuppressingSitesKey			"Log Sites Suppressing"
+
+#define kKernelDebugRateLimitSweepMS		5000
+#define kKernelDebugMaxSummaries			4
+#define kKernelDebugFormatCopySize			48
+
+typedef struct KernelDebugSuppressedSummary
+{
+	char					format[kKernelDebugFormatCopySize];		// the start of the format string, copied when the site took its slot
+	const void *			object;
+	UInt32					level;
+	UInt32					tag;
+	UInt32					suppressed;
+} KernelDebugSuppressedSummary;
+
+#ifdef	__cplusplus
+	extern "C" {
+#endif
+
+// A burst of 0 turns rate limiting off
+void	KernelDebugSetRateLimit( UInt32 inBurst, UInt32 inPerSecond );
+void	KernelDebugGetRateLimitStatistics( UInt64 *outSuppressedMessages, UInt32 *outSuppressingSites );
+
+// Returns false if the message should be dropped. Summaries which are due come back in outSummaries (room for kKernelDebugMaxSummaries)
+// for the caller to log once it can.
+bool	KernelDebugRateLimit( UInt32 inLevel, UInt32 inTag, char const *inFormatString, va_list inArgs,
+							  KernelDebugSuppressedSummary *outSummaries, UInt32 *outNumSummaries );
+
+// IOUSBLog.cpp's, for the summaries the sweep finds. It must not be rate limited itself
+void	KernelDebugLogSuppressed( const KernelDebugSuppressedSummary *inSummary );
+
+#ifdef	__cplusplus
+	}
+#endif
+
+#endif
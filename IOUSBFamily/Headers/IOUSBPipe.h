@@ -31,8 +31,11 @@
 #include <IOKit/usb/IOUSBControllerV2.h>
 
 class IOUSBInterface;
+class IOUSBDeviceAutoSuspend;
+struct IOUSBAutoSuspendIO;
 
 #define	kAppleUSBSSIsocContinuousFrame		0xFFFFFFFFFFFFFFFEull
+#define	kAppleUSBIsocASAPFrame				0xFFFFFFFFFFFFFFFDull		// UHCI and OHCI only: start at the next frame of the endpoint's cadence, or as soon after it as the controller can
 
 /*!
     @class IOUSBPipe
@@ -42,6 +45,8 @@ class IOUSBPipe : public OSObject
 {
     friend class IOUSBInterface;
     friend class IOUSBDevice;
+    friend class IOUSBDeviceAutoSuspend;
+    friend class IOUSBDeviceResetState;
 	
     OSDeclareDefaultStructors(IOUSBPipe)
 		
@@ -71,6 +76,18 @@ protected:
     
     IOReturn ClosePipe(void);
 	
+	// the public Read, Write and ControlRequest go through AutoSuspendIO, which brackets these with the device's autosuspend
+	// BeginIO/EndIO if it has one. DoIO is also how the autosuspend object issues requests it queued while the device was suspended.
+	// Both AutoSuspendIO and AutoSuspendNoteActivity, which the isoch calls make, fail with kIOReturnAborted while the device is
+	// being reset and restored
+	IOReturn					AutoSuspendIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead);
+	IOReturn					AutoSuspendNoteActivity(void);
+	IOReturn					DoIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead);
+	IOReturn					DoRead(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion, IOByteCount *bytesRead);
+	IOReturn					DoWrite(IOMemoryDescriptor *buffer, UInt32 noDataTimeout, UInt32 completionTimeout, IOByteCount reqCount, IOUSBCompletion *completion);
+	IOReturn					DoControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion);
+	IOReturn					DoControlRequest(IOUSBDevRequestDesc *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion);
+	
 public:
     
     // The following 4 methods are deprecated (replaced by the new IOUSBPipeV2 class)
@@ -330,7 +347,7 @@ public:
 	 Read from an isochronous endpoint and process the IOUSBLowLatencyIsocFrame fields at 
 	 hardware interrupt time
 	 @param buffer place to put the transferred data
-	 @param frameStart USB frame number of the frame to start transfer. For SuperSpeed Isoc devices, if the frameStart is kAppleUSBSSIsocContinuousFrame, then just continue after the last transfer which was called.
+	 @param frameStart USB frame number of the frame to start transfer. For SuperSpeed Isoc devices, if the frameStart is kAppleUSBSSIsocContinuousFrame, then just continue after the last transfer which was called. On a full speed (UHCI or OHCI) controller, if it is kAppleUSBIsocASAPFrame, the controller continues after the last transfer, or if that frame has already gone by, starts at the earliest frame it still can and skips the ones in between instead of failing with kIOReturnIsoTooOld. The controller adds the skipped frames to its IsochASAPFramesSkipped property. Other controllers return kIOReturnUnsupported for kAppleUSBIsocASAPFrame.
 	 @param numFrames Number of frames to transfer
 	 @param frameList Bytes to transfer, result, and time stamp for each frame
 	 @param completion describes action to take when buffer has been filled
@@ -346,7 +363,7 @@ public:
 	 AVAILABLE ONLY IN VERSION 1.9.2 AND ABOVE
 	 Write to an isochronous endpoint
 	 @param buffer place to get the data to transfer
-	 @param frameStart USB frame number of the frame to start transfer. For SuperSpeed Isoc devices, if the frameStart is kAppleUSBSSIsocContinuousFrame, then just continue after the last transfer which was called.
+	 @param frameStart USB frame number of the frame to start transfer. For SuperSpeed Isoc devices, if the frameStart is kAppleUSBSSIsocContinuousFrame, then just continue after the last transfer which was called. On a full speed (UHCI or OHCI) controller, if it is kAppleUSBIsocASAPFrame, the controller continues after the last transfer, or if that frame has already gone by, starts at the earliest frame it still can and skips the ones in between instead of failing with kIOReturnIsoTooOld. The controller adds the skipped frames to its IsochASAPFramesSkipped property. Other controllers return kIOReturnUnsupported for kAppleUSBIsocASAPFrame.
 	 @param numFrames Number of frames to transfer
 	 @param frameList Pointer to list of frames indicating bytes to transfer and result for each frame
 	 @param completion describes action to take when buffer has been emptied
@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _IOUSBQUIRKS_H
+#define _IOUSBQUIRKS_H
+
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSArray.h>
+
+#include <IOKit/IOLocks.h>
+
+
+class IOUSBDevice;
+
+#define kUSBQuirksKey							"USB Quirks"				// OSArray of OSDictionary, in a kUSBQuirksProviderClass personality
+#define kUSBQuirksProviderClass					"IOUSBQuirks"				// IOProviderClass of personalities which only carry a table - nothing matches them
+
+// keys of a quirk entry. A device entry has kUSBQuirkVendorIDKey, a controller entry kUSBQuirkPCIVendorIDKey
+#define kUSBQuirkVendorIDKey					"idVendor"
+#define kUSBQuirkProductIDKey					"idProduct"					// optional, any product if missing
+#define kUSBQuirkDeviceReleaseLowKey			"bcdDeviceLow"				// optional, inclusive
+#define kUSBQuirkDeviceReleaseHighKey			"bcdDeviceHigh"				// optional, inclusive
+#define kUSBQuirkPCIVendorIDKey					"PCIVendorID"
+#define kUSBQuirkPCIDeviceIDKey					"PCIDeviceID"				// optional, any device if missing
+#define kUSBQuirkPCIRevisionLowKey				"PCIRevisionLow"			// optional, inclusive
+#define kUSBQuirkPCIRevisionHighKey				"PCIRevisionHigh"			// optional, inclusive
+#define kUSBQuirkCommentKey						"Comment"					// logged when the entry is applied
+
+#define kUSBQuirkSkipStringDescriptorsKey		"SkipStringDescriptors"		// OSBoolean
+#define kUSBQuirkResetDelayKey					"ResetDelay"				// OSNumber, ms
+#define kUSBQuirkDisableLPMKey					"DisableLPM"				// OSBoolean
+#define kUSBQuirkForceConfigurationKey			"ForceConfiguration"		// OSNumber, bConfigurationValue
+#define kUSBQuirkBounceBufferKey				"BounceBuffer"				// OSBoolean
+#define kUSBQuirkErrataKey						"Errata"					// OSNumber, kErrata bits for a controller
+
+enum
+{
+	kUSBQuirkSkipStringDescriptors			= (1 << 0),					// don't read any strings at enumeration
+	kUSBQuirkExtraResetDelay				= (1 << 1),					// wait resetDelayMS more after a reset
+	kUSBQuirkDisableLPM						= (1 << 2),					// no U1/U2 or USB 2 L1 for this device
+	kUSBQuirkForceConfiguration				= (1 << 3),					// use configValue, whatever the device offers
+	kUSBQuirkBounceBuffer					= (1 << 4),					// copy transfers through a buffer below 4GB
+	
+	kUSBQuirksMaxEntries					= 256,
+	kUSBQuirksMaxResetDelayMS				= 5000
+};
+
+typedef struct IOUSBDeviceQuirks
+{
+	UInt32									quirks;						// kUSBQuirk bits
+	UInt32									resetDelayMS;
+	UInt8									configValue;
+} IOUSBDeviceQuirks;
+
+
+/*
+ class IOUSBQuirks
+ A table of device and controller workarounds read from a property list, so that a misbehaving device can be taken care of without a
+ code change. Device entries are matched on idVendor, idProduct and a bcdDevice range, controller entries on the PCI vendor and device
+ IDs and a revision range. Every entry which matches is applied in table order, so a later entry can override the values of an earlier,
+ more general one. The controller errata found here are ORed in with the built in ones.
+ There is one table for the family, whatever controllers the machine has. It is built from the kUSBQuirksKey arrays of every
+ personality in the catalogue whose IOProviderClass is kUSBQuirksProviderClass - the family's own, and any a codeless kext adds -
+ in the catalogue's order, and built again by the next lookup after the catalogue's generation count moves, so loading or unloading
+ such a kext takes effect for the next device without a restart. LoadQuirks puts a table of its own in place of the catalogue's until
+ it is called with NULL. MatchDevice and MatchController only look at the table itself, and GetDeviceQuirks and GetControllerErrata
+ wrap them with the locking and log every quirk which gets applied.
+*/
+class IOUSBQuirks : public OSObject
+{
+    OSDeclareDefaultStructors(IOUSBQuirks)
+
+private:
+	struct DeviceEntry
+	{
+		UInt16								vendorID;
+		UInt16								productID;
+		bool								anyProduct;
+		UInt16								releaseLow;
+		UInt16								releaseHigh;
+		IOUSBDeviceQuirks					quirks;
+		const char *						comment;					// points into _entries
+	};
+
+	struct ControllerEntry
+	{
+		UInt16								vendorID;
+		UInt16								deviceID;
+		bool								anyDevice;
+		UInt8								revisionLow;
+		UInt8								revisionHigh;
+		UInt64								errata;
+		const char *						comment;					// points into _entries
+	};
+
+	OSArray *							_entries;					// the array we were built from, retained for the comments
+	DeviceEntry *						_devices;
+	UInt32								_numDevices;
+	UInt32								_maxEntries;				// size of each of the entry arrays
+	ControllerEntry *					_controllers;
+	UInt32								_numControllers;
+
+	static IOLock *						_lock;
+	static IOUSBQuirks *				_current;
+	static bool							_loaded;					// _current has been built at least once
+	static bool							_pinned;					// _current is one LoadQuirks put there, not the catalogue's
+	static SInt32						_generation;				// of the catalogue _current was built from
+
+	bool								ParseDeviceEntry(OSDictionary *dict, DeviceEntry *entry);
+	bool								ParseControllerEntry(OSDictionary *dict, ControllerEntry *entry);
+	static bool							MakeLock(void);
+	static IOUSBQuirks *				CreateFromCatalogue(SInt32 *generation);
+	static IOUSBQuirks *				CopyCurrent(void);
+
+protected:
+	virtual bool						initWithArray(OSArray *entries);
+	virtual void						free();
+
+public:
+	static IOUSBQuirks *				withArray(OSArray *entries);
+
+	// the quirks of every matching entry, merged. false if nothing matched
+	bool								MatchDevice(UInt16 vendorID, UInt16 productID, UInt16 deviceRelease, IOUSBDeviceQuirks *quirks, const char **comment = NULL);
+	UInt64								MatchController(UInt16 vendorID, UInt16 deviceID, UInt8 revisionID, const char **comment = NULL);
+
+	UInt32								GetNumDeviceEntries(void)		{ return _numDevices; }
+	UInt32								GetNumControllerEntries(void)	{ return _numControllers; }
+
+	// use a table of our own in place of the catalogue's. An empty array leaves no table at all, NULL goes back to the catalogue's
+	static IOReturn						LoadQuirks(OSArray *entries);
+
+	// look a device or controller up in the family's table, logging what was applied
+	static bool							GetDeviceQuirks(IOUSBDevice *device, IOUSBDeviceQuirks *quirks);
+	static UInt64						GetControllerErrata(UInt16 vendorID, UInt16 deviceID, UInt8 revisionID, const char *name);
+};
+
+#endif
@@ -0,0 +1,493 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+/*
+ Host tests for IOUSBDeviceAutoSuspend's state machine, on a simulated device whose suspend and resume take its bus's workloop gate
+ as the controller's would. The idle and resume thread calls run from inside ShimAdvanceTimeMS, on the test's own thread, which is
+ also the workloop's. The synchronous waits are tested from a second thread, which the test lets go to sleep before it moves the
+ clock, so the two never touch the thread calls at once.
+*/
+
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <IOKit/IOMessage.h>
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBController.h>
+#include <IOKit/usb/IOUSBDeviceAutoSuspend.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestIdleMS				= 200,
+	kTestMaxPending			= 16,
+	kTestSleepWaitMS		= 2000						// real time a second thread is given to go to sleep
+};
+
+static char		gEvents[1024];
+static IOLock *	gEventLock = IOLockAlloc();
+
+static void
+Event(const char *format, ...)
+{
+	size_t		used;
+	va_list		args;
+
+	IOLockLock(gEventLock);
+	used = strlen(gEvents);
+	if (used)
+		gEvents[used++] = ' ';
+	va_start(args, format);
+	vsnprintf(gEvents + used, sizeof(gEvents) - used, format, args);
+	va_end(args);
+	IOLockUnlock(gEventLock);
+}
+
+
+
+#define CHECK_EVENTS(expected)																\
+	do {																					\
+		gTestChecks++;																		\
+		if (strcmp(gEvents, expected))														\
+		{																					\
+			gTestFailures++;																\
+			fprintf(stderr, "%s:%d: events were\n  %s\nexpected\n  %s\n", __FILE__, __LINE__, gEvents, expected);	\
+		}																					\
+		gEvents[0] = 0;																		\
+	} while (0)
+
+
+class TestDevice : public IOUSBDevice
+{
+public:
+	IOUSBConfigurationDescriptor	config;
+	IOReturn						suspendResult;
+
+	virtual IOReturn	SuspendDevice(bool suspend)
+	{
+		IOWorkLoop		*workLoop = GetBus()->getWorkLoop();
+
+		workLoop->closeGate();
+		Event(suspend ? "suspend" : "resume");
+		workLoop->openGate();
+		return suspend ? suspendResult : kIOReturnSuccess;
+	}
+
+	virtual const IOUSBConfigurationDescriptor *	FindConfig(UInt8 configValue, UInt8 *configIndex)
+	{
+		return (configValue == config.bConfigurationValue) ? &config : NULL;
+	}
+
+	virtual IOReturn	DeviceRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)
+	{
+		if (request->wValue == kUSBFeatureDeviceRemoteWakeup)
+			Event((request->bRequest == kUSBRqSetFeature) ? "arm-wakeup" : "disarm-wakeup");
+		return kIOReturnSuccess;
+	}
+};
+
+
+// hangs on to each asynchronous request it is given until the test completes it
+class TestPipe : public IOUSBPipe
+{
+public:
+	IOUSBCompletion		pending[kTestMaxPending];
+	int					pendingCount;
+	IOReturn			issueResult;
+
+	virtual IOReturn	DoIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead)
+	{
+		Event("io(%d)", (int)io->reqCount);
+		if (issueResult)
+			return issueResult;
+		if (completion)
+			pending[pendingCount++] = *completion;
+		return kIOReturnSuccess;
+	}
+
+	void				CompleteAll(void)
+	{
+		while (pendingCount)
+		{
+			IOUSBCompletion		completion = pending[0];
+
+			memmove(&pending[0], &pending[1], --pendingCount * sizeof(pending[0]));
+			(*completion.action)(completion.target, completion.parameter, kIOReturnSuccess, 0);
+		}
+	}
+};
+
+
+static void
+ClientDone(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining)
+{
+	Event(status ? "failed(%d)" : "done(%d)", (int)(uintptr_t)parameter);
+}
+
+
+struct Fixture
+{
+	IOUSBController *			bus;
+	TestDevice *				device;
+	TestPipe *					pipe;
+	IOUSBDeviceAutoSuspend *	autoSuspend;
+
+	void						SetUp(void)
+	{
+		bus = new IOUSBController;
+		bus->_workLoop = IOWorkLoop::workLoop();
+		device = new TestDevice;
+		device->_bus = bus;
+		device->_expansionData = (IOUSBDevice::ExpansionData *)IOMalloc(sizeof(IOUSBDevice::ExpansionData));
+		bzero(device->_expansionData, sizeof(IOUSBDevice::ExpansionData));
+		device->_currentConfigValue = 1;
+		device->config.bConfigurationValue = 1;
+		device->config.bmAttributes = 0x80 | kUSBAtrRemoteWakeup;
+		pipe = new TestPipe;
+
+		CHECK_EQUAL(IOUSBDeviceAutoSuspend::SetDeviceIdleTime(device, kTestIdleMS), kIOReturnSuccess);
+		autoSuspend = IOUSBDeviceAutoSuspend::CopyAutoSuspend(device);
+		CHECK(autoSuspend != NULL);
+		gEvents[0] = 0;
+	}
+
+	// as IOUSBPipe::AutoSuspendIO
+	IOReturn					AsyncIO(int id)
+	{
+		IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIORead, NULL, NULL, 0, 0, (IOByteCount)id };
+		IOUSBCompletion			completion = { NULL, ClientDone, (void *)(uintptr_t)id };
+		IOUSBCompletion			wrapped;
+		bool					deferred = false;
+		IOReturn				err;
+
+		err = autoSuspend->BeginIO(pipe, &io, &completion, &wrapped, &deferred);
+		if (deferred)
+			Event("queued(%d)", id);
+		else if (err == kIOReturnSuccess)
+		{
+			err = pipe->DoIO(&io, &wrapped, NULL);
+			if (err)
+				autoSuspend->EndIO(&wrapped);
+		}
+		return err;
+	}
+
+	IOReturn					SyncIO(int id)
+	{
+		IOUSBAutoSuspendIO		io = { kUSBAutoSuspendIORead, NULL, NULL, 0, 0, (IOByteCount)id };
+		IOReturn				err;
+
+		err = autoSuspend->BeginIO(pipe, NULL, NULL, NULL, NULL);
+		if (err == kIOReturnSuccess)
+		{
+			err = pipe->DoIO(&io, NULL, NULL);
+			autoSuspend->EndIO();
+		}
+		return err;
+	}
+
+	UInt32						Stat(const char *key)
+	{
+		OSDictionary	*stats = OSDynamicCast(OSDictionary, device->getProperty(kUSBAutoSuspendStatisticsKey));
+		OSNumber		*number = stats ? OSDynamicCast(OSNumber, stats->getObject(key)) : NULL;
+
+		return number ? (UInt32)number->unsigned64BitValue() : 0xFFFFFFFF;
+	}
+
+	void						Suspend(void)
+	{
+		ShimAdvanceTimeMS(kTestIdleMS);
+		CHECK_EVENTS("arm-wakeup suspend");
+	}
+
+	// the device goes away. Nothing may be left holding either of them once the idle thread call has let go
+	void						TearDown(void)
+	{
+		device->ShimTerminated = true;
+		device->ShimMessage(kIOMessageServiceIsTerminated);
+		ShimAdvanceTimeMS(1);
+		CHECK(device->_expansionData->_autoSuspend == NULL);
+		CHECK(!device->ShimHasInterest());
+
+		autoSuspend->release();
+		CHECK_EQUAL(device->getRetainCount(), 1);
+
+		pipe->release();
+		IOFree(device->_expansionData, sizeof(IOUSBDevice::ExpansionData));
+		device->release();
+		bus->_workLoop->release();
+		bus->release();
+		gEvents[0] = 0;
+	}
+};
+
+
+
+static void
+TestIdleSuspend(void)
+{
+	Fixture		fixture;
+
+	fixture.SetUp();
+	ShimAdvanceTimeMS(kTestIdleMS - 1);
+	CHECK_EVENTS("");
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("arm-wakeup suspend");
+	CHECK_EQUAL(fixture.Stat("Suspends"), 1);
+	CHECK_EQUAL(fixture.Stat("Resumes"), 0);
+
+	// a request while suspended is queued and issued from the resume thread call, and the client never sees the device suspended
+	ShimAdvanceTimeMS(500);
+	CHECK_EQUAL(fixture.AsyncIO(1), kIOReturnSuccess);
+	CHECK_EVENTS("queued(1)");
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("resume disarm-wakeup io(1)");
+	CHECK_EQUAL(fixture.Stat("Resumes"), 1);
+	CHECK_EQUAL(fixture.Stat("Suspended Time (ms)"), 500);
+
+	// and the idle time starts again once it completes
+	ShimAdvanceTimeMS(50);
+	fixture.pipe->CompleteAll();
+	CHECK_EVENTS("done(1)");
+	ShimAdvanceTimeMS(kTestIdleMS - 1);
+	CHECK_EVENTS("");
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("arm-wakeup suspend");
+	CHECK_EQUAL(fixture.Stat("Suspends"), 2);
+
+	fixture.TearDown();
+}
+
+
+
+static void
+TestActivity(void)
+{
+	Fixture		fixture;
+
+	fixture.SetUp();
+
+	// a request outstanding when the timer fires holds the suspend off until the idle time has gone by after it completes
+	ShimAdvanceTimeMS(150);
+	CHECK_EQUAL(fixture.AsyncIO(1), kIOReturnSuccess);
+	ShimAdvanceTimeMS(100);
+	CHECK_EVENTS("io(1)");
+	fixture.pipe->CompleteAll();
+	CHECK_EVENTS("done(1)");
+	ShimAdvanceTimeMS(kTestIdleMS - 1);
+	CHECK_EVENTS("");
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("arm-wakeup suspend");
+
+	// a synchronous request on the workloop can't wait for the resume, and doesn't start one
+	CHECK_EQUAL(fixture.SyncIO(2), kIOUSBSyncRequestOnWLThread);
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("");
+
+	// one we can't follow to completion resumes the device and restarts the idle time
+	CHECK_EQUAL(fixture.autoSuspend->NoteActivity(), kIOReturnSuccess);
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("resume disarm-wakeup");
+	ShimAdvanceTimeMS(kTestIdleMS);
+	CHECK_EVENTS("arm-wakeup suspend");
+
+	// turning the policy off resumes the device, and it stays up
+	fixture.autoSuspend->SetIdleTime(0);
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("resume disarm-wakeup");
+	ShimAdvanceTimeMS(10 * kTestIdleMS);
+	CHECK_EVENTS("");
+	CHECK_EQUAL(fixture.Stat("Idle Time (ms)"), 0);
+
+	fixture.TearDown();
+}
+
+
+
+static void
+TestQueueOrder(void)
+{
+	Fixture		fixture;
+
+	fixture.SetUp();
+	fixture.Suspend();
+
+	// requests queued for the resume go out in the order they came in
+	fixture.AsyncIO(1);
+	fixture.AsyncIO(2);
+	fixture.AsyncIO(3);
+	CHECK_EVENTS("queued(1) queued(2) queued(3)");
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("resume disarm-wakeup io(1) io(2) io(3)");
+	fixture.pipe->CompleteAll();
+	CHECK_EVENTS("done(1) done(2) done(3)");
+
+	// one the controller refuses when it is issued completes with the error instead
+	fixture.Suspend();
+	fixture.pipe->issueResult = kIOReturnNoResources;
+	fixture.AsyncIO(4);
+	ShimAdvanceTimeMS(1);
+	CHECK_EVENTS("queued(4) resume disarm-wakeup io(4) failed(4)");
+	fixture.pipe->issueResult = kIOReturnSuccess;
+
+	// and it doesn't count as outstanding, so the device still suspends
+	fixture.Suspend();
+
+	fixture.TearDown();
+}
+
+
+
+static void
+TestFailedSuspend(void)
+{
+	Fixture		fixture;
+
+	fixture.SetUp();
+	fixture.device->suspendResult = kIOReturnNotResponding;
+	ShimAdvanceTimeMS(kTestIdleMS);
+	CHECK_EVENTS("arm-wakeup suspend");
+	CHECK_EQUAL(fixture.Stat("Suspends"), 0);
+	CHECK_EQUAL(fixture.Stat("Failed Suspends"), 1);
+
+	// the device is still up, so requests go straight out, and it tries again after another idle time
+	CHECK_EQUAL(fixture.AsyncIO(1), kIOReturnSuccess);
+	CHECK_EVENTS("io(1)");
+	fixture.pipe->CompleteAll();
+	CHECK_EVENTS("done(1)");
+	fixture.device->suspendResult = kIOReturnSuccess;
+	fixture.Suspend();
+	CHECK_EQUAL(fixture.Stat("Suspends"), 1);
+
+	fixture.TearDown();
+}
+
+
+
+static void
+TestTermination(void)
+{
+	Fixture		fixture;
+
+	fixture.SetUp();
+	fixture.Suspend();
+
+	// the device goes away with requests queued and the resume not started: they fail, and the resume never runs
+	fixture.AsyncIO(1);
+	fixture.AsyncIO(2);
+	CHECK_EVENTS("queued(1) queued(2)");
+	fixture.device->ShimTerminated = true;
+	fixture.device->ShimMessage(kIOMessageServiceIsTerminated);
+	CHECK_EVENTS("failed(1) failed(2)");
+	ShimAdvanceTimeMS(kTestIdleMS);
+	CHECK_EVENTS("");
+
+	// a policy can't be set up again on a terminated device
+	fixture.autoSuspend->SetIdleTime(kTestIdleMS);
+	CHECK_EQUAL(IOUSBDeviceAutoSuspend::SetDeviceIdleTime(fixture.device, kTestIdleMS), kIOReturnNotResponding);
+
+	fixture.TearDown();
+}
+
+
+
+static bool
+WaitForSleeper(UInt32 (*sleepers)(void))
+{
+	for (int i = 0; i < kTestSleepWaitMS; i++)
+	{
+		if (sleepers())
+			return true;
+		usleep(1000);
+	}
+	return false;
+}
+
+
+struct SyncClient
+{
+	Fixture *		fixture;
+	bool			inGate;
+	IOReturn		result;
+};
+
+static void *
+SyncClientThread(void *arg)
+{
+	SyncClient		*client = (SyncClient *)arg;
+	IOWorkLoop		*workLoop = client->fixture->bus->getWorkLoop();
+
+	if (client->inGate)
+		workLoop->closeGate();
+	client->result = client->fixture->SyncIO(7);
+	if (client->inGate)
+		workLoop->openGate();
+	return NULL;
+}
+
+
+// a synchronous request from a thread which isn't the workloop's waits for the resume. One from a thread which holds the gate must
+// give it up while it waits, or the resume, which needs the gate, never happens
+static void
+TestSyncWait(bool inGate)
+{
+	Fixture			fixture;
+	SyncClient		client = { &fixture, inGate, kIOReturnInvalid };
+	pthread_t		thread;
+
+	fixture.SetUp();
+	fixture.Suspend();
+
+	pthread_create(&thread, NULL, SyncClientThread, &client);
+	if (!WaitForSleeper(inGate ? ShimGateSleepers : ShimLockSleepers))
+	{
+		fprintf(stderr, "%s:%d: the synchronous request never went to sleep %s the gate (%d asleep on the lock, %d in the gate)\n", __FILE__, __LINE__, inGate ? "in" : "outside",
+				(int)ShimLockSleepers(), (int)ShimGateSleepers());
+		gTestFailures++;
+		pthread_detach(thread);
+		return;
+	}
+	CHECK_EVENTS("");
+
+	ShimAdvanceTimeMS(1);
+	pthread_join(thread, NULL);
+	CHECK_EQUAL(client.result, kIOReturnSuccess);
+	CHECK_EVENTS("resume disarm-wakeup io(7)");
+	CHECK_EQUAL(fixture.Stat("Resumes"), 1);
+
+	fixture.Suspend();
+	fixture.TearDown();
+}
+
+static void		TestSyncWaitOutsideGate(void)	{ TestSyncWait(false); }
+static void		TestSyncWaitInGate(void)		{ TestSyncWait(true); }
+
+
+TEST_MAIN("IOUSBDeviceAutoSuspend", TestIdleSuspend, TestActivity, TestQueueOrder, TestFailedSuspend, TestTermination, TestSyncWaitOutsideGate, TestSyncWaitInGate)
@@ -0,0 +1,302 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBCommandPool's high water mark and idle trimming. A simulated controller grows the pool the way
+ IncreaseCommandPool does when getCommand comes back empty, and keeps the same count of the commands it has given the pool,
+ which the release action takes the released ones off. Time only moves when a test says so.
+*/
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBCommand.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestGrowBy				= 50,					// as IncreaseCommandPool
+	kTestBurst				= 1000
+};
+
+static int		gLiveDMACommands = 0;
+
+class TestDMACommand : public IODMACommand
+{
+public:
+	TestDMACommand()				{ gLiveDMACommands++; }
+	virtual ~TestDMACommand()		{ gLiveDMACommands--; }
+};
+
+
+class TestController : public OSObject
+{
+public:
+	IOWorkLoop *		workLoop;
+	IOUSBCommandPool *	pool;
+	bool				isoc;
+	UInt32				poolSize;					// _currentSizeOfCommandPool
+	UInt32				releaseCalls;
+
+	static TestController *	withPool(bool isoc)
+	{
+		TestController	*me = new TestController;
+
+		me->isoc = isoc;
+		me->workLoop = IOWorkLoop::workLoop();
+		me->pool = (IOUSBCommandPool *)IOUSBCommandPool::withWorkLoop(me->workLoop);
+		return me;
+	}
+
+	static void			Released(OSObject *owner, UInt32 released)
+	{
+		TestController	*me = (TestController *)owner;
+
+		me->poolSize -= released;
+		me->releaseCalls++;
+	}
+
+	void				Grow(void)
+	{
+		for (int i = 0; i < kTestGrowBy; i++)
+		{
+			IOCommand		*command;
+
+			if (isoc)
+			{
+				IOUSBIsocCommand	*isocCommand = IOUSBIsocCommand::NewCommand();
+
+				isocCommand->SetDMACommand(new TestDMACommand);
+				command = isocCommand;
+			}
+			else
+			{
+				IOUSBCommand		*usbCommand = IOUSBCommand::NewCommand();
+
+				usbCommand->SetDMACommand(new TestDMACommand);
+				command = usbCommand;
+			}
+			poolSize++;
+			pool->returnCommand(command);
+		}
+	}
+
+	// as Read and Write get one
+	IOCommand *			Get(void)
+	{
+		IOCommand		*command = pool->getCommand(false);
+
+		if (!command)
+		{
+			Grow();
+			command = pool->getCommand(false);
+		}
+		return command;
+	}
+
+	UInt32				Stat(const char *key)
+	{
+		OSDictionary	*stats = pool->CopyStatistics();
+		OSNumber		*number = OSDynamicCast(OSNumber, stats->getObject(key));
+		UInt32			value = number ? (UInt32)number->unsigned64BitValue() : 0xFFFFFFFF;
+
+		stats->release();
+		return value;
+	}
+
+	// the controller frees whatever is left in the pool when it goes away
+	void				TearDown(void)
+	{
+		IOCommand		*command;
+
+		while ((command = pool->getCommand(false)))
+		{
+			IODMACommand	*dmaCommand = isoc ? ((IOUSBIsocCommand *)command)->GetDMACommand() : ((IOUSBCommand *)command)->GetDMACommand();
+
+			if (dmaCommand)
+				dmaCommand->release();
+			command->release();
+		}
+		pool->release();
+		workLoop->release();
+		release();
+	}
+};
+
+
+
+static void
+Burst(TestController *controller, IOCommand **commands, int count)
+{
+	for (int i = 0; i < count; i++)
+		commands[i] = controller->Get();
+	for (int i = 0; i < count; i++)
+		if (commands[i])
+			controller->pool->returnCommand(commands[i]);
+}
+
+
+
+static void
+TestBurstThenIdle(void)
+{
+	// left after each interval. The burst itself used every command during the first one
+	static const UInt32		kExpected[] = { kTestBurst, 516, 274, 153, 92, 62, 47, 39, 35, 33, 32 };
+	static IOCommand		*commands[kTestBurst];
+	UInt32					allocations = ShimOutstandingAllocations();
+	TestController			*controller = TestController::withPool(false);
+	UInt32					interval;
+
+	controller->pool->SetReleaseAction(controller, TestController::Released);
+	Burst(controller, commands, kTestBurst);
+	CHECK_EQUAL(controller->poolSize, kTestBurst);
+	CHECK_EQUAL(controller->Stat("Commands"), kTestBurst);
+	CHECK_EQUAL(controller->Stat("Peak Commands"), kTestBurst);
+	CHECK_EQUAL(controller->Stat("Free Commands"), kTestBurst);
+	CHECK_EQUAL(gLiveDMACommands, kTestBurst);
+
+	// half of what stayed idle for a whole interval goes at the end of it, down to the minimum
+	for (interval = 0; interval < sizeof(kExpected) / sizeof(kExpected[0]); interval++)
+	{
+		ShimAdvanceTimeMS(kUSBCommandPoolTrimIntervalMS - 1);
+		CHECK_EQUAL(controller->Stat("Commands"), interval ? kExpected[interval - 1] : (UInt32)kTestBurst);
+		ShimAdvanceTimeMS(1);
+		CHECK_EQUAL(controller->Stat("Commands"), kExpected[interval]);
+		CHECK_EQUAL(controller->poolSize, kExpected[interval]);
+		CHECK_EQUAL(gLiveDMACommands, kExpected[interval]);
+	}
+	CHECK_EQUAL(controller->Stat("Trimmed Commands"), kTestBurst - kUSBCommandPoolMinIdleCommands);
+	CHECK_EQUAL(controller->Stat("Peak Commands"), kTestBurst);
+	printf("command pool: a burst of %d commands is back to %d within %d s\n", kTestBurst, kUSBCommandPoolMinIdleCommands, (int)(interval * kUSBCommandPoolTrimIntervalMS / 1000));
+
+	// and the timer has stopped
+	ShimAdvanceTimeMS(10 * kUSBCommandPoolTrimIntervalMS);
+	CHECK_EQUAL(controller->releaseCalls, interval - 1);
+
+	// each command took an expansion data allocation, and only the ones left in the pool still have it
+	CHECK_EQUAL(ShimOutstandingAllocations() - allocations, 1 + kUSBCommandPoolMinIdleCommands);
+
+	controller->TearDown();
+	CHECK_EQUAL(ShimOutstandingAllocations(), allocations);
+	CHECK_EQUAL(gLiveDMACommands, 0);
+}
+
+
+
+static void
+TestBusyCommandsStay(void)
+{
+	static IOCommand	*commands[400];
+	TestController		*controller = TestController::withPool(false);
+
+	controller->pool->SetReleaseAction(controller, TestController::Released);
+	Burst(controller, commands, 400);
+	ShimAdvanceTimeMS(kUSBCommandPoolTrimIntervalMS);
+	CHECK_EQUAL(controller->Stat("Commands"), 400);
+
+	// 300 are in use for the whole of the next interval, so only the other 100 count as idle
+	for (int i = 0; i < 300; i++)
+		commands[i] = controller->Get();
+	ShimAdvanceTimeMS(kUSBCommandPoolTrimIntervalMS);
+	CHECK_EQUAL(controller->Stat("Commands"), 400 - 34);
+	CHECK_EQUAL(controller->Stat("Free Commands"), 100 - 34);
+
+	// a dip in the free count during an interval protects what was needed
+	for (int i = 0; i < 300; i++)
+		controller->pool->returnCommand(commands[i]);
+	for (int i = 0; i < 350; i++)
+		commands[i] = controller->Get();
+	for (int i = 0; i < 350; i++)
+		controller->pool->returnCommand(commands[i]);
+	ShimAdvanceTimeMS(kUSBCommandPoolTrimIntervalMS);
+	CHECK_EQUAL(controller->Stat("Commands"), 366);
+	CHECK_EQUAL(controller->poolSize, 366);
+
+	controller->TearDown();
+}
+
+
+
+static void
+TestHighWaterMark(void)
+{
+	static IOCommand	*commands[kTestBurst];
+	TestController		*controller = TestController::withPool(false);
+	int					got = 0;
+
+	controller->pool->SetReleaseAction(controller, TestController::Released);
+	controller->pool->SetHighWaterMark(256);
+
+	// a burst that wants more gets refused rather than growing the pool, and the controller's count stays right
+	for (int i = 0; i < kTestBurst; i++)
+	{
+		commands[i] = controller->Get();
+		if (commands[i])
+			got++;
+	}
+	CHECK_EQUAL(got, 256);
+	CHECK_EQUAL(controller->Stat("Commands"), 256);
+	CHECK_EQUAL(controller->poolSize, 256);
+	CHECK(controller->Stat("Rejected Commands") > 0);
+	CHECK_EQUAL(gLiveDMACommands, 256);
+	for (int i = 0; i < kTestBurst; i++)
+		if (commands[i])
+			controller->pool->returnCommand(commands[i]);
+
+	controller->TearDown();
+}
+
+
+
+static void
+TestReleaseIdleCommands(void)
+{
+	static IOCommand	*commands[kTestBurst];
+	TestController		*controller = TestController::withPool(true);
+
+	// without a release action the controller still counts every command, so none may go
+	Burst(controller, commands, 300);
+	controller->pool->ReleaseIdleCommands();
+	ShimAdvanceTimeMS(20 * kUSBCommandPoolTrimIntervalMS);
+	CHECK_EQUAL(controller->Stat("Commands"), 300);
+	CHECK_EQUAL(controller->releaseCalls, 0);
+
+	// with one, memory pressure takes every idle command above the minimum at once
+	controller->pool->SetReleaseAction(controller, TestController::Released);
+	controller->pool->ReleaseIdleCommands();
+	CHECK_EQUAL(controller->Stat("Commands"), kUSBCommandPoolMinIdleCommands);
+	CHECK_EQUAL(controller->poolSize, kUSBCommandPoolMinIdleCommands);
+	CHECK_EQUAL(controller->releaseCalls, 1);
+	CHECK_EQUAL(gLiveDMACommands, kUSBCommandPoolMinIdleCommands);
+
+	// and the pool grows again when it is needed
+	Burst(controller, commands, 300);
+	CHECK_EQUAL(controller->Stat("Commands"), kUSBCommandPoolMinIdleCommands + (((300 - kUSBCommandPoolMinIdleCommands + kTestGrowBy - 1) / kTestGrowBy) * kTestGrowBy));
+
+	controller->TearDown();
+}
+
+
+TEST_MAIN("IOUSBCommandPool", TestBurstThenIdle, TestBusyCommandsStay, TestHighWaterMark, TestReleaseIdleCommands)
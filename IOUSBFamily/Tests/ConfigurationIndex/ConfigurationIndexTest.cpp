@@ -0,0 +1,386 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBConfigurationIndex on a synthetic composite device with 32 interfaces of many alternate settings each: the
+ interface walks keep descriptor order, a current descriptor from another copy of the same descriptors is found by its numbers,
+ duplicate settings from a bad device don't send a walk round in circles, and the endpoint tables line up with the pipe list.
+ TestWalkBenchmark times a full walk against walking the descriptors from the start for each step, as IOUSBDevice used to.
+*/
+
+#include <string.h>
+#include <time.h>
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBConfigurationIndex.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestInterfaces			= 32,
+	kTestAlternates			= 32,
+	kTestEndpoints			= 2,							// per alternate setting, except alternate 0 which has none
+	kTestBufferSize			= 65535,
+	kTestWalks				= 20
+};
+
+static UInt8		gConfig[kTestBufferSize];
+static UInt8		gForeign[kTestBufferSize];
+
+
+
+// interface n, alternate a has class (n % 4) + 1, and endpoints 0x80 | (n % 15 + 1) in and n % 15 + 1 out, isoch for an odd a, bulk otherwise
+static UInt32
+BuildConfiguration(UInt8 *buf, UInt32 numInterfaces, UInt32 numAlternates)
+{
+	IOUSBConfigurationDescriptor	*config = (IOUSBConfigurationDescriptor*)buf;
+	IOUSBInterfaceDescriptor		*ifDesc;
+	IOUSBEndpointDescriptor			*epDesc;
+	UInt32							length = sizeof(IOUSBConfigurationDescriptor);
+	UInt32							n, a, e;
+
+	memset(buf, 0, kTestBufferSize);
+	config->bLength = sizeof(IOUSBConfigurationDescriptor);
+	config->bDescriptorType = kUSBConfDesc;
+	config->bNumInterfaces = numInterfaces;
+	config->bConfigurationValue = 1;
+	config->MaxPower = 50;
+
+	for (n = 0; n < numInterfaces; n++)
+	{
+		for (a = 0; a < numAlternates; a++)
+		{
+			ifDesc = (IOUSBInterfaceDescriptor*)(buf + length);
+			ifDesc->bLength = sizeof(IOUSBInterfaceDescriptor);
+			ifDesc->bDescriptorType = kUSBInterfaceDesc;
+			ifDesc->bInterfaceNumber = n;
+			ifDesc->bAlternateSetting = a;
+			ifDesc->bNumEndpoints = a ? kTestEndpoints : 0;
+			ifDesc->bInterfaceClass = (n % 4) + 1;
+			length += sizeof(IOUSBInterfaceDescriptor);
+
+			for (e = 0; a && (e < kTestEndpoints); e++)
+			{
+				epDesc = (IOUSBEndpointDescriptor*)(buf + length);
+				epDesc->bLength = sizeof(IOUSBEndpointDescriptor);
+				epDesc->bDescriptorType = kUSBEndpointDesc;
+				epDesc->bEndpointAddress = (e ? 0x80 : 0) | ((n % 15) + 1);
+				epDesc->bmAttributes = (a & 1) ? kUSBIsoc : kUSBBulk;
+				epDesc->wMaxPacketSize = HostToUSBWord(a * 8);
+				length += sizeof(IOUSBEndpointDescriptor);
+			}
+		}
+	}
+	config->wTotalLength = HostToUSBWord(length);
+	return length;
+}
+
+
+
+static void
+AnyInterface(IOUSBFindInterfaceRequest *request)
+{
+	request->bInterfaceClass = kIOUSBFindInterfaceDontCare;
+	request->bInterfaceSubClass = kIOUSBFindInterfaceDontCare;
+	request->bInterfaceProtocol = kIOUSBFindInterfaceDontCare;
+	request->bAlternateSetting = kIOUSBFindInterfaceDontCare;
+}
+
+
+
+// the interface descriptor after current in a plain walk of the descriptors, which is what the index has to agree with
+static const IOUSBInterfaceDescriptor *
+WalkToNextInterface(const UInt8 *buf, const IOUSBInterfaceDescriptor *current)
+{
+	const IOUSBConfigurationDescriptor	*config = (const IOUSBConfigurationDescriptor*)buf;
+	const UInt8							*end = buf + USBToHostWord(config->wTotalLength);
+	const UInt8							*cur = current ? (const UInt8*)current + current->bLength : buf + config->bLength;
+
+	for ( ; cur < end; cur += ((const IOUSBDescriptorHeader*)cur)->bLength)
+	{
+		if (((const IOUSBDescriptorHeader*)cur)->bDescriptorType == kUSBInterfaceDesc)
+			return (const IOUSBInterfaceDescriptor*)cur;
+	}
+	return NULL;
+}
+
+
+
+static UInt64
+NowNS(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((UInt64)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+
+
+static void
+TestWalkOrder(void)
+{
+	UInt32							length = BuildConfiguration(gConfig, kTestInterfaces, kTestAlternates);
+	IOUSBConfigurationIndex			*index = IOUSBConfigurationIndex::withDescriptorBuffer(gConfig, length, "walk");
+	const IOUSBInterfaceDescriptor	*found = NULL;
+	const IOUSBInterfaceDescriptor	*expected = NULL;
+	IOUSBFindInterfaceRequest		request;
+	UInt32							count = 0;
+	bool							inOrder = true;
+
+	CHECK(index != NULL);
+	if (!index)
+		return;
+
+	AnyInterface(&request);
+	while ((found = index->FindNextInterfaceDescriptor(found, &request)) != NULL)
+	{
+		expected = WalkToNextInterface((const UInt8*)index->GetConfigurationDescriptor(), expected);
+		inOrder = inOrder && (found == expected);
+		count++;
+	}
+	CHECK(inOrder);
+	CHECK_EQUAL(count, kTestInterfaces * kTestAlternates);
+
+	// a class only walks its own chain, still in descriptor order
+	request.bInterfaceClass = 3;
+	count = 0;
+	inOrder = true;
+	found = NULL;
+	while ((found = index->FindNextInterfaceDescriptor(found, &request)) != NULL)
+	{
+		inOrder = inOrder && (found->bInterfaceClass == 3) && (found->bInterfaceNumber == (2 + 4 * (count / kTestAlternates))) &&
+				  (found->bAlternateSetting == (count % kTestAlternates));
+		count++;
+	}
+	CHECK(inOrder);
+	CHECK_EQUAL(count, (kTestInterfaces / 4) * kTestAlternates);
+
+	// and the alternates of one interface come in order, whatever is between them
+	request.bInterfaceClass = kIOUSBFindInterfaceDontCare;
+	count = 0;
+	inOrder = true;
+	found = NULL;
+	while ((found = index->FindNextAltInterface(17, found, &request)) != NULL)
+	{
+		inOrder = inOrder && (found->bInterfaceNumber == 17) && (found->bAlternateSetting == count);
+		count++;
+	}
+	CHECK(inOrder);
+	CHECK_EQUAL(count, kTestAlternates);
+
+	request.bAlternateSetting = 9;
+	found = index->FindNextAltInterface(17, NULL, &request);
+	CHECK(found && (found->bAlternateSetting == 9));
+	CHECK(index->FindNextAltInterface(17, found, &request) == NULL);
+
+	index->release();
+}
+
+
+
+// the device's own descriptors, or another index's, are a different copy - the walk goes on from the same interface in ours
+static void
+TestForeignCurrent(void)
+{
+	UInt32							length = BuildConfiguration(gConfig, kTestInterfaces, kTestAlternates);
+	IOUSBConfigurationIndex			*index = IOUSBConfigurationIndex::withDescriptorBuffer(gConfig, length, "foreign");
+	const IOUSBInterfaceDescriptor	*foreign = NULL;
+	const IOUSBInterfaceDescriptor	*next;
+	const IOUSBInterfaceDescriptor	*found;
+	IOUSBInterfaceDescriptor		stranger;
+	IOUSBFindInterfaceRequest		request;
+	const UInt8						*ours;
+	bool							same = true;
+	UInt32							i;
+
+	CHECK(index != NULL);
+	if (!index)
+		return;
+	ours = (const UInt8*)index->GetConfigurationDescriptor();
+	memcpy(gForeign, gConfig, length);
+
+	AnyInterface(&request);
+	for (i = 0; i < (kTestInterfaces * kTestAlternates) - 1; i++)
+	{
+		foreign = WalkToNextInterface(gForeign, foreign);
+		next = WalkToNextInterface(gForeign, foreign);
+		found = index->FindNextInterfaceDescriptor(foreign, &request);
+		same = same && found && next && (((const UInt8*)found - ours) == ((const UInt8*)next - gForeign));
+	}
+	CHECK(same);
+
+	// the last one has nothing after it, and one which isn't in the configuration at all finds nothing
+	foreign = WalkToNextInterface(gForeign, foreign);
+	CHECK(foreign && (foreign->bInterfaceNumber == kTestInterfaces - 1) && (foreign->bAlternateSetting == kTestAlternates - 1));
+	CHECK(index->FindNextInterfaceDescriptor(foreign, &request) == NULL);
+
+	stranger = *foreign;
+	stranger.bInterfaceNumber = 200;
+	CHECK(index->FindNextInterfaceDescriptor(&stranger, &request) == NULL);
+	CHECK(index->FindNextAltInterface(200, &stranger, &request) == NULL);
+
+	foreign = WalkToNextInterface(gForeign, NULL);
+	found = index->FindNextAltInterface(0, foreign, &request);
+	CHECK(found && ((const UInt8*)found >= ours) && ((const UInt8*)found < (ours + length)) && (found->bInterfaceNumber == 0) && (found->bAlternateSetting == 1));
+
+	index->release();
+}
+
+
+
+// a device which repeats an interface and alternate setting: a walk from our own descriptors still visits each once and ends
+static void
+TestDuplicateSettings(void)
+{
+	UInt32							length = BuildConfiguration(gConfig, 2, 3);
+	IOUSBInterfaceDescriptor		*ifDesc;
+	IOUSBConfigurationIndex			*index;
+	const IOUSBInterfaceDescriptor	*found = NULL;
+	IOUSBFindInterfaceRequest		request;
+	UInt32							count = 0;
+
+	// interface 1 alternate 0 becomes a second interface 0 alternate 2
+	ifDesc = (IOUSBInterfaceDescriptor*)WalkToNextInterface(gConfig, NULL);
+	while (ifDesc && (ifDesc->bInterfaceNumber != 1))
+		ifDesc = (IOUSBInterfaceDescriptor*)WalkToNextInterface(gConfig, ifDesc);
+	CHECK(ifDesc != NULL);
+	if (!ifDesc)
+		return;
+	ifDesc->bInterfaceNumber = 0;
+	ifDesc->bAlternateSetting = 2;
+
+	index = IOUSBConfigurationIndex::withDescriptorBuffer(gConfig, length, "duplicates");
+	CHECK(index != NULL);
+	if (!index)
+		return;
+
+	AnyInterface(&request);
+	while (((found = index->FindNextInterfaceDescriptor(found, &request)) != NULL) && (count < 100))
+		count++;
+	CHECK_EQUAL(count, 6);
+
+	count = 0;
+	found = NULL;
+	while (((found = index->FindNextAltInterface(0, found, &request)) != NULL) && (count < 100))
+		count++;
+	CHECK_EQUAL(count, 4);
+
+	index->release();
+}
+
+
+
+static void
+TestEndpoints(void)
+{
+	UInt32							length = BuildConfiguration(gConfig, kTestInterfaces, kTestAlternates);
+	IOUSBConfigurationIndex			*index = IOUSBConfigurationIndex::withDescriptorBuffer(gConfig, length, "endpoints");
+	const IOUSBEndpointDescriptor	*ep;
+
+	CHECK(index != NULL);
+	if (!index)
+		return;
+
+	// interface 20 has endpoints 6 out and 0x86 in, isoch in odd alternates
+	ep = index->FindEndpoint(20, 7, 0x86);
+	CHECK(ep && (ep->bmAttributes == kUSBIsoc) && (USBToHostWord(ep->wMaxPacketSize) == 56));
+	CHECK(index->FindEndpoint(20, 0, 0x86) == NULL);
+	CHECK(index->FindEndpoint(20, 7, 0x87) == NULL);
+	CHECK_EQUAL(index->GetEndpointIndex(20, 7, 0x06), 0);
+	CHECK_EQUAL(index->GetEndpointIndex(20, 7, 0x86), 1);
+
+	CHECK_EQUAL(index->FindNextEndpointIndex(20, 7, -1, kUSBIsoc, kUSBIn), 1);
+	CHECK_EQUAL(index->FindNextEndpointIndex(20, 7, -1, kUSBBulk, kUSBAnyDirn), -1);
+	CHECK_EQUAL(index->FindNextEndpointIndex(20, 8, -1, kUSBBulk, kUSBAnyDirn), 0);
+	CHECK_EQUAL(index->FindNextEndpointIndex(20, 8, 0, kUSBAnyType, kUSBAnyDirn), 1);
+	CHECK_EQUAL(index->FindNextEndpointIndex(20, 8, 1, kUSBAnyType, kUSBAnyDirn), -1);
+
+	index->release();
+}
+
+
+
+static void
+TestWalkBenchmark(void)
+{
+	UInt32							length = BuildConfiguration(gConfig, kTestInterfaces, kTestAlternates);
+	IOUSBConfigurationIndex			*index = IOUSBConfigurationIndex::withDescriptorBuffer(gConfig, length, "benchmark");
+	const IOUSBConfigurationDescriptor	*config;
+	const IOUSBInterfaceDescriptor	*found;
+	const IOUSBInterfaceDescriptor	*walked;
+	IOUSBFindInterfaceRequest		request;
+	UInt64							start, indexNS, walkNS;
+	UInt32							count = 0;
+	UInt32							i;
+
+	CHECK(index != NULL);
+	if (!index)
+		return;
+	config = index->GetConfigurationDescriptor();
+	AnyInterface(&request);
+
+	start = NowNS();
+	for (i = 0; i < kTestWalks; i++)
+	{
+		found = NULL;
+		while ((found = index->FindNextInterfaceDescriptor(found, &request)) != NULL)
+			count++;
+	}
+	indexNS = NowNS() - start;
+
+	// the old way: each step walks from the start of the descriptors up to current, then on to the next interface
+	start = NowNS();
+	for (i = 0; i < kTestWalks; i++)
+	{
+		walked = NULL;
+		do
+		{
+			const IOUSBInterfaceDescriptor	*cur = NULL;
+
+			while ((cur = WalkToNextInterface((const UInt8*)config, cur)) != NULL)
+			{
+				if (!walked || (cur > walked))
+					break;
+			}
+			walked = cur;
+			if (walked)
+				count--;
+		} while (walked);
+	}
+	walkNS = NowNS() - start;
+
+	CHECK_EQUAL(count, 0);
+	printf("configuration index: %d interfaces x %d alternate settings, a full walk takes %llu us indexed, %llu us walking the descriptors\n",
+		   kTestInterfaces, kTestAlternates, (unsigned long long)(indexNS / kTestWalks / 1000), (unsigned long long)(walkNS / kTestWalks / 1000));
+
+	index->release();
+}
+
+
+
+TEST_MAIN("IOUSBConfigurationIndex", TestWalkOrder, TestForeignCurrent, TestDuplicateSettings, TestEndpoints, TestWalkBenchmark)
@@ -0,0 +1,591 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <IOKit/usb/IOUSBControllerV2.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestAddress			= 5,
+	kTestMaxEndpoints		= 32,
+	kTestIsocBandwidth		= 1000,							// bytes per frame the controller can give isoch endpoints
+	kTestCommandUS			= 100,							// doorbell to command completion event, and the workloop waking for it
+	kTestEndpointContextUS	= 4								// the controller evaluating one endpoint context within a command
+};
+
+
+// A controller whose endpoints are a table, and whose only periodic bandwidth is an isoch pool, as on UHCI and OHCI. One at a time,
+// every OpenPipe and ClosePipe is a controller command, and with precheck it answers UIMCheckPipeBandwidth from its pool the way
+// UHCI and OHCI do. Batched, it is a software xHC: ConfigurePipes comes down to one Configure Endpoint command, which drops and
+// adds the endpoints and admits their bandwidth together or changes nothing.
+class SimulatedController : public IOUSBControllerV2
+{
+public:
+	Endpoint			endpoints[kTestMaxEndpoints];
+	USBDeviceAddress	addresses[kTestMaxEndpoints];
+	UInt32				numEndpoints;
+	UInt32				isocAvailable;
+	bool				batched;
+	bool				precheck;
+	UInt32				commands;
+	UInt32				busyUS;
+	UInt32				opens;
+	UInt32				failOpen;							// make the nth OpenPipe fail with failStatus, 0 for none
+	IOReturn			failStatus;
+
+	static SimulatedController *	Create(bool batched);
+	void				Release(void)						{ _commandGate->release(); release(); }
+
+	virtual const char *	getName() const					{ return batched ? "SimulatedXHC" : "SimulatedController"; }
+
+	Endpoint *			Find(USBDeviceAddress address, UInt8 number, UInt8 direction);
+	void				Add(USBDeviceAddress address, Endpoint *endpoint);
+	void				Remove(USBDeviceAddress address, Endpoint *endpoint);
+	void				Command(UInt32 endpointCount)		{ commands++; busyUS += kTestCommandUS + (endpointCount * kTestEndpointContextUS); }
+
+	virtual IOReturn	OpenPipe(USBDeviceAddress address, UInt8 speed, Endpoint *endpoint);
+	virtual IOReturn	ClosePipe(USBDeviceAddress address, Endpoint *endpoint);
+	virtual IOReturn	UIMConfigureEndpoints(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+	virtual IOReturn	UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+};
+
+
+static bool
+InList(Endpoint *list, UInt32 count, Endpoint *endpoint)
+{
+	for (UInt32 i = 0; i < count; i++)
+	{
+		if ((list[i].number == endpoint->number) && (list[i].direction == endpoint->direction))
+			return true;
+	}
+	return false;
+}
+
+
+SimulatedController *
+SimulatedController::Create(bool batched)
+{
+	SimulatedController		*me = new SimulatedController;
+
+	me->_commandGate = IOCommandGate::commandGate(me);
+	me->isocAvailable = kTestIsocBandwidth;
+	me->batched = batched;
+	return me;
+}
+
+
+Endpoint *
+SimulatedController::Find(USBDeviceAddress address, UInt8 number, UInt8 direction)
+{
+	for (UInt32 i = 0; i < numEndpoints; i++)
+	{
+		if ((addresses[i] == address) && (endpoints[i].number == number) && (endpoints[i].direction == direction))
+			return &endpoints[i];
+	}
+	return NULL;
+}
+
+
+void
+SimulatedController::Add(USBDeviceAddress address, Endpoint *endpoint)
+{
+	addresses[numEndpoints] = address;
+	endpoints[numEndpoints++] = *endpoint;
+	if (endpoint->transferType == kUSBIsoc)
+		isocAvailable -= endpoint->maxPacketSize;
+}
+
+
+void
+SimulatedController::Remove(USBDeviceAddress address, Endpoint *endpoint)
+{
+	Endpoint	*found = Find(address, endpoint->number, endpoint->direction);
+	UInt32		last = --numEndpoints;
+
+	if (found->transferType == kUSBIsoc)
+		isocAvailable += found->maxPacketSize;
+	addresses[found - endpoints] = addresses[last];
+	*found = endpoints[last];
+}
+
+
+IOReturn
+SimulatedController::OpenPipe(USBDeviceAddress address, UInt8 speed, Endpoint *endpoint)
+{
+	Command(1);
+	if (failOpen && (++opens == failOpen))
+		return failStatus;
+	if (Find(address, endpoint->number, endpoint->direction))
+		return kIOReturnBadArgument;
+	if ((endpoint->transferType == kUSBIsoc) && (endpoint->maxPacketSize > isocAvailable))
+		return kIOReturnNoBandwidth;
+	Add(address, endpoint);
+	return kIOReturnSuccess;
+}
+
+
+IOReturn
+SimulatedController::ClosePipe(USBDeviceAddress address, Endpoint *endpoint)
+{
+	Command(1);
+	if (!Find(address, endpoint->number, endpoint->direction))
+		return kIOReturnBadArgument;
+	Remove(address, endpoint);
+	return kIOReturnSuccess;
+}
+
+
+IOReturn
+SimulatedController::UIMConfigureEndpoints(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+	UInt32		available = isocAvailable;
+	UInt32		needed = 0;
+	UInt32		i;
+
+	if (!batched)
+		return kIOReturnUnsupported;
+
+	Command(closeCount + openCount);
+	for (i = 0; i < closeCount; i++)
+	{
+		Endpoint	*found = Find(address, closeList[i].number, closeList[i].direction);
+
+		if (!found)
+			return kIOReturnBadArgument;
+		if (found->transferType == kUSBIsoc)
+			available += found->maxPacketSize;
+	}
+	for (i = 0; i < openCount; i++)
+	{
+		if (Find(address, openList[i].number, openList[i].direction) && !InList(closeList, closeCount, &openList[i]))
+			return kIOReturnBadArgument;
+		if (openList[i].transferType == kUSBIsoc)
+			needed += openList[i].maxPacketSize;
+	}
+	if (needed > available)
+	{
+		*bandwidthShortfall = needed - available;
+		return kIOReturnNoBandwidth;
+	}
+
+	for (i = 0; i < closeCount; i++)
+		Remove(address, &closeList[i]);
+	for (i = 0; i < openCount; i++)
+		Add(address, &openList[i]);
+	return kIOReturnSuccess;
+}
+
+
+IOReturn
+SimulatedController::UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall)
+{
+	Endpoint	*found;
+	SInt32		needed = 0;
+	SInt32		available = isocAvailable;
+	UInt32		i;
+
+	if (!precheck)
+		return kIOReturnUnsupported;
+
+	for (i = 0; i < closeCount; i++)
+	{
+		found = Find(address, closeList[i].number, closeList[i].direction);
+		if (found && (found->transferType == kUSBIsoc))
+			available += found->maxPacketSize;
+	}
+	for (i = 0; i < openCount; i++)
+	{
+		if (openList[i].transferType != kUSBIsoc)
+			continue;
+		needed += openList[i].maxPacketSize;
+		found = Find(address, openList[i].number, openList[i].direction);
+		if (found && !IsochEndpointInList(closeList, closeCount, openList[i].number, openList[i].direction))
+			needed -= found->maxPacketSize;
+	}
+	if (needed > available)
+	{
+		*bandwidthShortfall = needed - available;
+		return kIOReturnNoBandwidth;
+	}
+	*bandwidthShortfall = 0;
+	return kIOReturnSuccess;
+}
+
+
+
+// what a device has open, in an order which doesn't depend on how it got there
+struct PipeState
+{
+	UInt32			numEndpoints;
+	UInt32			isocAvailable;
+	UInt32			keys[kTestMaxEndpoints];			// address, number, direction, type and max packet size
+};
+
+
+static int
+CompareKeys(const void *a, const void *b)
+{
+	UInt32	keyA = *(const UInt32 *)a;
+	UInt32	keyB = *(const UInt32 *)b;
+
+	return (keyA > keyB) - (keyA < keyB);
+}
+
+
+static PipeState
+Snapshot(SimulatedController *controller)
+{
+	PipeState	state;
+
+	memset(&state, 0, sizeof(state));
+	state.numEndpoints = controller->numEndpoints;
+	state.isocAvailable = controller->isocAvailable;
+	for (UInt32 i = 0; i < controller->numEndpoints; i++)
+	{
+		Endpoint	*endpoint = &controller->endpoints[i];
+
+		state.keys[i] = (controller->addresses[i] << 28) | (endpoint->number << 24) | (endpoint->direction << 20) | (endpoint->transferType << 16) | endpoint->maxPacketSize;
+	}
+	qsort(state.keys, state.numEndpoints, sizeof(UInt32), CompareKeys);
+	return state;
+}
+
+
+static bool
+SameState(const PipeState &a, const PipeState &b)
+{
+	return memcmp(&a, &b, sizeof(PipeState)) == 0;
+}
+
+
+static Endpoint
+MakeEndpoint(UInt8 number, UInt8 direction, UInt8 transferType, UInt16 maxPacketSize)
+{
+	Endpoint	endpoint;
+
+	memset(&endpoint, 0, sizeof(endpoint));
+	endpoint.number = number;
+	endpoint.direction = direction;
+	endpoint.transferType = transferType;
+	endpoint.maxPacketSize = maxPacketSize;
+	endpoint.interval = (transferType == kUSBIsoc) ? 1 : 8;
+	return endpoint;
+}
+
+
+// a dock: its hub's status endpoint, ethernet, audio with a feedback endpoint, a keyboard and mouse, and storage
+static Endpoint		gDock[] =
+{
+	MakeEndpoint(1, kUSBIn, kUSBInterrupt, 1),
+	MakeEndpoint(2, kUSBIn, kUSBBulk, 64),
+	MakeEndpoint(2, kUSBOut, kUSBBulk, 64),
+	MakeEndpoint(3, kUSBIn, kUSBInterrupt, 16),
+	MakeEndpoint(4, kUSBOut, kUSBIsoc, 192),
+	MakeEndpoint(4, kUSBIn, kUSBIsoc, 192),
+	MakeEndpoint(5, kUSBIn, kUSBIsoc, 3),
+	MakeEndpoint(6, kUSBIn, kUSBInterrupt, 8),
+	MakeEndpoint(7, kUSBIn, kUSBInterrupt, 8),
+	MakeEndpoint(8, kUSBIn, kUSBBulk, 64),
+	MakeEndpoint(8, kUSBOut, kUSBBulk, 64),
+	MakeEndpoint(9, kUSBIn, kUSBInterrupt, 8)
+};
+#define kDockEndpoints		(sizeof(gDock) / sizeof(gDock[0]))
+
+// a camera's video streaming interface going from a small alternate setting to a bigger one
+static Endpoint		gCameraSmall[] = { MakeEndpoint(1, kUSBIn, kUSBIsoc, 256) };
+static Endpoint		gCameraMedium[] = { MakeEndpoint(1, kUSBIn, kUSBIsoc, 600) };
+static Endpoint		gCameraLarge[] = { MakeEndpoint(1, kUSBIn, kUSBIsoc, 800) };
+
+// an audio interface's streaming alternate settings, stereo out and in at 48 kHz, 16 and 32 bit, sharing a feedback endpoint
+static Endpoint		gAudio48[] = { MakeEndpoint(1, kUSBOut, kUSBIsoc, 196), MakeEndpoint(1, kUSBIn, kUSBIsoc, 3), MakeEndpoint(2, kUSBIn, kUSBIsoc, 196), MakeEndpoint(3, kUSBIn, kUSBInterrupt, 6) };
+static Endpoint		gAudio48Wide[] = { MakeEndpoint(1, kUSBOut, kUSBIsoc, 392), MakeEndpoint(1, kUSBIn, kUSBIsoc, 3), MakeEndpoint(2, kUSBIn, kUSBIsoc, 392), MakeEndpoint(3, kUSBIn, kUSBInterrupt, 6) };
+
+
+
+// a whole configuration is one command on the xHC, and ends up the same as opening the pipes one by one
+static void
+TestBatchedOpen(void)
+{
+	SimulatedController		*xhc = SimulatedController::Create(true);
+	SimulatedController		*serial = SimulatedController::Create(false);
+	UInt32					shortfall = 1;
+	IOReturn				err;
+
+	err = xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gDock, kDockEndpoints, &shortfall);
+	CHECK_EQUAL(err, kIOReturnSuccess);
+	CHECK_EQUAL(shortfall, 0);
+	CHECK_EQUAL(xhc->commands, 1);
+	CHECK_EQUAL(xhc->numEndpoints, kDockEndpoints);
+	CHECK_EQUAL(xhc->isocAvailable, kTestIsocBandwidth - 192 - 192 - 3);
+
+	err = serial->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gDock, kDockEndpoints, NULL);
+	CHECK_EQUAL(err, kIOReturnSuccess);
+	CHECK_EQUAL(serial->commands, kDockEndpoints);
+	CHECK(SameState(Snapshot(xhc), Snapshot(serial)));
+
+	// and so is taking it down again
+	xhc->commands = serial->commands = 0;
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gDock, kDockEndpoints, NULL, 0, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(serial->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gDock, kDockEndpoints, NULL, 0, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(xhc->commands, 1);
+	CHECK_EQUAL(serial->commands, kDockEndpoints);
+	CHECK_EQUAL(xhc->numEndpoints, 0);
+	CHECK_EQUAL(xhc->isocAvailable, kTestIsocBandwidth);
+	CHECK(SameState(Snapshot(xhc), Snapshot(serial)));
+
+	xhc->Release();
+	serial->Release();
+}
+
+
+// the xHC admits the whole set or none of it, and the caller hears by how much it missed
+static void
+TestBatchedAllOrNothing(void)
+{
+	SimulatedController		*xhc = SimulatedController::Create(true);
+	UInt32					shortfall = 0;
+	PipeState				before;
+	IOReturn				err;
+
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gCameraSmall, 1, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, NULL, 0, gAudio48, 4, NULL), kIOReturnSuccess);
+	before = Snapshot(xhc);
+	xhc->commands = 0;
+
+	// 32 bit audio wants 392 + 3 + 392 back for the 196 + 3 + 196 it has, and the camera is holding 256 of the 1000
+	err = xhc->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, gAudio48, 4, gAudio48Wide, 4, &shortfall);
+	CHECK_EQUAL(err, kIOReturnNoBandwidth);
+	CHECK_EQUAL(shortfall, (392 + 3 + 392) - (kTestIsocBandwidth - 256));
+	CHECK_EQUAL(xhc->commands, 1);
+	CHECK(SameState(Snapshot(xhc), before));
+
+	// with the camera gone it fits
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, NULL, 0, NULL), kIOReturnSuccess);
+	err = xhc->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, gAudio48, 4, gAudio48Wide, 4, &shortfall);
+	CHECK_EQUAL(err, kIOReturnSuccess);
+	CHECK_EQUAL(shortfall, 0);
+	CHECK_EQUAL(xhc->isocAvailable, kTestIsocBandwidth - 392 - 3 - 392);
+
+	xhc->Release();
+}
+
+
+// one at a time, a failure part way through puts back every pipe the device had, and takes away every pipe it was given
+static void
+TestOneAtATimeRollback(void)
+{
+	SimulatedController		*controller = SimulatedController::Create(false);
+	PipeState				before;
+	IOReturn				err;
+
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gAudio48, 4, NULL), kIOReturnSuccess);
+	before = Snapshot(controller);
+
+	for (UInt32 failAt = 1; failAt <= 4; failAt++)
+	{
+		controller->opens = 0;
+		controller->failOpen = failAt;
+		controller->failStatus = kIOReturnNoMemory;
+		err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gAudio48, 4, gAudio48Wide, 4, NULL);
+		CHECK_EQUAL(err, kIOReturnNoMemory);
+		CHECK(SameState(Snapshot(controller), before));
+	}
+
+	controller->failOpen = 0;
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gAudio48, 4, gAudio48Wide, 4, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(controller->isocAvailable, kTestIsocBandwidth - 392 - 3 - 392);
+
+	controller->Release();
+}
+
+
+static void
+TestBadArguments(void)
+{
+	SimulatedController		*xhc = SimulatedController::Create(true);
+	UInt32					shortfall = 1;
+
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 1, gDock, kDockEndpoints, &shortfall), kIOReturnBadArgument);
+	CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, NULL, 2, &shortfall), kIOReturnBadArgument);
+	CHECK_EQUAL(shortfall, 1);
+	CHECK_EQUAL(xhc->commands, 0);
+	CHECK_EQUAL(xhc->numEndpoints, 0);
+
+	xhc->Release();
+}
+
+
+// The audio device holds 395 of the 1000 bytes per frame and the camera 256. An alternate setting which won't fit is turned down
+// before anything is closed, by exactly what it is missing, and the camera keeps streaming on the setting it had
+static void
+TestSwitchShortfall(void)
+{
+	SimulatedController		*controller = SimulatedController::Create(false);
+	UInt32					shortfall = 0;
+	PipeState				before;
+	IOReturn				err;
+
+	controller->precheck = true;
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gCameraSmall, 1, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, NULL, 0, gAudio48, 4, NULL), kIOReturnSuccess);
+	before = Snapshot(controller);
+	controller->commands = 0;
+
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, gCameraLarge, 1, &shortfall);
+	CHECK_EQUAL(err, kIOReturnNoBandwidth);
+	CHECK_EQUAL(shortfall, 800 - (kTestIsocBandwidth - 395));
+	CHECK_EQUAL(controller->commands, 0);
+	CHECK(SameState(Snapshot(controller), before));
+
+	// the same without anywhere to put the shortfall
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, gCameraLarge, 1, NULL);
+	CHECK_EQUAL(err, kIOReturnNoBandwidth);
+	CHECK_EQUAL(controller->commands, 0);
+	CHECK(SameState(Snapshot(controller), before));
+
+	// and the audio device is short by the camera's 256 and no more, since its own 395 comes back when its old setting is closed
+	err = controller->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, gAudio48, 4, gAudio48Wide, 4, &shortfall);
+	CHECK_EQUAL(err, kIOReturnNoBandwidth);
+	CHECK_EQUAL(shortfall, (392 + 3 + 392) - (kTestIsocBandwidth - 256));
+	CHECK_EQUAL(controller->commands, 0);
+	CHECK(SameState(Snapshot(controller), before));
+
+	controller->Release();
+}
+
+
+// 600 only fits once the camera's 256 is given back, which the check has to count
+static void
+TestSwitchFitsAfterClose(void)
+{
+	SimulatedController		*controller = SimulatedController::Create(false);
+	UInt32					shortfall = 1;
+	IOReturn				err;
+
+	controller->precheck = true;
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gCameraSmall, 1, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, NULL, 0, gAudio48, 4, NULL), kIOReturnSuccess);
+	CHECK(600 > controller->isocAvailable);
+
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, gCameraMedium, 1, &shortfall);
+	CHECK_EQUAL(err, kIOReturnSuccess);
+	CHECK_EQUAL(shortfall, 0);
+	CHECK_EQUAL(controller->isocAvailable, kTestIsocBandwidth - 395 - 600);
+	CHECK_EQUAL(controller->Find(kTestAddress, 1, kUSBIn)->maxPacketSize, 600);
+
+	// and back down again
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraMedium, 1, gCameraSmall, 1, &shortfall);
+	CHECK_EQUAL(err, kIOReturnSuccess);
+	CHECK_EQUAL(controller->isocAvailable, kTestIsocBandwidth - 395 - 256);
+
+	controller->Release();
+}
+
+
+// A controller which can't check up front still leaves the old setting working, by opening it again. It can't say how much was
+// missing, and the same goes for a failure which has nothing to do with bandwidth after the check has passed
+static void
+TestSwitchRollback(void)
+{
+	SimulatedController		*controller = SimulatedController::Create(false);
+	UInt32					shortfall = 1;
+	PipeState				before;
+	IOReturn				err;
+
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, gCameraSmall, 1, NULL), kIOReturnSuccess);
+	CHECK_EQUAL(controller->ConfigurePipes(kTestAddress + 1, kUSBDeviceSpeedFull, NULL, 0, gAudio48, 4, NULL), kIOReturnSuccess);
+	before = Snapshot(controller);
+	controller->commands = 0;
+
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, gCameraLarge, 1, &shortfall);
+	CHECK_EQUAL(err, kIOReturnNoBandwidth);
+	CHECK_EQUAL(shortfall, 0);
+	CHECK_EQUAL(controller->commands, 3);									// close, the open which failed, and the reopen
+	CHECK(SameState(Snapshot(controller), before));
+
+	controller->precheck = true;
+	controller->failOpen = 1;
+	controller->failStatus = kIOReturnNoMemory;
+	err = controller->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, gCameraSmall, 1, gCameraMedium, 1, &shortfall);
+	CHECK_EQUAL(err, kIOReturnNoMemory);
+	CHECK_EQUAL(shortfall, 0);
+	CHECK(SameState(Snapshot(controller), before));
+
+	controller->Release();
+}
+
+
+// what configuring each of these devices costs in controller commands and time, endpoint by endpoint and batched
+static void
+TestConfigureLatency(void)
+{
+	struct
+	{
+		const char *	name;
+		Endpoint *		closeList;
+		UInt32			closeCount;
+		Endpoint *		openList;
+		UInt32			openCount;
+	} changes[] =
+	{
+		{ "dock configuration", NULL, 0, gDock, kDockEndpoints },
+		{ "camera alternate setting", gCameraSmall, 1, gCameraLarge, 1 },
+		{ "audio alternate setting", gAudio48, 4, gAudio48Wide, 4 },
+	};
+
+	for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++)
+	{
+		SimulatedController		*xhc = SimulatedController::Create(true);
+		SimulatedController		*serial = SimulatedController::Create(false);
+		UInt32					endpoints = changes[i].closeCount + changes[i].openCount;
+
+		CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, changes[i].closeList, changes[i].closeCount, NULL), kIOReturnSuccess);
+		CHECK_EQUAL(serial->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, NULL, 0, changes[i].closeList, changes[i].closeCount, NULL), kIOReturnSuccess);
+		xhc->commands = xhc->busyUS = 0;
+		serial->commands = serial->busyUS = 0;
+
+		CHECK_EQUAL(xhc->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, changes[i].closeList, changes[i].closeCount, changes[i].openList, changes[i].openCount, NULL), kIOReturnSuccess);
+		CHECK_EQUAL(serial->ConfigurePipes(kTestAddress, kUSBDeviceSpeedFull, changes[i].closeList, changes[i].closeCount, changes[i].openList, changes[i].openCount, NULL), kIOReturnSuccess);
+		CHECK(SameState(Snapshot(xhc), Snapshot(serial)));
+		CHECK_EQUAL(xhc->commands, 1);
+		CHECK_EQUAL(serial->commands, endpoints);
+		CHECK(xhc->busyUS < serial->busyUS);
+
+		printf("%s, %d endpoints: %d commands and %d us one at a time, %d command and %d us batched\n", changes[i].name, (int)endpoints,
+			   (int)serial->commands, (int)serial->busyUS, (int)xhc->commands, (int)xhc->busyUS);
+
+		xhc->Release();
+		serial->Release();
+	}
+}
+
+
+TEST_MAIN("IOUSBControllerV2::ConfigurePipes", TestBatchedOpen, TestBatchedAllOrNothing, TestOneAtATimeRollback, TestBadArguments, TestSwitchShortfall, TestSwitchFitsAfterClose, TestSwitchRollback,
+		  TestConfigureLatency)
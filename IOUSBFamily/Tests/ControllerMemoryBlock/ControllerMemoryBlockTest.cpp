@@ -0,0 +1,493 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBControllerMemoryBlock: the layout of the elements in a block, the reverse lookup from a physical address across
+ a list of blocks which sit one after the other in physical memory, a UIM style free list allocating and freeing elements over
+ several blocks, the failures of initWithElements, and the counters for all blocks and for each subclass. TestFragmentation runs a
+ burst then idle load over each UIM's element shapes and reports how many blocks stay pinned by a few live elements, as blocks are
+ never given back while a UIM runs.
+*/
+
+#include <set>
+#include <vector>
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+
+#include "USBTest.h"
+
+
+class TestBlock : public IOUSBControllerMemoryBlock
+{
+	OSDeclareDefaultStructors(TestBlock)
+
+public:
+	bool			Init(UInt32 elementSize, UInt32 alignment, UInt32 boundary, UInt32 reservedElements, mach_vm_address_t physicalMask = kUSBControllerMemoryBlockPhysicalMask)
+					{ return initWithElements(elementSize, alignment, boundary, reservedElements, physicalMask); }
+	void *			Reserved(UInt32 index)		{ return GetReservedLogicalPtr(index); }
+};
+
+// two more classes of block, to be counted apart from the rest
+class TestTDBlock : public TestBlock
+{
+	OSDeclareDefaultStructors(TestTDBlock)
+};
+
+class TestQHBlock : public TestBlock
+{
+	OSDeclareDefaultStructors(TestQHBlock)
+};
+
+struct TestLayout
+{
+	const char *	name;
+	UInt32			elementSize;
+	UInt32			alignment;
+	UInt32			boundary;
+	UInt32			reservedElements;
+};
+
+// the UIMs' element shapes - the EHCI ones are the spec's sizes with the 64 bit extensions - and a tight boundary to see the gaps
+static const TestLayout		gLayouts[] =
+{
+	{ "UHCI TD",			16,	16,	0,		0 },
+	{ "UHCI QH",			16,	16,	0,		0 },
+	{ "OHCI ED",			16,	16,	0,		0 },
+	{ "OHCI GTD",			16,	16,	0,		1 },
+	{ "OHCI ITD",			32,	32,	0,		1 },
+	{ "EHCI QH",			68,	32,	0,		0 },
+	{ "EHCI qTD",			52,	32,	0,		0 },
+	{ "EHCI iTD",			92,	32,	0,		0 },
+	{ "EHCI siTD",			36,	32,	0,		0 },
+	{ "48 on a 256 boundary",	48,	16,	256,	2 }
+};
+
+enum
+{
+	kNumLayouts				= sizeof(gLayouts) / sizeof(gLayouts[0]),
+	kTestBlocks				= 4,
+	kBurstElements			= 2000,
+	kIdleElements			= 100,
+	kBursts					= 20
+};
+
+
+
+static TestBlock *
+NewBlock(TestBlock *block, const TestLayout *layout)
+{
+	if (!block->Init(layout->elementSize, layout->alignment, layout->boundary, layout->reservedElements))
+	{
+		block->release();
+		return NULL;
+	}
+	return block;
+}
+
+
+
+static UInt32
+ExpectedElements(const TestLayout *layout)
+{
+	UInt32	boundary = layout->boundary ? layout->boundary : kUSBControllerMemoryBlockSize;
+	UInt32	stride = (layout->elementSize + layout->alignment - 1) & ~(layout->alignment - 1);
+
+	return ((kUSBControllerMemoryBlockSize / boundary) * (boundary / stride)) - layout->reservedElements;
+}
+
+
+
+static void
+ReleaseBlocks(IOUSBControllerMemoryBlock *head)
+{
+	IOUSBControllerMemoryBlock	*next;
+
+	while (head)
+	{
+		next = head->GetNextMemoryBlock();
+		head->release();
+		head = next;
+	}
+}
+
+
+
+// a UIM's free list in front of its blocks: it only grows by a block when it runs dry, and never gives one back
+struct TestPool
+{
+	const TestLayout *				layout;
+	IOUSBControllerMemoryBlock *	blocks;
+	UInt32							numBlocks;
+	std::vector<IOPhysicalAddress>	freeList;
+
+	IOPhysicalAddress Allocate(void)
+	{
+		IOPhysicalAddress	addr;
+		TestBlock			*block;
+		UInt32				i;
+
+		if (freeList.empty())
+		{
+			block = NewBlock(new TestBlock, layout);
+			if (!block)
+				return 0;
+			block->SetNextMemoryBlock(blocks);
+			blocks = block;
+			numBlocks++;
+			for (i = block->NumElements(); i > 0; i--)
+				freeList.push_back(block->GetElementPhysicalPtr(i - 1));
+		}
+		addr = freeList.back();
+		freeList.pop_back();
+		return addr;
+	}
+
+	void Free(IOPhysicalAddress addr)
+	{
+		freeList.push_back(addr);
+	}
+};
+
+
+
+static void
+TestLayouts(void)
+{
+	const TestLayout	*layout;
+	TestBlock			*block;
+	UInt32				boundary, offset, lastEnd, i, k;
+	UInt8				*logical;
+	UInt8				*base;
+	bool				aligned, inside, ordered, mapped;
+
+	for (k = 0; k < kNumLayouts; k++)
+	{
+		layout = &gLayouts[k];
+		block = NewBlock(new TestBlock, layout);
+		CHECK(block != NULL);
+		if (!block)
+			continue;
+
+		boundary = layout->boundary ? layout->boundary : kUSBControllerMemoryBlockSize;
+		CHECK_EQUAL(block->NumElements(), ExpectedElements(layout));
+
+		// the reserved elements come first, and the UIM's start after them
+		base = layout->reservedElements ? (UInt8*)block->Reserved(0) : (UInt8*)block->GetElementLogicalPtr(0);
+		CHECK((layout->reservedElements == 0) || (block->Reserved(0) < block->GetElementLogicalPtr(0)));
+		CHECK(block->Reserved(layout->reservedElements) == NULL);
+
+		aligned = inside = ordered = mapped = true;
+		lastEnd = 0;
+		for (i = 0; i < block->NumElements(); i++)
+		{
+			logical = (UInt8*)block->GetElementLogicalPtr(i);
+			offset = (UInt32)(block->GetElementPhysicalPtr(i) - block->GetElementPhysicalPtr(0)) + (UInt32)((UInt8*)block->GetElementLogicalPtr(0) - base);
+			aligned = aligned && ((offset % layout->alignment) == 0) && ((block->GetElementPhysicalPtr(i) % layout->alignment) == 0);
+			inside = inside && ((offset + layout->elementSize) <= kUSBControllerMemoryBlockSize) && ((offset / boundary) == ((offset + layout->elementSize - 1) / boundary));
+			ordered = ordered && (offset >= lastEnd);
+			mapped = mapped && ((UInt32)(logical - base) == offset);
+			lastEnd = offset + layout->elementSize;
+		}
+		CHECK(aligned);
+		CHECK(inside);
+		CHECK(ordered);
+		CHECK(mapped);
+		CHECK(block->GetElementLogicalPtr(block->NumElements()) == NULL);
+		CHECK_EQUAL(block->GetElementPhysicalPtr(block->NumElements()), 0);
+
+		block->release();
+	}
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+}
+
+
+
+static void
+TestReverseLookup(void)
+{
+	const TestLayout			*layout = &gLayouts[kNumLayouts - 1];			// reserved elements and gaps at each boundary
+	TestBlock					*blocks[kTestBlocks];
+	IOUSBControllerMemoryBlock	*head = NULL;
+	IOPhysicalAddress			addr, first, last;
+	UInt32						b, i;
+	bool						found = true;
+
+	for (b = 0; b < kTestBlocks; b++)
+	{
+		blocks[b] = NewBlock(new TestBlock, layout);
+		CHECK(blocks[b] != NULL);
+		if (!blocks[b])
+			return;
+		blocks[b]->SetNextMemoryBlock(head);
+		head = blocks[b];
+	}
+
+	// the shim hands out physical pages one after the other, so the end of one block is the start of the next
+	first = blocks[0]->GetElementPhysicalPtr(0) & ~(kUSBControllerMemoryBlockSize - 1);
+	for (b = 1; b < kTestBlocks; b++)
+		CHECK_EQUAL(blocks[b]->GetElementPhysicalPtr(0) & ~(kUSBControllerMemoryBlockSize - 1), first + (b * kUSBControllerMemoryBlockSize));
+	last = first + (kTestBlocks * kUSBControllerMemoryBlockSize);
+
+	for (b = 0; b < kTestBlocks; b++)
+	{
+		for (i = 0; i < blocks[b]->NumElements(); i++)
+		{
+			addr = blocks[b]->GetElementPhysicalPtr(i);
+			found = found && (IOUSBControllerMemoryBlock::FindBlockForPhysical(head, addr) == blocks[b]) &&
+					(blocks[b]->PhysicalToIndex(addr) == (SInt32)i) && (blocks[b]->PhysicalToLogical(addr) == blocks[b]->GetElementLogicalPtr(i));
+
+			// the middle of an element is not an element, and no other block claims it
+			found = found && (blocks[b]->PhysicalToIndex(addr + 4) == -1) && (blocks[b]->PhysicalToLogical(addr + 4) == NULL);
+			found = found && ((b == 0) || (blocks[b - 1]->PhysicalToIndex(addr) == -1));
+		}
+
+		// the first two slots of the page are reserved, and the bytes past the last element before a boundary are a gap
+		addr = first + (b * kUSBControllerMemoryBlockSize);
+		found = found && (blocks[b]->PhysicalToIndex(addr) == -1) && (blocks[b]->PhysicalToIndex(addr + 48) == -1) && (blocks[b]->PhysicalToIndex(addr + 96) == 0);
+		found = found && (blocks[b]->PhysicalToIndex(addr + 240) == -1) && (blocks[b]->PhysicalToIndex(addr + 256) == 3);
+	}
+	CHECK(found);
+
+	CHECK(IOUSBControllerMemoryBlock::FindBlockForPhysical(head, first - 16) == NULL);
+	CHECK(IOUSBControllerMemoryBlock::FindBlockForPhysical(head, last) == NULL);
+	CHECK(IOUSBControllerMemoryBlock::FindBlockForPhysical(head, last - 1) == blocks[kTestBlocks - 1]);
+	CHECK(IOUSBControllerMemoryBlock::FindBlockForPhysical(NULL, first) == NULL);
+	CHECK_EQUAL(blocks[0]->PhysicalToIndex(last), -1);
+
+	ReleaseBlocks(head);
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+}
+
+
+
+static void
+TestAllocateFree(void)
+{
+	TestPool					pool = { &gLayouts[4], NULL, 0, std::vector<IOPhysicalAddress>() };
+	std::vector<IOPhysicalAddress>	live;
+	std::set<IOPhysicalAddress>	unique;
+	IOUSBControllerMemoryBlock	*block;
+	UInt32						perBlock = ExpectedElements(pool.layout);
+	UInt32						count = (perBlock * 3) + (perBlock / 2);
+	UInt32						*element;
+	UInt32						i;
+	bool						good = true;
+
+	// three and a half blocks' worth, each tagged through its logical address after finding it from the physical one
+	for (i = 0; i < count; i++)
+	{
+		live.push_back(pool.Allocate());
+		unique.insert(live.back());
+		block = IOUSBControllerMemoryBlock::FindBlockForPhysical(pool.blocks, live.back());
+		element = block ? (UInt32*)block->PhysicalToLogical(live.back()) : NULL;
+		good = good && element && (*element == 0);
+		if (element)
+			*element = i + 1;
+	}
+	CHECK(good);
+	CHECK_EQUAL(unique.size(), count);
+	CHECK_EQUAL(pool.numBlocks, 4);
+
+	for (i = 0; i < count; i++)
+	{
+		block = IOUSBControllerMemoryBlock::FindBlockForPhysical(pool.blocks, live[i]);
+		element = block ? (UInt32*)block->PhysicalToLogical(live[i]) : NULL;
+		good = good && element && (*element == i + 1);
+	}
+	CHECK(good);
+
+	// freeing everything and allocating it again comes from the free list, not new blocks
+	for (i = 0; i < count; i++)
+		pool.Free(live[i]);
+	for (i = 0; i < count; i++)
+		good = good && (unique.count(pool.Allocate()) == 1);
+	CHECK(good);
+	CHECK_EQUAL(pool.numBlocks, 4);
+
+	ReleaseBlocks(pool.blocks);
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+}
+
+
+
+static void
+TestInitFailures(void)
+{
+	TestBlock		*block;
+	UInt32			blocks, elements, wastedBytes;
+
+	IOUSBControllerMemoryBlock::GetStatistics(&blocks, &elements, &wastedBytes);
+
+	block = new TestBlock;
+	CHECK(!block->Init(16, 24, 0, 0));							// not a power of 2
+	block->release();
+	block = new TestBlock;
+	CHECK(!block->Init(300, 16, 256, 0));						// doesn't fit between two boundaries
+	block->release();
+	block = new TestBlock;
+	CHECK(!block->Init(16, 16, 100, 0));						// not a divisor of the block
+	block->release();
+	block = new TestBlock;
+	CHECK(!block->Init(1024, 1024, 0, 4));						// nothing left after the reserved ones
+	block->release();
+	block = new TestBlock;
+	CHECK(!block->Init(16, 16, 0, 0, 0x000FF000));				// nothing free below the mask
+	block->release();
+	block = new TestBlock;
+	ShimFailAllocation(0);
+	CHECK(!block->Init(16, 16, 0, 0));							// no memory
+	ShimFailAllocation((UInt32)-1);
+	block->release();
+
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+	IOUSBControllerMemoryBlock::GetStatistics(&blocks, &elements, &wastedBytes);
+	CHECK_EQUAL(blocks, 0);
+	CHECK_EQUAL(elements, 0);
+	CHECK_EQUAL(wastedBytes, 0);
+}
+
+
+
+static UInt32
+TypeCount(OSDictionary *statistics, const char *className, const char *key)
+{
+	OSDictionary	*type = OSDynamicCast(OSDictionary, statistics->getObject(className));
+	OSNumber		*number = type ? OSDynamicCast(OSNumber, type->getObject(key)) : NULL;
+
+	return number ? number->unsigned32BitValue() : 0xFFFFFFFF;
+}
+
+
+
+static void
+TestStatistics(void)
+{
+	TestLayout		td = { "TD", 16, 16, 0, 0 };
+	TestLayout		qh = { "QH", 68, 32, 0, 0 };
+	TestBlock		*blocks[5];
+	OSDictionary	*statistics;
+	UInt32			total, elements, wastedBytes;
+	UInt32			i;
+
+	blocks[0] = NewBlock(new TestTDBlock, &td);
+	blocks[1] = NewBlock(new TestTDBlock, &td);
+	blocks[2] = NewBlock(new TestQHBlock, &qh);
+	blocks[3] = NewBlock(new TestQHBlock, &qh);
+	blocks[4] = NewBlock(new TestQHBlock, &qh);
+
+	IOUSBControllerMemoryBlock::GetStatistics(&total, &elements, &wastedBytes);
+	CHECK_EQUAL(total, 5);
+	CHECK_EQUAL(elements, (2 * 256) + (3 * 42));
+	CHECK_EQUAL(wastedBytes, (3 * (4096 - (42 * 68))));
+
+	statistics = IOUSBControllerMemoryBlock::CopyStatistics();
+	CHECK(statistics != NULL);
+	CHECK_EQUAL(TypeCount(statistics, "TestTDBlock", kUSBControllerMemoryBlocksKey), 2);
+	CHECK_EQUAL(TypeCount(statistics, "TestTDBlock", kUSBControllerMemoryElementsKey), 512);
+	CHECK_EQUAL(TypeCount(statistics, "TestTDBlock", kUSBControllerMemoryElementSizeKey), 16);
+	CHECK_EQUAL(TypeCount(statistics, "TestTDBlock", kUSBControllerMemoryBytesUnusedKey), 0);
+	CHECK_EQUAL(TypeCount(statistics, "TestQHBlock", kUSBControllerMemoryBlocksKey), 3);
+	CHECK_EQUAL(TypeCount(statistics, "TestQHBlock", kUSBControllerMemoryElementsKey), 126);
+	CHECK_EQUAL(TypeCount(statistics, "TestQHBlock", kUSBControllerMemoryElementSizeKey), 68);
+	CHECK_EQUAL(TypeCount(statistics, "TestQHBlock", kUSBControllerMemoryBytesUnusedKey), 3 * (4096 - (42 * 68)));
+	CHECK_EQUAL(TypeCount(statistics, "TestBlock", kUSBControllerMemoryBlocksKey), 0);		// all of the earlier tests' are gone
+	statistics->release();
+
+	for (i = 0; i < 5; i++)
+		blocks[i]->release();
+
+	statistics = IOUSBControllerMemoryBlock::CopyStatistics();
+	CHECK_EQUAL(TypeCount(statistics, "TestTDBlock", kUSBControllerMemoryBlocksKey), 0);
+	CHECK_EQUAL(TypeCount(statistics, "TestQHBlock", kUSBControllerMemoryElementsKey), 0);
+	statistics->release();
+	IOUSBControllerMemoryBlock::GetStatistics(&total, &elements, &wastedBytes);
+	CHECK_EQUAL(total, 0);
+}
+
+
+
+// kBursts times: take kBurstElements, then free all but kIdleElements of them in random order, then see how many blocks those pin
+static void
+TestFragmentation(void)
+{
+	const TestLayout				*layout;
+	std::vector<IOPhysicalAddress>	live;
+	std::set<IOUSBControllerMemoryBlock *>	pinned;
+	UInt32							seed = 1;
+	UInt32							perBlock, needed, worst;
+	UInt32							burst, i, k, pick;
+	bool							allFound = true;
+
+	printf("controller memory blocks: %d bursts of %d elements, each followed by an idle spell with %d left\n", kBursts, kBurstElements, kIdleElements);
+	for (k = 0; k < kNumLayouts; k++)
+	{
+		TestPool	pool = { &gLayouts[k], NULL, 0, std::vector<IOPhysicalAddress>() };
+
+		layout = pool.layout;
+		perBlock = ExpectedElements(layout);
+		worst = 0;
+		live.clear();
+		for (burst = 0; burst < kBursts; burst++)
+		{
+			while (live.size() < kBurstElements)
+				live.push_back(pool.Allocate());
+			while (live.size() > kIdleElements)
+			{
+				seed = (seed * 1103515245) + 12345;
+				pick = (seed >> 8) % live.size();
+				pool.Free(live[pick]);
+				live[pick] = live.back();
+				live.pop_back();
+			}
+
+			pinned.clear();
+			for (i = 0; i < live.size(); i++)
+			{
+				IOUSBControllerMemoryBlock	*block = IOUSBControllerMemoryBlock::FindBlockForPhysical(pool.blocks, live[i]);
+
+				allFound = allFound && block && (block->PhysicalToIndex(live[i]) >= 0);
+				pinned.insert(block);
+			}
+			if (pinned.size() > worst)
+				worst = (UInt32)pinned.size();
+		}
+
+		needed = (kIdleElements + perBlock - 1) / perBlock;
+		CHECK_EQUAL(pool.numBlocks, (kBurstElements + perBlock - 1) / perBlock);
+		CHECK(worst <= pool.numBlocks);
+		printf("  %-22s %3d per block, %4d bytes unused each, %2d blocks for the burst, idle needs %d and pins up to %d\n",
+			   layout->name, (int)perBlock, (int)(kUSBControllerMemoryBlockSize - ((perBlock + layout->reservedElements) * layout->elementSize)),
+			   (int)pool.numBlocks, (int)needed, (int)worst);
+
+		ReleaseBlocks(pool.blocks);
+	}
+	CHECK(allFound);
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+}
+
+
+
+TEST_MAIN("IOUSBControllerMemoryBlock", TestLayouts, TestReverseLookup, TestAllocateFree, TestInitFailures, TestStatistics, TestFragmentation)
@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ libFuzzer target for IOUSBValidateConfigurationDescriptor. Whatever the input, the validator must not read or write outside it, and
+ anything it accepts must be a canonical copy: wTotalLength is the length it returned, every descriptor has a bLength of at least 2
+ which stays inside, interface, endpoint and IAD descriptors have their fixed parts, nothing nests a configuration and no endpoint
+ comes before an interface. Validating in place must give the same bytes as validating into a second buffer, and validating the
+ result again must not change it. Any violation aborts, which the fuzzer reports with the input.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <IOKit/usb/IOUSBDescriptorValidation.h>
+
+
+#define CHECK(condition)																	\
+	do {																					\
+		if (!(condition))																	\
+		{																					\
+			fprintf(stderr, "DescriptorFuzzer: %s:%d: %s\n", __FILE__, __LINE__, #condition);	\
+			abort();																		\
+		}																					\
+	} while (0)
+
+
+
+static void
+CheckCanonical(const UInt8 *desc, UInt32 length, UInt32 inputLength)
+{
+	const IOUSBConfigurationDescriptor	*config = (const IOUSBConfigurationDescriptor*)desc;
+	UInt32								offset;
+	UInt8								bLength, bDescriptorType;
+	bool								haveInterface = false;
+
+	CHECK(length <= inputLength);
+	CHECK(length >= sizeof(IOUSBConfigurationDescriptor));
+	CHECK(config->bDescriptorType == kUSBConfDesc);
+	CHECK(config->bLength >= sizeof(IOUSBConfigurationDescriptor));
+	CHECK(config->bLength <= length);
+	CHECK(USBToHostWord(config->wTotalLength) == length);
+
+	for (offset = config->bLength; offset < length; offset += bLength)
+	{
+		CHECK((length - offset) >= 2);
+		bLength = desc[offset];
+		bDescriptorType = desc[offset + 1];
+		CHECK(bLength >= 2);
+		CHECK(bLength <= (length - offset));
+
+		switch (bDescriptorType)
+		{
+			case kUSBConfDesc:
+				CHECK(!"nested configuration descriptor");
+				break;
+
+			case kUSBInterfaceDesc:
+				CHECK(bLength >= sizeof(IOUSBInterfaceDescriptor));
+				haveInterface = true;
+				break;
+
+			case kUSBEndpointDesc:
+				CHECK(bLength >= sizeof(IOUSBEndpointDescriptor));
+				CHECK(haveInterface);
+				break;
+
+			case kUSBInterfaceAssociationDesc:
+				CHECK(bLength >= sizeof(IOUSBInterfaceAssociationDescriptor));
+				CHECK(((const IOUSBInterfaceAssociationDescriptor*)(desc + offset))->bInterfaceCount != 0);
+				break;
+		}
+	}
+	CHECK(offset == length);
+}
+
+
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	UInt8		*input;
+	UInt8		*inPlace;
+	UInt8		*output;
+	UInt8		*again;
+	UInt32		length, outLength, inPlaceLength, againLength;
+	UInt32		repairs, inPlaceRepairs, againRepairs;
+	IOReturn	err, inPlaceErr;
+
+	// descriptors come from a 16 bit wTotalLength, so nothing longer can reach the validator
+	if (size > 0xFFFF)
+		return 0;
+	length = (UInt32)size;
+
+	// exact sized copies, so the sanitizers catch a read or write past the end of any of them
+	input = (UInt8*)malloc(length ? length : 1);
+	inPlace = (UInt8*)malloc(length ? length : 1);
+	output = (UInt8*)malloc(length ? length : 1);
+	again = (UInt8*)malloc(length ? length : 1);
+	CHECK(input && inPlace && output && again);
+	memcpy(input, data, length);
+	memcpy(inPlace, data, length);
+
+	err = IOUSBValidateConfigurationDescriptor(input, length, output, &outLength, &repairs);
+	CHECK(memcmp(input, data, length) == 0);									// the source is const unless it is also the destination
+
+	inPlaceErr = IOUSBValidateConfigurationDescriptor(inPlace, length, inPlace, &inPlaceLength, &inPlaceRepairs);
+	CHECK(inPlaceErr == err);
+
+	if (err == kIOReturnSuccess)
+	{
+		CheckCanonical(output, outLength, length);
+
+		CHECK(inPlaceLength == outLength);
+		CHECK(inPlaceRepairs == repairs);
+		CHECK(memcmp(inPlace, output, outLength) == 0);
+
+		// a canonical copy is its own canonical copy - only a bNumInterfaces mismatch, which isn't fixed, can be reported again
+		err = IOUSBValidateConfigurationDescriptor(output, outLength, again, &againLength, &againRepairs);
+		CHECK(err == kIOReturnSuccess);
+		CHECK(againLength == outLength);
+		CHECK((againRepairs & ~kUSBDescRepairInterfaceCount) == 0);
+		CHECK(memcmp(again, output, outLength) == 0);
+	}
+	else
+	{
+		CHECK((err == kIOReturnBadArgument) || (err == kIOReturnUnderrun));
+		CHECK(outLength == 0);
+	}
+
+	free(again);
+	free(output);
+	free(inPlace);
+	free(input);
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ Runs the fuzz target without libFuzzer, for compilers which don't have it: every file named on the command line (or every file in a
+ directory named there) is run as is, and then put through a fixed number of seeded random mutations - truncation, byte changes and
+ spliced bLength values, which is where the validator's decisions are. -mutations=N changes the count, -seed=N the seed.
+*/
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+
+extern "C" int	LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static unsigned long	gMutations = 2000;
+static unsigned long	gSeed = 1;
+static unsigned long	gInputs = 0;
+static unsigned long	gRuns = 0;
+
+
+
+static void
+Mutate(uint8_t *data, size_t *size, size_t capacity)
+{
+	size_t		n = (size_t)(rand() % 4) + 1;
+
+	while (n--)
+	{
+		switch (rand() % 5)
+		{
+			case 0:																		// truncate
+				if (*size)
+					*size = (size_t)rand() % (*size + 1);
+				break;
+
+			case 1:																		// grow with junk
+				while ((*size < capacity) && (rand() % 4))
+					data[(*size)++] = (uint8_t)rand();
+				break;
+
+			case 2:																		// change a byte
+				if (*size)
+					data[rand() % *size] = (uint8_t)rand();
+				break;
+
+			case 3:																		// a bLength which is 0, 1 or off by one
+				if (*size)
+				{
+					static const uint8_t	lengths[] = { 0, 1, 2, 6, 7, 8, 9, 10, 0xFF };
+					data[rand() % *size] = lengths[rand() % sizeof(lengths)];
+				}
+				break;
+
+			case 4:																		// a wTotalLength which disagrees
+				if (*size >= 4)
+				{
+					uint16_t	total = (uint16_t)((rand() % 2) ? (*size + (rand() % 8) - 4) : rand());
+					data[2] = (uint8_t)total;
+					data[3] = (uint8_t)(total >> 8);
+				}
+				break;
+		}
+	}
+}
+
+
+
+static int
+RunFile(const char *path)
+{
+	FILE			*file;
+	uint8_t			original[4096];
+	uint8_t			data[sizeof(original)];
+	size_t			originalSize, size;
+	unsigned long	i;
+
+	file = fopen(path, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "DescriptorFuzzer: can't open %s\n", path);
+		return 1;
+	}
+	originalSize = fread(original, 1, sizeof(original), file);
+	fclose(file);
+
+	gInputs++;
+	LLVMFuzzerTestOneInput(original, originalSize);
+	gRuns++;
+
+	for (i = 0; i < gMutations; i++)
+	{
+		memcpy(data, original, originalSize);
+		size = originalSize;
+		Mutate(data, &size, sizeof(data));
+		LLVMFuzzerTestOneInput(data, size);
+		gRuns++;
+	}
+	return 0;
+}
+
+
+
+static int
+RunPath(const char *path)
+{
+	struct stat		info;
+	DIR				*dir;
+	struct dirent	*entry;
+	char			child[1024];
+	int				failed = 0;
+
+	if (stat(path, &info) != 0)
+	{
+		fprintf(stderr, "DescriptorFuzzer: can't find %s\n", path);
+		return 1;
+	}
+	if (!S_ISDIR(info.st_mode))
+		return RunFile(path);
+
+	dir = opendir(path);
+	if (!dir)
+		return 1;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+		failed |= RunFile(child);
+	}
+	closedir(dir);
+	return failed;
+}
+
+
+
+int
+main(int argc, char **argv)
+{
+	int		failed = 0;
+	int		i;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strncmp(argv[i], "-mutations=", 11))
+			gMutations = strtoul(argv[i] + 11, NULL, 0);
+		else if (!strncmp(argv[i], "-seed=", 6))
+			gSeed = strtoul(argv[i] + 6, NULL, 0);
+	}
+	srand((unsigned int)gSeed);
+
+	for (i = 1; i < argc; i++)
+	{
+		if (argv[i][0] != '-')
+			failed |= RunPath(argv[i]);
+	}
+
+	printf("DescriptorFuzzer: %lu inputs, %lu runs%s\n", gInputs, gRuns, failed ? ", some inputs could not be read" : "");
+	return failed;
+}
@@ -0,0 +1,440 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBDeviceResetState, on a simulated device behind a simulated XHCI. The reset puts the device back in the
+ default state and, as an XHCI Reset Device command does, disables every endpoint on the controller but the default one. The tests
+ check the order the restore does things in, that the pipes come back on live endpoints with their streams and the data toggles in
+ step with the device, that I/O is refused for the whole window, and what is left behind when a step fails.
+*/
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBInterface.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBDeviceResetState.h>
+
+#include "USBTest.h"
+
+
+static char		gEvents[1024];
+
+static void
+Event(const char *format, ...)
+{
+	size_t		used = strlen(gEvents);
+	va_list		args;
+
+	if (used)
+		gEvents[used++] = ' ';
+	va_start(args, format);
+	vsnprintf(gEvents + used, sizeof(gEvents) - used, format, args);
+	va_end(args);
+}
+
+
+
+#define CHECK_EVENTS(expected)																\
+	do {																					\
+		gTestChecks++;																		\
+		if (strcmp(gEvents, expected))														\
+		{																					\
+			gTestFailures++;																\
+			fprintf(stderr, "%s:%d: events were\n  %s\nexpected\n  %s\n", __FILE__, __LINE__, gEvents, expected);	\
+		}																					\
+		gEvents[0] = 0;																		\
+	} while (0)
+
+
+// the controller's endpoint for a pipe
+class TestPipe : public IOUSBPipe
+{
+public:
+	bool				linked;						// the controller has an endpoint for it
+	bool				enabled;					// and the endpoint is running
+	UInt8				toggle;						// the next data toggle the controller will use
+	UInt32				streams;
+
+	virtual IOReturn	Abort(void)
+	{
+		Event("abort(%02x)", descriptor.bEndpointAddress);
+		return kIOReturnSuccess;
+	}
+};
+
+
+class TestDevice;
+
+// the default pipe, which hands standard requests to the device
+class TestPipeZero : public TestPipe
+{
+public:
+	TestDevice *		device;
+
+	virtual IOReturn	DoControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion);
+};
+
+
+class TestInterface : public IOUSBInterface
+{
+public:
+	UInt32				remembered[kUSBMaxPipes];
+
+	TestPipe *			Pipe(int i)			{ return (TestPipe *)pipes[i]; }
+
+	virtual IOReturn	RememberStreams(void)
+	{
+		Event("remember(%d)", interfaceNumber);
+		for (int i = 0; i < kUSBMaxPipes; i++)
+			remembered[i] = pipes[i] ? Pipe(i)->streams : 0;
+		return kIOReturnSuccess;
+	}
+
+	// a Configure Endpoint on an endpoint the controller has disabled fails, as it does on an XHCI
+	virtual IOReturn	RecreateStreams(void)
+	{
+		Event("streams(%d)", interfaceNumber);
+		for (int i = 0; i < kUSBMaxPipes; i++)
+		{
+			if (!pipes[i] || !remembered[i])
+				continue;
+			if (!Pipe(i)->enabled)
+				return kIOReturnNotResponding;
+			Pipe(i)->streams = remembered[i];
+		}
+		return kIOReturnSuccess;
+	}
+
+	virtual void		UnlinkPipes(void)
+	{
+		Event("unlink(%d)", interfaceNumber);
+		for (int i = 0; i < kUSBMaxPipes; i++)
+		{
+			if (pipes[i])
+			{
+				Pipe(i)->linked = false;
+				Pipe(i)->enabled = false;
+				Pipe(i)->streams = 0;
+			}
+		}
+	}
+
+	virtual void		ReopenPipes(void)
+	{
+		Event("reopen(%d)", interfaceNumber);
+		for (int i = 0; i < kUSBMaxPipes; i++)
+		{
+			if (pipes[i] && !Pipe(i)->linked)
+			{
+				Pipe(i)->linked = true;
+				Pipe(i)->enabled = true;
+				Pipe(i)->toggle = 0;
+			}
+		}
+	}
+};
+
+
+class TestDevice : public IOUSBDevice
+{
+public:
+	ExpansionData		expansion;
+	TestPipeZero		pipeZero;
+	UInt8				deviceConfig;				// what the device itself is set to
+	UInt8				deviceAlternate[4];
+	IOReturn			resetError;
+	IOReturn			requestError;				// for the next request only
+	bool				blockedDuringReset;
+	IOReturn			nestedReset;
+
+	TestDevice()
+	{
+		_expansionData = &expansion;
+		expansion._interfaceArrayLock = IOLockAlloc();
+		expansion._interfaceArray = OSArray::withCapacity(4);
+		_pipeZero = &pipeZero;
+		pipeZero.device = this;
+		pipeZero.linked = pipeZero.enabled = true;
+		name = "TestDevice";
+		nestedReset = kIOReturnSuccess;
+	}
+
+	~TestDevice()
+	{
+		expansion._interfaceArray->release();
+		IOLockFree(expansion._interfaceArrayLock);
+	}
+
+	TestInterface *		Interface(int i)	{ return (TestInterface *)expansion._interfaceArray->getObject(i); }
+
+	virtual IOReturn	ResetDevice(void)
+	{
+		TestInterface	*interface;
+
+		Event("reset");
+		blockedDuringReset = IOUSBDeviceResetState::BlocksIO(this);
+		nestedReset = IOUSBDeviceResetState::ResetDeviceAndRestore(this);
+		if (resetError)
+			return resetError;
+
+		// back to the default state, DATA0 on every endpoint, and on the controller only the default endpoint is left running
+		deviceConfig = 0;
+		bzero(deviceAlternate, sizeof(deviceAlternate));
+		for (unsigned int i = 0; i < expansion._interfaceArray->getCount(); i++)
+		{
+			interface = Interface(i);
+			for (int j = 0; j < kUSBMaxPipes; j++)
+				if (interface->pipes[j])
+					interface->Pipe(j)->enabled = false;
+		}
+		return kIOReturnSuccess;
+	}
+};
+
+
+IOReturn
+TestPipeZero::DoControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)
+{
+	IOReturn	err = device->requestError;
+
+	device->requestError = kIOReturnSuccess;
+	if ((request->bmRequestType == USBmakebmRequestType(kUSBOut, kUSBStandard, kUSBDevice)) && (request->bRequest == kUSBRqSetConfig))
+	{
+		Event("config(%d)", request->wValue);
+		if (!err)
+			device->deviceConfig = request->wValue;
+	}
+	else if ((request->bmRequestType == USBmakebmRequestType(kUSBOut, kUSBStandard, kUSBInterface)) && (request->bRequest == kUSBRqSetInterface))
+	{
+		Event("alt(%d,%d)", request->wIndex, request->wValue);
+		if (!err)
+			device->deviceAlternate[request->wIndex] = request->wValue;
+	}
+	else
+	{
+		Event("request(%02x,%d)", request->bmRequestType, request->bRequest);
+	}
+	return err;
+}
+
+
+
+static TestPipe *
+AddPipe(TestInterface *interface, int index, UInt8 address, UInt8 attributes, UInt32 streams)
+{
+	TestPipe	*pipe = new TestPipe;
+
+	pipe->descriptor.bLength = sizeof(IOUSBEndpointDescriptor);
+	pipe->descriptor.bDescriptorType = kUSBEndpointDesc;
+	pipe->descriptor.bEndpointAddress = address;
+	pipe->descriptor.bmAttributes = attributes;
+	pipe->linked = pipe->enabled = true;
+	pipe->toggle = 1;
+	pipe->streams = streams;
+	interface->pipes[index] = pipe;
+	return pipe;
+}
+
+
+
+// configuration 1: interface 0 is a bulk in with 4 streams and a bulk out, interface 1 is in alternate setting 2 with an isoch in
+static void
+SetUp(TestDevice *device)
+{
+	TestInterface	*interface;
+
+	device->_currentConfigValue = 1;
+	device->deviceConfig = 1;
+
+	interface = new TestInterface;
+	interface->interfaceNumber = 0;
+	AddPipe(interface, 0, 0x81, kUSBBulk, 4);
+	AddPipe(interface, 1, 0x02, kUSBBulk, 0);
+	device->expansion._interfaceArray->setObject(interface);
+	interface->release();
+
+	interface = new TestInterface;
+	interface->interfaceNumber = 1;
+	interface->alternateSetting = 2;
+	device->deviceAlternate[1] = 2;
+	AddPipe(interface, 0, 0x83, kUSBIsoc, 0);
+	device->expansion._interfaceArray->setObject(interface);
+	interface->release();
+
+	gEvents[0] = 0;
+}
+
+
+
+static void
+TearDown(TestDevice *device)
+{
+	TestInterface	*interface;
+
+	for (unsigned int i = 0; i < device->expansion._interfaceArray->getCount(); i++)
+	{
+		interface = device->Interface(i);
+		CHECK_EQUAL(interface->getRetainCount(), 1);
+		for (int j = 0; j < kUSBMaxPipes; j++)
+			if (interface->pipes[j])
+				interface->pipes[j]->release();
+	}
+	CHECK_EQUAL(device->getRetainCount(), 1);
+	CHECK(!IOUSBDeviceResetState::BlocksIO(device));
+	device->release();
+}
+
+
+
+static void
+TestRestoreSequence(void)
+{
+	TestDevice		*device = new TestDevice;
+	TestPipe		*pipe;
+
+	SetUp(device);
+	CHECK(!IOUSBDeviceResetState::BlocksIO(device));
+	CHECK_EQUAL(IOUSBDeviceResetState::ResetDeviceAndRestore(device), kIOReturnSuccess);
+	CHECK_EVENTS("remember(0) remember(1) abort(81) abort(02) abort(83) abort(00) reset "
+				 "config(1) unlink(0) reopen(0) streams(0) alt(1,2) unlink(1) reopen(1) streams(1)");
+
+	// I/O was refused from before the aborts until the restore was done, and a second reset in that window was turned away
+	CHECK(device->blockedDuringReset);
+	CHECK_EQUAL(device->nestedReset, kIOReturnBusy);
+	CHECK(!IOUSBDeviceResetState::BlocksIO(device));
+
+	// the device is back as it was, and every pipe has a running endpoint which starts from DATA0 as the device does
+	CHECK_EQUAL(device->deviceConfig, 1);
+	CHECK_EQUAL(device->deviceAlternate[0], 0);
+	CHECK_EQUAL(device->deviceAlternate[1], 2);
+	for (int i = 0; i < 2; i++)
+	{
+		for (int j = 0; j < kUSBMaxPipes; j++)
+		{
+			pipe = device->Interface(i)->Pipe(j);
+			if (!pipe)
+				continue;
+			CHECK(pipe->linked);
+			CHECK(pipe->enabled);
+			CHECK_EQUAL(pipe->toggle, 0);
+		}
+	}
+	CHECK_EQUAL(device->Interface(0)->Pipe(0)->streams, 4);
+	CHECK_EQUAL(device->Interface(0)->Pipe(1)->streams, 0);
+
+	// the default endpoint was never taken down
+	CHECK(device->pipeZero.linked && device->pipeZero.enabled);
+
+	TearDown(device);
+}
+
+
+
+static void
+TestRestoreOnly(void)
+{
+	TestDevice				*device = new TestDevice;
+	IOUSBDeviceResetState	*state;
+
+	// a driver which did its own ResetDevice can still have the state put back, with no reset or aborts of our own
+	SetUp(device);
+	state = IOUSBDeviceResetState::withDevice(device);
+	CHECK(state != NULL);
+	device->ResetDevice();
+	gEvents[0] = 0;
+	CHECK_EQUAL(state->Restore(), kIOReturnSuccess);
+	CHECK_EVENTS("config(1) unlink(0) reopen(0) streams(0) alt(1,2) unlink(1) reopen(1) streams(1)");
+	CHECK(device->Interface(0)->Pipe(0)->enabled);
+	CHECK_EQUAL(device->Interface(0)->Pipe(0)->streams, 4);
+	state->release();
+
+	TearDown(device);
+}
+
+
+
+static void
+TestFailures(void)
+{
+	// the reset itself fails: nothing is sent to the device, and I/O is let through again
+	{
+		TestDevice		*device = new TestDevice;
+
+		SetUp(device);
+		device->resetError = kIOReturnNotResponding;
+		CHECK_EQUAL(IOUSBDeviceResetState::ResetDeviceAndRestore(device), kIOReturnNotResponding);
+		CHECK_EVENTS("remember(0) remember(1) abort(81) abort(02) abort(83) abort(00) reset");
+		TearDown(device);
+	}
+
+	// the device won't take its configuration back
+	{
+		TestDevice		*device = new TestDevice;
+
+		SetUp(device);
+		device->requestError = kIOReturnNotResponding;
+		CHECK_EQUAL(IOUSBDeviceResetState::ResetDeviceAndRestore(device), kIOReturnNotResponding);
+		CHECK_EVENTS("remember(0) remember(1) abort(81) abort(02) abort(83) abort(00) reset config(1)");
+		TearDown(device);
+	}
+
+	// an unconfigured device has nothing to put back
+	{
+		TestDevice		*device = new TestDevice;
+
+		SetUp(device);
+		device->_currentConfigValue = 0;
+		CHECK_EQUAL(IOUSBDeviceResetState::ResetDeviceAndRestore(device), kIOReturnSuccess);
+		CHECK_EVENTS("remember(0) remember(1) abort(81) abort(02) abort(83) abort(00) reset");
+		TearDown(device);
+	}
+
+	// more interfaces than a snapshot can hold: no partial restore, and the device isn't touched
+	{
+		TestDevice		*device = new TestDevice;
+		TestInterface	*interface;
+
+		for (int i = 0; i <= kUSBResetStateMaxInterfaces; i++)
+		{
+			interface = new TestInterface;
+			interface->interfaceNumber = i;
+			device->expansion._interfaceArray->setObject(interface);
+			interface->release();
+		}
+		device->_currentConfigValue = 1;
+		gEvents[0] = 0;
+		CHECK_EQUAL(IOUSBDeviceResetState::ResetDeviceAndRestore(device), kIOReturnNoMemory);
+		CHECK_EVENTS("");
+		TearDown(device);
+	}
+
+	CHECK(!IOUSBDeviceResetState::BlocksIO(NULL));
+	CHECK(IOUSBDeviceResetState::withDevice(NULL) == NULL);
+}
+
+
+TEST_MAIN("IOUSBDeviceResetState", TestRestoreSequence, TestRestoreOnly, TestFailures)
@@ -0,0 +1,398 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for AppleUSBDiagnostics: the registry view, the shared page and the nub a user client reaches it through. The concurrent
+ test has several readers map the page at once and follow it with the generation protocol while the timer keeps updating it, and
+ checks that none of them ever sees a torn update or loses a count.
+*/
+
+#include <string.h>
+#include <pthread.h>
+
+#include <IOKit/IOService.h>
+#include <IOKit/usb/IOUSBLogRateLimit.h>
+
+#include "AppleUSBDiagnostics.h"
+#include "USBTest.h"
+
+
+typedef AppleUSBDiagnostics::UIMDiagnostics		UIMDiagnostics;
+typedef AppleUSBDiagnostics::SharedDiagnostics	SharedDiagnostics;
+
+#define kTestPorts			4
+#define kTestReaders		4
+#define kTestUpdates		200
+
+
+class TestController : public IOService
+{
+public:
+	IOWorkLoop *			workLoop;
+
+	virtual IOWorkLoop *	getWorkLoop() const		{ return workLoop; }
+};
+
+
+void
+KernelDebugLogSuppressed(const KernelDebugSuppressedSummary *inSummary)
+{
+}
+
+
+
+static AppleUSBDiagnostics *
+CreateDiagnostics(TestController *controller, UIMDiagnostics *uim, UInt32 *controlBulkTxOut)
+{
+	AppleUSBDiagnostics	*diagnostics = OSDynamicCast(AppleUSBDiagnostics, AppleUSBDiagnostics::createDiagnostics(uim, controlBulkTxOut, controller));
+
+	uim->numPorts = kTestPorts;
+	return diagnostics;
+}
+
+
+
+static UInt64
+NumberEntry(OSSerialize *s, const char *key)
+{
+	OSNumber	*number = OSDynamicCast(OSNumber, s->ShimDictionary()->getObject(key));
+
+	return number ? number->unsigned64BitValue() : ~0ULL;
+}
+
+
+
+// the UIM's counters after update k, so that a reader can tell a torn copy from a whole one
+static void
+SetCounters(UIMDiagnostics *uim, UInt32 k)
+{
+	uim->totalErrors = k;
+	uim->totalBytes = (UInt64)k * 512;
+	uim->timeouts = k / 2;
+	uim->resets = k / 3;
+	for (int i = 0; i < kTestPorts; i++)
+	{
+		uim->portCounts[i].errorCount = k + i;
+		uim->portCounts[i].totalBytes = (UInt64)k * (i + 1);
+	}
+}
+
+
+
+static bool
+CountersConsistent(const SharedDiagnostics *page)
+{
+	UInt32	k = page->totalErrors;
+	bool	ok = (page->totalBytes == (UInt64)k * 512) && (page->timeouts == k / 2) && (page->resets == k / 3) && (page->numPorts == kTestPorts);
+
+	for (int i = 0; ok && (i < kTestPorts); i++)
+		ok = (page->ports[i].errorCount == k + (UInt32)i) && (page->ports[i].totalBytes == (UInt64)k * (i + 1));
+	return ok;
+}
+
+
+
+// what a tool does with its mapping
+static bool
+ReadPage(const SharedDiagnostics *page, SharedDiagnostics *copy)
+{
+	UInt32	before, after;
+
+	before = page->generation;
+	if (before & 1)
+		return false;
+	__sync_synchronize();
+	memcpy(copy, (const void *)page, sizeof(*copy));
+	__sync_synchronize();
+	after = page->generation;
+	return before == after;
+}
+
+
+
+static void
+TestRegistry(void)
+{
+	TestController			*controller = new TestController;
+	UIMDiagnostics			uim;
+	UInt32					controlBulkTxOut = 3;
+	AppleUSBDiagnostics		*diagnostics;
+	OSSerialize				*first = OSSerialize::withCapacity(0), *second = OSSerialize::withCapacity(0);
+
+	controller->workLoop = IOWorkLoop::workLoop();
+	diagnostics = CreateDiagnostics(controller, &uim, &controlBulkTxOut);
+	CHECK(diagnostics != NULL);
+
+	// a read reports what happened since the last read, and leaves the UIM's counters alone
+	SetCounters(&uim, 10);
+	CHECK(diagnostics->serialize(first));
+	CHECK_EQUAL(NumberEntry(first, "Errors (Total)"), 10);
+	CHECK_EQUAL(NumberEntry(first, "Errors (New)"), 10);
+	CHECK_EQUAL(NumberEntry(first, "ControlBulkTxOut"), 3);
+	CHECK_EQUAL(uim.totalErrors, 10);
+
+	SetCounters(&uim, 15);
+	CHECK(diagnostics->serialize(second));
+	CHECK_EQUAL(NumberEntry(second, "Errors (Total)"), 15);
+	CHECK_EQUAL(NumberEntry(second, "Errors (New)"), 5);
+	CHECK_EQUAL(NumberEntry(second, "Resets"), 5);
+	CHECK_EQUAL(NumberEntry(second, "Access Count"), 2);
+	CHECK_EQUAL(uim.totalErrors, 15);
+
+	// and the rate limited logging is counted alongside
+	CHECK(NumberEntry(second, kUSBLogSuppressedMessagesKey) != ~0ULL);
+	CHECK(NumberEntry(second, kUSBLogSuppressingSitesKey) != ~0ULL);
+
+	first->release();
+	second->release();
+	diagnostics->release();
+	controller->workLoop->release();
+	controller->release();
+}
+
+
+
+static void
+TestSharedPage(void)
+{
+	TestController				*controller = new TestController;
+	UIMDiagnostics				uim;
+	UInt32						controlBulkTxOut = 0;
+	AppleUSBDiagnostics			*diagnostics;
+	AppleUSBDiagnosticsNub		*nub;
+	IOBufferMemoryDescriptor	*memory;
+	const SharedDiagnostics		*page;
+	SharedDiagnostics			copy;
+	OSString					*userClientClass;
+	UInt32						timers = ShimTimerCount(), generation;
+
+	controller->workLoop = IOWorkLoop::workLoop();
+	diagnostics = CreateDiagnostics(controller, &uim, &controlBulkTxOut);
+
+	// there's a nub under the controller for a user client to be opened on
+	nub = OSDynamicCast(AppleUSBDiagnosticsNub, controller->ShimChild);
+	CHECK(nub != NULL);
+	if (!nub)
+		return;
+	CHECK(nub->ShimRegistered);
+	userClientClass = OSDynamicCast(OSString, nub->getProperty("IOUserClientClass"));
+	CHECK(userClientClass && !strcmp(userClientClass->getCStringNoCopy(), kAppleUSBDiagnosticsUserClientClass));
+
+	// nothing is updated until the page is mapped, and then it is at once and every second
+	CHECK_EQUAL(ShimTimerCount(), timers);
+	memory = OSDynamicCast(IOBufferMemoryDescriptor, nub->copySharedMemory());
+	CHECK(memory != NULL);
+	if (!memory)
+		return;
+	CHECK_EQUAL(ShimTimerCount(), timers + 1);
+	page = (const SharedDiagnostics *)memory->getBytesNoCopy();
+	CHECK_EQUAL(page->version, AppleUSBDiagnostics::kSharedDiagnosticsVersion);
+	CHECK_EQUAL(page->length, sizeof(SharedDiagnostics));
+
+	SetCounters(&uim, 7);
+	ShimAdvanceTimeMS(1);
+	CHECK(ReadPage(page, &copy));
+	CHECK_EQUAL(copy.totalErrors, 7);
+	CHECK(CountersConsistent(&copy));
+	generation = copy.generation;
+
+	SetCounters(&uim, 9);
+	ShimAdvanceTimeMS(AppleUSBDiagnostics::kSharedDiagnosticsUpdateMS);
+	CHECK(ReadPage(page, &copy));
+	CHECK_EQUAL(copy.totalErrors, 9);
+	CHECK_EQUAL(copy.generation, generation + 2);
+
+	// a second client doesn't make another timer, and the updates only stop when the last one goes
+	nub->copySharedMemory()->release();
+	CHECK_EQUAL(ShimTimerCount(), timers + 1);
+	nub->releaseSharedMemory();
+	SetCounters(&uim, 11);
+	ShimAdvanceTimeMS(AppleUSBDiagnostics::kSharedDiagnosticsUpdateMS);
+	CHECK_EQUAL(page->totalErrors, 11);
+	nub->releaseSharedMemory();
+	SetCounters(&uim, 12);
+	ShimAdvanceTimeMS(10 * AppleUSBDiagnostics::kSharedDiagnosticsUpdateMS);
+	CHECK_EQUAL(page->totalErrors, 11);
+
+	// a release nobody asked for is refused
+	diagnostics->releaseSharedMemory();
+	memory->release();
+	memory = OSDynamicCast(IOBufferMemoryDescriptor, nub->copySharedMemory());
+	ShimAdvanceTimeMS(1);
+	CHECK_EQUAL(page->totalErrors, 12);
+	nub->releaseSharedMemory();
+
+	// once the diagnostics are gone, the nub is taken down and has nothing to hand out, but a mapping still made stays good
+	nub->retain();
+	diagnostics->release();
+	CHECK(nub->ShimTerminated);
+	CHECK(nub->copySharedMemory() == NULL);
+	nub->releaseSharedMemory();
+	CHECK_EQUAL(page->totalErrors, 12);
+	CHECK_EQUAL(ShimTimerCount(), timers);
+	memory->release();
+	nub->release();
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+
+	controller->workLoop->release();
+	controller->release();
+}
+
+
+
+struct TestReader
+{
+	AppleUSBDiagnosticsNub *	nub;
+	volatile bool *				go;
+	IOMemoryDescriptor *		memory;
+	UInt32						reads;
+	UInt32						retries;
+	UInt32						torn;					// copies which passed the generation check but don't add up
+	UInt32						backwards;
+	UInt64						deltas;					// the reader's own "(New)" errors, summed
+	UInt32						last;
+};
+
+
+
+static void *
+ReaderThread(void *arg)
+{
+	TestReader				*reader = (TestReader *)arg;
+	const SharedDiagnostics	*page;
+	SharedDiagnostics		copy;
+
+	while (!*reader->go)
+		;
+	reader->memory = reader->nub->copySharedMemory();
+	if (!reader->memory)
+		return NULL;
+	page = (const SharedDiagnostics *)((IOBufferMemoryDescriptor *)reader->memory)->getBytesNoCopy();
+
+	while (reader->last < kTestUpdates)
+	{
+		if (!ReadPage(page, &copy))
+		{
+			reader->retries++;
+			continue;
+		}
+		reader->reads++;
+		if (copy.totalErrors == 0)
+			continue;
+		if (!CountersConsistent(&copy))
+			reader->torn++;
+		if (copy.totalErrors < reader->last)
+			reader->backwards++;
+		else
+			reader->deltas += copy.totalErrors - reader->last;
+		reader->last = copy.totalErrors;
+	}
+	return NULL;
+}
+
+
+
+static void
+TestConcurrentReaders(void)
+{
+	TestController				*controller = new TestController;
+	UIMDiagnostics				uim;
+	UInt32						controlBulkTxOut = 0;
+	AppleUSBDiagnostics			*diagnostics;
+	AppleUSBDiagnosticsNub		*nub;
+	TestReader					readers[kTestReaders];
+	pthread_t					threads[kTestReaders];
+	volatile bool				go = false;
+	UInt32						timers = ShimTimerCount(), reads = 0, retries = 0;
+	int							i, mapped;
+
+	controller->workLoop = IOWorkLoop::workLoop();
+	diagnostics = CreateDiagnostics(controller, &uim, &controlBulkTxOut);
+	nub = OSDynamicCast(AppleUSBDiagnosticsNub, controller->ShimChild);
+	if (!nub)
+	{
+		CHECK(nub != NULL);
+		return;
+	}
+
+	// they all map the page at once, and between them make one timer
+	memset(readers, 0, sizeof(readers));
+	for (i = 0; i < kTestReaders; i++)
+	{
+		readers[i].nub = nub;
+		readers[i].go = &go;
+		pthread_create(&threads[i], NULL, ReaderThread, &readers[i]);
+	}
+	go = true;
+	do
+	{
+		for (i = 0, mapped = 0; i < kTestReaders; i++)
+			mapped += (__sync_fetch_and_add(&readers[i].memory, 0) != NULL);
+	} while (mapped < kTestReaders);
+	CHECK_EQUAL(ShimTimerCount(), timers + 1);
+
+	// the timer updates the page with the UIM's counters while they read
+	for (UInt32 k = 1; k <= kTestUpdates; k++)
+	{
+		SetCounters(&uim, k);
+		ShimAdvanceTimeMS(AppleUSBDiagnostics::kSharedDiagnosticsUpdateMS);
+	}
+
+	for (i = 0; i < kTestReaders; i++)
+	{
+		pthread_join(threads[i], NULL);
+		CHECK_EQUAL(readers[i].torn, 0);
+		CHECK_EQUAL(readers[i].backwards, 0);
+		CHECK_EQUAL(readers[i].deltas, kTestUpdates);
+		CHECK_EQUAL(readers[i].last, kTestUpdates);
+		reads += readers[i].reads;
+		retries += readers[i].retries;
+		nub->releaseSharedMemory();
+		readers[i].memory->release();
+	}
+
+	// the last one to go stopped the updates
+	SetCounters(&uim, kTestUpdates + 1);
+	ShimAdvanceTimeMS(10 * AppleUSBDiagnostics::kSharedDiagnosticsUpdateMS);
+	{
+		IOBufferMemoryDescriptor	*memory = OSDynamicCast(IOBufferMemoryDescriptor, nub->copySharedMemory());
+		const SharedDiagnostics		*page = (const SharedDiagnostics *)memory->getBytesNoCopy();
+
+		CHECK_EQUAL(page->totalErrors, kTestUpdates);
+		nub->releaseSharedMemory();
+		memory->release();
+	}
+
+	printf("diagnostics: %d readers followed %d updates with %u whole copies and %u retries, none torn\n",
+		   kTestReaders, kTestUpdates, (unsigned int)reads, (unsigned int)retries);
+
+	diagnostics->release();
+	controller->workLoop->release();
+	controller->release();
+}
+
+
+
+TEST_MAIN("AppleUSBDiagnostics", TestRegistry, TestSharedPage, TestConcurrentReaders)
@@ -0,0 +1,216 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+/*
+ Host tests for IOUSBIsocCommand::ResolveASAPStartFrame. SimulatedEndpoint keeps the frame after its last transfer the way the
+ UHCI endpoint's firstAvailableFrame and the OHCI ED's nextIsochFrame do, and counts what the UIMs export as IsochASAPResyncCount
+ and IsochASAPFramesSkipped. The bus clock only moves when a test says so, so a client which falls behind is simulated by
+ letting it go by before the next submission.
+*/
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBCommand.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestFramesPerRequest	= 8,
+	kTestRequestsAhead		= 4,						// how far ahead of the bus a client which keeps up stays
+	kTestStreamRequests		= 20000
+};
+
+
+struct SimulatedEndpoint
+{
+	UInt64		nextFrame;								// 0 until something is queued, and again after an abort
+	UInt64		busFrame;
+	UInt32		resyncCount;
+	UInt64		framesSkipped;
+
+	// as CreateIsochTransfer and UIMCreateIsochTransfer do for kAppleUSBIsocASAPFrame
+	UInt64		Submit(IOUSBIsocCommand *command, UInt32 frameCount, UInt32 *skipped)
+	{
+		UInt64		start = command->ResolveASAPStartFrame(nextFrame, busFrame, kUSBIsocASAPLeadFrames, skipped);
+
+		if (*skipped)
+		{
+			resyncCount++;
+			framesSkipped += *skipped;
+		}
+		nextFrame = start + frameCount;
+		return start;
+	}
+};
+
+
+static void
+TestFirstRequest(void)
+{
+	IOUSBIsocCommand	*command = IOUSBIsocCommand::NewCommand();
+	SimulatedEndpoint	endpoint = { 0, 1000, 0, 0 };
+	UInt32				skipped = 0xFFFFFFFF;
+	UInt64				start;
+
+	// nothing queued yet, so there is no cadence to have fallen behind
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, 1000 + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(command->GetStartFrame(), start);
+	CHECK_EQUAL(skipped, 0);
+	CHECK_EQUAL(endpoint.resyncCount, 0);
+
+	// a request made while the previous one is still queued continues right after it
+	endpoint.busFrame += 3;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, 1000 + kUSBIsocASAPLeadFrames + kTestFramesPerRequest);
+	CHECK_EQUAL(skipped, 0);
+
+	// the next frame of the cadence is exactly the earliest one the controller can still take
+	endpoint.busFrame = endpoint.nextFrame - kUSBIsocASAPLeadFrames;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, endpoint.busFrame + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(skipped, 0);
+
+	// an aborted stream starts a new cadence without counting anything as skipped
+	endpoint.nextFrame = 0;
+	endpoint.busFrame += 500;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, endpoint.busFrame + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(skipped, 0);
+	CHECK_EQUAL(endpoint.resyncCount, 0);
+
+	command->release();
+}
+
+
+static void
+TestLateSubmission(void)
+{
+	IOUSBIsocCommand	*command = IOUSBIsocCommand::NewCommand();
+	SimulatedEndpoint	endpoint = { 0, 200, 0, 0 };
+	UInt32				skipped;
+	UInt64				start;
+	UInt64				missedFrame;
+
+	endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	missedFrame = endpoint.nextFrame;
+
+	// the client stalls for 50 frames, so the frame its next request was due in has long gone by
+	endpoint.busFrame = missedFrame + 50;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, missedFrame + 50 + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(skipped, 50 + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(start - missedFrame, skipped);
+	CHECK_EQUAL(endpoint.resyncCount, 1);
+	CHECK_EQUAL(endpoint.framesSkipped, skipped);
+
+	// one frame short of the lead is still late
+	endpoint.busFrame = endpoint.nextFrame - kUSBIsocASAPLeadFrames + 1;
+	missedFrame = endpoint.nextFrame;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(skipped, 1);
+	CHECK_EQUAL(start, missedFrame + 1);
+	CHECK_EQUAL(endpoint.resyncCount, 2);
+
+	// once it has caught up the cadence is kept again
+	missedFrame = endpoint.nextFrame;
+	start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+	CHECK_EQUAL(start, missedFrame);
+	CHECK_EQUAL(skipped, 0);
+
+	// a caller which doesn't want the count can pass NULL
+	endpoint.busFrame = endpoint.nextFrame + 10;
+	start = command->ResolveASAPStartFrame(endpoint.nextFrame, endpoint.busFrame, kUSBIsocASAPLeadFrames, NULL);
+	CHECK_EQUAL(start, endpoint.busFrame + kUSBIsocASAPLeadFrames);
+
+	// a count which doesn't fit is pinned rather than wrapped
+	start = command->ResolveASAPStartFrame(1, 0x200000000ULL, kUSBIsocASAPLeadFrames, &skipped);
+	CHECK_EQUAL(start, 0x200000000ULL + kUSBIsocASAPLeadFrames);
+	CHECK_EQUAL(skipped, 0xFFFFFFFF);
+
+	command->release();
+}
+
+
+// a client which usually stays a few requests ahead of the bus, and every so often stalls for a random time. Every request must
+// start where the controller can still take it, the cadence must only break where a skip was reported, and the frames
+// transferred and skipped must add up to the whole stretch of bus time the stream took
+static void
+TestLongStream(void)
+{
+	IOUSBIsocCommand	*command = IOUSBIsocCommand::NewCommand();
+	SimulatedEndpoint	endpoint = { 0, 5000, 0, 0 };
+	UInt32				seed = 0x1234567;
+	UInt32				skipped;
+	UInt64				start;
+	UInt64				firstFrame = 0;
+	UInt64				framesTransferred = 0;
+	UInt32				stalls = 0;
+	UInt32				tooEarly = 0;
+	UInt32				brokenCadence = 0;
+
+	for (int i = 0; i < kTestStreamRequests; i++)
+	{
+		UInt64		expected = endpoint.nextFrame;
+
+		start = endpoint.Submit(command, kTestFramesPerRequest, &skipped);
+		if (i == 0)
+			firstFrame = start;
+		if (start < endpoint.busFrame + kUSBIsocASAPLeadFrames)
+			tooEarly++;
+		if ((i != 0) && (start != expected + skipped))
+			brokenCadence++;
+		framesTransferred += kTestFramesPerRequest;
+
+		seed = seed * 1103515245 + 12345;
+		if (((seed >> 16) % 64) == 0)
+		{
+			// the client misses its deadline by anything up to 40 ms
+			endpoint.busFrame = endpoint.nextFrame + ((seed >> 8) % 40);
+			stalls++;
+		}
+		else if (endpoint.nextFrame > endpoint.busFrame + (kTestRequestsAhead * kTestFramesPerRequest))
+		{
+			// it keeps up, waking as each request completes
+			endpoint.busFrame = endpoint.nextFrame - (kTestRequestsAhead * kTestFramesPerRequest);
+		}
+	}
+
+	CHECK_EQUAL(tooEarly, 0);
+	CHECK_EQUAL(brokenCadence, 0);
+	CHECK(stalls > 0);
+	CHECK(endpoint.resyncCount <= stalls);
+	CHECK(endpoint.resyncCount > 0);
+	CHECK_EQUAL(framesTransferred + endpoint.framesSkipped, endpoint.nextFrame - firstFrame);
+
+	printf("%d requests with %d stalls: %d resynchronized, %d frames skipped\n", kTestStreamRequests, (int)stalls, (int)endpoint.resyncCount, (int)endpoint.framesSkipped);
+
+	command->release();
+}
+
+
+TEST_MAIN("IOUSBIsocCommand", TestFirstRequest, TestLateSubmission, TestLongStream)
@@ -0,0 +1,556 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBIsocFeedback: the nominal rate at each speed, how FillFrameList carries the fraction of a sample from packet
+ to packet, how explicit feedback is read as 10.14 or 16.16 and checked against the nominal rate, and the rate implied by the
+ packets of an IN data pipe. TestClockDrift runs a stream for thousands of frames against a device whose clock wanders by a few
+ hundred ppm and whose feedback jitters, as a driver would run it with its Writes queued ahead of the feedback.
+*/
+
+#include <math.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBPipe.h>
+#include <IOKit/usb/IOUSBIsocFeedback.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kDataAttributes			= kUSBIsoc | (kUSBAsynchronousIsocSyncType << 2) | (kUSBDataIsocUsageType << 4),
+	kFeedbackAttributes		= kUSBIsoc | (kUSBNoSynchronizationIsocSyncType << 2) | (kUSBFeedbackIsocUsageType << 4),
+	kStereo16				= 4,												// bytes per sample frame
+	kDriftBlock				= 32,												// bus intervals in each Write and each feedback Read
+	kDriftBlocksAhead		= 2,												// Writes queued ahead of the one the device is playing
+	kDriftMaxPackets		= kDriftBlock
+};
+
+
+static IOUSBDevice *
+Device(UInt8 speed)
+{
+	IOUSBDevice		*device = new IOUSBDevice;
+
+	device->speed = speed;
+	return device;
+}
+
+
+
+static IOUSBPipe *
+Pipe(UInt8 address, UInt8 attributes, UInt16 maxPacketSize, UInt8 interval)
+{
+	IOUSBPipe		*pipe = new IOUSBPipe;
+
+	pipe->descriptor.bLength = sizeof(IOUSBEndpointDescriptor);
+	pipe->descriptor.bDescriptorType = kUSBEndpointDesc;
+	pipe->descriptor.bEndpointAddress = address;
+	pipe->descriptor.bmAttributes = attributes;
+	pipe->descriptor.wMaxPacketSize = HostToUSBWord(maxPacketSize);
+	pipe->descriptor.bInterval = interval;
+	return pipe;
+}
+
+
+
+// completes a feedback Read of numFrames packets of packetSize bytes each, all with the same status
+static void
+Complete(IOUSBLowLatencyIsocFrame *frameList, UInt32 numFrames, UInt16 packetSize, IOReturn status)
+{
+	for (UInt32 i = 0; i < numFrames; i++)
+	{
+		frameList[i].frStatus = status;
+		frameList[i].frActCount = packetSize;
+	}
+}
+
+
+
+static void
+TestNominalRate(void)
+{
+	IOUSBDevice					*fullSpeed = Device(kUSBDeviceSpeedFull);
+	IOUSBDevice					*highSpeed = Device(kUSBDeviceSpeedHigh);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 192, 1);
+	IOUSBPipe					*highSpeedData = Pipe(0x01, kDataAttributes, 192, 4);
+	IOUSBIsocFeedback			*feedback;
+	IOUSBLowLatencyIsocFrame	frames[8];
+
+	// a millisecond frame at full speed
+	feedback = IOUSBIsocFeedback::withPipes(fullSpeed, data, NULL, 48000, kStereo16);
+	CHECK(feedback != NULL);
+	CHECK_EQUAL(feedback->GetCurrentRate(), 48 << 16);
+	CHECK_EQUAL(feedback->GetCurrentSampleRate(), 48000);
+	CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedbackUnknown);
+	CHECK_EQUAL(feedback->FillFrameList(frames, 8), 8 * 48 * kStereo16);
+	for (int i = 0; i < 8; i++)
+	{
+		CHECK_EQUAL(frames[i].frReqCount, 48 * kStereo16);
+		CHECK_EQUAL(frames[i].frActCount, 0);
+		CHECK_EQUAL(frames[i].frStatus, kIOReturnInvalid);
+	}
+	feedback->release();
+
+	// a microframe at high speed, with bInterval 4 sending a packet every 8 of them
+	feedback = IOUSBIsocFeedback::withPipes(highSpeed, highSpeedData, NULL, 48000, kStereo16);
+	CHECK(feedback != NULL);
+	CHECK_EQUAL(feedback->GetCurrentRate(), 6 << 16);
+	CHECK_EQUAL(feedback->GetCurrentSampleRate(), 48000);
+	CHECK_EQUAL(feedback->FillFrameList(frames, 1), 48 * kStereo16);
+	feedback->release();
+
+	// no feedback pipe, so nothing to read
+	feedback = IOUSBIsocFeedback::withPipes(fullSpeed, data, NULL, 48000, kStereo16);
+	CHECK_EQUAL(feedback->GetFeedbackBufferSize(8), 0);
+	CHECK_EQUAL(feedback->ProcessFeedback((const UInt8 *)frames, frames, 8), 0);
+	feedback->release();
+
+	highSpeedData->release();
+	data->release();
+	highSpeed->release();
+	fullSpeed->release();
+}
+
+
+
+static void
+TestFractionalCarry(void)
+{
+	IOUSBDevice					*device = Device(kUSBDeviceSpeedFull);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 192, 1);
+	IOUSBIsocFeedback			*feedback = IOUSBIsocFeedback::withPipes(device, data, NULL, 44100, kStereo16);
+	IOUSBLowLatencyIsocFrame	frames[1000];
+	UInt32						rate = feedback->GetCurrentRate();
+	UInt32						total, bytes, packetsOf45;
+
+	CHECK_EQUAL(rate, ((UInt64)44100 << 16) / 1000);
+
+	// 44.1 samples a frame is 44 or 45 a packet, and nothing is lost to rounding
+	total = feedback->FillFrameList(frames, 1000);
+	CHECK_EQUAL(total, (((UInt64)rate * 1000) >> 16) * kStereo16);
+	bytes = 0;
+	packetsOf45 = 0;
+	for (int i = 0; i < 1000; i++)
+	{
+		CHECK((frames[i].frReqCount == 44 * kStereo16) || (frames[i].frReqCount == 45 * kStereo16));
+		if (frames[i].frReqCount == 45 * kStereo16)
+			packetsOf45++;
+		bytes += frames[i].frReqCount;
+	}
+	CHECK_EQUAL(bytes, total);
+	CHECK_EQUAL(packetsOf45, (total / kStereo16) - (44 * 1000));
+
+	// the fraction carries over from one call to the next, so two halves send what one whole does
+	feedback->Reset();
+	total = feedback->FillFrameList(frames, 500);
+	total += feedback->FillFrameList(frames + 500, 500);
+	CHECK_EQUAL(total, (((UInt64)rate * 1000) >> 16) * kStereo16);
+
+	feedback->release();
+	data->release();
+	device->release();
+}
+
+
+
+static void
+TestMaxPacketSize(void)
+{
+	IOUSBDevice					*device = Device(kUSBDeviceSpeedFull);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 102, 1);
+	IOUSBIsocFeedback			*feedback = IOUSBIsocFeedback::withPipes(device, data, NULL, 48000, kStereo16);
+	IOUSBLowLatencyIsocFrame	frames[4];
+
+	// 192 bytes won't fit, and a packet is cut back to whole sample frames
+	CHECK_EQUAL(feedback->FillFrameList(frames, 4), 4 * 100);
+	for (int i = 0; i < 4; i++)
+		CHECK_EQUAL(frames[i].frReqCount, 100);
+
+	feedback->release();
+	data->release();
+	device->release();
+}
+
+
+
+static void
+TestExplicitFormats(void)
+{
+	IOUSBDevice					*fullSpeed = Device(kUSBDeviceSpeedFull);
+	IOUSBDevice					*highSpeed = Device(kUSBDeviceSpeedHigh);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 256, 1);
+	IOUSBPipe					*feedback3 = Pipe(0x81, kFeedbackAttributes, 3, 1);
+	IOUSBPipe					*feedback4 = Pipe(0x81, kFeedbackAttributes, 8, 1);
+	IOUSBIsocFeedback			*feedback;
+	IOUSBLowLatencyIsocFrame	frames[2];
+
+	// 47.5 samples a frame in 10.14, the full speed format
+	{
+		const UInt8		packets[] = { 0x00, 0xE0, 0x0B, 0x00, 0xE0, 0x0B };
+
+		feedback = IOUSBIsocFeedback::withPipes(fullSpeed, data, feedback3, 48000, kStereo16);
+		CHECK_EQUAL(feedback->GetFeedbackBufferSize(2), 6);
+		feedback->PrepareFeedbackRead(frames, 2);
+		CHECK_EQUAL(frames[0].frReqCount, 3);
+		CHECK_EQUAL(frames[1].frStatus, kIOReturnInvalid);
+		Complete(frames, 2, 3, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 2), 2);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback10_14);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 0x2F8000);
+		CHECK_EQUAL(feedback->GetCurrentSampleRate(), 47500);
+		feedback->release();
+	}
+
+	// the same rate in 16.16, as plenty of full speed devices send it. The packet size is capped at 4 bytes
+	{
+		const UInt8		packets[] = { 0x00, 0x80, 0x2F, 0x00 };
+
+		feedback = IOUSBIsocFeedback::withPipes(fullSpeed, data, feedback4, 48000, kStereo16);
+		CHECK_EQUAL(feedback->GetFeedbackBufferSize(1), 4);
+		feedback->PrepareFeedbackRead(frames, 1);
+		Complete(frames, 1, 4, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 1), 1);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback16_16);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 0x2F8000);
+		feedback->release();
+	}
+
+	// 6.125 samples a microframe in 16.16, the high speed format
+	{
+		const UInt8		packets[] = { 0x00, 0x20, 0x06, 0x00 };
+
+		feedback = IOUSBIsocFeedback::withPipes(highSpeed, data, feedback4, 48000, kStereo16);
+		feedback->PrepareFeedbackRead(frames, 1);
+		Complete(frames, 1, 4, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 1), 1);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback16_16);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 0x62000);
+		CHECK_EQUAL(feedback->GetCurrentSampleRate(), 49000);
+		feedback->release();
+	}
+
+	// and 6.0 in 10.14 from a high speed device which gets it wrong
+	{
+		const UInt8		packets[] = { 0x00, 0x80, 0x01 };
+
+		feedback = IOUSBIsocFeedback::withPipes(highSpeed, data, feedback3, 48000, kStereo16);
+		feedback->PrepareFeedbackRead(frames, 1);
+		Complete(frames, 1, 3, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 1), 1);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback10_14);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 6 << 16);
+		feedback->release();
+	}
+
+	feedback4->release();
+	feedback3->release();
+	data->release();
+	highSpeed->release();
+	fullSpeed->release();
+}
+
+
+
+static void
+TestExplicitRejection(void)
+{
+	IOUSBDevice					*device = Device(kUSBDeviceSpeedFull);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 256, 1);
+	IOUSBPipe					*feedbackPipe = Pipe(0x81, kFeedbackAttributes, 3, 1);
+	IOUSBIsocFeedback			*feedback = IOUSBIsocFeedback::withPipes(device, data, feedbackPipe, 48000, kStereo16);
+	IOUSBLowLatencyIsocFrame	frames[4];
+	UInt32						count, rejected, minRate, maxRate;
+
+	// neither 10.14 nor 16.16 is anywhere near 48 (30.0 and 7.5), so the format stays unknown
+	{
+		const UInt8		packets[] = { 0x00, 0x80, 0x07 };
+
+		feedback->PrepareFeedbackRead(frames, 1);
+		Complete(frames, 1, 3, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 1), 0);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedbackUnknown);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 48 << 16);
+	}
+
+	// 48.5, 60.0 (more than an eighth off), a failed packet, then 47.75 in an underrun packet
+	{
+		const UInt8		packets[] = { 0x00, 0x20, 0x0C, 0x00, 0x00, 0x0F, 0x00, 0x00, 0x0C, 0x00, 0xF0, 0x0B };
+
+		feedback->PrepareFeedbackRead(frames, 4);
+		Complete(frames, 4, 3, kIOReturnSuccess);
+		frames[2].frStatus = kIOReturnInvalid;
+		frames[3].frStatus = kIOReturnUnderrun;
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 4), 2);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback10_14);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 0x2FC000);
+	}
+
+	// once the format is known it is kept: 48.0 in 16.16 reads as 192 in 10.14
+	{
+		const UInt8		packets[] = { 0x00, 0x00, 0x30 };
+
+		feedback->PrepareFeedbackRead(frames, 1);
+		Complete(frames, 1, 3, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 1), 0);
+		CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedback10_14);
+	}
+
+	// a short packet where the next would be is still read from the offset its frReqCount gave it
+	{
+		const UInt8		packets[] = { 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x0C };
+
+		feedback->PrepareFeedbackRead(frames, 2);
+		Complete(frames, 2, 3, kIOReturnSuccess);
+		frames[0].frActCount = 0;
+		CHECK_EQUAL(feedback->ProcessFeedback(packets, frames, 2), 1);
+		CHECK_EQUAL(feedback->GetCurrentRate(), 48 << 16);
+	}
+
+	feedback->GetStatistics(&count, &rejected, &minRate, &maxRate);
+	CHECK_EQUAL(count, 3);
+	CHECK_EQUAL(rejected, 3);
+	CHECK_EQUAL(minRate, 47750);
+	CHECK_EQUAL(maxRate, 48500);
+	feedback->GetStatistics(NULL, NULL, NULL, NULL);
+
+	// back to nominal, and to a new nominal rate. The statistics range starts again
+	feedback->Reset();
+	CHECK_EQUAL(feedback->GetCurrentRate(), 48 << 16);
+	feedback->Reset(44100);
+	CHECK_EQUAL(feedback->GetCurrentSampleRate(), 44100);
+	feedback->GetStatistics(NULL, NULL, &minRate, &maxRate);
+	CHECK_EQUAL(minRate, 44100);
+	CHECK_EQUAL(maxRate, 44100);
+
+	feedback->release();
+	feedbackPipe->release();
+	data->release();
+	device->release();
+}
+
+
+
+static void
+TestImplicitFeedback(void)
+{
+	IOUSBDevice					*device = Device(kUSBDeviceSpeedFull);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 256, 1);
+	IOUSBPipe					*inData = Pipe(0x82, kDataAttributes, 256, 1);
+	IOUSBIsocFeedback			*feedback = IOUSBIsocFeedback::withPipes(device, data, inData, 44100, kStereo16);
+	IOUSBLowLatencyIsocFrame	frames[5];
+	UInt8						buffer[5 * 256];
+
+	CHECK_EQUAL(feedback->GetFormat(), kUSBIsocFeedbackImplicit);
+	CHECK_EQUAL(feedback->GetFeedbackBufferSize(4), 4 * 256);
+
+	// 44 + 45 + 45 + 44 samples, an average of 44.5 a frame. The failed packet counts for nothing
+	feedback->PrepareFeedbackRead(frames, 5);
+	frames[0].frStatus = kIOReturnSuccess;
+	frames[0].frActCount = 44 * kStereo16;
+	frames[1].frStatus = kIOReturnUnderrun;
+	frames[1].frActCount = 45 * kStereo16;
+	frames[2].frActCount = 60 * kStereo16;
+	frames[3].frStatus = kIOReturnSuccess;
+	frames[3].frActCount = 45 * kStereo16;
+	frames[4].frStatus = kIOReturnSuccess;
+	frames[4].frActCount = 44 * kStereo16;
+	CHECK_EQUAL(feedback->ProcessFeedback(buffer, frames, 5), 1);
+	CHECK_EQUAL(feedback->GetCurrentRate(), 0x2C8000);
+	CHECK_EQUAL(feedback->GetCurrentSampleRate(), 44500);
+
+	// a packet with nothing in it drags the average down too far
+	frames[0].frActCount = 0;
+	CHECK_EQUAL(feedback->ProcessFeedback(buffer, frames, 5), 0);
+	CHECK_EQUAL(feedback->GetCurrentRate(), 0x2C8000);
+
+	feedback->release();
+	inData->release();
+	data->release();
+	device->release();
+}
+
+
+
+static void
+TestPipeChecks(void)
+{
+	IOUSBDevice					*device = Device(kUSBDeviceSpeedFull);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 256, 1);
+	IOUSBPipe					*inData = Pipe(0x81, kDataAttributes, 256, 1);
+	IOUSBPipe					*bulk = Pipe(0x02, kUSBBulk, 64, 0);
+	IOUSBPipe					*feedbackPipe = Pipe(0x81, kFeedbackAttributes, 3, 1);
+	IOUSBPipe					*outFeedback = Pipe(0x03, kFeedbackAttributes, 3, 1);
+	IOUSBIsocFeedback			*feedback;
+
+	CHECK(IOUSBIsocFeedback::withPipes(NULL, data, NULL, 48000, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, NULL, NULL, 48000, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, data, NULL, 0, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, data, NULL, 48000, 0) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, inData, NULL, 48000, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, bulk, NULL, 48000, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, data, outFeedback, 48000, kStereo16) == NULL);
+	CHECK(IOUSBIsocFeedback::withPipes(device, data, bulk, 48000, kStereo16) == NULL);
+
+	// a failed init gives back nothing it didn't take
+	CHECK_EQUAL(data->getRetainCount(), 1);
+	CHECK_EQUAL(bulk->getRetainCount(), 1);
+	CHECK_EQUAL(outFeedback->getRetainCount(), 1);
+
+	// both pipes are held for as long as the object is around
+	feedback = IOUSBIsocFeedback::withPipes(device, data, feedbackPipe, 48000, kStereo16);
+	CHECK(feedback != NULL);
+	CHECK_EQUAL(data->getRetainCount(), 2);
+	CHECK_EQUAL(feedbackPipe->getRetainCount(), 2);
+	feedback->release();
+	CHECK_EQUAL(data->getRetainCount(), 1);
+	CHECK_EQUAL(feedbackPipe->getRetainCount(), 1);
+
+	outFeedback->release();
+	feedbackPipe->release();
+	bulk->release();
+	inData->release();
+	data->release();
+	device->release();
+}
+
+
+struct DriftCase
+{
+	const char *	name;
+	UInt8			speed;
+	UInt32			sampleRate;
+	UInt8			feedbackInterval;			// bInterval of the feedback endpoint
+	UInt16			feedbackPacketSize;
+	UInt32			intervals;					// how long the stream runs
+};
+
+static const DriftCase		gDriftCases[] =
+{
+	{ "full speed, 10.14 every frame",			kUSBDeviceSpeedFull,	48000,	1,	3,	60000 },
+	{ "full speed 44.1, 10.14 every frame",		kUSBDeviceSpeedFull,	44100,	1,	3,	60000 },
+	{ "high speed, 16.16 every 8 microframes",	kUSBDeviceSpeedHigh,	44100,	4,	4,	160000 }
+};
+
+
+// the device's clock in ppm off nominal: a slow drift from -300 to +300 over the run, and a wander of 80 either way every 4000 intervals
+static double
+DevicePPM(UInt32 interval, UInt32 intervals)
+{
+	return -300.0 + (600.0 * interval / intervals) + (80.0 * sin((2.0 * M_PI * interval) / 4000.0));
+}
+
+
+
+// the samples the device plays in each bus interval, from the samples per packet each Write was filled with. The device counts its
+// own samples over each feedback packet's intervals and sends the total in the feedback format, carrying the part of an LSB it
+// could not send to the next packet, as devices which count do. Each value also has a couple of LSBs of noise on it
+static void
+RunDrift(const DriftCase *test)
+{
+	IOUSBDevice					*device = Device(test->speed);
+	IOUSBPipe					*data = Pipe(0x01, kDataAttributes, 512, 1);
+	IOUSBPipe					*feedbackPipe = Pipe(0x81, kFeedbackAttributes, test->feedbackPacketSize, test->feedbackInterval);
+	IOUSBIsocFeedback			*feedback = IOUSBIsocFeedback::withPipes(device, data, feedbackPipe, test->sampleRate, kStereo16);
+	IOUSBLowLatencyIsocFrame	writes[kDriftBlocksAhead + 1][kDriftBlock];
+	IOUSBLowLatencyIsocFrame	reads[kDriftMaxPackets];
+	UInt8						buffer[kDriftMaxPackets * 4];
+	UInt32						intervalsPerSecond = (test->speed == kUSBDeviceSpeedHigh) ? 8000 : 1000;
+	UInt32						feedbackIntervals = (test->speed == kUSBDeviceSpeedHigh) ? (1 << (test->feedbackInterval - 1)) : 1;
+	UInt32						readPackets = kDriftBlock / feedbackIntervals;
+	double						scale = (test->feedbackPacketSize == 3) ? 16384.0 : 65536.0;
+	double						nominal = (double)test->sampleRate / intervalsPerSecond;
+	double						rate, played = 0, carry = 0, worstPacket = 0, worstTotal = 0, measured;
+	UInt64						sent = 0;
+	UInt32						seed = 1, interval = 0, block, i, j, value, rejected;
+	SInt32						noise;
+
+	CHECK(feedback != NULL);
+	for (block = 0; block < kDriftBlocksAhead; block++)
+		feedback->FillFrameList(writes[block], kDriftBlock);
+
+	for (block = 0; interval < test->intervals; block++)
+	{
+		IOUSBLowLatencyIsocFrame	*playing = writes[block % (kDriftBlocksAhead + 1)];
+
+		// the device plays the Write which is due while the feedback Read for the same intervals runs
+		feedback->PrepareFeedbackRead(reads, readPackets);
+		for (i = 0; i < readPackets; i++)
+		{
+			measured = 0;
+			for (j = 0; j < feedbackIntervals; j++, interval++)
+			{
+				rate = nominal * (1.0 + (DevicePPM(interval, test->intervals) / 1000000.0));
+				measured += rate;
+				played += rate;
+
+				// each packet is within a sample of what the device plays in its interval
+				worstPacket = fmax(worstPacket, fabs((playing[(i * feedbackIntervals) + j].frReqCount / kStereo16) - rate));
+				sent += playing[(i * feedbackIntervals) + j].frReqCount / kStereo16;
+				worstTotal = fmax(worstTotal, fabs((double)sent - played));
+			}
+
+			seed = (seed * 1103515245) + 12345;
+			noise = (SInt32)((seed >> 16) % 5) - 2;
+			carry += (measured / feedbackIntervals) * scale;
+			value = (UInt32)((SInt32)floor(carry) + noise);
+			carry -= value;
+			for (j = 0; j < test->feedbackPacketSize; j++)
+				buffer[(i * test->feedbackPacketSize) + j] = (UInt8)(value >> (8 * j));
+		}
+		Complete(reads, readPackets, test->feedbackPacketSize, kIOReturnSuccess);
+		CHECK_EQUAL(feedback->ProcessFeedback(buffer, reads, readPackets), readPackets);
+
+		// and the driver fills the Write which goes on after the ones it already has queued
+		feedback->FillFrameList(writes[(block + kDriftBlocksAhead) % (kDriftBlocksAhead + 1)], kDriftBlock);
+	}
+
+	// the Writes were filled up to three blocks before the rate they played at was known, which costs a thousandth of a sample a
+	// packet. The total stays off by the samples the first Writes lost at the nominal rate, almost one, and the fraction carried over
+	CHECK(worstPacket < 1.001);
+	CHECK(worstTotal < 2.0);
+	feedback->GetStatistics(NULL, &rejected, NULL, NULL);
+	CHECK_EQUAL(rejected, 0);
+	if ((worstPacket >= 1.001) || (worstTotal >= 2.0))
+		fprintf(stderr, "%s: packets up to %.4f samples off, the total up to %.4f\n", test->name, worstPacket, worstTotal);
+
+	feedback->release();
+	feedbackPipe->release();
+	data->release();
+	device->release();
+}
+
+
+
+static void
+TestClockDrift(void)
+{
+	for (UInt32 i = 0; i < sizeof(gDriftCases) / sizeof(gDriftCases[0]); i++)
+		RunDrift(&gDriftCases[i]);
+}
+
+
+TEST_MAIN("IOUSBIsocFeedback", TestNominalRate, TestFractionalCarry, TestMaxPacketSize, TestExplicitFormats, TestExplicitRejection, TestImplicitFeedback, TestPipeChecks, TestClockDrift)
@@ -0,0 +1,292 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#include <string.h>
+#include <time.h>
+
+#include <IOKit/IOLib.h>
+#include <kern/clock.h>
+#include <IOKit/usb/IOUSBLog.h>
+#include <IOKit/usb/IOUSBLogOutput.h>
+
+#include "USBTest.h"
+
+
+enum
+{
+	kTestMessages			= 200000,
+	kTestScratchBuffers		= 8,							// kKernelDebugScratchBuffers
+	kTestLongMessage		= 600							// more than a scratch buffer holds
+};
+
+// what a USBLog message usually looks like
+static const char		kTestFormat[] = "%s[%p]::DoConfigureEPs - error 0x%x for address %d after closing %d and opening %d pipes, undoing";
+
+KernelDebuggingOutputType	gKernelDebugOutputType = kKernelDebugOutputIOLogType;
+com_apple_iokit_KLog *		gKernelLogger = NULL;
+
+// Both outputs format what they are given, as IOLog does into the message buffer and KLog into its ring. Each counts how often it
+// was handed the caller's format, and had to go through it again, rather than a message which had already been formatted
+static const char *		gCallerFormat;
+static char				gConsole[4096];
+static UInt32			gConsoleCalls;
+static UInt32			gConsoleFormats;
+
+
+class TestKLog : public com_apple_iokit_KLog
+{
+public:
+	char				text[4096];
+	UInt32				calls;
+	UInt32				formats;
+	UInt32				reenter;							// log this many more messages from inside vLog, as a logger which logs would
+
+	virtual SInt8		vLog(KLogLevel level, KLogTag tag, const char *format, va_list in_va_list);
+};
+
+static TestKLog			gKLog;
+
+
+
+static void
+ConsoleSink(const char *format, va_list args)
+{
+	size_t		used = strlen(gConsole);
+
+	gConsoleCalls++;
+	if (format == gCallerFormat)
+		gConsoleFormats++;
+	vsnprintf(gConsole + used, sizeof(gConsole) - used, format, args);
+}
+
+
+static void		Log(bool direct, UInt32 tag, const char *format, ...);
+
+SInt8
+TestKLog::vLog(KLogLevel level, KLogTag tag, const char *format, va_list in_va_list)
+{
+	calls++;
+	if (format == gCallerFormat)
+		formats++;
+	vsnprintf(text, sizeof(text), format, in_va_list);
+	if (reenter)
+	{
+		reenter--;
+		Log(false, 'USBF', kTestFormat, "TestKLog", this, 0, (int)reenter, 0, 0);
+	}
+	return 0;
+}
+
+
+static void
+Log(bool direct, UInt32 tag, const char *format, ...)
+{
+	va_list		args;
+
+	gCallerFormat = format;
+	va_start(args, format);
+	if (direct)
+		KernelDebugLogOutputDirect(3, tag, format, args);
+	else
+		KernelDebugLogOutput(3, tag, format, args);
+	va_end(args);
+}
+
+
+static void
+Reset(KernelDebuggingOutputType outputs)
+{
+	gKernelDebugOutputType = outputs;
+	gKernelLogger = &gKLog;
+	gShimIOLogSink = ConsoleSink;
+	gConsole[0] = 0;
+	gConsoleCalls = gConsoleFormats = 0;
+	gKLog.text[0] = 0;
+	gKLog.calls = gKLog.formats = 0;
+	gKLog.reenter = 0;
+}
+
+
+static UInt64
+NowNS(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((UInt64)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+
+
+// formatted once or once per output, the console and KLog get the same text, and only the old way do they format it themselves
+static void
+TestSameOutput(void)
+{
+	char		message[256];
+	char		expected[512];
+	char		console[512];
+
+	ShimAdvanceTimeMS(61234);
+	snprintf(message, sizeof(message), kTestFormat, "AppleUSBXHCI", (void *)0x1234, 0xe00002ec, 5, 1, 2);
+	snprintf(expected, sizeof(expected), "USBF:\t61.234\t%s\n", message);
+
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	Log(false, 'USBF', kTestFormat, "AppleUSBXHCI", (void *)0x1234, 0xe00002ec, 5, 1, 2);
+	CHECK(strcmp(gConsole, expected) == 0);
+	CHECK(strcmp(gKLog.text, message) == 0);
+	CHECK_EQUAL(gConsoleCalls, 1);
+	CHECK_EQUAL(gConsoleFormats + gKLog.formats, 0);
+	strlcpy(console, gConsole, sizeof(console));
+
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	Log(true, 'USBF', kTestFormat, "AppleUSBXHCI", (void *)0x1234, 0xe00002ec, 5, 1, 2);
+	CHECK(strcmp(gConsole, console) == 0);
+	CHECK(strcmp(gKLog.text, message) == 0);
+	CHECK_EQUAL(gConsoleFormats, 1);
+	CHECK_EQUAL(gKLog.formats, 1);
+
+	// only USB's own messages get a newline
+	Reset(kKernelDebugOutputIOLogType);
+	Log(false, 'HUB ', "port %d", 3);
+	CHECK(strcmp(gConsole, "HUB :\t61.234\tport 3") == 0);
+}
+
+
+static void
+TestOneOutput(void)
+{
+	Reset(kKernelDebugOutputIOLogType);
+	Log(false, 'USBF', "console only");
+	CHECK(strstr(gConsole, "\tconsole only\n") != NULL);
+	CHECK_EQUAL(gKLog.calls, 0);
+
+	Reset(kKernelDebugOutputKextLoggerType);
+	Log(false, 'USBF', "KLog only");
+	CHECK(strcmp(gKLog.text, "KLog only") == 0);
+	CHECK_EQUAL(gConsoleCalls, 0);
+
+	// KLog asked for but not loaded
+	Reset(kKernelDebugOutputKextLoggerType);
+	gKernelLogger = NULL;
+	Log(false, 'USBF', "nowhere");
+	Log(true, 'USBF', "nowhere");
+	CHECK_EQUAL(gConsoleCalls, 0);
+	CHECK_EQUAL(gKLog.calls, 0);
+
+	Reset(0);
+	Log(false, 'USBF', "nowhere");
+	CHECK_EQUAL(gConsoleCalls + gKLog.calls, 0);
+}
+
+
+// a message too long for a scratch buffer goes out whole, the old way, and the buffer it tried is free again afterwards
+static void
+TestLongMessage(void)
+{
+	char		payload[kTestLongMessage + 1];
+	char		*text;
+
+	memset(payload, 'x', kTestLongMessage);
+	payload[kTestLongMessage] = 0;
+
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	Log(false, 'USBF', "long: %s", payload);
+	text = strstr(gConsole, "long: ");
+	CHECK(text != NULL);
+	CHECK(text && (strlen(text) == strlen("long: ") + kTestLongMessage + 1));
+	CHECK_EQUAL(strlen(gKLog.text), strlen("long: ") + kTestLongMessage);
+	CHECK_EQUAL(gConsoleFormats, 1);
+	CHECK_EQUAL(gKLog.formats, 1);
+
+	for (int i = 0; i < kTestScratchBuffers; i++)
+	{
+		Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+		Log(false, 'USBF', "short %d", i);
+		CHECK_EQUAL(gConsoleFormats + gKLog.formats, 0);
+	}
+}
+
+
+// KLog logging from inside vLog nests as deep as there are scratch buffers, and one more falls back without losing anything.
+// They are all given back once it unwinds
+static void
+TestAllBuffersTaken(void)
+{
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	gKLog.reenter = kTestScratchBuffers;
+	Log(false, 'USBF', kTestFormat, "TestKLog", &gKLog, 0, kTestScratchBuffers, 0, 0);
+	CHECK_EQUAL(gKLog.calls, kTestScratchBuffers + 1);
+	CHECK_EQUAL(gConsoleCalls, kTestScratchBuffers + 3);					// one for each buffered message, tag, message and newline for the last
+	CHECK_EQUAL(gConsoleFormats, 1);
+	CHECK_EQUAL(gKLog.formats, 1);
+
+	for (int i = 0; i < kTestScratchBuffers; i++)
+	{
+		Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+		Log(false, 'USBF', kTestFormat, "AppleUSBEHCI", (void *)0x5678, 0, i, 0, 0);
+		CHECK_EQUAL(gConsoleFormats + gKLog.formats, 0);
+	}
+}
+
+
+// both outputs on, as when debugging with USB Prober's logger and the console open at once
+static void
+TestThroughput(void)
+{
+	UInt64		start, onceNS, perOutputNS;
+	UInt32		formats;
+
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	start = NowNS();
+	for (int i = 0; i < kTestMessages; i++)
+	{
+		gConsole[0] = 0;
+		Log(false, 'USBF', kTestFormat, "AppleUSBXHCI", (void *)0x1234, 0xe00002ec, i & 127, 1, 2);
+	}
+	onceNS = NowNS() - start;
+	formats = gConsoleFormats + gKLog.formats;
+	CHECK_EQUAL(gKLog.calls, kTestMessages);
+	CHECK_EQUAL(formats, 0);
+
+	Reset(kKernelDebugOutputIOLogType | kKernelDebugOutputKextLoggerType);
+	start = NowNS();
+	for (int i = 0; i < kTestMessages; i++)
+	{
+		gConsole[0] = 0;
+		Log(true, 'USBF', kTestFormat, "AppleUSBXHCI", (void *)0x1234, 0xe00002ec, i & 127, 1, 2);
+	}
+	perOutputNS = NowNS() - start;
+	formats = gConsoleFormats + gKLog.formats;
+	CHECK_EQUAL(gKLog.calls, kTestMessages);
+	CHECK_EQUAL(formats, 2 * kTestMessages);
+
+	printf("log output to the console and KLog: %d messages, %llu ns each formatted once, %llu ns each formatted for every output\n",
+		   kTestMessages, (unsigned long long)(onceNS / kTestMessages), (unsigned long long)(perOutputNS / kTestMessages));
+
+	gShimIOLogSink = NULL;
+}
+
+
+TEST_MAIN("KernelDebugLogOutput", TestSameOutput, TestOneOutput, TestLongMessage, TestAllBuffersTaken, TestThroughput)
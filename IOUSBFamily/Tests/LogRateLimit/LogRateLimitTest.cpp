@@ -0,0 +1,341 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for the log rate limiter. LogMessage does what KernelDebugLogInternal does with the limiter's answer, and the summaries
+ it is handed, and those the sweep logs by itself, are collected here in place of IOUSBLog.cpp's KernelDebugLogSuppressed. The
+ storm test has a bus full of failing devices logging from a handful of call sites for a minute, and checks that every message is
+ either logged or counted in a summary.
+*/
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <kern/clock.h>
+#include <IOKit/usb/IOUSBLogRateLimit.h>
+
+#include "USBTest.h"
+
+
+#define kTestBurst				20
+#define kTestPerSecond			5
+#define kTestMaxSummaries		4096
+
+static KernelDebugSuppressedSummary		gSummaries[kTestMaxSummaries];
+static UInt32							gNumSummaries = 0;
+static UInt64							gSummarizedMessages = 0;
+static UInt32							gLogged = 0;
+
+
+
+void
+KernelDebugLogSuppressed(const KernelDebugSuppressedSummary *inSummary)
+{
+	if (gNumSummaries < kTestMaxSummaries)
+		gSummaries[gNumSummaries++] = *inSummary;
+	gSummarizedMessages += inSummary->suppressed;
+}
+
+
+
+static bool
+LogMessage(UInt32 level, const char *format, ...)
+{
+	KernelDebugSuppressedSummary	summaries[kKernelDebugMaxSummaries];
+	UInt32							numSummaries, i;
+	va_list							ap;
+	bool							allow;
+
+	va_start(ap, format);
+	allow = KernelDebugRateLimit(level, 0, format, ap, summaries, &numSummaries);
+	va_end(ap);
+
+	for (i = 0; i < numSummaries; i++)
+		KernelDebugLogSuppressed(&summaries[i]);
+	if (allow)
+		gLogged++;
+	return allow;
+}
+
+
+
+// let the sweep report whatever earlier tests left behind, and start counting again
+static void
+Quiesce(void)
+{
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS + 1000);
+	KernelDebugSetRateLimit(kTestBurst, kTestPerSecond);
+	gNumSummaries = 0;
+	gSummarizedMessages = 0;
+	gLogged = 0;
+}
+
+
+
+static UInt64
+SuppressedMessages(void)
+{
+	UInt64		suppressed;
+
+	KernelDebugGetRateLimitStatistics(&suppressed, NULL);
+	return suppressed;
+}
+
+
+
+static UInt32
+SuppressingSites(void)
+{
+	UInt32		sites;
+
+	KernelDebugGetRateLimitStatistics(NULL, &sites);
+	return sites;
+}
+
+
+
+static UInt64
+NowNS(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((UInt64)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+
+
+static void
+TestBurstAndRefill(void)
+{
+	const void	*device = (const void *)0x1000;
+	UInt64		suppressed;
+	int			i;
+
+	Quiesce();
+	suppressed = SuppressedMessages();
+
+	for (i = 0; i < kTestBurst + 10; i++)
+		LogMessage(1, "TestDevice[%p]::Burst - transfer failed", device);
+	CHECK_EQUAL(gLogged, kTestBurst);
+	CHECK_EQUAL(SuppressedMessages() - suppressed, 10);
+	CHECK_EQUAL(SuppressingSites(), 1);
+	CHECK_EQUAL(gNumSummaries, 0);
+
+	// a fifth of a second buys one more message, which brings the summary with it
+	ShimAdvanceTimeMS(1000 / kTestPerSecond);
+	CHECK(LogMessage(1, "TestDevice[%p]::Burst - transfer failed", device));
+	CHECK(!LogMessage(1, "TestDevice[%p]::Burst - transfer failed", device));
+	CHECK_EQUAL(gNumSummaries, 1);
+	CHECK_EQUAL(gSummaries[0].suppressed, 10);
+	CHECK(gSummaries[0].object == device);
+	CHECK_EQUAL(gSummaries[0].level, 1);
+	CHECK(!strncmp(gSummaries[0].format, "TestDevice[%p]::Burst - transfer failed", kKernelDebugFormatCopySize - 1));
+
+	// a quiet spell refills the bucket, but only up to the burst
+	ShimAdvanceTimeMS(60 * 1000);
+	gLogged = 0;
+	for (i = 0; i < 2 * kTestBurst; i++)
+		LogMessage(1, "TestDevice[%p]::Burst - transfer failed", device);
+	CHECK_EQUAL(gLogged, kTestBurst);
+}
+
+
+
+static void
+TestPerObject(void)
+{
+	const void	*busy = (const void *)0x2000, *quiet = (const void *)0x3000;
+	int			i;
+
+	Quiesce();
+
+	// one device flooding doesn't silence the same message from another, whether the object is logged as Class[%p] or %s[%p]
+	for (i = 0; i < 3 * kTestBurst; i++)
+		LogMessage(1, "%s[%p]::PerObject - device not responding", "TestDevice", busy);
+	CHECK_EQUAL(gLogged, kTestBurst);
+	for (i = 0; i < 5; i++)
+		CHECK(LogMessage(1, "%s[%p]::PerObject - device not responding", "TestDevice", quiet));
+
+	// nor does it silence another call site logging for the same device
+	CHECK(LogMessage(1, "TestDevice[%p]::PerObject - another message", busy));
+
+	// a message without an object still gets its own bucket
+	for (i = 0; i < 2 * kTestBurst; i++)
+		LogMessage(1, "PerObject: %d messages without an object", i);
+	CHECK_EQUAL(gLogged, kTestBurst + 5 + 1 + kTestBurst);
+
+	// and whatever wasn't logged is in the summaries
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS);
+	CHECK_EQUAL(gSummarizedMessages, (2 * kTestBurst) + kTestBurst);
+	CHECK_EQUAL(SuppressingSites(), 0);
+}
+
+
+
+static void
+TestSweep(void)
+{
+	const void	*device = (const void *)0x4000;
+	UInt64		suppressed;
+	int			i;
+
+	Quiesce();
+	suppressed = SuppressedMessages();
+
+	// a site which floods and then goes quiet is reported by the sweep, and nothing more is said about it after that
+	for (i = 0; i < kTestBurst + 7; i++)
+		LogMessage(1, "TestDevice[%p]::Sweep - quiet after this", device);
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS - 1);
+	CHECK_EQUAL(gNumSummaries, 0);
+	ShimAdvanceTimeMS(1);
+	CHECK_EQUAL(gNumSummaries, 1);
+	CHECK_EQUAL(gSummaries[0].suppressed, 7);
+	CHECK(gSummaries[0].object == device);
+	CHECK_EQUAL(SuppressingSites(), 0);
+	ShimAdvanceTimeMS(10 * kKernelDebugRateLimitSweepMS);
+	CHECK_EQUAL(gNumSummaries, 1);
+
+	// one which keeps on flooding at 50 a second for 20 s is summarized every sweep, and only gets the burst and the refill through
+	Quiesce();
+	suppressed = SuppressedMessages();
+	for (i = 0; i < 50 * 20; i++)
+	{
+		LogMessage(1, "TestDevice[%p]::Sweep - keeps on failing", device);
+		ShimAdvanceTimeMS(20);
+	}
+	CHECK(gNumSummaries >= (20 * 1000 / kKernelDebugRateLimitSweepMS) - 1);
+	CHECK(gLogged <= kTestBurst + (20 * kTestPerSecond) + 1);
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS);
+	CHECK_EQUAL(gLogged + gSummarizedMessages, 50 * 20);
+	CHECK_EQUAL(SuppressedMessages() - suppressed, gSummarizedMessages);
+	CHECK_EQUAL(SuppressingSites(), 0);
+}
+
+
+
+static void
+TestSlotReuse(void)
+{
+	char		formats[3 * 64][48];
+	int			site, i;
+
+	Quiesce();
+
+	// more sites suppressing than there are slots: whichever loses its slot hands over what it held back at once
+	for (site = 0; site < 3 * 64; site++)
+	{
+		snprintf(formats[site], sizeof(formats[site]), "TestDevice[%%p]::SlotReuse - site %d", site);
+		for (i = 0; i < kTestBurst + 2; i++)
+			LogMessage(1, formats[site], (const void *)0x5000);
+	}
+	CHECK(gNumSummaries > 0);
+	CHECK(SuppressingSites() <= 64);
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS);
+	CHECK_EQUAL(gSummarizedMessages, 3 * 64 * 2);
+	CHECK_EQUAL(SuppressingSites(), 0);
+}
+
+
+
+static void
+TestSettings(void)
+{
+	const void	*device = (const void *)0x6000;
+	UInt64		suppressed;
+	int			i;
+
+	// a burst of 0 turns it off
+	Quiesce();
+	suppressed = SuppressedMessages();
+	KernelDebugSetRateLimit(0, kTestPerSecond);
+	for (i = 0; i < 10 * kTestBurst; i++)
+		LogMessage(1, "TestDevice[%p]::Settings - unlimited", device);
+	CHECK_EQUAL(gLogged, 10 * kTestBurst);
+	CHECK_EQUAL(SuppressedMessages(), suppressed);
+
+	// lowering the burst takes effect on a site which already has more saved up than the new one allows
+	Quiesce();
+	for (i = 0; i < 5; i++)
+		LogMessage(1, "TestDevice[%p]::Settings - lowered", device);
+	KernelDebugSetRateLimit(2, kTestPerSecond);
+	gLogged = 0;
+	for (i = 0; i < 10; i++)
+		LogMessage(1, "TestDevice[%p]::Settings - lowered", device);
+	CHECK_EQUAL(gLogged, 2);
+	KernelDebugSetRateLimit(kTestBurst, kTestPerSecond);
+}
+
+
+
+static void
+TestStorm(void)
+{
+	enum { kDevices = 40, kSites = 6, kSeconds = 60, kSpellMS = 5000 };
+	static char		formats[kSites][64];
+	UInt64			suppressed, start, elapsed = 0;
+	UInt32			seed = 1, messages = 0, lines;
+	int				ms, device, site;
+
+	Quiesce();
+	suppressed = SuppressedMessages();
+	for (site = 0; site < kSites; site++)
+		snprintf(formats[site], sizeof(formats[site]), "AppleUSBStorm[%%p]::Site%d - error 0x%%x", site);
+
+	// one device after another fails hard for a few seconds, logging every millisecond, while the rest mutter now and then
+	for (ms = 0; ms < kSeconds * 1000; ms++)
+	{
+		for (device = 0; device < kDevices; device++)
+		{
+			bool	failing = ((ms / kSpellMS) % kDevices) == device;
+
+			seed = seed * 1103515245 + 12345;
+			if (!failing && ((seed >> 16) % 1000))
+				continue;
+			site = (seed >> 8) % kSites;
+			start = NowNS();
+			LogMessage(1, formats[site], (const void *)(uintptr_t)(0x10000 + (device * 0x1000)), seed);
+			elapsed += NowNS() - start;
+			messages++;
+		}
+		ShimAdvanceTimeMS(1);
+	}
+	ShimAdvanceTimeMS(kKernelDebugRateLimitSweepMS);
+
+	CHECK_EQUAL(gLogged + gSummarizedMessages, messages);
+	CHECK_EQUAL(SuppressedMessages() - suppressed, gSummarizedMessages);
+	CHECK_EQUAL(SuppressingSites(), 0);
+	lines = gLogged + gNumSummaries;
+	CHECK(lines * 4 < messages);
+
+	printf("log storm: %u messages from %d devices in %d s, %u logged and %u summary lines, %llu ns a call\n",
+		   (unsigned int)messages, kDevices, kSeconds, (unsigned int)gLogged, (unsigned int)gNumSummaries,
+		   (unsigned long long)(elapsed / messages));
+}
+
+
+
+TEST_MAIN("IOUSBLogRateLimit", TestBurstAndRefill, TestPerObject, TestSweep, TestSlotReuse, TestSettings, TestStorm)
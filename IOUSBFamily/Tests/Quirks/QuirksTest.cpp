@@ -0,0 +1,342 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ Host tests for IOUSBQuirks: how entries are parsed and range checked, how MatchDevice and MatchController pick and merge entries,
+ and how the family table follows the catalogue's generation and is replaced by LoadQuirks.
+*/
+
+#include <IOKit/IOCatalogue.h>
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBQuirks.h>
+
+#include "USBTest.h"
+
+
+static void
+SetNumber(OSDictionary *dict, const char *key, unsigned long long value)
+{
+	OSNumber	*number = OSNumber::withNumber(value, 64);
+
+	dict->setObject(key, number);
+	number->release();
+}
+
+
+
+static void
+SetString(OSDictionary *dict, const char *key, const char *value)
+{
+	OSString	*string = OSString::withCString(value);
+
+	dict->setObject(key, string);
+	string->release();
+}
+
+
+
+static OSDictionary *
+DeviceEntry(unsigned long long vendorID, long long productID, long long releaseLow, long long releaseHigh, unsigned long long resetDelay, const char *comment)
+{
+	OSDictionary	*dict = OSDictionary::withCapacity(6);
+
+	SetNumber(dict, kUSBQuirkVendorIDKey, vendorID);
+	if (productID >= 0)
+		SetNumber(dict, kUSBQuirkProductIDKey, (unsigned long long)productID);
+	if (releaseLow >= 0)
+		SetNumber(dict, kUSBQuirkDeviceReleaseLowKey, (unsigned long long)releaseLow);
+	if (releaseHigh >= 0)
+		SetNumber(dict, kUSBQuirkDeviceReleaseHighKey, (unsigned long long)releaseHigh);
+	if (resetDelay)
+		SetNumber(dict, kUSBQuirkResetDelayKey, resetDelay);
+	if (comment)
+		SetString(dict, kUSBQuirkCommentKey, comment);
+	return dict;
+}
+
+
+
+static OSDictionary *
+ControllerEntry(unsigned long long vendorID, long long deviceID, long long revisionLow, long long revisionHigh, unsigned long long errata)
+{
+	OSDictionary	*dict = OSDictionary::withCapacity(5);
+
+	SetNumber(dict, kUSBQuirkPCIVendorIDKey, vendorID);
+	if (deviceID >= 0)
+		SetNumber(dict, kUSBQuirkPCIDeviceIDKey, (unsigned long long)deviceID);
+	if (revisionLow >= 0)
+		SetNumber(dict, kUSBQuirkPCIRevisionLowKey, (unsigned long long)revisionLow);
+	if (revisionHigh >= 0)
+		SetNumber(dict, kUSBQuirkPCIRevisionHighKey, (unsigned long long)revisionHigh);
+	if (errata)
+		SetNumber(dict, kUSBQuirkErrataKey, errata);
+	return dict;
+}
+
+
+
+static void
+Add(OSArray *array, OSDictionary *dict)
+{
+	array->setObject(dict);
+	dict->release();
+}
+
+
+
+// runs first, while the family table has never been looked at
+static void
+TestCatalogueLoad(void)
+{
+	OSDictionary		*personality;
+	OSArray				*table;
+	IOUSBDevice			*device = new IOUSBDevice;
+	IOUSBDeviceQuirks	quirks;
+
+	// the family's own personality and one from another kext are merged in catalogue order
+	personality = OSDictionary::withCapacity(2);
+	SetString(personality, "IOProviderClass", kUSBQuirksProviderClass);
+	table = OSArray::withCapacity(1);
+	Add(table, DeviceEntry(0x05AC, 0x1234, -1, -1, 100, "family"));
+	personality->setObject(kUSBQuirksKey, table);
+	table->release();
+	ShimCatalogueAdd(personality);
+	personality->release();
+
+	personality = OSDictionary::withCapacity(2);
+	SetString(personality, "IOProviderClass", kUSBQuirksProviderClass);
+	table = OSArray::withCapacity(1);
+	Add(table, DeviceEntry(0x05AC, 0x1234, -1, -1, 200, "codeless kext"));
+	personality->setObject(kUSBQuirksKey, table);
+	table->release();
+	ShimCatalogueAdd(personality);
+	personality->release();
+
+	// a table in a personality for anything else is not ours
+	personality = OSDictionary::withCapacity(2);
+	SetString(personality, "IOProviderClass", "AppleUSBUHCI");
+	table = OSArray::withCapacity(1);
+	Add(table, DeviceEntry(0x05AC, 0x5678, -1, -1, 300, "controller"));
+	personality->setObject(kUSBQuirksKey, table);
+	table->release();
+	ShimCatalogueAdd(personality);
+	personality->release();
+
+	device->vendorID = 0x05AC;
+	device->productID = 0x1234;
+	CHECK(IOUSBQuirks::GetDeviceQuirks(device, &quirks));
+	CHECK_EQUAL(quirks.resetDelayMS, 200);
+
+	device->productID = 0x5678;
+	CHECK(!IOUSBQuirks::GetDeviceQuirks(device, &quirks));
+
+	// unloading the codeless kext moves the generation on, and the next lookup sees only what is left
+	ShimCatalogueReset();
+	personality = OSDictionary::withCapacity(2);
+	SetString(personality, "IOProviderClass", kUSBQuirksProviderClass);
+	table = OSArray::withCapacity(1);
+	Add(table, DeviceEntry(0x05AC, 0x1234, -1, -1, 100, "family"));
+	personality->setObject(kUSBQuirksKey, table);
+	table->release();
+	ShimCatalogueAdd(personality);
+	personality->release();
+	device->productID = 0x1234;
+	CHECK(IOUSBQuirks::GetDeviceQuirks(device, &quirks));
+	CHECK_EQUAL(quirks.resetDelayMS, 100);
+
+	// a LoadQuirks table stays, whatever the catalogue does, until NULL goes back to the catalogue's
+	table = OSArray::withCapacity(1);
+	Add(table, ControllerEntry(0x8086, 0x2934, -1, -1, 0x40));
+	CHECK_EQUAL(IOUSBQuirks::LoadQuirks(table), kIOReturnSuccess);
+	table->release();
+	CHECK(!IOUSBQuirks::GetDeviceQuirks(device, &quirks));
+	CHECK_EQUAL(IOUSBQuirks::GetControllerErrata(0x8086, 0x2934, 3, "UHCI"), 0x40);
+	ShimCatalogueReset();
+	CHECK_EQUAL(IOUSBQuirks::GetControllerErrata(0x8086, 0x2934, 3, "UHCI"), 0x40);
+
+	CHECK_EQUAL(IOUSBQuirks::LoadQuirks(NULL), kIOReturnSuccess);
+	CHECK_EQUAL(IOUSBQuirks::GetControllerErrata(0x8086, 0x2934, 3, "UHCI"), 0);
+	CHECK(!IOUSBQuirks::GetDeviceQuirks(device, &quirks));
+
+	device->release();
+}
+
+
+
+static void
+TestDeviceMatching(void)
+{
+	OSArray				*array = OSArray::withCapacity(4);
+	IOUSBQuirks			*table;
+	IOUSBDeviceQuirks	quirks;
+	const char			*comment = NULL;
+	OSDictionary		*dict;
+
+	Add(array, DeviceEntry(0x1111, -1, -1, -1, 50, "any product"));
+	Add(array, DeviceEntry(0x1111, 0x0002, 0x0100, 0x0199, 0, NULL));
+	dict = OSDynamicCast(OSDictionary, array->getObject(1));
+	dict->setObject(kUSBQuirkSkipStringDescriptorsKey, kOSBooleanTrue);
+	SetString(dict, kUSBQuirkCommentKey, "old firmware");
+	Add(array, DeviceEntry(0x1111, 0x0002, 0x0150, 0x0150, 75, "one release"));
+
+	table = IOUSBQuirks::withArray(array);
+	CHECK(table != NULL);
+	CHECK_EQUAL(table->GetNumDeviceEntries(), 3);
+
+	// vendor only
+	CHECK(table->MatchDevice(0x1111, 0x0009, 0x0100, &quirks, &comment));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay);
+	CHECK_EQUAL(quirks.resetDelayMS, 50);
+	CHECK(!strcmp(comment, "any product"));
+	CHECK(!table->MatchDevice(0x1112, 0x0002, 0x0100, &quirks));
+	CHECK_EQUAL(quirks.quirks, 0);
+
+	// the release range is inclusive at both ends
+	CHECK(table->MatchDevice(0x1111, 0x0002, 0x00FF, &quirks));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay);
+	CHECK(table->MatchDevice(0x1111, 0x0002, 0x0100, &quirks, &comment));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay | kUSBQuirkSkipStringDescriptors);
+	CHECK(!strcmp(comment, "old firmware"));
+	CHECK(table->MatchDevice(0x1111, 0x0002, 0x0199, &quirks));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay | kUSBQuirkSkipStringDescriptors);
+	CHECK(table->MatchDevice(0x1111, 0x0002, 0x019A, &quirks));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay);
+
+	// every match is merged, and the values of the last one win
+	CHECK(table->MatchDevice(0x1111, 0x0002, 0x0150, &quirks, &comment));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkExtraResetDelay | kUSBQuirkSkipStringDescriptors);
+	CHECK_EQUAL(quirks.resetDelayMS, 75);
+	CHECK(!strcmp(comment, "one release"));
+
+	table->release();
+	array->release();
+}
+
+
+
+static void
+TestDeviceParsing(void)
+{
+	OSArray				*array = OSArray::withCapacity(8);
+	IOUSBQuirks			*table;
+	IOUSBDeviceQuirks	quirks;
+	OSDictionary		*dict;
+
+	Add(array, DeviceEntry(0x10000, -1, -1, -1, 10, "vendor too big"));
+	Add(array, DeviceEntry(0x2222, 0x10000, -1, -1, 10, "product too big"));
+	Add(array, DeviceEntry(0x2222, -1, 0x10000, -1, 10, "low too big"));			// used to be truncated to 0 and match everything
+	Add(array, DeviceEntry(0x2222, -1, -1, 0x1FFFF, 10, "high too big"));
+	Add(array, DeviceEntry(0x2222, -1, 0x0200, 0x0100, 10, "empty range"));
+	Add(array, DeviceEntry(0x2222, -1, -1, -1, 0, "no quirks"));
+	Add(array, DeviceEntry(0x2222, 0x0001, -1, -1, 60000, "long delay"));
+	Add(array, DeviceEntry(0x2222, 0x0002, -1, -1, 0, "force configuration"));
+	dict = OSDynamicCast(OSDictionary, array->getObject(7));
+	SetNumber(dict, kUSBQuirkForceConfigurationKey, 2);
+	Add(array, OSDictionary::withCapacity(1));										// neither kind
+	Add(array, DeviceEntry(0x2222, 0x0003, -1, -1, 0, "configuration too big"));
+	dict = OSDynamicCast(OSDictionary, array->getObject(9));
+	SetNumber(dict, kUSBQuirkForceConfigurationKey, 0x100);
+
+	table = IOUSBQuirks::withArray(array);
+	CHECK(table != NULL);
+	CHECK_EQUAL(table->GetNumDeviceEntries(), 2);
+	CHECK_EQUAL(table->GetNumControllerEntries(), 0);
+
+	CHECK(!table->MatchDevice(0x2222, 0x0009, 0x0000, &quirks));
+
+	CHECK(table->MatchDevice(0x2222, 0x0001, 0x0000, &quirks));
+	CHECK_EQUAL(quirks.resetDelayMS, kUSBQuirksMaxResetDelayMS);
+
+	CHECK(table->MatchDevice(0x2222, 0x0002, 0x0000, &quirks));
+	CHECK_EQUAL(quirks.quirks, kUSBQuirkForceConfiguration);
+	CHECK_EQUAL(quirks.configValue, 2);
+
+	table->release();
+	array->release();
+}
+
+
+
+static void
+TestControllerMatching(void)
+{
+	OSArray				*array = OSArray::withCapacity(6);
+	IOUSBQuirks			*table;
+	const char			*comment = NULL;
+
+	Add(array, ControllerEntry(0x8086, -1, -1, -1, 0x1));
+	Add(array, ControllerEntry(0x8086, 0x2934, 0x02, 0x03, 0x2));
+	SetString(OSDynamicCast(OSDictionary, array->getObject(1)), kUSBQuirkCommentKey, "rev 2 and 3");
+	Add(array, ControllerEntry(0x8086, 0x2935, 0x100, -1, 0x4));						// used to be truncated to 0
+	Add(array, ControllerEntry(0x8086, 0x2935, -1, 0x1FF, 0x8));
+	Add(array, ControllerEntry(0x8086, 0x2936, 0x05, 0x04, 0x10));
+	Add(array, ControllerEntry(0x8086, 0x2937, -1, -1, 0));							// no errata
+
+	table = IOUSBQuirks::withArray(array);
+	CHECK(table != NULL);
+	CHECK_EQUAL(table->GetNumControllerEntries(), 2);
+
+	CHECK_EQUAL(table->MatchController(0x8086, 0x2934, 0x01, &comment), 0x1);
+	CHECK_EQUAL(table->MatchController(0x8086, 0x2934, 0x02, &comment), 0x3);
+	CHECK(!strcmp(comment, "rev 2 and 3"));
+	CHECK_EQUAL(table->MatchController(0x8086, 0x2934, 0x03, NULL), 0x3);
+	CHECK_EQUAL(table->MatchController(0x8086, 0x2934, 0x04, NULL), 0x1);
+	CHECK_EQUAL(table->MatchController(0x8086, 0x2935, 0x00, NULL), 0x1);
+	CHECK_EQUAL(table->MatchController(0x1106, 0x3038, 0x00, NULL), 0);
+
+	table->release();
+	array->release();
+}
+
+
+
+static void
+TestLimitsAndFailure(void)
+{
+	OSArray				*array = OSArray::withCapacity(kUSBQuirksMaxEntries + 10);
+	IOUSBQuirks			*table;
+	UInt32				before = ShimOutstandingAllocations();
+	UInt32				i;
+
+	for (i = 0; i < kUSBQuirksMaxEntries + 10; i++)
+		Add(array, DeviceEntry(0x3333, i, -1, -1, 10, NULL));
+
+	table = IOUSBQuirks::withArray(array);
+	CHECK(table != NULL);
+	CHECK_EQUAL(table->GetNumDeviceEntries(), kUSBQuirksMaxEntries);
+	table->release();
+	CHECK_EQUAL(ShimOutstandingAllocations(), before);
+
+	// the second entry array can't be had - free() has to give the first one back with the size it was allocated with
+	ShimFailAllocation(1);
+	table = IOUSBQuirks::withArray(array);
+	CHECK(table == NULL);
+	CHECK_EQUAL(ShimOutstandingAllocations(), before);
+
+	CHECK(IOUSBQuirks::withArray(NULL) == NULL);
+	array->release();
+}
+
+
+TEST_MAIN("IOUSBQuirks", TestCatalogueLoad, TestDeviceMatching, TestDeviceParsing, TestControllerMatching, TestLimitsAndFailure)
@@ -0,0 +1,805 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ Host tests for the UHCI and OHCI schedule models. Each builds the schedule its UIM's HardwareInit builds, in real memory blocks, and
+ checks that the model walks all of it. Then transfers are queued the way the UIMs queue them, and the schedule is broken in the ways
+ a UIM bug would break it - a dropped link, a link to the wrong kind of element, a loop, reserved bits - to see that each one is caught
+ and pinned on the right element. The walk of the whole schedule is timed, as a debug UIM runs it on every schedule change.
+*/
+
+#include <time.h>
+
+#include <IOKit/IOLib.h>
+#include <IOKit/usb/IOUSBControllerMemoryBlock.h>
+
+#include "UHCIScheduleModel.h"
+#include "OHCIScheduleModel.h"
+#include "USBTest.h"
+
+
+class TestBlock : public IOUSBControllerMemoryBlock
+{
+	OSDeclareDefaultStructors(TestBlock)
+
+public:
+	bool			Init(UInt32 elementSize, UInt32 alignment, UInt32 reservedElements)
+					{ return initWithElements(elementSize, alignment, 0, reservedElements, kUSBControllerMemoryBlockPhysicalMask); }
+};
+
+OSDefineMetaClassAndStructors(TestBlock, IOUSBControllerMemoryBlock)
+
+// a UIM style list of blocks, handing out elements in order and adding a block when the last one is full
+struct TestPool
+{
+	UInt32							elementSize;
+	UInt32							alignment;
+	UInt32							reservedElements;
+	IOUSBControllerMemoryBlock *	head;
+	UInt32							next;
+};
+
+enum
+{
+	kUHCIIntrQHs			= 6,				// as kUHCI_NINTR_QHS
+	kUHCIRolloverSlot		= kUHCI_FRAME_COUNT - 1,
+	kOHCIIntrNodes			= 63,
+	kOHCIIntrLeaves			= 32,
+	kBenchmarkPasses		= 100
+};
+
+static const IOPhysicalAddress	kAnyElement = 0xFFFFFFFF;		// a loop is caught wherever the walk runs out of elements, somewhere on the loop
+
+
+
+static UInt64
+NowNS(void)
+{
+	struct timespec		now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((UInt64)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+
+
+static void
+InitPool(TestPool *pool, UInt32 elementSize, UInt32 alignment, UInt32 reservedElements)
+{
+	pool->elementSize = elementSize;
+	pool->alignment = alignment;
+	pool->reservedElements = reservedElements;
+	pool->head = NULL;
+	pool->next = 0;
+}
+
+
+
+static IOPhysicalAddress
+Allocate(TestPool *pool)
+{
+	TestBlock		*block;
+	UInt32			index;
+
+	if (!pool->head || (pool->next == pool->head->NumElements()))
+	{
+		block = new TestBlock;
+		if (!block->Init(pool->elementSize, pool->alignment, pool->reservedElements))
+		{
+			block->release();
+			return 0;
+		}
+		block->SetNextMemoryBlock(pool->head);
+		pool->head = block;
+		pool->next = 0;
+	}
+	index = pool->next++;
+	bzero(pool->head->GetElementLogicalPtr(index), pool->elementSize);
+	return pool->head->GetElementPhysicalPtr(index);
+}
+
+
+
+static void *
+Logical(TestPool *pool, IOPhysicalAddress addr)
+{
+	IOUSBControllerMemoryBlock	*block = IOUSBControllerMemoryBlock::FindBlockForPhysical(pool->head, addr);
+
+	return block ? block->PhysicalToLogical(addr) : NULL;
+}
+
+
+
+static void
+FreePool(TestPool *pool)
+{
+	IOUSBControllerMemoryBlock	*next;
+
+	while (pool->head)
+	{
+		next = pool->head->GetNextMemoryBlock();
+		pool->head->release();
+		pool->head = next;
+	}
+}
+
+
+
+#pragma mark UHCI
+
+struct UHCITestSchedule
+{
+	TestPool				tds;
+	TestPool				qhs;
+	UInt32					frameList[kUHCI_FRAME_COUNT];
+	IOPhysicalAddress		lastQH;
+	IOPhysicalAddress		bulkQH;
+	IOPhysicalAddress		fsQH;
+	IOPhysicalAddress		lsQH;
+	IOPhysicalAddress		intrQH[kUHCIIntrQHs];
+	IOPhysicalAddress		rolloverTD;
+	UHCIScheduleModel		model;
+};
+
+
+
+static UHCIQueueHeadSharedPtr
+QH(UHCITestSchedule *s, IOPhysicalAddress addr)
+{
+	return (UHCIQueueHeadSharedPtr)Logical(&s->qhs, addr);
+}
+
+
+
+static UHCITransferDescriptorSharedPtr
+TD(UHCITestSchedule *s, IOPhysicalAddress addr)
+{
+	return (UHCITransferDescriptorSharedPtr)Logical(&s->tds, addr);
+}
+
+
+
+static IOPhysicalAddress
+NewQH(UHCITestSchedule *s, UInt32 hlink)
+{
+	IOPhysicalAddress	qh = Allocate(&s->qhs);
+
+	QH(s, qh)->hlink = HostToUSBLong(hlink);
+	QH(s, qh)->elink = HostToUSBLong(kUHCI_QH_T);
+	return qh;
+}
+
+
+
+// as AppleUSBUHCI::HardwareInit
+static void
+BuildUHCISchedule(UHCITestSchedule *s)
+{
+	IOPhysicalAddress	previous;
+	UInt32				period, i, j;
+
+	InitPool(&s->tds, sizeof(UHCITransferDescriptorShared), kUHCI_TD_ALIGN, 0);
+	InitPool(&s->qhs, sizeof(UHCIQueueHeadShared), kUHCI_QH_ALIGN, 0);
+
+	s->lastQH = NewQH(s, kUHCI_QH_T);
+	s->bulkQH = NewQH(s, s->lastQH | kUHCI_QH_Q);
+	s->fsQH = NewQH(s, s->bulkQH | kUHCI_QH_Q);
+	s->lsQH = NewQH(s, s->fsQH | kUHCI_QH_Q);
+
+	previous = s->lsQH;
+	for (i = 0; i < kUHCIIntrQHs; i++)
+	{
+		s->intrQH[i] = NewQH(s, previous | kUHCI_QH_Q);
+		period = 1 << i;
+		for (j = period - 1; j < kUHCI_FRAME_COUNT; j += period)
+			s->frameList[j] = HostToUSBLong(s->intrQH[i] | kUHCI_QH_Q);
+		previous = s->intrQH[i];
+	}
+
+	s->rolloverTD = Allocate(&s->tds);
+	TD(s, s->rolloverTD)->ctrlStatus = HostToUSBLong(kUHCI_TD_IOC);
+	TD(s, s->rolloverTD)->link = s->frameList[kUHCIRolloverSlot];
+	s->frameList[kUHCIRolloverSlot] = HostToUSBLong(s->rolloverTD);
+
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->fsQH | kUHCI_QH_Q | kUHCI_QH_T);
+
+	s->model.tdBlocks = s->tds.head;
+	s->model.qhBlocks = s->qhs.head;
+	s->model.lastQH = s->lastQH;
+	s->model.reclamationQH = s->fsQH;
+}
+
+
+
+static void
+FreeUHCISchedule(UHCITestSchedule *s)
+{
+	FreePool(&s->tds);
+	FreePool(&s->qhs);
+}
+
+
+
+// count TDs on a new QH which goes in after the QH at "after", each depth first to the next
+static IOPhysicalAddress
+InsertUHCIQueue(UHCITestSchedule *s, IOPhysicalAddress after, UInt32 count, IOPhysicalAddress *tds)
+{
+	IOPhysicalAddress	qh = NewQH(s, USBToHostLong(QH(s, after)->hlink));
+	UInt32				link = kUHCI_TD_T;
+	UInt32				i;
+
+	for (i = count; i-- > 0; )
+	{
+		tds[i] = Allocate(&s->tds);
+		TD(s, tds[i])->ctrlStatus = HostToUSBLong(kUHCI_TD_ACTIVE);
+		TD(s, tds[i])->link = HostToUSBLong(link);
+		link = tds[i] | kUHCI_TD_VF;
+	}
+	QH(s, qh)->elink = HostToUSBLong(count ? tds[0] : kUHCI_QH_T);
+	QH(s, after)->hlink = HostToUSBLong(qh | kUHCI_QH_Q);
+	return qh;
+}
+
+
+
+// the QHs each slot goes through on the way to the last one, and its TDs
+static void
+ExpectedUHCIWalk(UInt32 *qhs, UInt32 *tds)
+{
+	UInt32		slot, level;
+
+	*qhs = 0;
+	*tds = 0;
+	for (slot = 0; slot < kUHCI_FRAME_COUNT; slot++)
+	{
+		for (level = kUHCIIntrQHs - 1; ((slot + 1) % (1 << level)) != 0; level--)
+			;
+		*qhs += level + 1 + 4;
+		if (slot == kUHCIRolloverSlot)
+			*tds += 1;
+	}
+}
+
+
+
+// every slot walked all the way to the last QH
+static void
+CheckUHCISlots(UHCITestSchedule *s, UInt32 qhs, UInt32 tds)
+{
+	UHCIScheduleWalk	walk;
+	UInt32				slot, slotQHs = 0, slotTDs = 0, errors = 0;
+
+	for (slot = 0; slot < kUHCI_FRAME_COUNT; slot++)
+	{
+		errors += (UHCICheckScheduleSlot(&s->model, s->frameList, slot, &walk) != kUHCIScheduleOK);
+		slotQHs += walk.qhs;
+		slotTDs += walk.tds;
+	}
+	CHECK_EQUAL(errors, 0);
+	CHECK_EQUAL(slotQHs, qhs);
+	CHECK_EQUAL(slotTDs, tds);
+}
+
+
+
+static void
+TestUHCIInitialSchedule(void)
+{
+	UHCITestSchedule	*s = new UHCITestSchedule;
+	UHCIScheduleWalk	walk;
+	UInt32				qhs, tds;
+
+	BuildUHCISchedule(s);
+	ExpectedUHCIWalk(&qhs, &tds);
+	CheckUHCISlots(s, qhs, tds);
+
+	// the slowest interrupt QH's slots go through every interrupt QH
+	CHECK_EQUAL(UHCICheckScheduleSlot(&s->model, s->frameList, 31, &walk), kUHCIScheduleOK);
+	CHECK_EQUAL(walk.qhs, kUHCIIntrQHs + 4);
+
+	// and the whole schedule only goes through each of the shared QHs once
+	CHECK_EQUAL(UHCICheckSchedule(&s->model, s->frameList, kUHCI_FRAME_COUNT, &walk), kUHCIScheduleOK);
+	CHECK_EQUAL(walk.qhs, kUHCIIntrQHs + 4);
+	CHECK_EQUAL(walk.tds, 1);
+
+	// the reclamation loop, open and closed again
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->fsQH | kUHCI_QH_Q);
+	CHECK_EQUAL(UHCICheckSchedule(&s->model, s->frameList, kUHCI_FRAME_COUNT, &walk), kUHCIScheduleOK);
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->fsQH | kUHCI_QH_Q | kUHCI_QH_T);
+
+	// the UIM stops every frame for sleep by setting T in each slot
+	for (UInt32 slot = 0; slot < kUHCI_FRAME_COUNT; slot++)
+		s->frameList[slot] |= HostToUSBLong(kUHCI_FRAME_T);
+	CHECK_EQUAL(UHCICheckSchedule(&s->model, s->frameList, kUHCI_FRAME_COUNT, &walk), kUHCIScheduleOK);
+	CHECK_EQUAL(walk.qhs, 0);
+
+	FreeUHCISchedule(s);
+	delete s;
+}
+
+
+
+static void
+TestUHCITransfers(void)
+{
+	UHCITestSchedule	*s = new UHCITestSchedule;
+	UHCIScheduleWalk	walk;
+	IOPhysicalAddress	controlTDs[3], bulkTDs[300], intrTDs[1], isoch;
+	UInt32				qhs, tds, slot;
+
+	BuildUHCISchedule(s);
+	ExpectedUHCIWalk(&qhs, &tds);
+
+	// a control transfer on a full speed device, a long bulk transfer which takes a second TD block, and an interrupt endpoint every 8 ms
+	InsertUHCIQueue(s, s->fsQH, 3, controlTDs);
+	InsertUHCIQueue(s, s->bulkQH, 300, bulkTDs);
+	InsertUHCIQueue(s, s->intrQH[3], 1, intrTDs);
+	qhs += 2 * kUHCI_FRAME_COUNT;
+	tds += (3 + 300) * kUHCI_FRAME_COUNT;
+	for (slot = 0; slot < kUHCI_FRAME_COUNT; slot++)
+	{
+		if (((slot + 1) % 8) == 0)
+		{
+			qhs++;
+			tds++;
+		}
+	}
+
+	// and isoch TDs at the front of 10 slots, the way the UIM puts them ahead of the interrupt tree
+	for (slot = 100; slot < 110; slot++)
+	{
+		isoch = Allocate(&s->tds);
+		TD(s, isoch)->ctrlStatus = HostToUSBLong(kUHCI_TD_ISO | kUHCI_TD_ACTIVE);
+		TD(s, isoch)->link = s->frameList[slot];
+		s->frameList[slot] = HostToUSBLong(isoch);
+		tds++;
+	}
+	CHECK(s->tds.head->GetNextMemoryBlock() != NULL);
+
+	// the UIM only adds blocks to the front of its lists, so the model's heads have to follow
+	s->model.tdBlocks = s->tds.head;
+	s->model.qhBlocks = s->qhs.head;
+	CheckUHCISlots(s, qhs, tds);
+	CHECK_EQUAL(UHCICheckSchedule(&s->model, s->frameList, kUHCI_FRAME_COUNT, &walk), kUHCIScheduleOK);
+	CHECK_EQUAL(walk.qhs, kUHCIIntrQHs + 4 + 3);
+	CHECK_EQUAL(walk.tds, 1 + 10 + 3 + 300 + 1);
+
+	FreeUHCISchedule(s);
+	delete s;
+}
+
+
+
+static void
+CheckUHCIError(UHCITestSchedule *s, UHCIScheduleError error, UInt32 slot, IOPhysicalAddress element)
+{
+	UHCIScheduleWalk	walk;
+
+	s->model.tdBlocks = s->tds.head;
+	s->model.qhBlocks = s->qhs.head;
+	CHECK_EQUAL(UHCICheckSchedule(&s->model, s->frameList, kUHCI_FRAME_COUNT, &walk), error);
+	CHECK_EQUAL(walk.error, error);
+	CHECK_EQUAL(walk.slot, slot);
+	if (element != kAnyElement)
+		CHECK_EQUAL(walk.element, element);
+}
+
+
+
+static void
+TestUHCICorruption(void)
+{
+	UHCITestSchedule	*s = new UHCITestSchedule;
+	IOPhysicalAddress	tds[3], qh, td;
+	UInt32				saved;
+
+	BuildUHCISchedule(s);
+
+	// a QH linked as a TD, a TD linked as a QH, and somewhere which is neither
+	saved = QH(s, s->lsQH)->hlink;
+	QH(s, s->lsQH)->hlink = HostToUSBLong(s->fsQH);
+	CheckUHCIError(s, kUHCIScheduleNotTD, 0, s->lsQH);
+	QH(s, s->lsQH)->hlink = HostToUSBLong(s->rolloverTD | kUHCI_QH_Q);
+	CheckUHCIError(s, kUHCIScheduleNotQH, 0, s->lsQH);
+	QH(s, s->lsQH)->hlink = HostToUSBLong(0x10 | kUHCI_QH_Q);
+	CheckUHCIError(s, kUHCIScheduleNotQH, 0, s->lsQH);
+	QH(s, s->lsQH)->hlink = saved;
+
+	// a frame list slot pointing half way into a QH
+	saved = s->frameList[7];
+	s->frameList[7] = HostToUSBLong((s->intrQH[3] + 8) | kUHCI_FRAME_Q);
+	CheckUHCIError(s, kUHCIScheduleReservedBits, 7, 0);
+	s->frameList[7] = saved;
+
+	// the control QHs dropped out of the schedule, and a bulk QH which links back to the control QHs instead of going on
+	saved = QH(s, s->fsQH)->hlink;
+	QH(s, s->fsQH)->hlink = HostToUSBLong(kUHCI_QH_T);
+	CheckUHCIError(s, kUHCIScheduleNoLastQH, 0, s->fsQH);
+	QH(s, s->fsQH)->hlink = saved;
+	saved = QH(s, s->bulkQH)->hlink;
+	QH(s, s->bulkQH)->hlink = HostToUSBLong(s->lsQH | kUHCI_QH_Q);
+	CheckUHCIError(s, kUHCIScheduleLoop, 0, kAnyElement);
+	QH(s, s->bulkQH)->hlink = saved;
+
+	// a reclamation loop to the wrong QH, to one which this frame never went through, and one which lost its Q bit
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->bulkQH | kUHCI_QH_Q);
+	CheckUHCIError(s, kUHCIScheduleBadReclamation, 0, s->lastQH);
+	qh = NewQH(s, s->fsQH | kUHCI_QH_Q);
+	s->model.reclamationQH = qh;
+	QH(s, s->lastQH)->hlink = HostToUSBLong(qh | kUHCI_QH_Q);
+	CheckUHCIError(s, kUHCIScheduleBadReclamation, 0, s->lastQH);
+	s->model.reclamationQH = s->fsQH;
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->fsQH);
+	CheckUHCIError(s, kUHCIScheduleBadReclamation, 0, s->lastQH);
+	QH(s, s->lastQH)->hlink = HostToUSBLong(s->fsQH | kUHCI_QH_Q | kUHCI_QH_T);
+
+	// a queue whose TDs loop, one which runs on into a QH, and one with a reserved bit set
+	qh = InsertUHCIQueue(s, s->fsQH, 3, tds);
+	CheckUHCIError(s, kUHCIScheduleOK, kUHCI_FRAME_COUNT - 1, 0);
+	TD(s, tds[2])->link = HostToUSBLong(tds[0] | kUHCI_TD_VF);
+	CheckUHCIError(s, kUHCIScheduleLoop, 0, qh);
+	TD(s, tds[2])->link = HostToUSBLong(s->bulkQH | kUHCI_TD_Q);
+	CheckUHCIError(s, kUHCIScheduleNestedQH, 0, tds[2]);
+	TD(s, tds[2])->link = HostToUSBLong(kUHCI_TD_T | 8);
+	CheckUHCIError(s, kUHCIScheduleOK, kUHCI_FRAME_COUNT - 1, 0);
+	TD(s, tds[1])->link = HostToUSBLong(tds[2] | 8);
+	CheckUHCIError(s, kUHCIScheduleReservedBits, 0, tds[1]);
+	TD(s, tds[1])->link = HostToUSBLong(tds[2] | kUHCI_TD_VF);
+
+	// an isoch TD which loops back on the one before it, only in the slots it was put in
+	td = Allocate(&s->tds);
+	TD(s, td)->link = s->frameList[500];
+	s->frameList[500] = HostToUSBLong(td);
+	TD(s, s->rolloverTD)->link = HostToUSBLong(s->rolloverTD);
+	TD(s, td)->link = HostToUSBLong(td);
+	CheckUHCIError(s, kUHCIScheduleLoop, 500, kAnyElement);
+
+	FreeUHCISchedule(s);
+	delete s;
+}
+
+
+
+#pragma mark OHCI
+
+struct OHCITestSchedule
+{
+	TestPool				eds;
+	TestPool				gtds;
+	TestPool				itds;
+	UInt32					interruptTable[kOHCIIntrLeaves];
+	IOPhysicalAddress		intrNode[kOHCIIntrNodes];
+	IOPhysicalAddress		isochHead;
+	IOPhysicalAddress		isochTail;
+	IOPhysicalAddress		controlHead;
+	IOPhysicalAddress		controlTail;
+	IOPhysicalAddress		bulkHead;
+	IOPhysicalAddress		bulkTail;
+	OHCIScheduleModel		model;
+};
+
+
+
+static OHCIEndpointDescriptorSharedPtr
+ED(OHCITestSchedule *s, IOPhysicalAddress addr)
+{
+	return (OHCIEndpointDescriptorSharedPtr)Logical(&s->eds, addr);
+}
+
+
+
+static OHCIGeneralTransferDescriptorSharedPtr
+GTD(OHCITestSchedule *s, IOPhysicalAddress addr)
+{
+	return (OHCIGeneralTransferDescriptorSharedPtr)Logical(&s->gtds, addr);
+}
+
+
+
+static OHCIIsochTransferDescriptorSharedPtr
+ITD(OHCITestSchedule *s, IOPhysicalAddress addr)
+{
+	return (OHCIIsochTransferDescriptorSharedPtr)Logical(&s->itds, addr);
+}
+
+
+
+// an ED with its dummy TD, which is both its head and its tail while it has nothing queued
+static IOPhysicalAddress
+NewED(OHCITestSchedule *s, UInt32 flags, IOPhysicalAddress next)
+{
+	IOPhysicalAddress	ed = Allocate(&s->eds);
+	IOPhysicalAddress	td = (flags & kOHCIEDControl_F) ? Allocate(&s->itds) : Allocate(&s->gtds);
+
+	ED(s, ed)->flags = HostToUSBLong(flags);
+	ED(s, ed)->tdQueueHeadPtr = HostToUSBLong(td);
+	ED(s, ed)->tdQueueTailPtr = HostToUSBLong(td);
+	ED(s, ed)->nextED = HostToUSBLong(next);
+	return ed;
+}
+
+
+
+// the interrupt tree is 32 leaves, one for each HCCA entry, and each level links on into the one with half as many nodes
+static void
+BuildOHCISchedule(OHCITestSchedule *s)
+{
+	int		level, first, count, parent, i;
+
+	InitPool(&s->eds, sizeof(OHCIEndpointDescriptorShared), kOHCIEDAlignment, 0);
+	InitPool(&s->gtds, sizeof(OHCIGeneralTransferDescriptorShared), kOHCIGTDAlignment, 1);
+	InitPool(&s->itds, sizeof(OHCIIsochTransferDescriptorShared), kOHCIITDAlignment, 1);
+
+	s->isochTail = NewED(s, kOHCIEDControl_K | kOHCIEDControl_F, 0);
+	s->isochHead = NewED(s, kOHCIEDControl_K | kOHCIEDControl_F, s->isochTail);
+	s->controlTail = NewED(s, kOHCIEDControl_K, 0);
+	s->controlHead = NewED(s, kOHCIEDControl_K, s->controlTail);
+	s->bulkTail = NewED(s, kOHCIEDControl_K, 0);
+	s->bulkHead = NewED(s, kOHCIEDControl_K, s->bulkTail);
+
+	// the root is the last node, and the leaves the first 32
+	s->intrNode[kOHCIIntrNodes - 1] = NewED(s, kOHCIEDControl_K, s->isochHead);
+	for (count = 2, first = kOHCIIntrNodes - 3, level = 1; count <= kOHCIIntrLeaves; first -= count * 2, count *= 2, level++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			parent = first + count + (i / 2);
+			s->intrNode[first + i] = NewED(s, kOHCIEDControl_K, s->intrNode[parent]);
+		}
+	}
+	for (i = 0; i < kOHCIIntrLeaves; i++)
+		s->interruptTable[i] = HostToUSBLong(s->intrNode[i]);
+
+	s->model.edBlocks = s->eds.head;
+	s->model.gtdBlocks = s->gtds.head;
+	s->model.itdBlocks = s->itds.head;
+	s->model.periodicTailED = s->isochTail;
+	s->model.stoppedEDsOnly = false;
+}
+
+
+
+static void
+FreeOHCISchedule(OHCITestSchedule *s)
+{
+	FreePool(&s->eds);
+	FreePool(&s->gtds);
+	FreePool(&s->itds);
+}
+
+
+
+static OHCIScheduleError
+CheckOHCI(OHCITestSchedule *s, OHCIScheduleWalk *walk)
+{
+	s->model.edBlocks = s->eds.head;
+	s->model.gtdBlocks = s->gtds.head;
+	s->model.itdBlocks = s->itds.head;
+	return OHCICheckSchedule(&s->model, s->interruptTable, s->controlHead, s->bulkHead, walk);
+}
+
+
+
+// a running ED after "after" with count TDs queued ahead of its dummy tail
+static IOPhysicalAddress
+InsertOHCIEndpoint(OHCITestSchedule *s, IOPhysicalAddress after, UInt32 flags, UInt32 count, IOPhysicalAddress *tds)
+{
+	IOPhysicalAddress	ed = NewED(s, flags, USBToHostLong(ED(s, after)->nextED));
+	bool				isoch = (flags & kOHCIEDControl_F) != 0;
+	IOPhysicalAddress	next = USBToHostLong(ED(s, ed)->tdQueueTailPtr);
+	UInt32				i;
+
+	for (i = count; i-- > 0; )
+	{
+		tds[i] = isoch ? Allocate(&s->itds) : Allocate(&s->gtds);
+		if (isoch)
+			ITD(s, tds[i])->nextTD = HostToUSBLong(next);
+		else
+			GTD(s, tds[i])->nextTD = HostToUSBLong(next);
+		next = tds[i];
+	}
+	ED(s, ed)->tdQueueHeadPtr = HostToUSBLong(next | kOHCIHeadPointer_C);
+	ED(s, after)->nextED = HostToUSBLong(ed);
+	return ed;
+}
+
+
+
+static void
+TestOHCIInitialSchedule(void)
+{
+	OHCITestSchedule	*s = new OHCITestSchedule;
+	OHCIScheduleWalk	walk;
+
+	BuildOHCISchedule(s);
+
+	// each entry goes through a node at each of the 6 levels and then the two isoch EDs, and control and bulk are two each
+	CHECK_EQUAL(CheckOHCI(s, &walk), kOHCIScheduleOK);
+	CHECK_EQUAL(walk.eds, (kOHCIIntrLeaves * (6 + 2)) + 2 + 2);
+	CHECK_EQUAL(walk.tds, 0);
+
+	// an empty control list is fine, but the periodic list has to get to its tail
+	CHECK_EQUAL(OHCICheckScheduleList(&s->model, 0, 0, &walk), kOHCIScheduleOK);
+	CHECK_EQUAL(OHCICheckScheduleList(&s->model, 0, s->isochTail, &walk), kOHCIScheduleNoTail);
+
+	FreeOHCISchedule(s);
+	delete s;
+}
+
+
+
+static void
+TestOHCITransfers(void)
+{
+	OHCITestSchedule	*s = new OHCITestSchedule;
+	OHCIScheduleWalk	walk;
+	IOPhysicalAddress	controlTDs[3], bulkTDs[300], intrTDs[2], isochTDs[4];
+
+	BuildOHCISchedule(s);
+
+	InsertOHCIEndpoint(s, s->controlHead, 0, 3, controlTDs);
+	InsertOHCIEndpoint(s, s->bulkHead, 0, 300, bulkTDs);
+	InsertOHCIEndpoint(s, s->intrNode[32 + 16 + 2], 0, 2, intrTDs);			// a node 8 ms down the tree, which 4 of the leaves go through
+	InsertOHCIEndpoint(s, s->isochHead, kOHCIEDControl_F, 4, isochTDs);
+	CHECK(s->gtds.head->GetNextMemoryBlock() != NULL);
+
+	CHECK_EQUAL(CheckOHCI(s, &walk), kOHCIScheduleOK);
+	CHECK_EQUAL(walk.eds, (kOHCIIntrLeaves * (6 + 2 + 1)) + 4 + 3 + 3);
+	CHECK_EQUAL(walk.tds, (kOHCIIntrLeaves * 4) + (4 * 2) + 3 + 300);
+
+	FreeOHCISchedule(s);
+	delete s;
+}
+
+
+
+static void
+CheckOHCIError(OHCITestSchedule *s, OHCIScheduleError error, IOPhysicalAddress list, IOPhysicalAddress element)
+{
+	OHCIScheduleWalk	walk;
+
+	CHECK_EQUAL(CheckOHCI(s, &walk), error);
+	CHECK_EQUAL(walk.error, error);
+	CHECK_EQUAL(walk.list, list);
+	if (element != kAnyElement)
+		CHECK_EQUAL(walk.element, element);
+}
+
+
+
+static void
+TestOHCICorruption(void)
+{
+	OHCITestSchedule	*s = new OHCITestSchedule;
+	IOPhysicalAddress	tds[3], isochTDs[2], ed, isochED;
+	UInt32				saved;
+
+	BuildOHCISchedule(s);
+	ed = InsertOHCIEndpoint(s, s->bulkHead, 0, 3, tds);
+	isochED = InsertOHCIEndpoint(s, s->isochHead, kOHCIEDControl_F, 2, isochTDs);
+	CheckOHCIError(s, kOHCIScheduleOK, s->bulkHead, 0);
+
+	// an ED linked to a TD, and an ED list with reserved bits in a link
+	saved = ED(s, s->controlHead)->nextED;
+	ED(s, s->controlHead)->nextED = HostToUSBLong(tds[0]);
+	CheckOHCIError(s, kOHCIScheduleNotED, s->controlHead, s->controlHead);
+	ED(s, s->controlHead)->nextED = HostToUSBLong(s->controlTail | 4);
+	CheckOHCIError(s, kOHCIScheduleReservedBits, s->controlHead, s->controlHead);
+	ED(s, s->controlHead)->nextED = saved;
+
+	// a node of the interrupt tree which lost its link on, so 2 of the leaves never get to the isoch EDs, and a loop in the bulk list
+	saved = ED(s, s->intrNode[32 + 5])->nextED;
+	ED(s, s->intrNode[32 + 5])->nextED = 0;
+	CheckOHCIError(s, kOHCIScheduleNoTail, s->intrNode[10], s->intrNode[32 + 5]);
+	ED(s, s->intrNode[32 + 5])->nextED = saved;
+	saved = ED(s, s->bulkTail)->nextED;
+	ED(s, s->bulkTail)->nextED = HostToUSBLong(s->bulkHead);
+	CheckOHCIError(s, kOHCIScheduleLoop, s->bulkHead, kAnyElement);
+	ED(s, s->bulkTail)->nextED = saved;
+
+	// TDs which end before the tail, loop, or run into the isoch TDs, and a head pointer with reserved bits
+	GTD(s, tds[1])->nextTD = 0;
+	CheckOHCIError(s, kOHCIScheduleNoTail, s->bulkHead, tds[1]);
+	GTD(s, tds[1])->nextTD = HostToUSBLong(tds[0]);
+	CheckOHCIError(s, kOHCIScheduleLoop, s->bulkHead, ed);
+	GTD(s, tds[1])->nextTD = HostToUSBLong(isochTDs[0]);
+	CheckOHCIError(s, kOHCIScheduleNotTD, s->bulkHead, tds[1]);
+	GTD(s, tds[1])->nextTD = HostToUSBLong(tds[2]);
+	saved = ED(s, ed)->tdQueueHeadPtr;
+	ED(s, ed)->tdQueueHeadPtr = HostToUSBLong(tds[0] | 8);
+	CheckOHCIError(s, kOHCIScheduleReservedBits, s->bulkHead, ed);
+	ED(s, ed)->tdQueueHeadPtr = saved;
+
+	// an isoch TD linked half way into the next one, which is on a GTD boundary but not an ITD one
+	ITD(s, isochTDs[0])->nextTD = HostToUSBLong(isochTDs[1] + 16);
+	CheckOHCIError(s, kOHCIScheduleReservedBits, s->interruptTable[0], isochTDs[0]);
+	ITD(s, isochTDs[0])->nextTD = HostToUSBLong(isochTDs[1]);
+	saved = ED(s, isochED)->tdQueueTailPtr;
+	ED(s, isochED)->tdQueueTailPtr = HostToUSBLong(tds[2]);
+	CheckOHCIError(s, kOHCIScheduleNotTD, s->interruptTable[0], isochED);
+	ED(s, isochED)->tdQueueTailPtr = saved;
+
+	// a live controller can only have the TDs of a stopped ED checked, so the broken queue is only seen once the ED is halted
+	GTD(s, tds[1])->nextTD = 0;
+	s->model.stoppedEDsOnly = true;
+	CheckOHCIError(s, kOHCIScheduleOK, s->bulkHead, 0);
+	ED(s, ed)->tdQueueHeadPtr |= HostToUSBLong(kOHCIHeadPointer_H);
+	CheckOHCIError(s, kOHCIScheduleNoTail, s->bulkHead, tds[1]);
+
+	FreeOHCISchedule(s);
+	delete s;
+}
+
+
+
+static void
+TestScheduleBenchmark(void)
+{
+	UHCITestSchedule	*uhci = new UHCITestSchedule;
+	OHCITestSchedule	*ohci = new OHCITestSchedule;
+	UHCIScheduleWalk	uhciWalk;
+	OHCIScheduleWalk	ohciWalk;
+	IOPhysicalAddress	tds[64];
+	UInt64				start, uhciNS, ohciNS;
+	int					i, errors = 0;
+
+	// a busy bus - a few devices' worth of control, bulk and interrupt queues
+	BuildUHCISchedule(uhci);
+	BuildOHCISchedule(ohci);
+	for (i = 0; i < 8; i++)
+	{
+		InsertUHCIQueue(uhci, uhci->fsQH, 2, tds);
+		InsertUHCIQueue(uhci, uhci->bulkQH, 16, tds);
+		InsertUHCIQueue(uhci, uhci->intrQH[i % kUHCIIntrQHs], 1, tds);
+		InsertOHCIEndpoint(ohci, ohci->controlHead, 0, 2, tds);
+		InsertOHCIEndpoint(ohci, ohci->bulkHead, 0, 16, tds);
+		InsertOHCIEndpoint(ohci, ohci->intrNode[i * 7], 0, 1, tds);
+	}
+	uhci->model.tdBlocks = uhci->tds.head;
+	uhci->model.qhBlocks = uhci->qhs.head;
+
+	start = NowNS();
+	for (i = 0; i < kBenchmarkPasses; i++)
+		errors += (UHCICheckSchedule(&uhci->model, uhci->frameList, kUHCI_FRAME_COUNT, &uhciWalk) != kUHCIScheduleOK);
+	uhciNS = (NowNS() - start) / kBenchmarkPasses;
+
+	start = NowNS();
+	for (i = 0; i < kBenchmarkPasses; i++)
+		errors += (CheckOHCI(ohci, &ohciWalk) != kOHCIScheduleOK);
+	ohciNS = (NowNS() - start) / kBenchmarkPasses;
+
+	CHECK_EQUAL(errors, 0);
+	printf("schedule models: UHCI visits %u QHs and %u TDs in %llu us, OHCI visits %u EDs and %u TDs in %llu us\n",
+		   (unsigned)uhciWalk.qhs, (unsigned)uhciWalk.tds, (unsigned long long)(uhciNS / 1000),
+		   (unsigned)ohciWalk.eds, (unsigned)ohciWalk.tds, (unsigned long long)(ohciNS / 1000));
+
+	FreeUHCISchedule(uhci);
+	FreeOHCISchedule(ohci);
+	delete uhci;
+	delete ohci;
+	CHECK_EQUAL(ShimOutstandingBuffers(), 0);
+}
+
+
+TEST_MAIN("ScheduleModel", TestUHCIInitialSchedule, TestUHCITransfers, TestUHCICorruption, TestOHCIInitialSchedule, TestOHCITransfers, TestOHCICorruption, TestScheduleBenchmark)
@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ A page aligned buffer with a made up physical address, for the host tests. Each buffer gets the next unused range of physical
+ addresses below physicalMask, so buffers sit one after the other as pages handed out by the kernel often do, and an address just
+ past the end of one is the start of the next. ShimOutstandingBuffers lets a test check that every buffer was released.
+*/
+
+#ifndef _IOBUFFERMEMORYDESCRIPTOR_H
+#define _IOBUFFERMEMORYDESCRIPTOR_H
+
+#include <IOKit/IOTypes.h>
+#include <IOKit/IOLib.h>
+#include <IOKit/IOMemoryDescriptor.h>
+
+enum
+{
+	kIODirectionOut					= 2,
+	kIODirectionInOut				= 3,
+	kIOMemoryUnshared				= 0x00040000,
+	kIOMemoryKernelUserShared		= 0x00010000
+};
+
+class IOBufferMemoryDescriptor : public IOMemoryDescriptor
+{
+	void *								_bytes;
+	IOByteCount							_length;
+	IOPhysicalAddress					_physical;
+
+protected:
+	virtual void						free();
+
+public:
+	static IOBufferMemoryDescriptor *	inTaskWithPhysicalMask(task_t inTask, IOOptionBits options, mach_vm_address_t capacity, mach_vm_address_t physicalMask);
+	static IOBufferMemoryDescriptor *	withOptions(IOOptionBits options, vm_size_t capacity, vm_offset_t alignment = 1)
+	{
+		return inTaskWithPhysicalMask(kernel_task, options, capacity, ~(mach_vm_address_t)0);
+	}
+
+	void *								getBytesNoCopy()		{ return _bytes; }
+	IOByteCount							getLength() const		{ return _length; }
+	IOReturn							prepare()				{ return kIOReturnSuccess; }
+	IOReturn							complete()				{ return kIOReturnSuccess; }
+
+	IOPhysicalAddress					ShimPhysicalAddress() const		{ return _physical; }
+};
+
+UInt32		ShimOutstandingBuffers(void);
+
+#endif
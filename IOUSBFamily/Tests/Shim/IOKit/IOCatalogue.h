@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The catalogue, as far as looking up personalities goes. A test adds the personalities it wants found with ShimCatalogueAdd, and
+ findDrivers returns those whose values match every string in the matching dictionary, in the order they were added. Adding or
+ resetting moves the generation count on, as loading or unloading a kext does.
+*/
+
+#ifndef __IOKIT_IOCATALOGUE_H
+#define __IOKIT_IOCATALOGUE_H
+
+#include <libkern/c++/OSContainers.h>
+
+#include <IOKit/usb/USB.h>
+
+class IOCatalogue
+{
+public:
+	OSOrderedSet *		findDrivers(OSDictionary *matching, SInt32 *generationCount);
+	SInt32				getGenerationCount(void) const;
+};
+
+extern IOCatalogue *		gIOCatalogue;
+extern const OSSymbol *		gIOProviderClassKey;
+
+void		ShimCatalogueAdd(OSDictionary *personality);
+void		ShimCatalogueReset(void);
+
+#endif
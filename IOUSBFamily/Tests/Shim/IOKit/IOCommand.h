@@ -0,0 +1,47 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+#ifndef _IOKIT_IOCOMMAND_H
+#define _IOKIT_IOCOMMAND_H
+
+#include <libkern/c++/OSObject.h>
+
+struct queue_entry
+{
+	struct queue_entry *	next;
+	struct queue_entry *	prev;
+};
+typedef struct queue_entry	queue_chain_t;
+typedef struct queue_entry	queue_head_t;
+
+class IOCommand : public OSObject
+{
+public:
+	queue_chain_t		fCommandChain;
+
+	virtual bool		init()			{ fCommandChain.next = fCommandChain.prev = &fCommandChain; return OSObject::init(); }
+};
+
+#endif
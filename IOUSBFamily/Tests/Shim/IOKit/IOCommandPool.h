@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ IOCommandPool as xnu has it: a LIFO of IOCommands, got and returned through its command gate. getCommand doesn't block here,
+ there being nobody else to return a command. A command's fCommandChain points into the queue while it is on it, and at itself
+ once it has been taken off, which is what IOUSBCommandPool looks at to catch a command returned twice.
+*/
+
+#ifndef _IOKIT_IOCOMMANDPOOL_H
+#define _IOKIT_IOCOMMANDPOOL_H
+
+#include <vector>
+
+#include <IOKit/IOCommand.h>
+#include <IOKit/IOWorkLoop.h>
+
+class IOCommandPool : public OSObject
+{
+protected:
+	queue_head_t		fQueueHead;
+	IOCommandGate *		fSerializer;
+	std::vector<IOCommand *>	_queue;
+
+	static IOReturn		gatedGetCommandAction(OSObject *owner, void *arg0, void *arg1, void *, void *)
+	{
+		return ((IOCommandPool *)owner)->gatedGetCommand((IOCommand **)arg0, (bool)(uintptr_t)arg1);
+	}
+	static IOReturn		gatedReturnCommandAction(OSObject *owner, void *arg0, void *, void *, void *)
+	{
+		return ((IOCommandPool *)owner)->gatedReturnCommand((IOCommand *)arg0);
+	}
+
+public:
+	virtual bool		initWithWorkLoop(IOWorkLoop *workLoop)
+	{
+		fQueueHead.next = fQueueHead.prev = &fQueueHead;
+		fSerializer = IOCommandGate::commandGate(this);
+		return fSerializer && (workLoop->addEventSource(fSerializer) == kIOReturnSuccess);
+	}
+
+protected:
+	virtual void		free()
+	{
+		if (fSerializer)
+		{
+			if (fSerializer->getWorkLoop())
+				fSerializer->getWorkLoop()->removeEventSource(fSerializer);
+			fSerializer->release();
+		}
+		OSObject::free();
+	}
+
+	virtual IOReturn	gatedGetCommand(IOCommand **command, bool blockForCommand)
+	{
+		if (_queue.empty())
+			return kIOReturnNoResources;
+		*command = _queue.back();
+		_queue.pop_back();
+		(*command)->fCommandChain.next = (*command)->fCommandChain.prev = &(*command)->fCommandChain;
+		return kIOReturnSuccess;
+	}
+
+	virtual IOReturn	gatedReturnCommand(IOCommand *command)
+	{
+		command->fCommandChain.next = command->fCommandChain.prev = &fQueueHead;
+		_queue.push_back(command);
+		return kIOReturnSuccess;
+	}
+
+public:
+	IOCommand *			getCommand(bool blockForCommand = true)
+	{
+		IOCommand	*command = NULL;
+
+		fSerializer->runAction(gatedGetCommandAction, &command, (void *)(uintptr_t)blockForCommand);
+		return command;
+	}
+
+	void				returnCommand(IOCommand *command)	{ fSerializer->runAction(gatedReturnCommandAction, command); }
+};
+
+#endif
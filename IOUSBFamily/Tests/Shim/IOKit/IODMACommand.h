@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ An IODMACommand which only remembers its memory descriptor, and for an IOBufferMemoryDescriptor gives its made up physical address
+ as the one segment. A test subclasses it to count them.
+*/
+
+#ifndef _IODMACOMMAND_H
+#define _IODMACOMMAND_H
+
+#include <IOKit/IOBufferMemoryDescriptor.h>
+
+#define kIODMACommandOutputHost32	NULL
+
+class IODMACommand : public OSObject
+{
+	const IOMemoryDescriptor *	_memory;
+
+public:
+	enum MappingOptions
+	{
+		kMapped					= 0x00000000,
+		kIterateOnly			= 0x00000002
+	};
+
+	struct Segment32
+	{
+		UInt32					fIOVMAddr;
+		UInt32					fLength;
+	};
+
+	static IODMACommand *		withSpecification(const void *outSegFunc, UInt8 numAddressBits, UInt64 maxSegmentSize, MappingOptions mappingOptions = kMapped)
+								{ return new IODMACommand; }
+	IOReturn					gen32IOVMSegments(UInt64 *offset, Segment32 *segments, UInt32 *numSegments);
+
+	const IOMemoryDescriptor *	getMemoryDescriptor() const							{ return _memory; }
+	IOReturn					setMemoryDescriptor(const IOMemoryDescriptor *mem)	{ _memory = mem; return kIOReturnSuccess; }
+	IOReturn					clearMemoryDescriptor()								{ _memory = NULL; return kIOReturnSuccess; }
+};
+
+#endif
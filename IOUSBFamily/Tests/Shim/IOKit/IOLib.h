@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ IOMalloc and IOFree for the host tests. IOFree checks the size it is given against the one allocated, as the kernel zone allocator
+ effectively does, and ShimOutstandingAllocations lets a test check that everything was given back. IOSleep returns at once.
+ strlcpy is here because the kernel's comes in with IOLib.h too.
+*/
+
+#ifndef __IOKIT_IOLIB_H
+#define __IOKIT_IOLIB_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include <IOKit/usb/USB.h>
+
+typedef size_t		vm_size_t;
+
+void *		IOMalloc(vm_size_t size);
+void		IOFree(void *address, vm_size_t size);
+UInt32		ShimOutstandingAllocations(void);
+void		ShimFailAllocation(UInt32 after);								// the allocation after this many more fails
+
+void		IOSleep(UInt32 milliseconds);									// doesn't sleep, only adds up what was asked for
+UInt64		ShimSleptMS(void);
+
+// formatted and handed to gShimIOLogSink if a test has set one, and printed if USB_TEST_VERBOSE is set in the environment
+void		ShimIOLog(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void		ShimIOLogv(const char *format, va_list args);
+extern void	(*gShimIOLogSink)(const char *format, va_list args);
+
+#define IOLog		ShimIOLog
+#define IOLogv		ShimIOLogv
+
+// libkern's, which older glibcs don't have
+static inline size_t ShimStrlcpy(char *dst, const char *src, size_t size)
+{
+	size_t	length = strlen(src);
+
+	if (size)
+	{
+		size_t	copy = (length < size) ? length : size - 1;
+
+		memcpy(dst, src, copy);
+		dst[copy] = 0;
+	}
+	return length;
+}
+#define strlcpy		ShimStrlcpy
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef __IOKIT_IOLOCKS_H
+#define __IOKIT_IOLOCKS_H
+
+#include <pthread.h>
+
+#include <IOKit/IOLib.h>
+
+typedef pthread_mutex_t		IOLock;
+
+IOLock *	IOLockAlloc(void);
+void		IOLockFree(IOLock *lock);
+
+#define IOLockLock(lock)		pthread_mutex_lock(lock)
+#define IOLockUnlock(lock)		pthread_mutex_unlock(lock)
+
+enum
+{
+	THREAD_UNINT			= 0,
+	THREAD_INTERRUPTIBLE	= 1
+};
+
+#define THREAD_AWAKENED			0
+
+typedef struct ShimThread *	thread_t;
+
+#define current_thread()		((thread_t)pthread_self())
+
+// every sleeper is woken by every wakeup, whatever its event, so a caller has to look again at what it was waiting for, as it must anyway
+int			IOLockSleep(IOLock *lock, void *event, UInt32 interType);
+void		IOLockWakeup(IOLock *lock, void *event, bool oneThread);
+
+UInt32		ShimLockSleepers(void);										// threads asleep in IOLockSleep just now
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+/*
+ An IOService for the host tests is somewhere to hang a work loop and properties. attach, registerService and terminate only take
+ note, so that a test can find a nub which was published and see it taken down. There is no matching. One client at a time can
+ register interest, and ShimMessage delivers a message to it as the provider would.
+*/
+
+#ifndef _IOKIT_IOSERVICE_H
+#define _IOKIT_IOSERVICE_H
+
+#include <libkern/c++/OSContainers.h>
+#include <kern/clock.h>
+
+#include <IOKit/IOLocks.h>
+#include <IOKit/IOTypes.h>
+#include <IOKit/IOWorkLoop.h>
+#include <IOKit/usb/USB.h>
+
+class IOService;
+
+typedef IOReturn (*IOServiceInterestHandler)(void *target, void *refCon, UInt32 messageType, IOService *provider, void *messageArgument, vm_size_t argSize);
+
+extern const OSSymbol *		gIOGeneralInterest;
+
+class IONotifier : public OSObject
+{
+	friend class IOService;
+
+	IOService *					_provider;
+	IOServiceInterestHandler	_handler;
+	void *						_target;
+	void *						_ref;
+
+public:
+	virtual void			remove();
+};
+
+
+class IOService : public OSObject
+{
+	friend class IONotifier;
+
+	OSDictionary *			_properties;
+	IONotifier *			_interest;
+
+protected:
+	virtual void			free()					{ if (_properties) _properties->release(); OSObject::free(); }
+
+public:
+	IOService *				ShimProvider;
+	IOService *				ShimChild;				// the last one attached
+	bool					ShimRegistered;
+	bool					ShimTerminated;
+
+	virtual const char *	getName() const			{ return "IOService"; }
+	virtual IOWorkLoop *	getWorkLoop() const		{ return NULL; }
+	virtual bool			attach(IOService *provider)	{ ShimProvider = provider; provider->ShimChild = this; return true; }
+	virtual void			registerService(IOOptionBits options = 0)	{ ShimRegistered = true; }
+	virtual bool			terminate(IOOptionBits options = 0)		{ ShimTerminated = true; return true; }
+
+	bool					isInactive() const		{ return ShimTerminated; }
+
+	IONotifier *			registerInterest(const OSSymbol *typeOfInterest, IOServiceInterestHandler handler, void *target, void *ref = 0)
+	{
+		IONotifier	*notifier;
+
+		if (_interest)
+			return NULL;
+		notifier = new IONotifier;
+		notifier->_provider = this;
+		notifier->_handler = handler;
+		notifier->_target = target;
+		notifier->_ref = ref;
+		_interest = notifier;
+		return notifier;
+	}
+
+	// to the client which registered interest, if there is one
+	IOReturn				ShimMessage(UInt32 type, void *argument = 0)
+	{
+		if (!_interest)
+			return kIOReturnSuccess;
+		return (*_interest->_handler)(_interest->_target, _interest->_ref, type, this, argument, 0);
+	}
+	bool					ShimHasInterest(void) const	{ return _interest != NULL; }
+
+	OSObject *				getProperty(const char *key) const	{ return _properties ? _properties->getObject(key) : NULL; }
+	bool					setProperty(const char *key, OSObject *value)
+	{
+		if (!_properties)
+			_properties = OSDictionary::withCapacity(4);
+		return _properties->setObject(key, value);
+	}
+	bool					setProperty(const char *key, const char *value)
+	{
+		OSString	*string = OSString::withCString(value);
+		bool		ok = setProperty(key, string);
+
+		string->release();
+		return ok;
+	}
+};
+
+inline void
+IONotifier::remove()
+{
+	if (_provider && (_provider->_interest == this))
+		_provider->_interest = NULL;
+	_provider = NULL;
+	release();
+}
+
+#endif
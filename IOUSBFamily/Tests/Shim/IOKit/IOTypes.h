@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ The address and task types of <IOKit/IOTypes.h> which the family's memory block code uses, for the host tests. Physical addresses
+ are 32 bits, as in an x86_64 kernel.
+*/
+
+#ifndef __IOKIT_IOTYPES_H
+#define __IOKIT_IOTYPES_H
+
+#include <IOKit/usb/USB.h>
+
+typedef UInt32				IOPhysicalAddress;
+typedef UInt64				mach_vm_address_t;
+typedef struct task *		task_t;
+
+#define kernel_task			((task_t)NULL)
+
+enum
+{
+	kNanosecondScale		= 1,
+	kMicrosecondScale		= 1000,
+	kMillisecondScale		= 1000 * 1000,
+	kSecondScale			= 1000 * 1000 * 1000
+};
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE			4096
+#endif
+
+typedef uintptr_t			vm_offset_t;
+
+#define page_size			PAGE_SIZE
+#define round_page(x)		(((x) + PAGE_SIZE - 1) & ~(vm_offset_t)(PAGE_SIZE - 1))
+
+enum
+{
+	kIOMapReadOnly			= 0x00001000
+};
+
+#endif
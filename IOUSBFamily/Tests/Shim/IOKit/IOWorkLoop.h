@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ A workloop is somewhere to hang event sources, a command gate runs its action at once, and the time a timer event source waits for
+ is ShimAdvanceTimeMS's. A timer fires from inside ShimAdvanceTimeMS when its time comes. The workloop's thread is the one which made
+ it, and its gate is a real one, so that a test can have another thread close it and sleep in it.
+*/
+
+#ifndef _IOKIT_IOWORKLOOP_H
+#define _IOKIT_IOWORKLOOP_H
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/IOLocks.h>
+#include <IOKit/usb/USB.h>
+
+class IOWorkLoop;
+
+class IOEventSource : public OSObject
+{
+	friend class IOWorkLoop;
+
+protected:
+	OSObject *			owner;
+	IOWorkLoop *		workLoop;
+
+public:
+	IOWorkLoop *		getWorkLoop() const			{ return workLoop; }
+};
+
+
+class IOWorkLoop : public OSObject
+{
+	pthread_t			_thread;
+	pthread_mutex_t		_gateLock;								// guards the gate's owner and depth
+	pthread_cond_t		_gateOpened;
+	pthread_cond_t		_gateWakeup;
+	pthread_t			_gateOwner;
+	int					_gateDepth;
+
+protected:
+	virtual void		free();
+
+public:
+	static IOWorkLoop *	workLoop();
+	IOReturn			addEventSource(IOEventSource *source)		{ source->retain(); source->workLoop = this; return kIOReturnSuccess; }
+	IOReturn			removeEventSource(IOEventSource *source)	{ source->workLoop = NULL; source->release(); return kIOReturnSuccess; }
+	bool				onThread() const						{ return pthread_equal(pthread_self(), _thread); }
+	bool				inGate() const;
+	void				closeGate();
+	void				openGate();
+	int					sleepGate(void *event, UInt32 interType);		// every sleeper is woken by every wakeupGate
+	void				wakeupGate(void *event, bool oneThread);
+};
+
+
+class IOCommandGate : public IOEventSource
+{
+public:
+	typedef IOReturn	(*Action)(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3);
+
+	static IOCommandGate *	commandGate(OSObject *owner)		{ IOCommandGate *me = new IOCommandGate; me->owner = owner; return me; }
+	IOReturn			runAction(Action action, void *arg0 = 0, void *arg1 = 0, void *arg2 = 0, void *arg3 = 0)
+	{
+		return (*action)(owner, arg0, arg1, arg2, arg3);
+	}
+};
+
+
+class IOTimerEventSource : public IOEventSource
+{
+public:
+	typedef void		(*Action)(OSObject *owner, IOTimerEventSource *sender);
+
+private:
+	Action				_action;
+	bool				_armed;
+	UInt64				_deadlineMS;
+	IOTimerEventSource	*_nextTimer;
+
+	friend void			ShimAdvanceTimeMS(UInt64 milliseconds);
+	friend UInt32		ShimTimerCount(void);
+
+protected:
+	virtual void		free();
+
+public:
+	static IOTimerEventSource *	timerEventSource(OSObject *owner, Action action);
+	IOReturn			setTimeoutMS(UInt32 milliseconds);
+	void				cancelTimeout()							{ _armed = false; }
+};
+
+void		ShimAdvanceTimeMS(UInt64 milliseconds);
+UInt64		ShimTimeMS(void);
+UInt32		ShimTimerCount(void);											// timer event sources not yet freed
+UInt32		ShimGateSleepers(void);											// threads asleep in sleepGate just now
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+
+/*
+ A controller is the bus a device hangs off. The family's IOKit-light classes want its workloop, and ConfigurePipes its command gate
+ and the one-at-a-time OpenPipe and ClosePipe, which a simulated controller overrides.
+*/
+
+#ifndef _IOKIT_IOUSBCONTROLLER_H
+#define _IOKIT_IOUSBCONTROLLER_H
+
+#include <IOKit/IOService.h>
+#include <IOKit/IOWorkLoop.h>
+#include <IOKit/IOCommandGate.h>
+
+class IOUSBController : public IOService
+{
+public:
+	IOWorkLoop *			_workLoop;
+	IOCommandGate *			_commandGate;
+
+	virtual IOWorkLoop *	getWorkLoop() const		{ return _workLoop; }
+
+	virtual IOReturn		OpenPipe(USBDeviceAddress address, UInt8 speed, Endpoint *endpoint)	{ return kIOReturnUnsupported; }
+	virtual IOReturn		ClosePipe(USBDeviceAddress address, Endpoint *endpoint)				{ return kIOReturnUnsupported; }
+};
+
+#endif
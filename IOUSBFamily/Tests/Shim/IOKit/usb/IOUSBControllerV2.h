@@ -0,0 +1,47 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The V2 controller as far as ConfigurePipes goes. A test subclasses it, with OpenPipe and ClosePipe for the one-at-a-time path and
+ UIMConfigureEndpoints or UIMCheckPipeBandwidth for the UIM it is modelling.
+*/
+
+#ifndef _IOKIT_IOUSBCONTROLLERV2_H
+#define _IOKIT_IOUSBCONTROLLERV2_H
+
+#include <IOKit/usb/IOUSBController.h>
+
+class IOUSBControllerV2 : public IOUSBController
+{
+protected:
+	static IOReturn			DoConfigureEPs(OSObject *owner, void *arg0, void *arg1, void *arg2, void *arg3);
+	static bool				IsochEndpointInList(Endpoint *list, UInt32 count, UInt8 number, UInt8 direction);
+
+public:
+	virtual IOReturn		ConfigurePipes(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+	virtual IOReturn		UIMConfigureEndpoints(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+	virtual IOReturn		UIMCheckPipeBandwidth(USBDeviceAddress address, UInt8 speed, Endpoint *closeList, UInt32 closeCount, Endpoint *openList, UInt32 openCount, UInt32 *bandwidthShortfall);
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The identity and speed of a device, its string indexes, its pipe zero, its bus and the expansion data fields the family's IOKit-light
+ classes look at. A test subclasses it to see ResetDevice and SuspendDevice called, or to answer DeviceRequest, GetStringDescriptor
+ and FindConfig.
+*/
+
+#ifndef _IOKIT_IOUSBDEVICE_H
+#define _IOKIT_IOUSBDEVICE_H
+
+#include <libkern/c++/OSObject.h>
+#include <libkern/c++/OSArray.h>
+
+#include <IOKit/IOLocks.h>
+#include <IOKit/IOService.h>
+#include <IOKit/usb/USB.h>
+
+class IOUSBPipe;
+class IOUSBController;
+class IOUSBDeviceAutoSuspend;
+
+class IOUSBDevice : public IOService
+{
+public:
+	struct ExpansionData
+	{
+		IOLock *			_interfaceArrayLock;
+		OSArray *			_interfaceArray;
+		volatile UInt32		_resetRestoreInProgress;
+		IOUSBDeviceAutoSuspend *	_autoSuspend;
+	};
+
+	UInt16			vendorID;
+	UInt16			productID;
+	UInt16			deviceRelease;
+	const char *	name;
+	UInt8			speed;
+	UInt8			_currentConfigValue;
+	UInt8			iManufacturer;
+	UInt8			iProduct;
+	UInt8			iSerialNumber;
+	IOUSBPipe *		_pipeZero;
+	IOUSBController *	_bus;
+	ExpansionData *	_expansionData;
+
+	UInt16			GetVendorID(void)			{ return vendorID; }
+	UInt16			GetProductID(void)			{ return productID; }
+	UInt16			GetDeviceRelease(void)		{ return deviceRelease; }
+	UInt8			GetSpeed(void)				{ return speed; }
+	const char *	getName(void) const			{ return name ? name : "IOUSBDevice"; }
+	UInt8			GetManufacturerStringIndex(void)	{ return iManufacturer; }
+	UInt8			GetProductStringIndex(void)			{ return iProduct; }
+	UInt8			GetSerialNumberStringIndex(void)	{ return iSerialNumber; }
+	IOUSBPipe *		GetPipeZero(void)			{ return _pipeZero; }
+	IOUSBController *	GetBus(void)			{ return _bus; }
+	virtual IOReturn	ResetDevice(void)		{ return kIOReturnSuccess; }
+	virtual IOReturn	SuspendDevice(bool suspend)		{ return kIOReturnSuccess; }
+	virtual const IOUSBConfigurationDescriptor *	FindConfig(UInt8 configValue, UInt8 *configIndex = NULL)	{ return NULL; }
+	virtual IOReturn	DeviceRequest(IOUSBDevRequest *request, UInt32 noDataTimeout = kUSBDefaultControlNoDataTimeoutMS, UInt32 completionTimeout = kUSBDefaultControlCompletionTimeoutMS, IOUSBCompletion *completion = NULL)	{ return kIOReturnUnsupported; }
+	virtual IOReturn	GetStringDescriptor(UInt8 index, char *buf, int maxLen, UInt16 lang = 0x409)		{ return kIOReturnUnsupported; }
+};
+
+#endif
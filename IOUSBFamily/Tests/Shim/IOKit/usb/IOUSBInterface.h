@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ The part of an interface IOUSBDeviceResetState works with: its number and alternate setting, its pipe list, and the calls which
+ unlink, reopen and recreate the streams on those pipes. They do nothing here, and a test overrides the ones it wants to watch.
+*/
+
+#ifndef _IOKIT_IOUSBINTERFACE_H
+#define _IOKIT_IOUSBINTERFACE_H
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/usb/USB.h>
+#include <IOKit/usb/IOUSBPipe.h>
+
+class IOUSBInterface : public OSObject
+{
+public:
+	UInt8						interfaceNumber;
+	UInt8						alternateSetting;
+	IOUSBPipe *					pipes[kUSBMaxPipes];
+
+	virtual IOUSBPipe *			GetPipeObj(UInt8 index)			{ return (index < kUSBMaxPipes) ? pipes[index] : NULL; }
+	virtual UInt8				GetInterfaceNumber(void)		{ return interfaceNumber; }
+	virtual UInt8				GetAlternateSetting(void)		{ return alternateSetting; }
+	virtual IOReturn			RememberStreams(void)			{ return kIOReturnSuccess; }
+	virtual IOReturn			RecreateStreams(void)			{ return kIOReturnSuccess; }
+	virtual void				UnlinkPipes(void)				{ }
+	virtual void				ReopenPipes(void)				{ }
+};
+
+#endif
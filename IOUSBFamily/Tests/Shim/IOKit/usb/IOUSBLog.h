@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+// the family's logging, compiled out of the host tests unless USB_TEST_VERBOSE is set in the environment, and what the KernelDebug
+// outputs need to know about where to send a message
+
+#ifndef _IOKIT_IOUSBLOG_H
+#define _IOKIT_IOUSBLOG_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <IOKit/IOLib.h>
+
+void		ShimUSBLog(UInt32 level, const char *format, ...);
+
+#define USBLog(level, ...)			ShimUSBLog(level, __VA_ARGS__)
+#define USBError(level, ...)		ShimUSBLog(level, __VA_ARGS__)
+#define USBTrace(...)				do { } while (0)
+
+typedef UInt32				KernelDebuggingOutputType;
+typedef UInt32				KLogLevel;
+typedef UInt32				KLogTag;
+
+enum
+{
+	kKernelDebugOutputIOLogType			= 0x00000001,
+	kKernelDebugOutputKextLoggerType	= 0x00000002
+};
+
+// the KLog kext's logger. A test subclasses it to see what it is given
+class com_apple_iokit_KLog
+{
+public:
+	virtual				~com_apple_iokit_KLog() {}
+	virtual SInt8		vLog(KLogLevel level, KLogTag tag, const char *format, va_list in_va_list) = 0;
+};
+
+extern "C"
+{
+	extern KernelDebuggingOutputType	gKernelDebugOutputType;
+	extern com_apple_iokit_KLog *		gKernelLogger;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ An endpoint as the pipe describes it, and the calls the family's IOKit-light classes make on a pipe. Abort, DoControlRequest and
+ DoIO are virtual so that a test can watch them.
+*/
+
+#ifndef _IOKIT_IOUSBPIPE_H
+#define _IOKIT_IOUSBPIPE_H
+
+#include <libkern/c++/OSObject.h>
+
+#include <IOKit/IOMemoryDescriptor.h>
+#include <IOKit/usb/USB.h>
+
+struct IOUSBAutoSuspendIO;
+
+class IOUSBPipe : public OSObject
+{
+public:
+	IOUSBEndpointDescriptor				descriptor;
+
+	const IOUSBEndpointDescriptor *		GetEndpointDescriptor(void)		{ return &descriptor; }
+	UInt8								GetDirection(void)				{ return (descriptor.bEndpointAddress & 0x80) ? kUSBIn : kUSBOut; }
+	UInt8								GetType(void)					{ return descriptor.bmAttributes & 0x03; }
+	UInt16								GetMaxPacketSize(void)			{ return USBToHostWord(descriptor.wMaxPacketSize) & 0x07FF; }
+	UInt8								GetSyncType(void)				{ return (descriptor.bmAttributes >> 2) & 0x03; }
+	UInt8								GetUsageType(void)				{ return (descriptor.bmAttributes >> 4) & 0x03; }
+
+	virtual IOReturn					Abort(void)						{ return kIOReturnSuccess; }
+	virtual IOReturn					DoControlRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)	{ return kIOReturnSuccess; }
+	virtual IOReturn					DoIO(const IOUSBAutoSuspendIO *io, IOUSBCompletion *completion, IOByteCount *bytesRead)	{ return kIOReturnSuccess; }
+};
+
+#endif
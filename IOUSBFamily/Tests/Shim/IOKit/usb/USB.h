@@ -0,0 +1,301 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ Just enough of <IOKit/usb/USB.h> to build the family's IOKit-free code (descriptor validation, the policy tables) and its tests
+ on a Linux or macOS host without the kernel headers. The names and values match the real header; anything not listed here is
+ not used by code built against it. USB is little endian, and so are the hosts this is meant for.
+*/
+
+#ifndef _USB_H
+#define _USB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "the test shim only supports little endian hosts"
+#endif
+
+#include <libkern/OSTypes.h>
+
+typedef int					IOReturn;
+typedef uint32_t			IOOptionBits;
+
+#define kIOReturnSuccess			0
+#define kIOReturnNoMemory			((IOReturn)0xe00002bd)
+#define kIOReturnNoResources		((IOReturn)0xe00002be)
+#define kIOReturnBadArgument		((IOReturn)0xe00002c2)
+#define kIOReturnUnsupported		((IOReturn)0xe00002c7)
+#define kIOReturnNotFound			((IOReturn)0xe00002f0)
+#define kIOReturnUnderrun			((IOReturn)0xe00002e7)
+#define kIOReturnInvalid			((IOReturn)0xe00002f1)
+#define kIOReturnBusy				((IOReturn)0xe00002d5)
+#define kIOReturnAborted			((IOReturn)0xe00002eb)
+#define kIOReturnNotResponding		((IOReturn)0xe00002ed)
+#define kIOReturnNoBandwidth		((IOReturn)0xe00002ec)
+
+#define kIOUSBSyncRequestOnWLThread	((IOReturn)0xe0004010)
+
+#define USBToHostWord(x)			((UInt16)(x))
+#define HostToUSBWord(x)			((UInt16)(x))
+#define USBToHostLong(x)			((UInt32)(x))
+#define HostToUSBLong(x)			((UInt32)(x))
+
+typedef UInt32						USBPhysicalAddress32;
+
+enum
+{
+	kUSBControl						= 0,
+	kUSBIsoc						= 1,
+	kUSBBulk						= 2,
+	kUSBInterrupt					= 3
+};
+
+enum
+{
+	kUSBAnyType						= 0xFF
+};
+
+enum
+{
+	kUSBOut							= 0,
+	kUSBIn							= 1,
+	kUSBAnyDirn						= 3
+};
+
+enum
+{
+	kUSBbEndpointAddressMask					= 0x0F,
+	kUSBbEndpointDirectionMask					= 0x80,
+	kUSBEndpointbmAttributesTransferTypeMask	= 0x03
+};
+
+enum
+{
+	kUSBDeviceSpeedLow				= 0,
+	kUSBDeviceSpeedFull				= 1,
+	kUSBDeviceSpeedHigh				= 2,
+	kUSBDeviceSpeedSuper			= 3
+};
+
+enum
+{
+	kUSBNoSynchronizationIsocSyncType	= 0,
+	kUSBAsynchronousIsocSyncType		= 1,
+	kUSBAdaptiveIsocSyncType			= 2,
+	kUSBSynchronousIsocSyncType			= 3
+};
+
+enum
+{
+	kUSBDataIsocUsageType				= 0,
+	kUSBFeedbackIsocUsageType			= 1,
+	kUSBImplicitFeedbackDataIsocUsageType	= 2
+};
+
+enum
+{
+	kUSBStandard					= 0,
+	kUSBClass						= 1,
+	kUSBVendor						= 2
+};
+
+enum
+{
+	kUSBDevice						= 0,
+	kUSBInterface					= 1,
+	kUSBEndpoint					= 2
+};
+
+enum
+{
+	kUSBRqGetStatus					= 0,
+	kUSBRqClearFeature				= 1,
+	kUSBRqSetFeature				= 3,
+	kUSBRqSetAddress				= 5,
+	kUSBRqGetDescriptor				= 6,
+	kUSBRqSetDescriptor				= 7,
+	kUSBRqGetConfig					= 8,
+	kUSBRqSetConfig					= 9,
+	kUSBRqGetInterface				= 10,
+	kUSBRqSetInterface				= 11
+};
+
+enum
+{
+	kUSBFeatureDeviceRemoteWakeup	= 1,
+	kUSBAtrRemoteWakeup				= 0x20
+};
+
+enum
+{
+	kUSBMaxPipes					= 32,
+	kUSBDefaultControlNoDataTimeoutMS		= 5000,
+	kUSBDefaultControlCompletionTimeoutMS	= 0
+};
+
+#define USBmakebmRequestType(direction, type, recipient)		((((direction) & 1) << 7) | (((type) & 3) << 5) | ((recipient) & 0x1F))
+
+enum
+{
+	kUSBAnyDesc						= 0,
+	kUSBDeviceDesc					= 1,
+	kUSBConfDesc					= 2,
+	kUSBStringDesc					= 3,
+	kUSBInterfaceDesc				= 4,
+	kUSBEndpointDesc				= 5,
+	kUSBInterfaceAssociationDesc	= 0x0B,
+	kUSBHIDDesc						= 0x21
+};
+
+#pragma pack(1)
+
+typedef struct IOUSBDescriptorHeader
+{
+	UInt8			bLength;
+	UInt8			bDescriptorType;
+} IOUSBDescriptorHeader;
+
+typedef struct IOUSBConfigurationDescriptor
+{
+	UInt8			bLength;
+	UInt8			bDescriptorType;
+	UInt16			wTotalLength;
+	UInt8			bNumInterfaces;
+	UInt8			bConfigurationValue;
+	UInt8			iConfiguration;
+	UInt8			bmAttributes;
+	UInt8			MaxPower;
+} IOUSBConfigurationDescriptor;
+
+typedef struct IOUSBInterfaceDescriptor
+{
+	UInt8			bLength;
+	UInt8			bDescriptorType;
+	UInt8			bInterfaceNumber;
+	UInt8			bAlternateSetting;
+	UInt8			bNumEndpoints;
+	UInt8			bInterfaceClass;
+	UInt8			bInterfaceSubClass;
+	UInt8			bInterfaceProtocol;
+	UInt8			iInterface;
+} IOUSBInterfaceDescriptor;
+
+typedef struct IOUSBEndpointDescriptor
+{
+	UInt8			bLength;
+	UInt8			bDescriptorType;
+	UInt8			bEndpointAddress;
+	UInt8			bmAttributes;
+	UInt16			wMaxPacketSize;
+	UInt8			bInterval;
+} IOUSBEndpointDescriptor;
+
+typedef struct IOUSBInterfaceAssociationDescriptor
+{
+	UInt8			bLength;
+	UInt8			bDescriptorType;
+	UInt8			bFirstInterface;
+	UInt8			bInterfaceCount;
+	UInt8			bFunctionClass;
+	UInt8			bFunctionSubClass;
+	UInt8			bFunctionProtocol;
+	UInt8			iFunction;
+} IOUSBInterfaceAssociationDescriptor;
+
+#pragma pack()
+
+typedef struct IOUSBDevRequest
+{
+	UInt8			bmRequestType;
+	UInt8			bRequest;
+	UInt16			wValue;
+	UInt16			wIndex;
+	UInt16			wLength;
+	void *			pData;
+	UInt32			wLenDone;
+} IOUSBDevRequest;
+
+enum
+{
+	kIOUSBFindInterfaceDontCare		= 0xFFFF
+};
+
+typedef struct IOUSBFindInterfaceRequest
+{
+	UInt16			bInterfaceClass;
+	UInt16			bInterfaceSubClass;
+	UInt16			bInterfaceProtocol;
+	UInt16			bAlternateSetting;
+} IOUSBFindInterfaceRequest;
+
+typedef IOUSBDevRequest *	IOUSBDeviceRequestPtr;
+typedef UInt16				USBDeviceAddress;
+
+typedef struct Endpoint
+{
+	IOUSBEndpointDescriptor *	descriptor;
+	UInt8						number;
+	UInt8						direction;
+	UInt8						transferType;
+	UInt16						maxPacketSize;
+	UInt8						interval;
+} Endpoint;
+
+typedef void (*IOUSBCompletionAction)(void *target, void *parameter, IOReturn status, UInt32 bufferSizeRemaining);
+
+typedef struct IOUSBCompletion
+{
+	void *					target;
+	IOUSBCompletionAction	action;
+	void *					parameter;
+} IOUSBCompletion;
+
+typedef struct IOUSBIsocFrame
+{
+	IOReturn		frStatus;
+	UInt16			frReqCount;
+	UInt16			frActCount;
+} IOUSBIsocFrame;
+
+typedef void (*IOUSBIsocCompletionAction)(void *target, void *parameter, IOReturn status, IOUSBIsocFrame *pFrames);
+
+typedef struct IOUSBIsocCompletion
+{
+	void *						target;
+	IOUSBIsocCompletionAction	action;
+	void *						parameter;
+} IOUSBIsocCompletion;
+
+typedef struct IOUSBLowLatencyIsocFrame
+{
+	IOReturn		frStatus;
+	UInt16			frReqCount;
+	UInt16			frActCount;
+	AbsoluteTime	frTimeStamp;
+} IOUSBLowLatencyIsocFrame;
+
+#endif
@@ -0,0 +1,738 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The globals and out of line parts of the host test shim.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cxxabi.h>
+#include <map>
+#include <typeindex>
+
+#include <libkern/c++/OSContainers.h>
+
+#include <IOKit/IOLib.h>
+#include <IOKit/IOLocks.h>
+#include <IOKit/IOCatalogue.h>
+#include <IOKit/IOService.h>
+#include <IOKit/IOTimerEventSource.h>
+#include <IOKit/IODMACommand.h>
+#include <IOKit/usb/IOUSBLog.h>
+#include <kern/clock.h>
+#include <kern/thread_call.h>
+
+
+OSBoolean *				kOSBooleanTrue = OSBoolean::withBoolean(true);
+OSBoolean *				kOSBooleanFalse = OSBoolean::withBoolean(false);
+
+static IOCatalogue		gCatalogue;
+IOCatalogue *			gIOCatalogue = &gCatalogue;
+const OSSymbol *		gIOProviderClassKey = OSSymbol::withCString("IOProviderClass");
+const OSSymbol *		gIOGeneralInterest = OSSymbol::withCString("IOGeneralInterest");
+
+static OSArray *		gPersonalities = NULL;
+static SInt32			gGeneration = 1;
+static UInt32			gAllocations = 0;
+static SInt64			gFailAfter = -1;
+static UInt64			gSleptMS = 0;
+static UInt64			gTimeMS = 0;
+static IOTimerEventSource *	gTimers = NULL;
+static struct ShimThreadCall *	gThreadCalls = NULL;
+static UInt32			gBuffers = 0;
+static UInt64			gNextPhysical = 0x00100000;
+
+extern "C" {
+UInt32					gUSBStackDebugFlags = 0;
+}
+
+
+
+void *
+IOMalloc(vm_size_t size)
+{
+	vm_size_t	*header;
+
+	if ((gFailAfter >= 0) && (gFailAfter-- == 0))
+		return NULL;
+
+	header = (vm_size_t *)malloc(sizeof(vm_size_t) + size);
+	if (!header)
+		return NULL;
+	*header = size;
+	gAllocations++;
+	return header + 1;
+}
+
+
+
+void
+IOFree(void *address, vm_size_t size)
+{
+	vm_size_t	*header;
+
+	if (!address)
+		return;
+	header = (vm_size_t *)address - 1;
+	if (*header != size)
+	{
+		fprintf(stderr, "IOFree(%p, %zu) of a %zu byte allocation\n", address, size, *header);
+		abort();
+	}
+	gAllocations--;
+	free(header);
+}
+
+
+
+UInt32
+ShimOutstandingAllocations(void)
+{
+	return gAllocations;
+}
+
+
+
+void
+ShimFailAllocation(UInt32 after)
+{
+	gFailAfter = after;
+}
+
+
+
+void
+IOSleep(UInt32 milliseconds)
+{
+	gSleptMS += milliseconds;
+}
+
+
+
+UInt64
+ShimSleptMS(void)
+{
+	return gSleptMS;
+}
+
+
+
+IOLock *
+IOLockAlloc(void)
+{
+	IOLock	*lock = (IOLock *)malloc(sizeof(IOLock));
+
+	if (lock)
+		pthread_mutex_init(lock, NULL);
+	return lock;
+}
+
+
+
+void
+IOLockFree(IOLock *lock)
+{
+	pthread_mutex_destroy(lock);
+	free(lock);
+}
+
+
+
+static pthread_cond_t	gLockSleep = PTHREAD_COND_INITIALIZER;
+static UInt32			gLockSleepers = 0;
+
+int
+IOLockSleep(IOLock *lock, void *event, UInt32 interType)
+{
+	__sync_fetch_and_add(&gLockSleepers, 1);
+	pthread_cond_wait(&gLockSleep, lock);
+	__sync_fetch_and_sub(&gLockSleepers, 1);
+	return THREAD_AWAKENED;
+}
+
+
+
+void
+IOLockWakeup(IOLock *lock, void *event, bool oneThread)
+{
+	pthread_cond_broadcast(&gLockSleep);
+}
+
+
+
+UInt32
+ShimLockSleepers(void)
+{
+	return __sync_fetch_and_add(&gLockSleepers, 0);
+}
+
+
+
+void					(*gShimIOLogSink)(const char *format, va_list args) = NULL;
+
+void
+ShimIOLogv(const char *format, va_list args)
+{
+	va_list		copy;
+
+	if (gShimIOLogSink)
+	{
+		va_copy(copy, args);
+		(*gShimIOLogSink)(format, copy);
+		va_end(copy);
+	}
+	if (getenv("USB_TEST_VERBOSE"))
+		vprintf(format, args);
+}
+
+
+
+void
+ShimIOLog(const char *format, ...)
+{
+	va_list		args;
+
+	va_start(args, format);
+	ShimIOLogv(format, args);
+	va_end(args);
+}
+
+
+
+void
+ShimUSBLog(UInt32 level, const char *format, ...)
+{
+	va_list		args;
+
+	if (!getenv("USB_TEST_VERBOSE"))
+		return;
+
+	va_start(args, format);
+	printf("[%u] ", (unsigned int)level);
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+}
+
+
+
+OSOrderedSet *
+IOCatalogue::findDrivers(OSDictionary *matching, SInt32 *generationCount)
+{
+	OSOrderedSet	*set = OSOrderedSet::withCapacity(4);
+	OSDictionary	*personality;
+	OSString		*want, *have;
+	unsigned int	i, k;
+	bool			match;
+
+	if (generationCount)
+		*generationCount = gGeneration;
+	for (i = 0; gPersonalities && (i < gPersonalities->getCount()); i++)
+	{
+		personality = OSDynamicCast(OSDictionary, gPersonalities->getObject(i));
+		match = (personality != NULL);
+		for (k = 0; match && (k < matching->getCount()); k++)
+		{
+			want = OSDynamicCast(OSString, matching->getObject(matching->keyAt(k)));
+			have = OSDynamicCast(OSString, personality->getObject(matching->keyAt(k)));
+			match = want && have && have->isEqualTo(want->getCStringNoCopy());
+		}
+		if (match)
+			set->setLastObject(personality);
+	}
+	return set;
+}
+
+
+
+SInt32
+IOCatalogue::getGenerationCount(void) const
+{
+	return gGeneration;
+}
+
+
+
+void
+ShimCatalogueAdd(OSDictionary *personality)
+{
+	if (!gPersonalities)
+		gPersonalities = OSArray::withCapacity(4);
+	gPersonalities->setObject(personality);
+	gGeneration++;
+}
+
+
+
+void
+ShimCatalogueReset(void)
+{
+	if (gPersonalities)
+	{
+		gPersonalities->release();
+		gPersonalities = NULL;
+	}
+	gGeneration++;
+}
+
+
+
+static UInt32			gGateSleepers = 0;
+
+IOWorkLoop *
+IOWorkLoop::workLoop()
+{
+	IOWorkLoop	*me = new IOWorkLoop;
+
+	me->_thread = pthread_self();
+	pthread_mutex_init(&me->_gateLock, NULL);
+	pthread_cond_init(&me->_gateOpened, NULL);
+	pthread_cond_init(&me->_gateWakeup, NULL);
+	return me;
+}
+
+
+
+void
+IOWorkLoop::free()
+{
+	pthread_cond_destroy(&_gateWakeup);
+	pthread_cond_destroy(&_gateOpened);
+	pthread_mutex_destroy(&_gateLock);
+	OSObject::free();
+}
+
+
+
+bool
+IOWorkLoop::inGate() const
+{
+	bool	owned;
+
+	pthread_mutex_lock(const_cast<pthread_mutex_t *>(&_gateLock));
+	owned = _gateDepth && pthread_equal(_gateOwner, pthread_self());
+	pthread_mutex_unlock(const_cast<pthread_mutex_t *>(&_gateLock));
+	return owned;
+}
+
+
+
+void
+IOWorkLoop::closeGate()
+{
+	pthread_mutex_lock(&_gateLock);
+	while (_gateDepth && !pthread_equal(_gateOwner, pthread_self()))
+		pthread_cond_wait(&_gateOpened, &_gateLock);
+	_gateOwner = pthread_self();
+	_gateDepth++;
+	pthread_mutex_unlock(&_gateLock);
+}
+
+
+
+void
+IOWorkLoop::openGate()
+{
+	pthread_mutex_lock(&_gateLock);
+	if (--_gateDepth == 0)
+		pthread_cond_broadcast(&_gateOpened);
+	pthread_mutex_unlock(&_gateLock);
+}
+
+
+
+// gives the gate up altogether while asleep, and takes it back before returning
+int
+IOWorkLoop::sleepGate(void *event, UInt32 interType)
+{
+	int		depth;
+
+	pthread_mutex_lock(&_gateLock);
+	depth = _gateDepth;
+	_gateDepth = 0;
+	pthread_cond_broadcast(&_gateOpened);
+
+	__sync_fetch_and_add(&gGateSleepers, 1);
+	pthread_cond_wait(&_gateWakeup, &_gateLock);
+	__sync_fetch_and_sub(&gGateSleepers, 1);
+
+	while (_gateDepth)
+		pthread_cond_wait(&_gateOpened, &_gateLock);
+	_gateOwner = pthread_self();
+	_gateDepth = depth;
+	pthread_mutex_unlock(&_gateLock);
+	return THREAD_AWAKENED;
+}
+
+
+
+void
+IOWorkLoop::wakeupGate(void *event, bool oneThread)
+{
+	pthread_mutex_lock(&_gateLock);
+	pthread_cond_broadcast(&_gateWakeup);
+	pthread_mutex_unlock(&_gateLock);
+}
+
+
+
+UInt32
+ShimGateSleepers(void)
+{
+	return __sync_fetch_and_add(&gGateSleepers, 0);
+}
+
+
+
+IOTimerEventSource *
+IOTimerEventSource::timerEventSource(OSObject *owner, Action action)
+{
+	IOTimerEventSource	*me = new IOTimerEventSource;
+
+	me->owner = owner;
+	me->_action = action;
+	me->_nextTimer = gTimers;
+	gTimers = me;
+	return me;
+}
+
+
+
+void
+IOTimerEventSource::free()
+{
+	IOTimerEventSource	**link;
+
+	for (link = &gTimers; *link; link = &(*link)->_nextTimer)
+	{
+		if (*link == this)
+		{
+			*link = _nextTimer;
+			break;
+		}
+	}
+	IOEventSource::free();
+}
+
+
+
+IOReturn
+IOTimerEventSource::setTimeoutMS(UInt32 milliseconds)
+{
+	_armed = true;
+	_deadlineMS = gTimeMS + milliseconds;
+	return kIOReturnSuccess;
+}
+
+
+
+struct ShimThreadCall
+{
+	thread_call_func_t		func;
+	thread_call_param_t		param0;
+	thread_call_param_t		param1;
+	bool					armed;
+	UInt64					deadlineMS;
+	struct ShimThreadCall	*next;
+};
+
+
+
+thread_call_t
+thread_call_allocate(thread_call_func_t func, thread_call_param_t param0)
+{
+	thread_call_t	call = (thread_call_t)calloc(1, sizeof(struct ShimThreadCall));
+
+	call->func = func;
+	call->param0 = param0;
+	call->next = gThreadCalls;
+	gThreadCalls = call;
+	return call;
+}
+
+
+
+boolean_t
+thread_call_free(thread_call_t call)
+{
+	thread_call_t	*link;
+
+	if (call->armed)
+		return false;
+	for (link = &gThreadCalls; *link; link = &(*link)->next)
+	{
+		if (*link == call)
+		{
+			*link = call->next;
+			break;
+		}
+	}
+	free(call);
+	return true;
+}
+
+
+
+boolean_t
+thread_call_enter_delayed(thread_call_t call, uint64_t deadline)
+{
+	boolean_t	wasArmed = call->armed;
+
+	call->armed = true;
+	call->deadlineMS = (deadline + kMillisecondScale - 1) / kMillisecondScale;
+	return wasArmed;
+}
+
+
+
+boolean_t
+thread_call_enter1(thread_call_t call, thread_call_param_t param1)
+{
+	call->param1 = param1;
+	return thread_call_enter_delayed(call, mach_absolute_time());
+}
+
+
+
+boolean_t
+thread_call_enter(thread_call_t call)
+{
+	return thread_call_enter_delayed(call, mach_absolute_time());
+}
+
+
+
+boolean_t
+thread_call_cancel(thread_call_t call)
+{
+	boolean_t	wasArmed = call->armed;
+
+	call->armed = false;
+	return wasArmed;
+}
+
+
+
+bool
+ShimThreadCallPending(thread_call_t call)
+{
+	return call->armed;
+}
+
+
+
+uint64_t
+mach_absolute_time(void)
+{
+	// a thread woken from inside ShimAdvanceTimeMS may look at the clock while it is still moving
+	return __atomic_load_n(&gTimeMS, __ATOMIC_RELAXED) * kMillisecondScale;
+}
+
+
+
+void
+clock_timebase_info(mach_timebase_info_data_t *info)
+{
+	info->numer = 1;
+	info->denom = 1;
+}
+
+
+
+void
+clock_get_uptime(uint64_t *result)
+{
+	*result = mach_absolute_time();
+}
+
+
+
+void
+absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result)
+{
+	*result = abstime;
+}
+
+
+
+void
+nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result)
+{
+	*result = nanoseconds;
+}
+
+
+
+void
+clock_interval_to_deadline(uint32_t interval, uint32_t scale_factor, uint64_t *result)
+{
+	*result = mach_absolute_time() + (uint64_t)interval * scale_factor;
+}
+
+
+
+void
+clock_interval_to_absolutetime_interval(uint32_t interval, uint32_t scale_factor, uint64_t *result)
+{
+	*result = (uint64_t)interval * scale_factor;
+}
+
+
+
+// fire each timer and thread call whose time comes in the next so many milliseconds, earliest first and with the clock at its deadline
+void
+ShimAdvanceTimeMS(UInt64 milliseconds)
+{
+	UInt64				end = gTimeMS + milliseconds;
+	IOTimerEventSource	*timer, *next;
+	thread_call_t		call, nextCall;
+
+	for (;;)
+	{
+		next = NULL;
+		for (timer = gTimers; timer; timer = timer->_nextTimer)
+		{
+			if (timer->_armed && timer->workLoop && (timer->_deadlineMS <= end) && (!next || (timer->_deadlineMS < next->_deadlineMS)))
+				next = timer;
+		}
+		nextCall = NULL;
+		for (call = gThreadCalls; call; call = call->next)
+		{
+			if (call->armed && (call->deadlineMS <= end) && (!nextCall || (call->deadlineMS < nextCall->deadlineMS)))
+				nextCall = call;
+		}
+		if (nextCall && (!next || (nextCall->deadlineMS < next->_deadlineMS)))
+		{
+			if (nextCall->deadlineMS > gTimeMS)
+				__atomic_store_n(&gTimeMS, nextCall->deadlineMS, __ATOMIC_RELAXED);
+			nextCall->armed = false;
+			(*nextCall->func)(nextCall->param0, nextCall->param1);
+			continue;
+		}
+		if (!next)
+			break;
+		if (next->_deadlineMS > gTimeMS)
+			__atomic_store_n(&gTimeMS, next->_deadlineMS, __ATOMIC_RELAXED);
+		next->_armed = false;
+		(*next->_action)(next->owner, next);
+	}
+	__atomic_store_n(&gTimeMS, end, __ATOMIC_RELAXED);
+}
+
+
+
+UInt64
+ShimTimeMS(void)
+{
+	return gTimeMS;
+}
+
+
+
+UInt32
+ShimTimerCount(void)
+{
+	IOTimerEventSource	*timer;
+	UInt32				count = 0;
+
+	for (timer = gTimers; timer; timer = timer->_nextTimer)
+		count++;
+	return count;
+}
+
+
+
+// one for each class, for as long as the test runs
+const OSMetaClass *
+OSObject::getMetaClass() const
+{
+	static std::map<std::type_index, OSMetaClass *>	metaClasses;
+	std::type_index		type(typeid(*this));
+	OSMetaClass			*&metaClass = metaClasses[type];
+
+	if (!metaClass)
+	{
+		int			status = 0;
+		char		*name = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+
+		metaClass = new OSMetaClass((status == 0) && name ? name : type.name());
+	}
+	return metaClass;
+}
+
+
+
+IOBufferMemoryDescriptor *
+IOBufferMemoryDescriptor::inTaskWithPhysicalMask(task_t inTask, IOOptionBits options, mach_vm_address_t capacity, mach_vm_address_t physicalMask)
+{
+	IOBufferMemoryDescriptor	*buffer;
+	UInt64						length = (capacity + PAGE_SIZE - 1) & ~(UInt64)(PAGE_SIZE - 1);
+
+	if (((gNextPhysical + length - 1) & ~physicalMask & ~(UInt64)(PAGE_SIZE - 1)) || ((gFailAfter >= 0) && (gFailAfter-- == 0)))
+		return NULL;
+
+	buffer = new IOBufferMemoryDescriptor;
+	buffer->_bytes = aligned_alloc(PAGE_SIZE, length);
+	buffer->_length = capacity;
+	buffer->_physical = (IOPhysicalAddress)gNextPhysical;
+	gNextPhysical += length;
+	gBuffers++;
+	return buffer;
+}
+
+
+
+void
+IOBufferMemoryDescriptor::free()
+{
+	::free(_bytes);
+	gBuffers--;
+	IOMemoryDescriptor::free();
+}
+
+
+
+UInt32
+ShimOutstandingBuffers(void)
+{
+	return gBuffers;
+}
+
+
+
+IOReturn
+IODMACommand::gen32IOVMSegments(UInt64 *offset, Segment32 *segments, UInt32 *numSegments)
+{
+	const IOBufferMemoryDescriptor	*buffer = OSDynamicCast(const IOBufferMemoryDescriptor, _memory);
+
+	if (!buffer || !*numSegments || (*offset >= buffer->getLength()))
+		return kIOReturnBadArgument;
+
+	segments[0].fIOVMAddr = buffer->ShimPhysicalAddress() + (UInt32)*offset;
+	segments[0].fLength = (UInt32)(buffer->getLength() - *offset);
+	*offset = buffer->getLength();
+	*numSegments = 1;
+	return kIOReturnSuccess;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The smallest test harness that does the job: CHECK records a failure and carries on, and TEST_MAIN runs the listed tests and exits
+ with the number of failures.
+*/
+
+#ifndef _USBTEST_H
+#define _USBTEST_H
+
+#include <stdio.h>
+
+extern int	gTestFailures;
+extern int	gTestChecks;
+
+#define CHECK(condition)																\
+	do {																				\
+		gTestChecks++;																	\
+		if (!(condition))																\
+		{																				\
+			gTestFailures++;															\
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);	\
+		}																				\
+	} while (0)
+
+#define CHECK_EQUAL(actual, expected)													\
+	do {																				\
+		unsigned long long	_actual = (unsigned long long)(actual);						\
+		unsigned long long	_expected = (unsigned long long)(expected);					\
+		gTestChecks++;																	\
+		if (_actual != _expected)														\
+		{																				\
+			gTestFailures++;															\
+			fprintf(stderr, "%s:%d: %s is 0x%llx, expected 0x%llx\n", __FILE__, __LINE__, #actual, _actual, _expected);	\
+		}																				\
+	} while (0)
+
+#define TEST_MAIN(name, ...)															\
+	int gTestFailures = 0;																\
+	int gTestChecks = 0;																\
+	int main(void)																		\
+	{																					\
+		void	(*tests[])(void) = { __VA_ARGS__ };										\
+		for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)					\
+			tests[i]();																	\
+		printf("%s: %d checks, %d failed\n", name, gTestChecks, gTestFailures);			\
+		return gTestFailures ? 1 : 0;													\
+	}
+
+#endif
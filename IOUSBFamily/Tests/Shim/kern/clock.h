@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+/*
+ The kernel's clock for the host tests. Absolute time is in nanoseconds and is ShimAdvanceTimeMS's clock, so a test decides when
+ time passes.
+*/
+
+#ifndef _KERN_CLOCK_H_
+#define _KERN_CLOCK_H_
+
+#include <IOKit/usb/USB.h>
+
+typedef struct mach_timebase_info
+{
+	uint32_t	numer;
+	uint32_t	denom;
+} mach_timebase_info_data_t;
+
+uint64_t	mach_absolute_time(void);
+void		clock_timebase_info(mach_timebase_info_data_t *info);				// absolute time is in nanoseconds
+void		clock_get_uptime(uint64_t *result);
+void		absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result);
+void		nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result);
+void		clock_interval_to_deadline(uint32_t interval, uint32_t scale_factor, uint64_t *result);
+void		clock_interval_to_absolutetime_interval(uint32_t interval, uint32_t scale_factor, uint64_t *result);
+
+void		ShimAdvanceTimeMS(UInt64 milliseconds);
+UInt64		ShimTimeMS(void);
+
+#endif
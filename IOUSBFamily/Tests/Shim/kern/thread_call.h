@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+
+/*
+ Thread calls for the host tests. A call which has been entered runs from inside ShimAdvanceTimeMS once the clock reaches its
+ deadline, in deadline order along with the timer event sources. thread_call_enter runs it the next time the clock is advanced.
+*/
+
+#ifndef _KERN_THREAD_CALL_H_
+#define _KERN_THREAD_CALL_H_
+
+#include <IOKit/usb/USB.h>
+
+typedef int							boolean_t;
+typedef struct ShimThreadCall *		thread_call_t;
+typedef void *						thread_call_param_t;
+typedef void						(*thread_call_func_t)(thread_call_param_t param0, thread_call_param_t param1);
+
+thread_call_t	thread_call_allocate(thread_call_func_t func, thread_call_param_t param0);
+boolean_t		thread_call_free(thread_call_t call);
+boolean_t		thread_call_enter(thread_call_t call);
+boolean_t		thread_call_enter1(thread_call_t call, thread_call_param_t param1);
+boolean_t		thread_call_enter_delayed(thread_call_t call, uint64_t deadline);
+boolean_t		thread_call_cancel(thread_call_t call);
+
+bool			ShimThreadCallPending(thread_call_t call);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#ifndef _OS_OSATOMIC_H
+#define _OS_OSATOMIC_H
+
+#include <IOKit/usb/USB.h>
+
+#define OSCompareAndSwapPtr(oldValue, newValue, address)	__sync_bool_compare_and_swap((void **)(address), (void *)(oldValue), (void *)(newValue))
+#define OSCompareAndSwap(oldValue, newValue, address)		__sync_bool_compare_and_swap((UInt32 *)(address), (UInt32)(oldValue), (UInt32)(newValue))
+#define OSIncrementAtomic(address)							__sync_fetch_and_add((SInt32 *)(address), 1)
+#define OSDecrementAtomic(address)							__sync_fetch_and_sub((SInt32 *)(address), 1)
+#define OSAddAtomic(amount, address)						__sync_fetch_and_add((SInt32 *)(address), (SInt32)(amount))
+#define OSBitOrAtomic(mask, address)						__sync_fetch_and_or((UInt32 *)(address), (UInt32)(mask))
+#define OSBitAndAtomic(mask, address)						__sync_fetch_and_and((UInt32 *)(address), (UInt32)(mask))
+#define OSMemoryBarrier()									__sync_synchronize()
+
+typedef SInt32		OSSpinLock;
+
+#define OSSpinLockTry(lock)									__sync_bool_compare_and_swap((SInt32 *)(lock), 0, 1)
+#define OSSpinLockUnlock(lock)								__sync_lock_release((SInt32 *)(lock))
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The fixed size integer types and AbsoluteTime of <libkern/OSTypes.h>, for the host tests. The BSD u_intN_t types, which the kernel headers
+ always bring along, come from the host's <sys/types.h>.
+*/
+
+#ifndef _OS_OSTYPES_H
+#define _OS_OSTYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef uint8_t				UInt8;
+typedef int8_t				SInt8;
+typedef uint16_t			UInt16;
+typedef int16_t				SInt16;
+typedef uint32_t			UInt32;
+typedef int32_t				SInt32;
+typedef uint64_t			UInt64;
+typedef int64_t				SInt64;
+
+typedef struct UnsignedWide
+{
+	UInt32			lo;
+	UInt32			hi;
+} UnsignedWide;
+
+// as in the kernel, 64 bit hosts have a plain integer
+#if defined(__LP64__)
+typedef UInt64				AbsoluteTime;
+#else
+typedef UnsignedWide		AbsoluteTime;
+#endif
+
+#define AbsoluteTime_to_scalar(x)	(*(uint64_t *)(x))
+
+#ifndef TRUE
+#define TRUE	1
+#endif
+#ifndef FALSE
+#define FALSE	0
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The host tests' stand ins for the libkern collections - simple vectors, enough for building property list style tables in a test and
+ reading them back the way the kernel code does.
+*/
+
+#ifndef _OS_OSCONTAINERS_H
+#define _OS_OSCONTAINERS_H
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libkern/c++/OSObject.h>
+
+
+class OSString : public OSObject
+{
+protected:
+	std::string			_string;
+
+public:
+	static OSString *	withCString(const char *cString)	{ OSString *me = new OSString; me->_string = cString; return me; }
+	const char *		getCStringNoCopy() const			{ return _string.c_str(); }
+	unsigned int		getLength() const					{ return (unsigned int)_string.length(); }
+	bool				isEqualTo(const char *cString) const	{ return _string == cString; }
+};
+
+class OSSymbol : public OSString
+{
+public:
+	static const OSSymbol *	withCString(const char *cString)	{ OSSymbol *me = new OSSymbol; me->_string = cString; return me; }
+};
+
+class OSNumber : public OSObject
+{
+	unsigned long long	_value;
+
+public:
+	static OSNumber *	withNumber(unsigned long long value, unsigned int numberOfBits)
+	{
+		OSNumber	*me = new OSNumber;
+
+		me->_value = (numberOfBits < 64) ? (value & ((1ULL << numberOfBits) - 1)) : value;
+		return me;
+	}
+	unsigned long long	unsigned64BitValue() const			{ return _value; }
+	unsigned int		unsigned32BitValue() const			{ return (unsigned int)_value; }
+	unsigned short		unsigned16BitValue() const			{ return (unsigned short)_value; }
+	unsigned char		unsigned8BitValue() const			{ return (unsigned char)_value; }
+};
+
+class OSBoolean : public OSObject
+{
+	bool				_value;
+
+public:
+	static OSBoolean *	withBoolean(bool value)				{ OSBoolean *me = new OSBoolean; me->_value = value; return me; }
+	bool				isTrue() const						{ return _value; }
+	bool				isFalse() const						{ return !_value; }
+};
+
+extern OSBoolean *		kOSBooleanTrue;
+extern OSBoolean *		kOSBooleanFalse;
+
+class OSArray : public OSObject
+{
+	std::vector<const OSObject *>	_objects;
+
+protected:
+	virtual void		free()
+	{
+		for (size_t i = 0; i < _objects.size(); i++)
+			_objects[i]->release();
+		OSObject::free();
+	}
+
+public:
+	static OSArray *	withCapacity(unsigned int capacity)	{ OSArray *me = new OSArray; me->_objects.reserve(capacity); return me; }
+	unsigned int		getCount() const					{ return (unsigned int)_objects.size(); }
+	OSObject *			getObject(unsigned int index) const	{ return (index < _objects.size()) ? const_cast<OSObject *>(_objects[index]) : NULL; }
+	bool				setObject(const OSMetaClassBase *object)	{ if (!object) return false; object->retain(); _objects.push_back(object); return true; }
+	bool				setObject(unsigned int index, const OSMetaClassBase *object)
+	{
+		if (!object || (index > _objects.size()))
+			return false;
+		object->retain();
+		_objects.insert(_objects.begin() + index, object);
+		return true;
+	}
+	bool				merge(const OSArray *other)
+	{
+		for (unsigned int i = 0; i < other->getCount(); i++)
+			setObject(other->getObject(i));
+		return true;
+	}
+};
+
+class OSOrderedSet : public OSObject
+{
+	std::vector<const OSObject *>	_objects;
+
+protected:
+	virtual void		free()
+	{
+		for (size_t i = 0; i < _objects.size(); i++)
+			_objects[i]->release();
+		OSObject::free();
+	}
+
+public:
+	static OSOrderedSet *	withCapacity(unsigned int capacity)	{ OSOrderedSet *me = new OSOrderedSet; me->_objects.reserve(capacity); return me; }
+	unsigned int		getCount() const					{ return (unsigned int)_objects.size(); }
+	OSObject *			getObject(unsigned int index) const	{ return (index < _objects.size()) ? const_cast<OSObject *>(_objects[index]) : NULL; }
+	bool				setLastObject(const OSMetaClassBase *object)	{ if (!object) return false; object->retain(); _objects.push_back(object); return true; }
+};
+
+class OSDictionary : public OSObject
+{
+	std::vector<std::pair<std::string, const OSObject *> >	_entries;
+
+protected:
+	virtual void		free()
+	{
+		for (size_t i = 0; i < _entries.size(); i++)
+			_entries[i].second->release();
+		OSObject::free();
+	}
+
+public:
+	static OSDictionary *	withCapacity(unsigned int capacity)	{ OSDictionary *me = new OSDictionary; me->_entries.reserve(capacity); return me; }
+	unsigned int		getCount() const					{ return (unsigned int)_entries.size(); }
+
+	OSObject *			getObject(const char *key) const
+	{
+		for (size_t i = 0; i < _entries.size(); i++)
+			if (_entries[i].first == key)
+				return const_cast<OSObject *>(_entries[i].second);
+		return NULL;
+	}
+	OSObject *			getObject(const OSString *key) const	{ return getObject(key->getCStringNoCopy()); }
+
+	bool				setObject(const char *key, const OSMetaClassBase *object)
+	{
+		if (!key || !object)
+			return false;
+		object->retain();
+		for (size_t i = 0; i < _entries.size(); i++)
+		{
+			if (_entries[i].first == key)
+			{
+				_entries[i].second->release();
+				_entries[i].second = object;
+				return true;
+			}
+		}
+		_entries.push_back(std::make_pair(std::string(key), object));
+		return true;
+	}
+	bool				setObject(const OSString *key, const OSMetaClassBase *object)	{ return setObject(key->getCStringNoCopy(), object); }
+
+	const char *		keyAt(unsigned int index) const		{ return (index < _entries.size()) ? _entries[index].first.c_str() : NULL; }
+	virtual bool		serialize(OSSerialize *s) const;
+};
+
+// rather than text, a test gets back the last dictionary serialized into it
+class OSSerialize : public OSObject
+{
+	const OSDictionary *	_dictionary;
+
+protected:
+	virtual void		free()								{ if (_dictionary) _dictionary->release(); OSObject::free(); }
+
+public:
+	static OSSerialize *	withCapacity(unsigned int capacity)	{ return new OSSerialize; }
+	const OSDictionary *	ShimDictionary() const				{ return _dictionary; }
+	void				ShimSetDictionary(const OSDictionary *dictionary)
+	{
+		dictionary->retain();
+		if (_dictionary)
+			_dictionary->release();
+		_dictionary = dictionary;
+	}
+};
+
+inline bool OSDictionary::serialize(OSSerialize *s) const		{ s->ShimSetDictionary(this); return true; }
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ The host tests' stand in for libkern's OSObject: reference counted, zero filled by new, with OSDynamicCast done by the C++ runtime.
+ getMetaClass gives one OSMetaClass for each class, named from its RTTI. Only what the family's IOKit-light classes use is here.
+*/
+
+#ifndef _OS_OSOBJECT_H
+#define _OS_OSOBJECT_H
+
+#include <stdlib.h>
+
+#define OSDeclareDefaultStructors(className)											\
+	public:																			\
+		className() {}																\
+		virtual ~className() {}														\
+	private:
+
+#define OSDeclareAbstractStructors(className)		OSDeclareDefaultStructors(className)
+
+#define OSDefineMetaClassAndStructors(className, superclassName)
+#define OSMetaClassDeclareReservedUnused(className, index)
+#define OSMetaClassDeclareReservedUsed(className, index)
+#define OSMetaClassDefineReservedUnused(className, index)
+#define OSMetaClassDefineReservedUsed(className, index)
+
+#define OSDynamicCast(type, inst)		(dynamic_cast<type *>(const_cast<OSObject *>(static_cast<const OSObject *>(inst))))
+
+class OSMetaClass;
+class OSSerialize;
+
+class OSObject
+{
+private:
+	mutable int			_retainCount;
+
+protected:
+	virtual void		free()				{ delete this; }
+
+public:
+						OSObject() : _retainCount(1) {}
+	virtual				~OSObject() {}
+
+	// the kernel's allocator hands out zeroed memory, and the classes count on it
+	static void *		operator new(size_t size)		{ return calloc(1, size); }
+	static void			operator delete(void *mem)		{ ::free(mem); }
+
+	virtual bool		init()				{ return true; }
+	void				retain() const		{ __sync_fetch_and_add(&_retainCount, 1); }
+	void				release() const		{ if (__sync_sub_and_fetch(&_retainCount, 1) == 0) const_cast<OSObject *>(this)->free(); }
+	int					getRetainCount() const	{ return _retainCount; }
+	const OSMetaClass *	getMetaClass() const;
+	virtual bool		serialize(OSSerialize *s) const	{ return false; }
+};
+
+typedef OSObject		OSMetaClassBase;
+
+class OSMetaClass
+{
+	const char *		_className;
+
+public:
+						OSMetaClass(const char *className) : _className(className) {}
+	const char *		getClassName() const	{ return _className; }
+};
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+
+/*
+ Host tests for IOUSBDeviceStringCache, against a simulated device which counts the control transfers it is sent. GetStringDescriptor
+ costs two of them, as IOUSBDevice's does: one for the length and one for the string. The storm test plays an enumeration in which
+ matching, SetProperties, the Prober and user-space tools keep asking for the same few strings, and reports what the cache saved.
+*/
+
+#include <string.h>
+
+#include <IOKit/usb/IOUSBDevice.h>
+#include <IOKit/usb/IOUSBDeviceStringCache.h>
+
+#include "USBTest.h"
+
+
+class TestDevice : public IOUSBDevice
+{
+public:
+	UInt8				langDesc[16];				// what a GET_DESCRIPTOR(string 0) returns
+	UInt32				langDescLength;
+	UInt32				transfers;					// control transfers the device has seen
+	UInt32				failures;					// fail this many more string reads
+
+	TestDevice()
+	{
+		static const UInt8	langs[] = { 6, kUSBStringDesc, 0x07, 0x04, 0x09, 0x04 };	// German, then US English
+
+		memcpy(langDesc, langs, sizeof(langs));
+		langDescLength = sizeof(langs);
+		iManufacturer = 1;
+		iProduct = 2;
+		iSerialNumber = 3;
+	}
+
+	virtual IOReturn	DeviceRequest(IOUSBDevRequest *request, UInt32 noDataTimeout, UInt32 completionTimeout, IOUSBCompletion *completion)
+	{
+		transfers++;
+		if ((request->bRequest != kUSBRqGetDescriptor) || (request->wValue != (kUSBStringDesc << 8)))
+			return kIOReturnUnsupported;
+		request->wLenDone = (langDescLength < request->wLength) ? langDescLength : request->wLength;
+		memcpy(request->pData, langDesc, request->wLenDone);
+		return kIOReturnSuccess;
+	}
+
+	virtual IOReturn	GetStringDescriptor(UInt8 index, char *buf, int maxLen, UInt16 lang)
+	{
+		transfers += 2;
+		if (failures)
+		{
+			failures--;
+			return kIOReturnNotResponding;
+		}
+		snprintf(buf, maxLen, "string %d/%04x", index, lang);
+		return kIOReturnSuccess;
+	}
+};
+
+
+
+static void
+TestPrefetch(void)
+{
+	TestDevice				*device = new TestDevice;
+	IOUSBDeviceStringCache	*cache = IOUSBDeviceStringCache::withDevice(device);
+	char					buf[64];
+	UInt32					hits, misses, saved;
+
+	// the LANGID list, then three strings in each of its two languages
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 1 + (3 * 2 * 2));
+
+	device->transfers = 0;
+	CHECK(cache->Lookup(2, 0x407, buf, sizeof(buf)));
+	CHECK(!strcmp(buf, "string 2/0407"));
+	CHECK_EQUAL(cache->GetString(1, buf, sizeof(buf)), kIOReturnSuccess);
+	CHECK(!strcmp(buf, "string 1/0409"));
+	CHECK_EQUAL(cache->GetString(3, buf, sizeof(buf), 0x407), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 0);
+
+	// a string nobody prefetched goes to the bus once
+	CHECK_EQUAL(cache->GetString(4, buf, sizeof(buf)), kIOReturnSuccess);
+	CHECK_EQUAL(cache->GetString(4, buf, sizeof(buf)), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 2);
+
+	cache->GetStatistics(&hits, &misses, &saved);
+	CHECK_EQUAL(hits, 4);
+	CHECK_EQUAL(misses, 1);
+	CHECK_EQUAL(saved, 4 * kUSBStringCacheTransfersPerString);
+
+	// a truncated copy still comes back NUL terminated
+	CHECK(cache->Lookup(1, 0x409, buf, 5));
+	CHECK(!strcmp(buf, "stri"));
+
+	// re-enumeration
+	cache->Invalidate();
+	CHECK(!cache->Lookup(1, 0x409, buf, sizeof(buf)));
+
+	cache->release();
+	device->release();
+}
+
+
+
+static void
+TestLanguages(void)
+{
+	TestDevice				*device = new TestDevice;
+	IOUSBDeviceStringCache	*cache = IOUSBDeviceStringCache::withDevice(device);
+	char					buf[64];
+
+	// US English is read even when the device doesn't list it
+	device->langDesc[0] = 4;
+	device->langDesc[2] = 0x0c;
+	device->langDesc[3] = 0x04;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 1 + (3 * 2 * 2));
+	CHECK(cache->Lookup(1, 0x40c, buf, sizeof(buf)));
+	CHECK(cache->Lookup(1, 0x409, buf, sizeof(buf)));
+	CHECK(!cache->Lookup(1, 0x407, buf, sizeof(buf)));
+	cache->Invalidate();
+
+	// a bLength with no room for a LANGID is refused, however much data came back
+	for (UInt8 length = 0; length < 4; length++)
+	{
+		device->langDesc[0] = length;
+		device->transfers = 0;
+		CHECK_EQUAL(cache->Prefetch(), kIOReturnUnderrun);
+		CHECK_EQUAL(device->transfers, 1);
+	}
+
+	// as is a short transfer, or something which isn't a string descriptor
+	device->langDesc[0] = 6;
+	device->langDescLength = 3;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnUnderrun);
+	device->langDescLength = 6;
+	device->langDesc[1] = kUSBConfDesc;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnUnderrun);
+	device->langDesc[1] = kUSBStringDesc;
+
+	// a bLength longer than the transfer only counts what arrived
+	device->langDesc[0] = 200;
+	device->transfers = 0;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 1 + (3 * 2 * 2));
+
+	// a device with no strings isn't asked anything
+	cache->Invalidate();
+	device->iManufacturer = device->iProduct = device->iSerialNumber = 0;
+	device->transfers = 0;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 0);
+
+	cache->release();
+	device->release();
+}
+
+
+
+static void
+TestFailuresAndEviction(void)
+{
+	TestDevice				*device = new TestDevice;
+	IOUSBDeviceStringCache	*cache = IOUSBDeviceStringCache::withDevice(device);
+	char					buf[64];
+
+	// a failed read isn't cached, so the next caller asks again
+	device->failures = 1;
+	CHECK_EQUAL(cache->GetString(1, buf, sizeof(buf)), kIOReturnNotResponding);
+	CHECK_EQUAL(cache->GetString(1, buf, sizeof(buf)), kIOReturnSuccess);
+	CHECK_EQUAL(device->transfers, 4);
+
+	// prefetch carries on past a string which fails and caches the rest
+	cache->Invalidate();
+	device->failures = 1;
+	CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+	CHECK(!cache->Lookup(1, 0x407, buf, sizeof(buf)));
+	CHECK(cache->Lookup(2, 0x407, buf, sizeof(buf)));
+
+	// once full, the oldest entries go first
+	cache->Invalidate();
+	for (int i = 1; i <= kUSBStringCacheEntries + 2; i++)
+		CHECK_EQUAL(cache->GetString(i, buf, sizeof(buf)), kIOReturnSuccess);
+	CHECK(!cache->Lookup(1, 0x409, buf, sizeof(buf)));
+	CHECK(!cache->Lookup(2, 0x409, buf, sizeof(buf)));
+	for (int i = 3; i <= kUSBStringCacheEntries + 2; i++)
+		CHECK(cache->Lookup(i, 0x409, buf, sizeof(buf)));
+
+	// string 0 is the LANGID list and never cached
+	cache->Insert(0, 0x409, "langs");
+	CHECK(!cache->Lookup(0, 0x409, buf, sizeof(buf)));
+
+	cache->release();
+	device->release();
+}
+
+
+
+// rounds of everyone asking for the device's strings, with a re-enumeration every so often
+static void
+TestEnumerationStorm(void)
+{
+	enum { kRounds = 1000, kReenumerateEvery = 100, kAsksPerRound = 8 };
+
+	TestDevice				*device = new TestDevice;
+	TestDevice				*uncached = new TestDevice;
+	IOUSBDeviceStringCache	*cache = IOUSBDeviceStringCache::withDevice(device);
+	char					buf[64];
+	UInt32					hits, misses, saved;
+
+	for (int round = 0; round < kRounds; round++)
+	{
+		if ((round % kReenumerateEvery) == 0)
+		{
+			cache->Invalidate();
+			CHECK_EQUAL(cache->Prefetch(), kIOReturnSuccess);
+		}
+		for (int ask = 0; ask < kAsksPerRound; ask++)
+		{
+			UInt8	index = 1 + (ask % 3);
+			UInt16	lang = (ask == (kAsksPerRound - 1)) ? 0x407 : 0x409;
+
+			CHECK_EQUAL(cache->GetString(index, buf, sizeof(buf), lang), kIOReturnSuccess);
+			CHECK_EQUAL(uncached->GetStringDescriptor(index, buf, sizeof(buf), lang), kIOReturnSuccess);
+		}
+	}
+
+	cache->GetStatistics(&hits, &misses, &saved);
+	CHECK_EQUAL(hits, kRounds * kAsksPerRound);
+	CHECK_EQUAL(misses, 0);
+	CHECK_EQUAL(saved, uncached->transfers);
+
+	// all the cached device saw was the prefetch after each enumeration
+	CHECK_EQUAL(device->transfers, (kRounds / kReenumerateEvery) * (1 + (3 * 2 * 2)));
+	printf("string cache storm: %d lookups, %d%% hits, %d control transfers saved, %d made prefetching\n",
+		   (int)(hits + misses), (int)((100 * hits) / (hits + misses)), (int)saved, (int)device->transfers);
+
+	cache->release();
+	uncached->release();
+	device->release();
+}
+
+
+TEST_MAIN("IOUSBDeviceStringCache", TestPrefetch, TestLanguages, TestFailuresAndEviction, TestEnumerationStorm)
@@ -0,0 +1,341 @@
+/*
+ * Copyright © 2013 Apple Inc.  All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ Host tests for AppleXHCILinkPowerPolicy, driven by synthetic traffic. The policy makes no calls out of itself, so it is built
+ as is against the shim's libkern and IOKit headers.
+*/
+
+#include "USBTest.h"
+
+#include "AppleUSBXHCI_LinkPower.h"
+#include "XHCI.h"
+
+
+// one transfer of transferUS followed by gapUS of idle time, count times. The first gap is only counted by the next transfer
+static void
+RunTraffic(AppleXHCILinkPowerPolicy *policy, UInt64 *nowUS, int count, UInt32 transferUS, UInt32 gapUS)
+{
+	for (int i = 0; i < count; i++)
+	{
+		policy->TransferStarted(*nowUS);
+		*nowUS += transferUS;
+		policy->TransferCompleted(*nowUS);
+		*nowUS += gapUS;
+	}
+}
+
+static void
+SuperSpeedDevice(AppleXHCILinkPowerPolicy *policy, UInt64 *nowUS)
+{
+	policy->Init(true);
+	policy->SetSuperSpeedExitLatencies(2, 100, 0);
+	*nowUS = 1000;
+}
+
+
+
+static void
+TestStartsDisabled(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	
+	policy.Init(true);
+	CHECK_EQUAL(policy.GetU1Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK(!policy.GetL1Enabled());
+	CHECK_EQUAL(policy.GetBESL(), kLinkPowerBESLInvalid);
+	CHECK(!policy.PolicyChanged());
+}
+
+static void
+TestWaitsForEnoughSamples(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	
+	// kLinkPowerMinGapSamples - 1 gaps, plus the transfer which ends the last of them
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples, 10, 10000);
+	CHECK_EQUAL(policy.GetU1Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK(!policy.PolicyChanged());
+	
+	RunTraffic(&policy, &now, 1, 10, 10000);
+	CHECK(policy.GetU1Timeout() != kXHCIUxTimeoutDisabled);
+	CHECK(policy.PolicyChanged());
+}
+
+static void
+TestLongGapsEnableU1AndU2(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 10000);
+	
+	// U1: twice the 2us exit latency. U2: twice the 100us exit latency, rounded up to 256us units
+	CHECK_EQUAL(policy.GetU1Timeout(), 4);
+	CHECK_EQUAL(policy.GetU2Timeout(), 1);
+	CHECK(policy.PolicyChanged());
+	CHECK(!policy.PolicyChanged());
+	
+	// the same traffic doesn't change anything
+	RunTraffic(&policy, &now, 4, 10, 10000);
+	CHECK(!policy.PolicyChanged());
+}
+
+static void
+TestShortGapsStayInU0(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	// U1 needs a typical gap of 4 x (2us + 4us), and U2 4 x (100us + 256us)
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 20);
+	CHECK_EQUAL(policy.GetU1Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+	
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 1000);
+	CHECK_EQUAL(policy.GetU1Timeout(), 4);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+}
+
+static void
+TestGapsShrinkingTurnsItOff(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 10000);
+	CHECK_EQUAL(policy.GetU2Timeout(), 1);
+	policy.PolicyChanged();
+	
+	// the 1/8 weighted average takes a while to come down below the U2 break even point
+	RunTraffic(&policy, &now, 64, 10, 10);
+	CHECK_EQUAL(policy.GetU1Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK(policy.PolicyChanged());
+}
+
+static void
+TestPeriodicEndpointLimitsExitLatency(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 10000);
+	
+	// a 125us interval counts as 64us, which leaves 16us for the link to wake up in: U1's 2us fits, U2's 100us does not
+	policy.AddPeriodicEndpoint(125);
+	CHECK_EQUAL(policy.GetU1Timeout(), 4);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+	
+	policy.RemovePeriodicEndpoint(125);
+	CHECK_EQUAL(policy.GetU2Timeout(), 1);
+	
+	// removing one which was never added doesn't underflow
+	policy.RemovePeriodicEndpoint(125);
+	CHECK_EQUAL(policy.GetU2Timeout(), 1);
+}
+
+static void
+TestHubPathAndClamping(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	// exit latencies beyond what the descriptor allows are clamped, and the hubs' latency is added on top
+	policy.Init(true);
+	policy.SetSuperSpeedExitLatencies(50, 5000, 20);
+	now = 1000;
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 100000);
+	
+	// U1: 2 x (10 + 20) = 60us. U2: 2 x (2047 + 20) = 4134us, which is 17 units of 256us
+	CHECK_EQUAL(policy.GetU1Timeout(), 60);
+	CHECK_EQUAL(policy.GetU2Timeout(), 17);
+}
+
+static void
+TestNoExitLatenciesNoU1U2(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now = 1000;
+	
+	policy.Init(true);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 100000);
+	CHECK_EQUAL(policy.GetU1Timeout(), kXHCIUxTimeoutDisabled);
+	CHECK_EQUAL(policy.GetU2Timeout(), kXHCIUxTimeoutDisabled);
+}
+
+static void
+TestOverlappingTransfersAreOneBusyPeriod(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	for (int i = 0; i < kLinkPowerMinGapSamples + 1; i++)
+	{
+		// two transfers in flight at once, with only a short gap between the first finishing and the third starting
+		policy.TransferStarted(now);
+		policy.TransferStarted(now + 5);
+		policy.TransferCompleted(now + 10);
+		policy.TransferStarted(now + 12);
+		policy.TransferCompleted(now + 20);
+		policy.TransferCompleted(now + 30);
+		now += 30 + 10000;
+	}
+	CHECK_EQUAL(policy.GetIdleTimeUS(), kLinkPowerMinGapSamples * 10000);
+	CHECK_EQUAL(policy.GetU2Timeout(), 1);
+}
+
+static void
+TestUSB2L1PrefersDeepBESL(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now = 1000;
+	
+	// baseline BESL 0 is 125us, deep BESL 6 is 1000us
+	policy.Init(false);
+	policy.SetUSB2L1Capabilities(true, 0, 6);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 20000);
+	CHECK(policy.GetL1Enabled());
+	CHECK_EQUAL(policy.GetBESL(), 6);
+	
+	// deep needs 4 x (1000us + 2000us) of typical gap, baseline 4 x (125us + 250us)
+	policy.Init(false);
+	policy.SetUSB2L1Capabilities(true, 0, 6);
+	now = 1000;
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 2000);
+	CHECK(policy.GetL1Enabled());
+	CHECK_EQUAL(policy.GetBESL(), 0);
+	
+	policy.Init(false);
+	policy.SetUSB2L1Capabilities(true, 0, 6);
+	now = 1000;
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 1000);
+	CHECK(!policy.GetL1Enabled());
+	CHECK_EQUAL(policy.GetBESL(), kLinkPowerBESLInvalid);
+}
+
+static void
+TestUSB2L1NeedsBESLSupport(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now = 1000;
+	
+	policy.Init(false);
+	policy.SetUSB2L1Capabilities(false, 0, 6);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 20000);
+	CHECK(!policy.GetL1Enabled());
+	
+	// a deep BESL shallower than the baseline is raised to the baseline
+	policy.Init(false);
+	policy.SetUSB2L1Capabilities(true, 4, 1);
+	now = 1000;
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 20000);
+	CHECK(policy.GetL1Enabled());
+	CHECK_EQUAL(policy.GetBESL(), 4);
+}
+
+static void
+TestBESLTable(void)
+{
+	CHECK_EQUAL(AppleXHCILinkPowerPolicy::BESLToMicroseconds(0), 125);
+	CHECK_EQUAL(AppleXHCILinkPowerPolicy::BESLToMicroseconds(15), 10000);
+	CHECK_EQUAL(AppleXHCILinkPowerPolicy::BESLToMicroseconds(kLinkPowerNumBESLValues), 0xFFFFFFFF);
+	CHECK_EQUAL(AppleXHCILinkPowerPolicy::BESLToMicroseconds(kLinkPowerBESLInvalid), 0xFFFFFFFF);
+}
+
+static void
+TestResidencyAccounting(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	RunTraffic(&policy, &now, kLinkPowerMinGapSamples + 1, 10, 10000);
+	policy.ResetStatistics();
+	CHECK_EQUAL(policy.GetIdleTimeUS(), 0);
+	
+	// RunTraffic left a 10000us gap open. The link enters U1 after 4us and goes on to U2, so it wakes with U2's 100us exit latency
+	policy.TransferStarted(now);
+	CHECK_EQUAL(policy.GetIdleTimeUS(), 10000);
+	CHECK_EQUAL(policy.GetLowPowerResidencyUS(), 10000 - 4);
+	CHECK_EQUAL(policy.GetAddedLatencyUS(), 100);
+	CHECK_EQUAL(policy.GetLowPowerEntries(), 1);
+	
+	// a gap shorter than the U1 timeout costs nothing and saves nothing
+	policy.TransferCompleted(now + 10);
+	now += 10 + 3;
+	policy.TransferStarted(now);
+	CHECK_EQUAL(policy.GetIdleTimeUS(), 10003);
+	CHECK_EQUAL(policy.GetLowPowerEntries(), 1);
+	
+	// a gap between the U1 timeout and the U2 one only reaches U1
+	policy.TransferCompleted(now + 10);
+	now += 10 + 100;
+	policy.TransferStarted(now);
+	CHECK_EQUAL(policy.GetLowPowerEntries(), 2);
+	CHECK_EQUAL(policy.GetLowPowerResidencyUS(), (10000 - 4) + (100 - 4));
+	CHECK_EQUAL(policy.GetAddedLatencyUS(), 100 + 2);
+}
+
+static void
+TestClockGoingBackwardsIsIgnored(void)
+{
+	AppleXHCILinkPowerPolicy	policy;
+	UInt64						now;
+	
+	SuperSpeedDevice(&policy, &now);
+	policy.TransferStarted(now);
+	policy.TransferCompleted(now + 10);
+	policy.TransferStarted(now + 5);
+	CHECK_EQUAL(policy.GetIdleTimeUS(), 0);
+}
+
+
+
+TEST_MAIN("LinkPowerTest",
+		  TestStartsDisabled,
+		  TestWaitsForEnoughSamples,
+		  TestLongGapsEnableU1AndU2,
+		  TestShortGapsStayInU0,
+		  TestGapsShrinkingTurnsItOff,
+		  TestPeriodicEndpointLimitsExitLatency,
+		  TestHubPathAndClamping,
+		  TestNoExitLatenciesNoU1U2,
+		  TestOverlappingTransfersAreOneBusyPeriod,
+		  TestUSB2L1PrefersDeepBESL,
+		  TestUSB2L1NeedsBESLSupport,
+		  TestBESLTable,
+		  TestResidencyAccounting,
+		  TestClockGoingBackwardsIsIgnored)